@@ -0,0 +1,86 @@
+#include "BufferPool.h"
+
+const int BufferPool::MinClassSize;
+const int BufferPool::MaxClassSize;
+const int BufferPool::ClassCount;
+
+BufferPool::BufferPool(int maxPerClass) : maxPerClass(qMax(maxPerClass, 0))
+{
+}
+
+int BufferPool::classFor(int capacity)
+{
+    int size = MinClassSize;
+    for (int sizeClass = 0; sizeClass < ClassCount; ++sizeClass, size *= 2)
+    {
+        if (capacity <= size)
+        {
+            return sizeClass;
+        }
+    }
+    return -1;
+}
+
+QByteArray BufferPool::acquire(int minCapacity)
+{
+    counters.acquired++;
+
+    int sizeClass = classFor(qMax(minCapacity, 1));
+    if (sizeClass < 0)
+    {
+        // 超大缓冲区不进入池，按需分配
+        counters.allocated++;
+        QByteArray buffer;
+        buffer.reserve(minCapacity);
+        return buffer;
+    }
+
+    QVector<QByteArray> &freeList = freeLists[sizeClass];
+    if (!freeList.isEmpty())
+    {
+        counters.reused++;
+        return freeList.takeLast();
+    }
+
+    counters.allocated++;
+    QByteArray buffer;
+    buffer.reserve(MinClassSize << sizeClass);
+    return buffer;
+}
+
+void BufferPool::release(QByteArray &buffer)
+{
+    counters.released++;
+
+    // 放入容量不超过缓冲区容量的最大分级，保证取出时容量足够
+    int capacity = int(buffer.capacity());
+    int sizeClass = -1;
+    if (capacity <= MaxClassSize)
+    {
+        for (int size = MinClassSize; size <= capacity; size *= 2)
+        {
+            sizeClass++;
+        }
+    }
+
+    // 仍被其他对象共享的缓冲区无法复用
+    if (sizeClass < 0 || !buffer.isDetached() || freeLists[sizeClass].size() >= maxPerClass)
+    {
+        counters.dropped++;
+        buffer = QByteArray();
+        return;
+    }
+
+    // resize(0)保留已分配的容量
+    buffer.resize(0);
+    freeLists[sizeClass].append(buffer);
+    buffer = QByteArray();
+}
+
+void BufferPool::clear()
+{
+    for (QVector<QByteArray> &freeList : freeLists)
+    {
+        freeList.clear();
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QByteArray>
+#include <QVector>
+
+// 按容量分级的接收缓冲区池
+// 容量按2的幂分级（4KB ~ 4MB），连接断开时缓冲区归还到池中，新连接直接复用，
+// 稳定运行时接收路径不再向分配器申请内存
+class BufferPool
+{
+  public:
+    // 统计信息
+    struct Stats
+    {
+        quint64 acquired = 0;  // 取出缓冲区的次数
+        quint64 reused = 0;    // 其中直接复用池中缓冲区的次数
+        quint64 allocated = 0; // 其中新分配的次数
+        quint64 released = 0;  // 归还的次数
+        quint64 dropped = 0;   // 因池已满或容量不在分级范围内而释放的次数
+    };
+
+    static const int MinClassSize = 4 * 1024;
+    static const int MaxClassSize = 4 * 1024 * 1024;
+    static const int ClassCount = 11;
+
+    // 每个分级最多缓存的缓冲区数
+    explicit BufferPool(int maxPerClass = 64);
+
+    // 取出容量至少为minCapacity的空缓冲区
+    QByteArray acquire(int minCapacity);
+
+    // 归还缓冲区，buffer被置为空
+    void release(QByteArray &buffer);
+
+    // 释放池中所有缓冲区
+    void clear();
+
+    Stats stats() const
+    {
+        return counters;
+    }
+
+  private:
+    QVector<QByteArray> freeLists[ClassCount];
+    int maxPerClass;
+    Stats counters;
+
+    // 容量对应的分级，超出范围返回-1
+    static int classFor(int capacity);
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,109 @@
+#include "ConnectionTable.h"
+
+const quint32 ConnectionTable::InvalidId;
+
+ConnectionTable::ConnectionTable()
+{
+    clock.start();
+}
+
+quint32 ConnectionTable::add(QTcpSocket *socket, const QString &address, const QString &info,
+                             TCPFrameReader *reader)
+{
+    quint32 id;
+    if (!freeIds.isEmpty())
+    {
+        // 复用最近释放的槽位，数组保持紧凑
+        id = freeIds.takeLast();
+    }
+    else
+    {
+        id = quint32(states.size());
+        states.append(Free);
+        sockets.append(nullptr);
+        lastActivity.append(0);
+        bytesReceived.append(0);
+        cold.append(ColdData());
+    }
+
+    states[id] = Active;
+    sockets[id] = socket;
+    lastActivity[id] = clock.elapsed();
+    bytesReceived[id] = 0;
+
+    ColdData &data = cold[id];
+    data.info = info;
+    data.address = address;
+    data.reader = reader;
+
+    socketIds.insert(socket, id);
+    infoIds.insert(info, id);
+    return id;
+}
+
+TCPFrameReader *ConnectionTable::remove(quint32 id)
+{
+    if (id >= slotCount() || states.at(id) == Free)
+    {
+        return nullptr;
+    }
+
+    ColdData &data = cold[id];
+    TCPFrameReader *reader = data.reader;
+    socketIds.remove(sockets.at(id));
+    infoIds.remove(data.info);
+
+    states[id] = Free;
+    sockets[id] = nullptr;
+    bytesReceived[id] = 0;
+    data = ColdData();
+    freeIds.append(id);
+    return reader;
+}
+
+QVector<quint32> ConnectionTable::idleConnections(qint64 idleMs) const
+{
+    QVector<quint32> idle;
+    qint64 deadline = clock.elapsed() - idleMs;
+    for (quint32 id = 0; id < slotCount(); ++id)
+    {
+        if (states.at(id) == Active && lastActivity.at(id) < deadline)
+        {
+            idle.append(id);
+        }
+    }
+    return idle;
+}
+
+quint64 ConnectionTable::totalBytesReceived() const
+{
+    quint64 total = 0;
+    for (quint32 id = 0; id < slotCount(); ++id)
+    {
+        // 空闲槽位的计数为0，直接累加，不需要判断状态
+        total += bytesReceived.at(id);
+    }
+    return total;
+}
+
+QVector<TCPFrameReader *> ConnectionTable::clear()
+{
+    QVector<TCPFrameReader *> readers;
+    for (const ColdData &data : cold)
+    {
+        if (data.reader)
+        {
+            readers.append(data.reader);
+        }
+    }
+
+    states.clear();
+    sockets.clear();
+    lastActivity.clear();
+    bytesReceived.clear();
+    cold.clear();
+    freeIds.clear();
+    socketIds.clear();
+    infoIds.clear();
+    return readers;
+}
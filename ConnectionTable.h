@@ -0,0 +1,183 @@
+#ifndef CONNECTIONTABLE_H
+#define CONNECTIONTABLE_H
+
+#include "TCPFrame.h"
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QTcpSocket>
+#include <QVector>
+
+// 服务端连接表，按连续的连接ID索引，断开后ID回收复用
+// 热字段（状态、socket、最后活动时间、接收字节数）各自存放在连续数组中，
+// 广播、空闲扫描和统计只顺序访问需要的数组；
+// 冷字段（客户端信息字符串、地址、帧读取器、待答复的内容）单独存放，只在需要时访问
+class ConnectionTable
+{
+  public:
+    // 连接状态
+    enum State
+    {
+        Free = 0,   // 空闲槽位
+        Active = 1, // 正常连接
+        Closing = 2 // 正在关闭，不再发送数据
+    };
+
+    static const quint32 InvalidId = 0xFFFFFFFF;
+
+    ConnectionTable();
+
+    // 添加连接，返回连接ID
+    quint32 add(QTcpSocket *socket, const QString &address, const QString &info,
+                TCPFrameReader *reader);
+
+    // 移除连接，返回其帧读取器（由调用者释放）
+    TCPFrameReader *remove(quint32 id);
+
+    // 按socket/客户端信息查找连接ID，不存在时返回InvalidId
+    quint32 idOf(QTcpSocket *socket) const
+    {
+        return socketIds.value(socket, InvalidId);
+    }
+
+    quint32 findByInfo(const QString &info) const
+    {
+        return infoIds.value(info, InvalidId);
+    }
+
+    // 活动连接数（含正在关闭的连接）
+    int size() const
+    {
+        return socketIds.size();
+    }
+
+    bool isEmpty() const
+    {
+        return socketIds.isEmpty();
+    }
+
+    // 槽位数，遍历时连接ID的上界
+    quint32 slotCount() const
+    {
+        return quint32(states.size());
+    }
+
+    // 热字段
+    State state(quint32 id) const
+    {
+        return State(states.at(id));
+    }
+
+    void setState(quint32 id, State state)
+    {
+        states[id] = quint8(state);
+    }
+
+    QTcpSocket *socket(quint32 id) const
+    {
+        return sockets.at(id);
+    }
+
+    // 记录收到的数据，更新最后活动时间
+    void touch(quint32 id, qint64 bytes)
+    {
+        lastActivity[id] = clock.elapsed();
+        bytesReceived[id] += quint64(bytes);
+    }
+
+    // 冷字段
+    const QString &info(quint32 id) const
+    {
+        return cold.at(id).info;
+    }
+
+    const QString &address(quint32 id) const
+    {
+        return cold.at(id).address;
+    }
+
+    TCPFrameReader *reader(quint32 id) const
+    {
+        return cold.at(id).reader;
+    }
+
+    // 客户端在Hello中声明的能力（TCPFrame::Capability），未协商的连接为0
+    quint32 capabilities(quint32 id) const
+    {
+        return cold.at(id).capabilities;
+    }
+
+    void setCapabilities(quint32 id, quint32 capabilities)
+    {
+        cold[id].capabilities = capabilities;
+    }
+
+    // 客户端接受的单条消息上限，客户端没有声明时为TCPFrameReader的默认上限
+    qint64 messageLimit(quint32 id) const
+    {
+        return cold.at(id).messageLimit;
+    }
+
+    void setMessageLimit(quint32 id, qint64 bytes)
+    {
+        cold[id].messageLimit = bytes;
+    }
+
+    // 已提供的一份内容：客户端请求增量时保留到客户端确认还原成功或请求完整消息为止
+    struct Offer
+    {
+        enum State
+        {
+            Offered,  // 等待客户端答复提供
+            Diffing,  // 正在计算增量
+            DeltaSent // 已发送增量，等待客户端确认
+        };
+
+        QByteArray message; // 完整的文件消息
+        State state = Offered;
+        qint64 deltaBytes = 0; // 发送的增量字节数
+    };
+
+    // 已提供但尚未完成的内容，按内容哈希索引；同一内容多次提供时按提供顺序排列
+    QHash<QByteArray, QList<Offer>> &offers(quint32 id)
+    {
+        return cold[id].offers;
+    }
+
+    // 超过idleMs毫秒没有收到数据的活动连接
+    QVector<quint32> idleConnections(qint64 idleMs) const;
+
+    // 当前连接收到的总字节数
+    quint64 totalBytesReceived() const;
+
+    // 清空所有连接，返回各连接的帧读取器（由调用者释放）
+    QVector<TCPFrameReader *> clear();
+
+  private:
+    // 冷字段
+    struct ColdData
+    {
+        QString info;
+        QString address;
+        TCPFrameReader *reader = nullptr;
+        quint32 capabilities = 0;
+        qint64 messageLimit = TCPFrameReader::DefaultMaxStreamSize;
+        QHash<QByteArray, QList<Offer>> offers;
+    };
+
+    // 热字段，按连接ID索引
+    QVector<quint8> states;
+    QVector<QTcpSocket *> sockets;
+    QVector<qint64> lastActivity; // 相对clock的毫秒数
+    QVector<quint64> bytesReceived;
+
+    QVector<ColdData> cold;
+    QVector<quint32> freeIds;
+    QHash<QTcpSocket *, quint32> socketIds;
+    QHash<QString, quint32> infoIds;
+    QElapsedTimer clock;
+};
+
+#endif // CONNECTIONTABLE_H
@@ -0,0 +1,47 @@
+#include "ContentCache.h"
+#include <QCryptographicHash>
+
+const int ContentCache::HashSize;
+const qint64 ContentCache::DefaultBudget;
+
+ContentCache::ContentCache(qint64 budgetBytes)
+{
+    setBudget(budgetBytes);
+}
+
+QByteArray ContentCache::hash(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Blake2b_256);
+}
+
+void ContentCache::setBudget(qint64 bytes)
+{
+    // 缩小预算时QCache立即淘汰多出的内容
+    entries.setMaxCost(qsizetype(qMax<qint64>(bytes, 0)));
+}
+
+QByteArray ContentCache::find(const QByteArray &key)
+{
+    QByteArray *value = entries.object(key);
+    if (!value)
+    {
+        counters.misses++;
+        return QByteArray();
+    }
+
+    counters.hits++;
+    return *value;
+}
+
+bool ContentCache::insert(const QByteArray &key, const QByteArray &value)
+{
+    // 失败时QCache会删除传入的对象
+    if (!entries.insert(key, new QByteArray(value), qMax<qsizetype>(value.size(), 1)))
+    {
+        counters.rejected++;
+        return false;
+    }
+
+    counters.insertions++;
+    return true;
+}
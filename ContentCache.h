@@ -0,0 +1,79 @@
+#ifndef CONTENTCACHE_H
+#define CONTENTCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+
+// 按内容哈希（BLAKE2b-256）索引的缓存，总大小超过预算时淘汰最久未使用的内容
+// 缓存的QByteArray是隐式共享的，取出后即使被淘汰，正在发送的数据也不受影响
+class ContentCache
+{
+  public:
+    // 统计信息
+    struct Stats
+    {
+        quint64 hits = 0;       // 命中次数
+        quint64 misses = 0;     // 未命中次数
+        quint64 insertions = 0; // 加入缓存的次数
+        quint64 rejected = 0;   // 超过预算而无法缓存的次数
+    };
+
+    static const int HashSize = 32;
+    static const qint64 DefaultBudget = 64 * 1024 * 1024;
+
+    explicit ContentCache(qint64 budgetBytes = DefaultBudget);
+
+    // 计算内容哈希
+    static QByteArray hash(const QByteArray &data);
+
+    // 内存预算（字节），为0时不缓存任何内容
+    void setBudget(qint64 bytes);
+
+    qint64 budget() const
+    {
+        return qint64(entries.maxCost());
+    }
+
+    bool isEnabled() const
+    {
+        return entries.maxCost() > 0;
+    }
+
+    // 已缓存内容的总大小
+    qint64 usedBytes() const
+    {
+        return qint64(entries.totalCost());
+    }
+
+    bool contains(const QByteArray &key) const
+    {
+        return entries.contains(key);
+    }
+
+    // 查找内容并标记为最近使用，未命中时返回空
+    QByteArray find(const QByteArray &key);
+
+    // 加入缓存，必要时淘汰最久未使用的内容；单个内容超过预算时不缓存
+    bool insert(const QByteArray &key, const QByteArray &value);
+
+    void remove(const QByteArray &key)
+    {
+        entries.remove(key);
+    }
+
+    void clear()
+    {
+        entries.clear();
+    }
+
+    Stats stats() const
+    {
+        return counters;
+    }
+
+  private:
+    QCache<QByteArray, QByteArray> entries; // 以字节数作为开销
+    Stats counters;
+};
+
+#endif // CONTENTCACHE_H
@@ -0,0 +1,518 @@
+#include "EpollServer.h"
+#include <QHostAddress>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+const quint32 EpollServer::Capabilities;
+const int EpollServer::MaxEvents;
+const qint64 EpollServer::DefaultMaxPendingBytes;
+
+#ifdef Q_OS_LINUX
+// epoll事件数据的低32位为描述符，高32位为连接的代数
+static quint64 eventKey(int fd, quint32 generation)
+{
+    return (quint64(generation) << 32) | quint32(fd);
+}
+#endif
+
+EpollServer::EpollServer(QObject *parent) : QObject(parent)
+{
+}
+
+EpollServer::~EpollServer()
+{
+    stop();
+}
+
+bool EpollServer::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool EpollServer::start(quint16 port, const SocketTuning::Profile &profile, int backlog,
+                        QAbstractSocket::SocketError *error, QString *errorString)
+{
+    stop();
+
+#ifdef Q_OS_LINUX
+    qintptr descriptor =
+        SocketTuning::createListeningSocket(port, profile, backlog, error, errorString);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+
+    int fd = int(descriptor);
+    epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = eventKey(fd, 0);
+    if (epollFd < 0 || ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) != 0 ||
+        ::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+        if (error)
+        {
+            *error = QAbstractSocket::UnknownSocketError;
+        }
+        if (errorString)
+        {
+            *errorString = QString::fromLocal8Bit(strerror(errno));
+        }
+        ::close(fd);
+        if (epollFd >= 0)
+        {
+            ::close(epollFd);
+            epollFd = -1;
+        }
+        return false;
+    }
+
+    listenFd = fd;
+    tuning = profile;
+    counters = Stats();
+
+    // epoll描述符本身可读表示有就绪事件，整个后端只需要一个通知器
+    notifier = new QSocketNotifier(epollFd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &EpollServer::onEpollReady);
+    return true;
+#else
+    Q_UNUSED(port);
+    Q_UNUSED(profile);
+    Q_UNUSED(backlog);
+    if (error)
+    {
+        *error = QAbstractSocket::UnsupportedSocketOperationError;
+    }
+    if (errorString)
+    {
+        *errorString = QString("当前平台不支持epoll");
+    }
+    return false;
+#endif
+}
+
+void EpollServer::stop()
+{
+    if (!isRunning())
+    {
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    delete notifier;
+    notifier = nullptr;
+
+    for (int fd = 0; fd < byFd.size(); ++fd)
+    {
+        if (byFd.at(fd))
+        {
+            closeConnection(fd);
+        }
+    }
+    byFd.clear();
+    receivePool.clear();
+
+    ::close(listenFd);
+    ::close(epollFd);
+#endif
+    listenFd = -1;
+    epollFd = -1;
+}
+
+QStringList EpollServer::clients() const
+{
+    return infoFds.keys();
+}
+
+bool EpollServer::isFramed(const QString &clientInfo) const
+{
+    Connection *conn = connectionAt(infoFds.value(clientInfo, -1));
+    return conn && conn->framed;
+}
+
+quint32 EpollServer::capabilities(const QString &clientInfo) const
+{
+    Connection *conn = connectionAt(infoFds.value(clientInfo, -1));
+    return conn ? conn->capabilities : 0;
+}
+
+bool EpollServer::send(const QString &clientInfo, const QByteArray &data, quint8 frameType)
+{
+    int fd = infoFds.value(clientInfo, -1);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    writeMessage(fd, data, frameType);
+    return true;
+}
+
+int EpollServer::broadcast(const QByteArray &data, quint8 frameType)
+{
+    int count = 0;
+    for (int fd = 0; fd < byFd.size(); ++fd)
+    {
+        if (byFd.at(fd))
+        {
+            writeMessage(fd, data, frameType);
+            count++;
+        }
+    }
+    return count;
+}
+
+void EpollServer::onEpollReady()
+{
+#ifdef Q_OS_LINUX
+    counters.wakeups++;
+
+    struct epoll_event events[MaxEvents];
+    int count;
+    do
+    {
+        count = ::epoll_wait(epollFd, events, MaxEvents, 0);
+        for (int i = 0; i < count; ++i)
+        {
+            // 信号处理函数中可能已经停止了服务器
+            if (!isRunning())
+            {
+                return;
+            }
+
+            counters.events++;
+            int fd = int(quint32(events[i].data.u64));
+            quint32 generation = quint32(events[i].data.u64 >> 32);
+            if (fd == listenFd && generation == 0)
+            {
+                acceptConnections();
+                continue;
+            }
+
+            // 同一批事件中连接可能已关闭，描述符编号又被新连接复用，旧事件不能用于新连接
+            Connection *conn = connectionAt(fd);
+            if (!conn || conn->generation != generation)
+            {
+                counters.staleEvents++;
+                continue;
+            }
+
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                readConnection(fd);
+            }
+            if ((events[i].events & EPOLLOUT) && connectionAt(fd) == conn)
+            {
+                flushPending(fd);
+            }
+        }
+        // 取满时可能还有就绪事件，继续取
+    } while (count == MaxEvents);
+#endif
+}
+
+void EpollServer::acceptConnections()
+{
+#ifdef Q_OS_LINUX
+    for (;;)
+    {
+        struct sockaddr_storage address;
+        socklen_t length = socklen_t(sizeof(address));
+        int fd = ::accept4(listenFd, reinterpret_cast<struct sockaddr *>(&address), &length,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                emit errorOccurred(
+                    tr("接受连接失败: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+            }
+            return;
+        }
+
+        QString tuningError;
+        SocketTuning::apply(fd, tuning, &tuningError);
+
+        quint32 generation = nextGeneration++;
+        if (nextGeneration == 0)
+        {
+            nextGeneration = 1;
+        }
+
+        // 读写事件一次注册，之后不再修改
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = eventKey(fd, generation);
+        if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            ::close(fd);
+            continue;
+        }
+
+        // 客户端信息的格式与Qt后端一致，IPv4映射地址去掉"::ffff:"前缀
+        QHostAddress peer(reinterpret_cast<const struct sockaddr *>(&address));
+        quint16 port = address.ss_family == AF_INET6
+                           ? ntohs(reinterpret_cast<struct sockaddr_in6 *>(&address)->sin6_port)
+                           : ntohs(reinterpret_cast<struct sockaddr_in *>(&address)->sin_port);
+        QString host = peer.toString();
+        if (host.startsWith("::ffff:"))
+        {
+            host = host.mid(7);
+        }
+
+        Connection *conn = new Connection;
+        conn->info = QString("%1:%2").arg(host).arg(port);
+        conn->generation = generation;
+        conn->reader.setBufferPool(&receivePool);
+        if (fd >= byFd.size())
+        {
+            byFd.resize(fd + 1);
+        }
+        byFd[fd] = conn;
+        infoFds.insert(conn->info, fd);
+        counters.accepted++;
+
+        emit clientConnected(conn->info);
+        if (!isRunning())
+        {
+            return;
+        }
+    }
+#endif
+}
+
+void EpollServer::readConnection(int fd)
+{
+    Connection *conn = connectionAt(fd);
+    if (!conn)
+    {
+        return;
+    }
+
+    // 每次读取的数据量有上限，处理完已读的消息后再继续读，直到读空描述符
+    bool closed = false;
+    bool drained = false;
+    while (!closed && !drained)
+    {
+        counters.bytesReceived +=
+            quint64(conn->reader.readFromDescriptor(fd, &closed, &drained));
+        if (tuning.quickAck > 0 && !closed)
+        {
+            SocketTuning::rearmQuickAck(fd);
+        }
+        if (!processMessages(fd, conn))
+        {
+            return;
+        }
+
+        // 格式错误之后的数据无法再分帧，关闭连接，不把帧的剩余部分当作纯文本消息
+        if (conn->reader.hasError())
+        {
+            QString message =
+                tr("来自 %1 的数据格式错误: %2").arg(conn->info, conn->reader.errorString());
+            closeConnection(fd);
+            emit errorOccurred(message);
+            return;
+        }
+    }
+
+    if (closed)
+    {
+        closeConnection(fd);
+    }
+}
+
+bool EpollServer::processMessages(int fd, Connection *conn)
+{
+    TCPFrameReader::Message &frame = conn->reader.scratchMessage();
+    while (conn->reader.next(frame))
+    {
+        if (frame.framed)
+        {
+            conn->framed = true;
+        }
+
+        if (frame.type == TCPFrame::TextFrame || frame.type == TCPFrame::FileFrame ||
+            frame.type == TCPFrame::ImageFrame || frame.type >= TCPFrame::UserFrameBase)
+        {
+            counters.messages++;
+            emit messageReceived(conn->info, frame.type, frame.payload);
+
+            // 信号处理函数中可能关闭了连接或停止了服务器
+            if (connectionAt(fd) != conn)
+            {
+                return false;
+            }
+        }
+        else if (frame.type == TCPFrame::ControlFrame && !frame.payload.isEmpty() &&
+                 quint8(frame.payload.at(0)) == TCPFrame::HelloOpcode)
+        {
+            // 回复本端的能力，客户端据此完成协商
+            conn->capabilities = TCPFrame::decodeHelloPayload(frame.payload) & Capabilities;
+            writeMessage(fd, TCPFrame::encodeHelloPayload(Capabilities), TCPFrame::ControlFrame);
+            if (connectionAt(fd) != conn)
+            {
+                return false;
+            }
+        }
+        // 其他内置帧（其他控制帧、RPC、发布）在这个后端中忽略
+    }
+    return true;
+}
+
+void EpollServer::writeMessage(int fd, const QByteArray &data, quint8 frameType)
+{
+    Connection *conn = connectionAt(fd);
+    if (!conn)
+    {
+        return;
+    }
+
+    char header[TCPFrame::HeaderSize];
+    int headerSize = 0;
+    if (conn->framed)
+    {
+        TCPFrame::writeHeader(header, frameType, TCPFrame::EndOfStream, 0, quint32(data.size()));
+        headerSize = TCPFrame::HeaderSize;
+    }
+
+    // 已有积压数据时只能排在其后，等EPOLLOUT时一起写出
+    if (!conn->pending.isEmpty())
+    {
+        if (conn->pending.size() - conn->pendingOffset + headerSize + data.size() > maxPendingBytes)
+        {
+            // 对端接收过慢，不再为它继续积压数据
+            counters.slowClosed++;
+            QString info = conn->info;
+            closeConnection(fd);
+            emit errorOccurred(tr("客户端 %1 接收过慢，积压的数据超过上限，已断开连接").arg(info));
+            return;
+        }
+        conn->pending.append(header, headerSize);
+        conn->pending.append(data);
+        return;
+    }
+
+    qint64 written = 0;
+#ifdef Q_OS_LINUX
+    struct iovec vectors[2];
+    vectors[0].iov_base = header;
+    vectors[0].iov_len = size_t(headerSize);
+    vectors[1].iov_base = const_cast<char *>(data.constData());
+    vectors[1].iov_len = size_t(data.size());
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = headerSize > 0 ? vectors : vectors + 1;
+    message.msg_iovlen = headerSize > 0 ? 2 : 1;
+
+    // MSG_NOSIGNAL：对端已关闭时返回EPIPE而不是产生SIGPIPE
+    written = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+    if (written < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            closeConnection(fd);
+            return;
+        }
+        written = 0;
+    }
+#endif
+    counters.bytesSent += quint64(written);
+
+    // 未写完的部分保存起来，内核发送缓冲区有空间时由EPOLLOUT通知继续写
+    qint64 total = headerSize + data.size();
+    if (written < total)
+    {
+        if (written < headerSize)
+        {
+            conn->pending.append(header + written, int(headerSize - written));
+            conn->pending.append(data);
+        }
+        else
+        {
+            conn->pending.append(data.constData() + (written - headerSize),
+                                 int(total - written));
+        }
+    }
+}
+
+void EpollServer::flushPending(int fd)
+{
+    Connection *conn = connectionAt(fd);
+    if (!conn || conn->pending.isEmpty())
+    {
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    while (conn->pendingOffset < conn->pending.size())
+    {
+        ssize_t written =
+            ::send(fd, conn->pending.constData() + conn->pendingOffset,
+                   size_t(conn->pending.size() - conn->pendingOffset), MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                closeConnection(fd);
+            }
+            else if (conn->pendingOffset > conn->pending.size() / 2)
+            {
+                // 已写出的部分过半时前移，积压数据占用的内存不超过上限的两倍
+                conn->pending.remove(0, conn->pendingOffset);
+                conn->pendingOffset = 0;
+            }
+            return;
+        }
+        conn->pendingOffset += int(written);
+        counters.bytesSent += quint64(written);
+    }
+#endif
+
+    // 全部写出后保留容量，下次积压时复用
+    conn->pending.resize(0);
+    conn->pendingOffset = 0;
+}
+
+void EpollServer::closeConnection(int fd)
+{
+    Connection *conn = connectionAt(fd);
+    if (!conn)
+    {
+        return;
+    }
+
+    byFd[fd] = nullptr;
+    infoFds.remove(conn->info);
+#ifdef Q_OS_LINUX
+    // 关闭描述符会自动从epoll中移除
+    ::close(fd);
+#endif
+
+    QString info = conn->info;
+    delete conn;
+    emit clientDisconnected(info);
+}
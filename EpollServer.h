@@ -0,0 +1,153 @@
+#ifndef EPOLLSERVER_H
+#define EPOLLSERVER_H
+
+#include "BufferPool.h"
+#include "SocketTuning.h"
+#include "TCPFrame.h"
+#include <QAbstractSocket>
+#include <QHash>
+#include <QObject>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QVector>
+
+// 基于epoll边沿触发的服务端后端，不为每个连接创建QTcpSocket，
+// 所有连接共用一个epoll描述符，通过一个QSocketNotifier接入Qt事件循环，
+// 连接状态按描述符编号存放在连续数组中，每个空闲连接只占用一个小结构体
+// 只处理应用消息（文本、文件、图片和自定义类型）和Hello控制帧，
+// 不支持TLS、RPC、发布/订阅、准入控制和出站调度，仅在Linux上可用
+class EpollServer : public QObject
+{
+    Q_OBJECT
+
+  public:
+    // 统计信息
+    struct Stats
+    {
+        quint64 accepted = 0;      // 已接受的连接
+        quint64 messages = 0;      // 收到的应用消息
+        quint64 bytesReceived = 0; // 收到的字节数
+        quint64 bytesSent = 0;     // 写入内核的字节数
+        quint64 wakeups = 0;       // 事件循环唤醒次数
+        quint64 events = 0;        // 处理的epoll事件数
+        quint64 staleEvents = 0;   // 属于已关闭连接而被忽略的事件数
+        quint64 slowClosed = 0;    // 因待发送数据超过上限而断开的连接数
+    };
+
+    // 默认的单连接待发送数据上限
+    static const qint64 DefaultMaxPendingBytes = 32 * 1024 * 1024;
+
+    explicit EpollServer(QObject *parent = nullptr);
+    ~EpollServer();
+
+    // 当前平台是否可用
+    static bool isSupported();
+
+    // 开始监听所有地址的port端口，失败时通过error和errorString返回原因
+    bool start(quint16 port, const SocketTuning::Profile &profile, int backlog,
+               QAbstractSocket::SocketError *error = nullptr, QString *errorString = nullptr);
+
+    // 停止监听并关闭所有连接
+    void stop();
+
+    bool isRunning() const
+    {
+        return listenFd >= 0;
+    }
+
+    // 当前连接数
+    int connectionCount() const
+    {
+        return infoFds.size();
+    }
+
+    // 所有连接的客户端信息
+    QStringList clients() const;
+
+    // 客户端是否使用帧格式
+    bool isFramed(const QString &clientInfo) const;
+
+    // 与客户端协商得到的能力（TCPFrame::Capability），未协商的连接为0
+    quint32 capabilities(const QString &clientInfo) const;
+
+    // 发送给一个客户端，对端使用帧格式时按frameType加帧头；客户端不存在时返回false
+    bool send(const QString &clientInfo, const QByteArray &data, quint8 frameType);
+
+    // 发送给所有客户端，返回发送的连接数
+    int broadcast(const QByteArray &data, quint8 frameType);
+
+    // 设置单连接待发送数据的上限：对端接收过慢、积压的数据超过上限时断开连接；
+    // 没有积压时单条消息不受限制
+    void setMaxPendingBytes(qint64 bytes)
+    {
+        maxPendingBytes = qMax<qint64>(bytes, 1);
+    }
+
+    Stats stats() const
+    {
+        return counters;
+    }
+
+  signals:
+    void clientConnected(const QString &clientInfo);
+    void clientDisconnected(const QString &clientInfo);
+
+    // 收到一条完整的应用消息，旧版纯文本消息的frameType为TextFrame
+    void messageReceived(const QString &clientInfo, quint8 frameType, const QByteArray &payload);
+
+    void errorOccurred(const QString &errorMessage);
+
+  private slots:
+    void onEpollReady();
+
+  private:
+    // 一个连接的状态
+    struct Connection
+    {
+        QString info;
+        TCPFrameReader reader;
+        QByteArray pending; // 内核发送缓冲区已满时未写出的数据
+        int pendingOffset = 0;
+        bool framed = false; // 对端使用帧格式
+        quint32 capabilities = 0;
+        quint32 generation = 0; // 与描述符一起存入epoll事件，描述符编号被复用时据此识别旧事件
+    };
+
+    // 本后端在Hello中声明的能力：文件和图片消息交给TCPServer解析，不支持内容缓存和批量传输
+    static const quint32 Capabilities = TCPFrame::SchemaCapability;
+
+    // 一次epoll_wait最多取出的事件数
+    static const int MaxEvents = 256;
+
+    int epollFd = -1;
+    int listenFd = -1;
+    QSocketNotifier *notifier = nullptr;
+    QVector<Connection *> byFd; // 按描述符编号索引，未使用的位置为nullptr
+    QHash<QString, int> infoFds;
+    quint32 nextGeneration = 1; // 0留给监听socket
+    qint64 maxPendingBytes = DefaultMaxPendingBytes;
+    BufferPool receivePool;
+    SocketTuning::Profile tuning;
+    Stats counters;
+
+    Connection *connectionAt(int fd) const
+    {
+        return fd >= 0 && fd < byFd.size() ? byFd.at(fd) : nullptr;
+    }
+
+    void acceptConnections();
+    void readConnection(int fd);
+
+    // 处理读取器中所有完整的消息，连接在处理过程中被关闭时返回false
+    bool processMessages(int fd, Connection *conn);
+
+    // 写出一条消息，之前还有未写出的数据时排在其后
+    void writeMessage(int fd, const QByteArray &data, quint8 frameType);
+
+    // 写出积压的数据，出错时关闭连接
+    void flushPending(int fd);
+
+    void closeConnection(int fd);
+};
+
+#endif // EPOLLSERVER_H
@@ -0,0 +1,415 @@
+#include "FileBatch.h"
+#include "MappedFile.h"
+#include "TCPSchema.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QtEndian>
+
+const int FileBatch::MaxBatchFiles;
+const qint64 FileBatch::MaxBatchBytes;
+const char FileBatch::PartSuffix[] = ".part";
+const int FileBatchReader::ReadAhead;
+
+static void setError(QString *errorString, const QString &message)
+{
+    if (errorString)
+    {
+        *errorString = message;
+    }
+}
+
+// 对方发来的相对路径只能指向接收目录之内
+static bool isSafePath(const QString &path)
+{
+    if (path.isEmpty() || QDir::isAbsolutePath(path) || path.contains('\\') || path.contains(':'))
+    {
+        return false;
+    }
+
+    for (const QString &part : path.split('/'))
+    {
+        if (part.isEmpty() || part == "." || part == "..")
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 接收目录之下已经存在的各级路径都不能是符号链接，否则写入可能落到接收目录之外
+static bool passesSymLink(const QString &root, const QString &path)
+{
+    QString current = root;
+    for (const QString &part : path.split('/'))
+    {
+        current += '/' + part;
+        QFileInfo info(current);
+        if (info.isSymLink())
+        {
+            return true;
+        }
+        if (!info.exists())
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool FileBatch::list(const QStringList &paths, QList<Entry> &entries, QString *errorString)
+{
+    for (const QString &path : paths)
+    {
+        QFileInfo info(path);
+        if (info.isDir())
+        {
+            // 相对路径相对于目录的上一级，接收端按目录名还原整个目录结构
+            QDir parent = info.absoluteDir();
+            QDirIterator it(info.absoluteFilePath(), QDir::Files | QDir::Hidden,
+                            QDirIterator::Subdirectories);
+            while (it.hasNext())
+            {
+                it.next();
+                QFileInfo file = it.fileInfo();
+                Entry entry;
+                entry.path = file.absoluteFilePath();
+                entry.relativePath = parent.relativeFilePath(entry.path);
+                entry.size = file.size();
+                entry.length = entry.size;
+                entries.append(entry);
+            }
+        }
+        else if (info.isFile())
+        {
+            Entry entry;
+            entry.path = info.absoluteFilePath();
+            entry.relativePath = info.fileName();
+            entry.size = info.size();
+            entry.length = entry.size;
+            entries.append(entry);
+        }
+        else
+        {
+            setError(errorString, QString("无法访问: %1").arg(path));
+            return false;
+        }
+    }
+
+    if (entries.isEmpty())
+    {
+        setError(errorString, QString("没有可发送的文件"));
+        return false;
+    }
+    return true;
+}
+
+QList<QList<FileBatch::Entry>> FileBatch::split(const QList<Entry> &entries)
+{
+    QList<QList<Entry>> batches;
+    QList<Entry> batch;
+    qint64 bytes = 0;
+    for (const Entry &entry : entries)
+    {
+        if (!batch.isEmpty() &&
+            (batch.size() >= MaxBatchFiles || bytes + entry.size > MaxBatchBytes))
+        {
+            batches.append(batch);
+            batch.clear();
+            bytes = 0;
+        }
+
+        if (entry.size > MaxBatchBytes)
+        {
+            // 大文件的每一段单独成为一批，接收端按偏移依次写入同一个临时文件
+            for (qint64 offset = 0; offset < entry.size; offset += MaxBatchBytes)
+            {
+                Entry piece = entry;
+                piece.offset = offset;
+                piece.length = qMin(MaxBatchBytes, entry.size - offset);
+                batches.append(QList<Entry>() << piece);
+            }
+            continue;
+        }
+        batch.append(entry);
+        bytes += entry.size;
+    }
+
+    if (!batch.isEmpty())
+    {
+        batches.append(batch);
+    }
+    return batches;
+}
+
+QByteArray FileBatch::encode(const QList<Entry> &batch, bool last, QString *errorString)
+{
+    qint64 total = 0;
+    for (const Entry &entry : batch)
+    {
+        total += entry.length;
+    }
+
+    QByteArray manifest;
+    QByteArray pieces;
+    QByteArray data;
+    data.reserve(qsizetype(total));
+    for (const Entry &entry : batch)
+    {
+        QByteArray path = entry.relativePath.toUtf8();
+        QFile file(entry.path);
+        if (path.size() > 0xFFFF || !file.open(QIODevice::ReadOnly) || !file.seek(entry.offset))
+        {
+            setError(errorString, QString("无法读取文件: %1").arg(entry.path));
+            continue;
+        }
+
+        // 整个文件在一批中时读取当前的全部内容，文件在列出后发生变化时按实际读到的长度记录；
+        // 拆成多段的文件每段必须读满，否则接收端无法拼接
+        bool whole = entry.offset == 0 && entry.length == entry.size;
+        qsizetype offset = data.size();
+        qint64 size = whole ? file.size() : entry.length;
+        if (size > MaxBatchBytes && whole)
+        {
+            setError(errorString, QString("文件在发送过程中发生变化: %1").arg(entry.path));
+            continue;
+        }
+
+        // 直接读入数据缓冲区
+        data.resize(offset + qsizetype(size));
+        qint64 read = file.read(data.data() + offset, size);
+        if (read < 0 || (!whole && read != size))
+        {
+            data.resize(offset);
+            QString reason = read < 0 ? "无法读取文件: %1" : "文件在发送过程中发生变化: %1";
+            setError(errorString, reason.arg(entry.path));
+            continue;
+        }
+        data.resize(offset + qsizetype(read));
+
+        char field[8];
+        qToBigEndian<quint16>(quint16(path.size()), field);
+        manifest.append(field, 2);
+        manifest.append(path);
+        qToBigEndian<quint64>(quint64(read), field);
+        manifest.append(field, 8);
+        qToBigEndian<quint64>(quint64(whole ? read : entry.size), field);
+        pieces.append(field, 8);
+        qToBigEndian<quint64>(quint64(entry.offset), field);
+        pieces.append(field, 8);
+    }
+
+    TCPSchema::BatchMessage message;
+    message.last = last ? 1 : 0;
+    message.manifest = manifest;
+    message.data = data;
+    message.pieces = pieces;
+    return TCPSchema::encode(message);
+}
+
+bool FileBatch::save(const QByteArray &payload, const QString &directory, Result &result,
+                     QString *errorString)
+{
+    TCPSchema::BatchMessage message;
+    if (!TCPSchema::decode(payload, message))
+    {
+        setError(errorString, QString("收到的批量文件消息格式错误"));
+        return false;
+    }
+    result.last = message.last != 0;
+
+    QDir root(directory);
+    const char *cursor = message.manifest.data();
+    const char *end = cursor + message.manifest.size();
+    const char *piece = message.pieces.data();
+    const char *piecesEnd = piece + message.pieces.size();
+    qint64 offset = 0;
+    while (cursor < end)
+    {
+        quint16 length = end - cursor >= 2 ? qFromBigEndian<quint16>(cursor) : 0;
+        if (end - cursor < 2 + qint64(length) + 8)
+        {
+            setError(errorString, QString("收到的批量文件清单格式错误"));
+            return false;
+        }
+        QString path = QString::fromUtf8(cursor + 2, length);
+        quint64 size = qFromBigEndian<quint64>(cursor + 2 + length);
+        cursor += 2 + length + 8;
+
+        // 没有分段表的旧版消息中每项都是完整的文件
+        quint64 fileSize = size;
+        quint64 fileOffset = 0;
+        if (!message.pieces.isEmpty())
+        {
+            if (piecesEnd - piece < 16)
+            {
+                setError(errorString, QString("收到的批量文件清单格式错误"));
+                return false;
+            }
+            fileSize = qFromBigEndian<quint64>(piece);
+            fileOffset = qFromBigEndian<quint64>(piece + 8);
+            piece += 16;
+        }
+
+        if (size > quint64(message.data.size() - offset) || fileOffset > fileSize ||
+            size > fileSize - fileOffset)
+        {
+            setError(errorString, QString("收到的批量文件清单格式错误"));
+            return false;
+        }
+        if (!isSafePath(path))
+        {
+            setError(errorString, QString("拒绝保存到接收目录之外: %1").arg(path));
+            return false;
+        }
+
+        QString target = root.filePath(path);
+        QString partial = target + PartSuffix;
+        if (passesSymLink(root.path(), path) || QFileInfo(partial).isSymLink())
+        {
+            setError(errorString, QString("拒绝经由符号链接保存: %1").arg(path));
+            return false;
+        }
+        if (QFileInfo::exists(target))
+        {
+            setError(errorString, QString("文件已存在，拒绝覆盖: %1").arg(target));
+            return false;
+        }
+        if (!root.mkpath(QFileInfo(target).path()))
+        {
+            setError(errorString, QString("无法创建目录: %1").arg(QFileInfo(target).path()));
+            return false;
+        }
+
+        // 第一段新建临时文件，之后各段追加在临时文件末尾，偏移必须与已写入的长度一致
+        QByteArrayView data = message.data.sliced(offset, qsizetype(size));
+        if (fileOffset == 0)
+        {
+            if (!MappedFile::write(partial, data, errorString))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            QFile file(partial);
+            if (!file.exists() || !file.open(QIODevice::WriteOnly | QIODevice::Append) ||
+                quint64(file.size()) != fileOffset)
+            {
+                setError(errorString, QString("文件的分段不连续: %1").arg(target));
+                return false;
+            }
+            if (file.write(data.data(), data.size()) != data.size())
+            {
+                setError(errorString, QString("无法写入文件: %1").arg(partial));
+                return false;
+            }
+        }
+        offset += qint64(size);
+        result.bytes += qint64(size);
+
+        // 最后一段写入后改为最终的文件名，目标在此期间出现时保留临时文件并报错
+        if (fileOffset + size == fileSize)
+        {
+            if (!QFile::rename(partial, target))
+            {
+                setError(errorString, QString("无法保存文件: %1").arg(target));
+                return false;
+            }
+            result.paths.append(target);
+        }
+    }
+    return true;
+}
+
+QString FileBatch::defaultDirectory()
+{
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
+    return directory.isEmpty() ? QDir::currentPath() : directory;
+}
+
+FileBatchReader::FileBatchReader(QObject *parent)
+    : QObject(parent), shared(std::make_shared<Shared>())
+{
+    shared->reader = this;
+}
+
+FileBatchReader::~FileBatchReader()
+{
+    // 加锁保证正在结束的任务不会向已析构的对象投递回调；已投递的回调随对象一起删除
+    QMutexLocker locker(&shared->mutex);
+    shared->reader = nullptr;
+}
+
+bool FileBatchReader::start(const QStringList &paths, QString *errorString)
+{
+    QList<FileBatch::Entry> entries;
+    if (!FileBatch::list(paths, entries, errorString))
+    {
+        return false;
+    }
+
+    batches = FileBatch::split(entries);
+    submit();
+    return true;
+}
+
+bool FileBatchReader::takeNext(QByteArray &payload)
+{
+    QMap<int, QByteArray>::iterator it = prepared.find(nextTake);
+    if (it == prepared.end())
+    {
+        return false;
+    }
+
+    payload = it.value();
+    prepared.erase(it);
+    nextTake++;
+    submit();
+    return true;
+}
+
+void FileBatchReader::submit()
+{
+    while (nextSubmit < batches.size() && nextSubmit - nextTake < ReadAhead)
+    {
+        int index = nextSubmit++;
+        bool last = nextSubmit == batches.size();
+        QList<FileBatch::Entry> batch;
+        batch.swap(batches[index]); // 交给任务后不再需要
+        std::shared_ptr<Shared> state = shared;
+
+        QThreadPool::globalInstance()->start([state, batch, index, last]() {
+            QString error;
+            QByteArray payload = FileBatch::encode(batch, last, &error);
+
+            QMutexLocker locker(&state->mutex);
+            FileBatchReader *reader = state->reader;
+            if (reader)
+            {
+                QMetaObject::invokeMethod(
+                    reader, [reader, index, payload, error]() {
+                        reader->onPrepared(index, payload, error);
+                    },
+                    Qt::QueuedConnection);
+            }
+        });
+    }
+}
+
+void FileBatchReader::onPrepared(int index, const QByteArray &payload, const QString &error)
+{
+    if (!error.isEmpty())
+    {
+        emit errorOccurred(error);
+    }
+
+    prepared.insert(index, payload);
+    if (index == nextTake)
+    {
+        emit batchReady();
+    }
+}
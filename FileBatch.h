@@ -0,0 +1,111 @@
+#ifndef FILEBATCH_H
+#define FILEBATCH_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <memory>
+
+// 批量文件传输：许多小文件打包为一条批量消息（TCPSchema::BatchMessage），清单中记录相对路径和大小，
+// 不必为每个文件单独发送一条带完整元数据的消息；大文件拆成多段，每条消息都不超过字节上限
+class FileBatch
+{
+  public:
+    // 每批的文件数和字节数上限，超过字节上限的文件按上限拆成多段，每段单独成为一批
+    static const int MaxBatchFiles = 1024;
+    static const qint64 MaxBatchBytes = 4 * 1024 * 1024;
+
+    // 待发送的文件
+    struct Entry
+    {
+        QString path;         // 本地路径
+        QString relativePath; // 发给对方的相对路径，以'/'分隔
+        qint64 size = 0;      // 列出时的文件大小
+        qint64 offset = 0;    // 本批发送的部分在文件中的偏移
+        qint64 length = 0;    // 本批发送的字节数，整个文件在一批中时等于size
+    };
+
+    // 保存一批文件的结果
+    struct Result
+    {
+        QStringList paths; // 已完整保存的文件的本地路径
+        qint64 bytes = 0;
+        bool last = false;
+    };
+
+    // 列出paths中的文件，目录递归展开，其中文件的相对路径以目录名开头
+    static bool list(const QStringList &paths, QList<Entry> &entries,
+                     QString *errorString = nullptr);
+
+    // 按文件数和字节数上限分批，大文件拆成多段
+    static QList<QList<Entry>> split(const QList<Entry> &entries);
+
+    // 读取一批文件并编码为批量消息，无法读取的文件被跳过并通过errorString返回原因
+    static QByteArray encode(const QList<Entry> &batch, bool last, QString *errorString = nullptr);
+
+    // 解码批量消息并把文件保存到directory下的相对路径
+    // 拒绝绝对路径、含".."的路径和经过符号链接的路径，不覆盖已存在的文件；
+    // 文件先写入同目录下加PartSuffix后缀的临时文件，收到最后一段后才改为最终的文件名
+    static bool save(const QByteArray &payload, const QString &directory, Result &result,
+                     QString *errorString = nullptr);
+
+    // 接收中的文件的临时后缀
+    static const char PartSuffix[];
+
+    // 建议的接收目录（下载目录），用作选择接收目录时的初始位置
+    static QString defaultDirectory();
+};
+
+// 在线程池中提前读取和编码批次，按顺序交给发送方
+// 最多同时准备ReadAhead个批次，取走一批后才开始读取下一批，内存占用不随文件数量增长
+class FileBatchReader : public QObject
+{
+    Q_OBJECT
+
+  public:
+    static const int ReadAhead = 4;
+
+    explicit FileBatchReader(QObject *parent = nullptr);
+    ~FileBatchReader();
+
+    // 列出文件并开始读取，没有可发送的文件时返回false
+    bool start(const QStringList &paths, QString *errorString = nullptr);
+
+    // 取出下一个按顺序准备好的批次，尚未准备好时返回false
+    bool takeNext(QByteArray &payload);
+
+    // 所有批次都已取出
+    bool atEnd() const
+    {
+        return nextTake >= batches.size();
+    }
+
+  signals:
+    // 下一个批次已准备好
+    void batchReady();
+    void errorOccurred(const QString &errorMessage);
+
+  private:
+    // 与线程池中的任务共享，读取器析构后任务不再回调
+    struct Shared
+    {
+        QMutex mutex;
+        FileBatchReader *reader = nullptr;
+    };
+
+    std::shared_ptr<Shared> shared;
+    QList<QList<FileBatch::Entry>> batches;
+    QMap<int, QByteArray> prepared; // 已准备好但尚未取出的批次
+    int nextSubmit = 0;
+    int nextTake = 0;
+
+    // 在预读窗口内把后续批次交给线程池
+    void submit();
+    void onPrepared(int index, const QByteArray &payload, const QString &error);
+};
+
+#endif // FILEBATCH_H
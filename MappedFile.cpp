@@ -0,0 +1,144 @@
+#include "MappedFile.h"
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+const qint64 MappedFile::MinMappedSize;
+
+static void setError(QString *errorString, const QString &message)
+{
+    if (errorString)
+    {
+        *errorString = message;
+    }
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const QString &path, QString *errorString)
+{
+    std::shared_ptr<MappedFile> mapped(new MappedFile);
+    mapped->file.setFileName(path);
+    if (!mapped->file.open(QIODevice::ReadOnly))
+    {
+        setError(errorString, QString("无法打开文件: %1").arg(path));
+        return nullptr;
+    }
+
+    mapped->length = mapped->file.size();
+    if (!mapped->map(errorString))
+    {
+        return nullptr;
+    }
+
+#ifdef Q_OS_UNIX
+    // 文件按顺序发送：内核加大预读，已发送的页可以尽早回收
+    if (mapped->address)
+    {
+        ::madvise(mapped->address, size_t(mapped->length), MADV_SEQUENTIAL);
+    }
+#endif
+    return mapped;
+}
+
+std::shared_ptr<MappedFile> MappedFile::create(const QString &path, qint64 size,
+                                               QString *errorString)
+{
+    std::shared_ptr<MappedFile> mapped(new MappedFile);
+    mapped->file.setFileName(path);
+    if (!mapped->file.open(QIODevice::ReadWrite | QIODevice::Truncate))
+    {
+        setError(errorString, QString("无法创建文件: %1").arg(path));
+        return nullptr;
+    }
+
+    // 先分配磁盘空间：稀疏文件在写入映射区时才分配，磁盘写满时进程会收到SIGBUS
+    bool allocated;
+#ifdef Q_OS_LINUX
+    allocated = size == 0 || ::posix_fallocate(mapped->file.handle(), 0, off_t(size)) == 0;
+#else
+    allocated = mapped->file.resize(size);
+#endif
+    if (!allocated || mapped->file.size() != size)
+    {
+        setError(errorString, QString("无法分配文件空间: %1").arg(path));
+        mapped->file.close();
+        mapped->file.remove();
+        return nullptr;
+    }
+
+    mapped->length = size;
+    if (!mapped->map(errorString))
+    {
+        mapped->file.close();
+        mapped->file.remove();
+        return nullptr;
+    }
+    return mapped;
+}
+
+bool MappedFile::write(const QString &path, QByteArrayView data, QString *errorString)
+{
+    if (data.size() < MinMappedSize)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(data.data(), data.size()) != data.size())
+        {
+            setError(errorString, QString("无法写入文件: %1").arg(path));
+            return false;
+        }
+        return true;
+    }
+
+    std::shared_ptr<MappedFile> mapped = create(path, data.size(), errorString);
+    if (!mapped)
+    {
+        return false;
+    }
+    memcpy(mapped->data(), data.data(), size_t(data.size()));
+    return mapped->close(errorString);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::map(QString *errorString)
+{
+    if (length == 0)
+    {
+        return true;
+    }
+
+    address = file.map(0, length);
+    if (!address)
+    {
+        setError(errorString, QString("无法映射文件: %1").arg(file.errorString()));
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::close(QString *errorString)
+{
+    bool ok = true;
+    if (address)
+    {
+        ok = file.unmap(address);
+        address = nullptr;
+    }
+    if (file.isOpen())
+    {
+        file.close();
+        ok = ok && file.error() == QFileDevice::NoError;
+    }
+    length = 0;
+
+    if (!ok)
+    {
+        setError(errorString, QString("无法关闭文件: %1").arg(file.errorString()));
+    }
+    return ok;
+}
@@ -0,0 +1,65 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QString>
+#include <memory>
+
+// 映射到内存的文件
+// 发送时以只读方式映射源文件，负载通过QByteArray::fromRawData直接引用映射区，
+// 文件内容不读入堆内存，由页缓存按需换入；接收时先把输出文件预分配到最终大小，再映射写入
+class MappedFile
+{
+  public:
+    // 小于该大小的文件直接读写更划算，映射的建立和解除开销超过节省的复制
+    static const qint64 MinMappedSize = 64 * 1024;
+
+    // 以只读方式映射文件并提示内核顺序读取，失败时返回空指针并通过errorString返回原因
+    static std::shared_ptr<MappedFile> open(const QString &path, QString *errorString = nullptr);
+
+    // 创建大小为size的文件（已存在时覆盖）并以读写方式映射
+    static std::shared_ptr<MappedFile> create(const QString &path, qint64 size,
+                                              QString *errorString = nullptr);
+
+    // 把data写入文件：较大的数据先预分配空间，再复制到映射区
+    static bool write(const QString &path, QByteArrayView data, QString *errorString = nullptr);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // 映射区的只读视图，不复制数据；使用期间必须持有MappedFile
+    QByteArray bytes() const
+    {
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(address), qsizetype(length));
+    }
+
+    // 可写映射的起始地址
+    char *data()
+    {
+        return reinterpret_cast<char *>(address);
+    }
+
+    qint64 size() const
+    {
+        return length;
+    }
+
+    // 解除映射并关闭文件，写入的数据由内核写回磁盘
+    bool close(QString *errorString = nullptr);
+
+  private:
+    MappedFile() = default;
+
+    // 映射整个文件，空文件不需要映射
+    bool map(QString *errorString);
+
+    QFile file;
+    uchar *address = nullptr;
+    qint64 length = 0;
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,47 @@
+#ifndef MESSAGEDISPATCHER_H
+#define MESSAGEDISPATCHER_H
+
+#include <QByteArray>
+#include <array>
+#include <functional>
+
+// 按帧类型字节分派应用消息的处理表
+// 查找只是一次数组下标访问，在解码负载之前完成，因此文件、图片等大负载不会经过文本解码
+// Args为处理函数在负载之前的参数，例如服务端传入客户端信息
+template <typename... Args> class MessageDispatcher
+{
+  public:
+    typedef std::function<void(Args..., const QByteArray &payload)> Handler;
+
+    void setHandler(quint8 type, const Handler &handler)
+    {
+        handlers[type] = handler;
+    }
+
+    void removeHandler(quint8 type)
+    {
+        handlers[type] = Handler();
+    }
+
+    bool hasHandler(quint8 type) const
+    {
+        return bool(handlers[type]);
+    }
+
+    // 调用type对应的处理函数，没有注册处理函数时返回false
+    bool dispatch(quint8 type, Args... args, const QByteArray &payload) const
+    {
+        const Handler &handler = handlers[type];
+        if (!handler)
+        {
+            return false;
+        }
+        handler(args..., payload);
+        return true;
+    }
+
+  private:
+    std::array<Handler, 256> handlers;
+};
+
+#endif // MESSAGEDISPATCHER_H
@@ -0,0 +1,177 @@
+#include "OfflineQueue.h"
+#include <QtEndian>
+
+static const int SpillRecordHeaderSize = 14;
+
+OfflineQueue::~OfflineQueue()
+{
+    removeSpillFile();
+}
+
+void OfflineQueue::setLimits(int maxMessages, qint64 maxBytes)
+{
+    this->maxMessages = qMax(maxMessages, 1);
+    this->maxBytes = qMax<qint64>(maxBytes, 1);
+}
+
+void OfflineQueue::setSpillPath(const QString &path)
+{
+    if (path == spillPath)
+    {
+        return;
+    }
+
+    // 切换文件前把已溢出的消息全部读回内存，不能丢失
+    loadSpilled(true);
+    removeSpillFile();
+    spillPath = path;
+}
+
+bool OfflineQueue::fitsInMemory(const Entry &entry) const
+{
+    return memory.size() < maxMessages && memoryBytes + entry.data.size() <= maxBytes;
+}
+
+bool OfflineQueue::enqueue(const Entry &entry)
+{
+    // 已有消息在磁盘上时，新消息也必须写入磁盘以保持顺序
+    if (spilledCount == 0 && fitsInMemory(entry))
+    {
+        memory.enqueue(entry);
+        memoryBytes += entry.data.size();
+        return true;
+    }
+
+    if (!spillPath.isEmpty() && spill(entry))
+    {
+        return true;
+    }
+
+    // 内存中的消息先于磁盘上的消息出队，写磁盘失败时不能放入内存，否则会越过更早的消息
+    if (spilledCount > 0 || entry.data.size() > maxBytes)
+    {
+        dropped++;
+        return false;
+    }
+
+    // 丢弃最旧的消息，为新消息腾出空间
+    while (!memory.isEmpty() && !fitsInMemory(entry))
+    {
+        memoryBytes -= memory.dequeue().data.size();
+        dropped++;
+    }
+    memory.enqueue(entry);
+    memoryBytes += entry.data.size();
+    return true;
+}
+
+bool OfflineQueue::dequeue(Entry &entry)
+{
+    if (memory.isEmpty() && spilledCount > 0)
+    {
+        loadSpilled();
+    }
+
+    if (memory.isEmpty())
+    {
+        return false;
+    }
+
+    entry = memory.dequeue();
+    memoryBytes -= entry.data.size();
+    return true;
+}
+
+bool OfflineQueue::spill(const Entry &entry)
+{
+    if (!spillFile.isOpen())
+    {
+        spillFile.setFileName(spillPath);
+        if (!spillFile.open(QIODevice::ReadWrite | QIODevice::Truncate))
+        {
+            return false;
+        }
+        spillReadPos = 0;
+    }
+
+    char header[SpillRecordHeaderSize];
+    qToBigEndian<quint64>(entry.sequence, header);
+    header[8] = char(entry.frameType);
+    header[9] = char(entry.trafficClass);
+    qToBigEndian<quint32>(quint32(entry.data.size()), header + 10);
+
+    qint64 end = spillFile.size();
+    spillFile.seek(end);
+    if (spillFile.write(header, SpillRecordHeaderSize) != SpillRecordHeaderSize ||
+        spillFile.write(entry.data) != entry.data.size())
+    {
+        // 去掉写了一半的记录，后续记录仍能对齐
+        spillFile.resize(end);
+        return false;
+    }
+
+    spilledCount++;
+    return true;
+}
+
+void OfflineQueue::loadSpilled(bool ignoreLimits)
+{
+    if (!spillFile.isOpen())
+    {
+        return;
+    }
+
+    spillFile.seek(spillReadPos);
+    while (spilledCount > 0)
+    {
+        char header[SpillRecordHeaderSize];
+        if (spillFile.peek(header, SpillRecordHeaderSize) != SpillRecordHeaderSize)
+        {
+            break;
+        }
+
+        Entry entry;
+        entry.sequence = qFromBigEndian<quint64>(header);
+        entry.frameType = quint8(header[8]);
+        entry.trafficClass = quint8(header[9]);
+        quint32 length = qFromBigEndian<quint32>(header + 10);
+
+        // 内存放不下时停止读取，但至少读回一条以保证进度
+        if (!ignoreLimits && !memory.isEmpty() &&
+            (memory.size() >= maxMessages || memoryBytes + length > maxBytes))
+        {
+            break;
+        }
+
+        spillFile.skip(SpillRecordHeaderSize);
+        entry.data = spillFile.read(length);
+        spillReadPos += SpillRecordHeaderSize + length;
+        spilledCount--;
+
+        memory.enqueue(entry);
+        memoryBytes += entry.data.size();
+    }
+
+    if (spilledCount == 0)
+    {
+        removeSpillFile();
+    }
+}
+
+void OfflineQueue::removeSpillFile()
+{
+    if (spillFile.isOpen())
+    {
+        spillFile.close();
+        spillFile.remove();
+    }
+    spillReadPos = 0;
+    spilledCount = 0;
+}
+
+void OfflineQueue::clear()
+{
+    memory.clear();
+    memoryBytes = 0;
+    removeSpillFile();
+}
@@ -0,0 +1,77 @@
+#ifndef OFFLINEQUEUE_H
+#define OFFLINEQUEUE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QQueue>
+#include <QString>
+
+// 断线期间的有界发送队列
+// 超过内存限制后，新消息按顺序追加到磁盘文件，出队时再按顺序读回；
+// 未设置磁盘文件时丢弃最旧的消息
+class OfflineQueue
+{
+  public:
+    // 排队的消息
+    struct Entry
+    {
+        quint64 sequence = 0; // 至少一次投递的序号，0表示未分配
+        quint8 frameType = 0;
+        quint8 trafficClass = 0;
+        QByteArray data;
+    };
+
+    ~OfflineQueue();
+
+    // 设置内存中最多保留的消息数和字节数
+    void setLimits(int maxMessages, qint64 maxBytes);
+
+    // 设置溢出文件路径，为空表示不写磁盘
+    void setSpillPath(const QString &path);
+
+    // 入队，消息被丢弃时返回false；已有消息在磁盘上而写磁盘失败时丢弃新消息以保持顺序
+    bool enqueue(const Entry &entry);
+
+    // 按入队顺序取出一条消息
+    bool dequeue(Entry &entry);
+
+    bool isEmpty() const
+    {
+        return memory.isEmpty() && spilledCount == 0;
+    }
+
+    int size() const
+    {
+        return memory.size() + spilledCount;
+    }
+
+    // 因队列已满被丢弃的消息数
+    quint64 droppedCount() const
+    {
+        return dropped;
+    }
+
+    void clear();
+
+  private:
+    QQueue<Entry> memory;
+    qint64 memoryBytes = 0;
+    int maxMessages = 1000;
+    qint64 maxBytes = 16 * 1024 * 1024;
+    quint64 dropped = 0;
+
+    // 磁盘溢出文件，记录格式: [序号 8B][帧类型 1B][流量类别 1B][长度 4B][数据]
+    QString spillPath;
+    QFile spillFile;
+    qint64 spillReadPos = 0;
+    int spilledCount = 0;
+
+    bool fitsInMemory(const Entry &entry) const;
+    bool spill(const Entry &entry);
+
+    // 从溢出文件读回消息，直到内存限制或文件末尾
+    void loadSpilled(bool ignoreLimits = false);
+    void removeSpillFile();
+};
+
+#endif // OFFLINEQUEUE_H
@@ -0,0 +1,669 @@
+#include "OutboundScheduler.h"
+#include <QSslSocket>
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+const int OutboundScheduler::MaxBatchSegments;
+
+OutboundScheduler::OutboundScheduler(QObject *parent)
+    : QObject(parent), throttleTimer(new QTimer(this)), coalesceTimer(new QTimer(this))
+{
+    throttleTimer->setSingleShot(true);
+    connect(throttleTimer, &QTimer::timeout, this, &OutboundScheduler::onThrottleTimeout);
+
+    coalesceTimer->setSingleShot(true);
+    coalesceTimer->setTimerType(Qt::PreciseTimer);
+    connect(coalesceTimer, &QTimer::timeout, this, &OutboundScheduler::onCoalesceTimeout);
+}
+
+OutboundScheduler::~OutboundScheduler()
+{
+    clear();
+}
+
+void OutboundScheduler::addConnection(QTcpSocket *socket)
+{
+    if (!socket || connections.contains(socket))
+    {
+        return;
+    }
+
+    Connection *conn = new Connection;
+    conn->socket = socket;
+    applyRateLimit(conn, defaultRateLimit, defaultBurst);
+    connections.insert(socket, conn);
+    conn->baseNoDelay = socket->socketOption(QAbstractSocket::LowDelayOption).toInt() != 0;
+    applyNoDelay(conn);
+
+    // socket写缓冲区有空间后继续发送
+    connect(socket, &QTcpSocket::bytesWritten, this, &OutboundScheduler::onBytesWritten);
+}
+
+void OutboundScheduler::removeConnection(QTcpSocket *socket)
+{
+    Connection *conn = connections.take(socket);
+    if (!conn)
+    {
+        return;
+    }
+
+    disconnect(socket, &QTcpSocket::bytesWritten, this, &OutboundScheduler::onBytesWritten);
+    activeConnections.removeAll(conn);
+    throttledConnections.removeAll(conn);
+    flushList.removeAll(conn);
+    delete conn;
+}
+
+void OutboundScheduler::clear()
+{
+    for (auto it = connections.begin(); it != connections.end(); ++it)
+    {
+        disconnect(it.key(), &QTcpSocket::bytesWritten, this, &OutboundScheduler::onBytesWritten);
+        delete it.value();
+    }
+    connections.clear();
+    activeConnections.clear();
+    throttledConnections.clear();
+    flushList.clear();
+    throttleTimer->stop();
+}
+
+void OutboundScheduler::enqueue(QTcpSocket *socket, const QByteArray &data,
+                                TrafficClass trafficClass, quint8 frameType)
+{
+    enqueue(socket, QByteArray(), data, nullptr, trafficClass, frameType);
+}
+
+void OutboundScheduler::enqueue(QTcpSocket *socket, const QByteArray &head,
+                                const QByteArray &body, std::shared_ptr<const void> owner,
+                                TrafficClass trafficClass, quint8 frameType)
+{
+    Connection *conn = connections.value(socket);
+    if (!conn || (head.isEmpty() && body.isEmpty()))
+    {
+        return;
+    }
+
+    // data非空表示消息正在发送，只有head时把它作为data
+    QueuedMessage message;
+    if (body.isEmpty())
+    {
+        message.data = head;
+    }
+    else
+    {
+        message.head = head;
+        message.data = body;
+        message.owner = std::move(owner);
+    }
+    message.frameType = frameType;
+    if (enqueueObserver)
+    {
+        enqueueObserver(socket, frameType, conn->framed, message.head, message.data);
+    }
+    conn->queues[trafficClass].enqueue(message);
+    conn->queuedBytes += message.size();
+    statistics.messagesQueued++;
+
+    markActive(conn);
+
+    // 上次调度之后的计数已经写出，重新开始累计
+    if (conn->coalesceRound != pumpRound)
+    {
+        conn->coalesceRound = pumpRound;
+        conn->coalescedBytes = 0;
+    }
+    conn->coalescedBytes += message.size();
+    coalescePending = true;
+    requestPump(trafficClass == ControlClass, conn->coalescedBytes);
+}
+
+void OutboundScheduler::setCoalescingPolicy(const CoalescingPolicy &policy)
+{
+    coalescing = policy;
+    coalescing.delayUs = qMax(coalescing.delayUs, 0);
+    coalescing.maxBytes = qMax(coalescing.maxBytes, 1);
+
+    for (Connection *conn : std::as_const(connections))
+    {
+        applyNoDelay(conn);
+    }
+
+    if (coalescing.delayUs == 0 && coalesceTimer->isActive())
+    {
+        coalesceTimer->stop();
+        schedulePump();
+    }
+}
+
+void OutboundScheduler::applyNoDelay(Connection *conn)
+{
+    // 关闭写合并时恢复加入调度器时的值，重新交给Nagle算法（或调优预设）决定
+    bool noDelay = coalescing.delayUs > 0 || conn->baseNoDelay;
+    conn->socket->setSocketOption(QAbstractSocket::LowDelayOption, noDelay ? 1 : 0);
+}
+
+void OutboundScheduler::flushNow()
+{
+    if (coalescePending || coalesceTimer->isActive())
+    {
+        statistics.urgentFlushes++;
+    }
+    coalesceTimer->stop();
+    schedulePump();
+}
+
+void OutboundScheduler::requestPump(bool urgent, qint64 connectionBytes)
+{
+    if (coalescing.delayUs <= 0)
+    {
+        schedulePump();
+        return;
+    }
+
+    if (urgent)
+    {
+        flushNow();
+    }
+    else if (connectionBytes >= coalescing.maxBytes)
+    {
+        statistics.sizeFlushes++;
+        coalesceTimer->stop();
+        schedulePump();
+    }
+    else if (!coalesceTimer->isActive() && !pumpScheduled)
+    {
+        // 时间窗口从第一条未写出的数据开始计算
+        coalesceTimer->start(qMax((coalescing.delayUs + 999) / 1000, 1));
+    }
+}
+
+void OutboundScheduler::onCoalesceTimeout()
+{
+    statistics.delayFlushes++;
+    schedulePump();
+}
+
+void OutboundScheduler::setFramed(QTcpSocket *socket, bool framed)
+{
+    Connection *conn = connections.value(socket);
+    if (conn)
+    {
+        conn->framed = framed;
+    }
+}
+
+bool OutboundScheduler::isFramed(QTcpSocket *socket) const
+{
+    Connection *conn = connections.value(socket);
+    return conn && conn->framed;
+}
+
+void OutboundScheduler::setDefaultRateLimit(qint64 bytesPerSecond, qint64 burstBytes)
+{
+    defaultRateLimit = bytesPerSecond;
+    defaultBurst = burstBytes;
+}
+
+void OutboundScheduler::setRateLimit(QTcpSocket *socket, qint64 bytesPerSecond,
+                                     qint64 burstBytes)
+{
+    Connection *conn = connections.value(socket);
+    if (conn)
+    {
+        applyRateLimit(conn, bytesPerSecond, burstBytes);
+    }
+}
+
+void OutboundScheduler::applyRateLimit(Connection *conn, qint64 bytesPerSecond,
+                                       qint64 burstBytes)
+{
+    // 桶容量至少为一个分片（含帧头），否则该连接永远拿不到足够的令牌
+    conn->rateLimit = bytesPerSecond;
+    conn->burst = burstBytes;
+    conn->bucket.configure(double(bytesPerSecond),
+                           double(qMax<qint64>(burstBytes, chunkSize + TCPFrame::HeaderSize)));
+}
+
+void OutboundScheduler::setChunkSize(int bytes)
+{
+    chunkSize = qMax(bytes, 512);
+
+    // 分片变大后原有的桶可能装不下一个分片，重新设置容量
+    for (Connection *conn : connections)
+    {
+        if (conn->rateLimit > 0 && conn->burst < chunkSize + TCPFrame::HeaderSize)
+        {
+            applyRateLimit(conn, conn->rateLimit, conn->burst);
+        }
+    }
+}
+
+void OutboundScheduler::setConnectionWeight(QTcpSocket *socket, int weight)
+{
+    Connection *conn = connections.value(socket);
+    if (conn)
+    {
+        conn->weight = qMax(weight, 1);
+    }
+}
+
+void OutboundScheduler::setClassWeight(TrafficClass trafficClass, int weight)
+{
+    if (trafficClass >= 0 && trafficClass < TrafficClassCount)
+    {
+        classWeights[trafficClass] = qMax(weight, 1);
+    }
+}
+
+qint64 OutboundScheduler::queuedBytes(QTcpSocket *socket) const
+{
+    Connection *conn = connections.value(socket);
+    return conn ? conn->queuedBytes : 0;
+}
+
+void OutboundScheduler::schedulePump()
+{
+    if (!pumpScheduled)
+    {
+        pumpScheduled = true;
+        QMetaObject::invokeMethod(this, "pump", Qt::QueuedConnection);
+    }
+}
+
+void OutboundScheduler::markActive(Connection *conn)
+{
+    if (!conn->active && !conn->throttled && conn->hasPending())
+    {
+        conn->active = true;
+        activeConnections.enqueue(conn);
+    }
+}
+
+void OutboundScheduler::activate(Connection *conn)
+{
+    markActive(conn);
+    schedulePump();
+}
+
+int OutboundScheduler::selectClass(Connection *conn) const
+{
+    // 旧版连接无法区分交错的数据，上一条消息发完之前不能切换类别
+    if (!conn->framed && conn->legacyClass >= 0)
+    {
+        return conn->legacyClass;
+    }
+
+    int best = -1;
+    double bestTag = 0;
+    for (int c = 0; c < TrafficClassCount; ++c)
+    {
+        if (!conn->hasPending(c))
+        {
+            continue;
+        }
+
+        const QueuedMessage &message =
+            conn->current[c].data.isEmpty() ? conn->queues[c].head() : conn->current[c];
+        qint64 length = message.size() - message.offset;
+        if (conn->framed)
+        {
+            length = qMin(length, qint64(chunkSize));
+        }
+
+        double tag = qMax(conn->classFinishTag[c], conn->virtualTime) +
+                     double(length) / classWeights[c];
+        if (best < 0 || tag < bestTag)
+        {
+            best = c;
+            bestTag = tag;
+        }
+    }
+    return best;
+}
+
+void OutboundScheduler::advanceVirtualTime(Connection *conn, int trafficClass, qint64 length)
+{
+    conn->classFinishTag[trafficClass] =
+        qMax(conn->classFinishTag[trafficClass], conn->virtualTime) +
+        double(length) / classWeights[trafficClass];
+    conn->virtualTime = conn->classFinishTag[trafficClass];
+}
+
+void OutboundScheduler::pump()
+{
+    pumpScheduled = false;
+    pumping = true;
+    pumpRound++;
+    coalescePending = false;
+    coalesceTimer->stop();
+    qint64 budget = maxBytesPerPump;
+    qint64 throttleWaitMs = -1;
+
+    // 逐轮遍历活跃连接，直到本次预算用完或没有连接能继续发送
+    bool progress = true;
+    while (progress && budget > 0 && !activeConnections.isEmpty())
+    {
+        progress = false;
+        int count = activeConnections.size();
+        for (int i = 0; i < count && budget > 0; ++i)
+        {
+            Connection *conn = activeConnections.dequeue();
+            conn->active = false;
+
+            if (conn->socket->state() != QAbstractSocket::ConnectedState)
+            {
+                continue;
+            }
+
+            bool blocked = false;
+            bool throttled = false;
+            // 上一轮未用完的额度最多保留一个配额，避免被阻塞的连接积攒过多额度
+            qint64 share = quantum * conn->weight;
+            conn->deficit = qMin(conn->deficit, share) + share;
+
+            while (conn->deficit > 0 && budget > 0 && conn->hasPending())
+            {
+                int c = selectClass(conn);
+                QueuedMessage &message = conn->current[c];
+                if (message.data.isEmpty())
+                {
+                    message = conn->queues[c].dequeue();
+                    message.streamId = conn->nextStreamId++;
+                    if (conn->nextStreamId == 0)
+                    {
+                        conn->nextStreamId = 1;
+                    }
+                    if (!conn->framed)
+                    {
+                        // 旧版连接整条消息一次性参与排序
+                        conn->legacyClass = c;
+                        advanceVirtualTime(conn, c, message.size());
+                    }
+                }
+
+                qint64 overhead = conn->framed ? TCPFrame::HeaderSize : 0;
+                qint64 room = socketHighWater - conn->socket->bytesToWrite() -
+                              conn->batch.bytes - overhead;
+                if (room <= 0)
+                {
+                    blocked = true;
+                    break;
+                }
+
+                qint64 remaining = message.size() - message.offset;
+                qint64 chunk = qMin(remaining, qMin(qint64(chunkSize), room));
+                qint64 headSize = message.head.size();
+                if (message.offset < headSize)
+                {
+                    // 分片不跨越head和data的边界，各自只引用自己的数据
+                    chunk = qMin(chunk, headSize - message.offset);
+                }
+
+                if (!conn->bucket.tryConsume(double(chunk + overhead)))
+                {
+                    qint64 wait = conn->bucket.msUntilAvailable(double(chunk + overhead));
+                    throttleWaitMs = throttleWaitMs < 0 ? wait : qMin(throttleWaitMs, wait);
+                    throttled = true;
+                    break;
+                }
+
+                if (conn->framed)
+                {
+                    // 每个分片都是独立的帧，接收端按流ID重组
+                    quint8 flags = chunk == remaining ? quint8(TCPFrame::EndOfStream) : quint8(0);
+                    appendHeader(conn, message.frameType, flags, message.streamId,
+                                 quint32(chunk));
+                    advanceVirtualTime(conn, c, chunk);
+                }
+
+                // 负载只引用消息数据，本次调度结束时与帧头一起写出
+                if (message.offset < headSize)
+                {
+                    appendData(conn, message.head, message.offset, chunk);
+                }
+                else
+                {
+                    appendData(conn, message.data, message.offset - headSize, chunk,
+                               message.owner);
+                }
+                qint64 written = chunk;
+
+                message.offset += written;
+                conn->deficit -= written + overhead;
+                conn->queuedBytes -= written;
+                budget -= written + overhead;
+                statistics.bytesSent += written + overhead;
+                progress = true;
+
+                if (message.offset >= message.size())
+                {
+                    message = QueuedMessage();
+                    if (!conn->framed)
+                    {
+                        conn->legacyClass = -1;
+                    }
+                    statistics.messagesSent++;
+                }
+            }
+
+            if (!conn->hasPending())
+            {
+                // 队列清空后赤字清零，避免空闲连接积累发送额度
+                conn->deficit = 0;
+            }
+            else if (blocked)
+            {
+                // 等待bytesWritten后重新激活
+                statistics.blockedCount++;
+            }
+            else if (throttled)
+            {
+                conn->throttled = true;
+                throttledConnections.append(conn);
+                statistics.throttledCount++;
+            }
+            else
+            {
+                conn->active = true;
+                activeConnections.enqueue(conn);
+            }
+        }
+    }
+
+    // 每个连接本次调度的所有分片一次写出
+    pumping = false;
+    QList<Connection *> pending;
+    pending.swap(flushList);
+    for (Connection *conn : pending)
+    {
+        flush(conn);
+    }
+
+    if (!activeConnections.isEmpty() && budget <= 0)
+    {
+        // 本次预算已用完，让出事件循环后继续
+        schedulePump();
+    }
+
+    if (throttleWaitMs >= 0 &&
+        (!throttleTimer->isActive() || throttleTimer->remainingTime() > throttleWaitMs))
+    {
+        throttleTimer->start(static_cast<int>(qMax<qint64>(throttleWaitMs, 1)));
+    }
+}
+
+void OutboundScheduler::appendHeader(Connection *conn, quint8 frameType, quint8 flags,
+                                     quint32 streamId, quint32 length)
+{
+    WriteBatch &batch = conn->batch;
+    int offset = batch.headers.size();
+    batch.headers.resize(offset + TCPFrame::HeaderSize);
+    TCPFrame::writeHeader(batch.headers.data() + offset, frameType, flags, streamId, length);
+
+    Segment segment;
+    segment.offset = offset;
+    segment.length = TCPFrame::HeaderSize;
+    batch.segments.append(segment);
+    batch.bytes += TCPFrame::HeaderSize;
+}
+
+void OutboundScheduler::appendData(Connection *conn, const QByteArray &data, qint64 offset,
+                                   qint64 length, const std::shared_ptr<const void> &owner)
+{
+    WriteBatch &batch = conn->batch;
+    Segment segment;
+    segment.data = data;
+    segment.owner = owner;
+    segment.offset = offset;
+    segment.length = length;
+    batch.segments.append(segment);
+    batch.bytes += length;
+
+    if (batch.segments.size() >= MaxBatchSegments - 1)
+    {
+        // 分段数达到上限，提前写出
+        flush(conn);
+    }
+    else if (!batch.scheduled)
+    {
+        batch.scheduled = true;
+        flushList.append(conn);
+    }
+}
+
+bool OutboundScheduler::canWriteDirectly(QTcpSocket *socket) const
+{
+#ifdef Q_OS_UNIX
+    if (!vectoredWritesEnabled || socket->bytesToWrite() > 0 || socket->socketDescriptor() < 0)
+    {
+        // socket写缓冲区中还有数据时必须排在其后，不能直接写入
+        return false;
+    }
+
+    // 加密连接必须经由QSslSocket加密
+    QSslSocket *sslSocket = qobject_cast<QSslSocket *>(socket);
+    return !sslSocket || sslSocket->mode() == QSslSocket::UnencryptedMode;
+#else
+    Q_UNUSED(socket);
+    return false;
+#endif
+}
+
+void OutboundScheduler::flush(Connection *conn)
+{
+    WriteBatch &batch = conn->batch;
+    if (batch.scheduled)
+    {
+        batch.scheduled = false;
+        flushList.removeOne(conn);
+    }
+    if (batch.segments.isEmpty())
+    {
+        return;
+    }
+
+    qint64 direct = 0;
+    bool reset = false; // 对端已关闭或重置连接，本批数据无法送达
+#ifdef Q_OS_UNIX
+    if (canWriteDirectly(conn->socket))
+    {
+        struct iovec vectors[MaxBatchSegments];
+        int count = batch.segments.size();
+        for (int i = 0; i < count; ++i)
+        {
+            const Segment &segment = batch.segments.at(i);
+            const char *base =
+                segment.data.isEmpty() ? batch.headers.constData() : segment.data.constData();
+            vectors[i].iov_base = const_cast<char *>(base + segment.offset);
+            vectors[i].iov_len = size_t(segment.length);
+        }
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = vectors;
+        message.msg_iovlen = count;
+
+        // MSG_NOSIGNAL：对端已关闭时返回EPIPE而不是产生SIGPIPE（与Qt自身的写入一致）
+        ssize_t result;
+        do
+        {
+            result = ::sendmsg(int(conn->socket->socketDescriptor()), &message, MSG_NOSIGNAL);
+        } while (result < 0 && errno == EINTR);
+        statistics.vectoredWrites++;
+
+        if (result < 0 && (errno == EPIPE || errno == ECONNRESET))
+        {
+            // 丢弃本批数据并断开连接；abort()会同步发出disconnected，
+            // 处理函数可能移除本连接，而调用者还在使用它，因此排队执行
+            reset = true;
+            QMetaObject::invokeMethod(conn->socket, &QAbstractSocket::abort, Qt::QueuedConnection);
+        }
+
+        // 内核缓冲区已满（EAGAIN）时全部交给socket，由Qt在可写时写出
+        direct = result > 0 ? qint64(result) : 0;
+    }
+#endif
+
+    // 内核未接收的部分交给socket写缓冲区，保持顺序
+    qint64 skip = reset ? batch.bytes : direct;
+    for (const Segment &segment : batch.segments)
+    {
+        if (skip >= segment.length)
+        {
+            skip -= segment.length;
+            continue;
+        }
+
+        const char *base =
+            segment.data.isEmpty() ? batch.headers.constData() : segment.data.constData();
+        conn->socket->write(base + segment.offset + skip, segment.length - skip);
+        statistics.bufferedWrites++;
+        skip = 0;
+    }
+
+    QTcpSocket *socket = conn->socket;
+    qint64 bytes = batch.bytes;
+    batch.headers.resize(0);
+    batch.segments.clear();
+    batch.bytes = 0;
+    if (reset)
+    {
+        return;
+    }
+
+    // 直接写入内核的数据不会触发bytesWritten，调度结束后需要主动重新激活仍有数据的连接；
+    // 调度过程中提前写出时由调度循环自己决定是否继续
+    if (!pumping && direct > 0 && socket->bytesToWrite() < socketHighWater)
+    {
+        activate(conn);
+    }
+
+    emit dataWritten(socket, bytes);
+}
+
+void OutboundScheduler::onBytesWritten()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    Connection *conn = connections.value(socket);
+    if (conn && socket->bytesToWrite() < socketHighWater)
+    {
+        activate(conn);
+    }
+}
+
+void OutboundScheduler::onThrottleTimeout()
+{
+    QList<Connection *> waiting = throttledConnections;
+    throttledConnections.clear();
+    for (Connection *conn : waiting)
+    {
+        conn->throttled = false;
+        activate(conn);
+    }
+}
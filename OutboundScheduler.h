@@ -0,0 +1,284 @@
+#ifndef OUTBOUNDSCHEDULER_H
+#define OUTBOUNDSCHEDULER_H
+
+#include "TCPFrame.h"
+#include "TokenBucket.h"
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QQueue>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QVector>
+#include <functional>
+#include <memory>
+
+// 出站调度器：在多个连接之间公平地分配发送带宽
+// 连接之间使用赤字轮询（DRR），每个连接内部按消息类别做加权公平排队（SCFQ），
+// 控制和文本消息的权重远高于大块文件数据，同时每个连接可设置令牌桶限速。
+// 使用帧格式的连接以分片为单位调度，文本消息可以插在大文件的分片之间发送；
+// 旧版纯文本连接只能在消息边界切换类别
+class OutboundScheduler : public QObject
+{
+    Q_OBJECT
+
+  public:
+    // 流量类别
+    enum TrafficClass
+    {
+        ControlClass,
+        TextClass,
+        BulkClass,
+        TrafficClassCount
+    };
+
+    // 调度统计
+    struct Stats
+    {
+        quint64 messagesQueued = 0;
+        quint64 messagesSent = 0;
+        quint64 bytesSent = 0;
+        quint64 throttledCount = 0; // 因令牌不足暂停发送的次数
+        quint64 blockedCount = 0;   // 因socket写缓冲区已满暂停发送的次数
+        quint64 vectoredWrites = 0; // sendmsg系统调用次数
+        quint64 bufferedWrites = 0; // 交给socket写缓冲区的次数（由Qt稍后写出）
+        quint64 delayFlushes = 0;   // 写合并等待时间到期后写出的次数
+        quint64 sizeFlushes = 0;    // 写合并累计字节数达到上限后写出的次数
+        quint64 urgentFlushes = 0;  // 因紧急消息立即写出的次数
+    };
+
+    // 写合并策略：新入队的数据最多等待delayUs微秒或某个连接累计maxBytes字节后再统一写出，
+    // 启用时连接设置TCP_NODELAY，由应用层而不是Nagle算法决定何时发包。
+    // delayUs为0时在下一次事件循环中写出（默认行为）；控制消息总是立即写出
+    struct CoalescingPolicy
+    {
+        int delayUs = 0;
+        int maxBytes = 64 * 1024;
+    };
+
+    explicit OutboundScheduler(QObject *parent = nullptr);
+    ~OutboundScheduler();
+
+    // 注册/注销连接
+    void addConnection(QTcpSocket *socket);
+    void removeConnection(QTcpSocket *socket);
+    void clear();
+
+    // 将消息加入指定连接的发送队列，frameType仅对使用帧格式的连接有效
+    void enqueue(QTcpSocket *socket, const QByteArray &data, TrafficClass trafficClass,
+                 quint8 frameType = TCPFrame::TextFrame);
+
+    // 将由head和body两部分组成的消息加入发送队列，两部分不拼接复制；
+    // body可以引用外部内存（例如映射的文件），owner在数据写出之前保持其有效
+    void enqueue(QTcpSocket *socket, const QByteArray &head, const QByteArray &body,
+                 std::shared_ptr<const void> owner, TrafficClass trafficClass,
+                 quint8 frameType = TCPFrame::TextFrame);
+
+    // 消息入队时的观察函数（例如流量捕获），在入队的线程中同步调用，应尽快返回；
+    // head可以为空，framed为连接当时是否使用帧格式
+    typedef std::function<void(QTcpSocket *socket, quint8 frameType, bool framed,
+                               const QByteArray &head, const QByteArray &data)>
+        EnqueueObserver;
+
+    void setEnqueueObserver(const EnqueueObserver &observer)
+    {
+        enqueueObserver = observer;
+    }
+
+    // 设置连接是否使用帧格式发送
+    void setFramed(QTcpSocket *socket, bool framed);
+    bool isFramed(QTcpSocket *socket) const;
+
+    // 设置新连接默认的限速（字节/秒），0表示不限速
+    void setDefaultRateLimit(qint64 bytesPerSecond, qint64 burstBytes = 0);
+
+    // 设置指定连接的限速（字节/秒），0表示不限速
+    void setRateLimit(QTcpSocket *socket, qint64 bytesPerSecond, qint64 burstBytes = 0);
+
+    // 设置连接在DRR中的权重，权重越大分得的带宽越多
+    void setConnectionWeight(QTcpSocket *socket, int weight);
+
+    // 设置流量类别的权重
+    void setClassWeight(TrafficClass trafficClass, int weight);
+
+    // 单次写入socket的最大块大小，已限速连接的桶容量随之调整
+    void setChunkSize(int bytes);
+
+    // socket写缓冲区高水位，超过后等待bytesWritten再继续写入
+    void setSocketHighWater(qint64 bytes)
+    {
+        socketHighWater = qMax<qint64>(bytes, chunkSize);
+    }
+
+    // 设置写合并策略，计时精度为毫秒，delayUs会向上取整到毫秒
+    void setCoalescingPolicy(const CoalescingPolicy &policy);
+    CoalescingPolicy coalescingPolicy() const
+    {
+        return coalescing;
+    }
+
+    // 立即写出所有排队的数据，不等待写合并的时间窗口
+    void flushNow();
+
+    // 是否使用sendmsg直接把帧头和负载一起写入内核（仅非加密连接，默认启用）
+    // 同一次调度中同一连接的所有分片合并为一次写入，负载不再与帧头拼接复制
+    void setVectoredWrites(bool enabled)
+    {
+        vectoredWritesEnabled = enabled;
+    }
+
+    // 获取指定连接尚未写入socket的字节数
+    qint64 queuedBytes(QTcpSocket *socket) const;
+
+    // 获取统计信息
+    Stats stats() const
+    {
+        return statistics;
+    }
+
+  signals:
+    // 数据已写入内核或socket写缓冲区，连接的队列有了新空间
+    void dataWritten(QTcpSocket *socket, qint64 bytes);
+
+  private slots:
+    void pump();
+    void onBytesWritten();
+    void onThrottleTimeout();
+    void onCoalesceTimeout();
+
+  private:
+    // 排队中的消息
+    struct QueuedMessage
+    {
+        QByteArray head; // 在data之前发送，可以为空
+        QByteArray data;
+        std::shared_ptr<const void> owner; // data引用的外部内存
+        quint8 frameType = TCPFrame::TextFrame;
+        quint32 streamId = 0;
+        qint64 offset = 0; // 已发送的字节数
+
+        qint64 size() const
+        {
+            return head.size() + data.size();
+        }
+    };
+
+    // 待写出的一段数据：帧头存放在WriteBatch::headers中，负载引用队列中的消息
+    struct Segment
+    {
+        QByteArray data; // 为空表示帧头
+        std::shared_ptr<const void> owner;
+        qint64 offset = 0;
+        qint64 length = 0;
+    };
+
+    // 一次调度中同一连接待写出的所有分段
+    struct WriteBatch
+    {
+        QByteArray headers;
+        QVector<Segment> segments;
+        qint64 bytes = 0;
+        bool scheduled = false; // 是否已在待写出列表中
+    };
+
+    // 每个连接的发送状态
+    struct Connection
+    {
+        QTcpSocket *socket = nullptr;
+        bool framed = false;
+        quint32 nextStreamId = 1;
+
+        QQueue<QueuedMessage> queues[TrafficClassCount];
+        QueuedMessage current[TrafficClassCount]; // 每个类别正在发送的消息
+        int legacyClass = -1; // 旧版连接上正在发送的消息所属类别
+
+        // SCFQ：每个类别上一个分片的虚拟完成时间，以及连接的虚拟时间
+        double classFinishTag[TrafficClassCount] = {0, 0, 0};
+        double virtualTime = 0;
+
+        qint64 deficit = 0; // DRR赤字计数
+        int weight = 1;
+        qint64 queuedBytes = 0;
+        TokenBucket bucket;
+        qint64 rateLimit = 0;
+        qint64 burst = 0; // 设置的桶容量，实际容量不小于一个分片
+        bool baseNoDelay = false; // 加入调度器时的TCP_NODELAY（例如调优预设设置的值）
+
+        // 写合并：本连接自第coalesceRound次调度以来新入队的字节数
+        qint64 coalescedBytes = 0;
+        quint64 coalesceRound = 0;
+
+        bool active = false;    // 是否在活跃队列中
+        bool throttled = false; // 是否在等待令牌
+        WriteBatch batch;
+
+        bool hasPending(int trafficClass) const
+        {
+            return !current[trafficClass].data.isEmpty() || !queues[trafficClass].isEmpty();
+        }
+
+        bool hasPending() const
+        {
+            return hasPending(ControlClass) || hasPending(TextClass) || hasPending(BulkClass);
+        }
+    };
+
+    QHash<QTcpSocket *, Connection *> connections;
+    QQueue<Connection *> activeConnections;
+    QList<Connection *> throttledConnections;
+    QList<Connection *> flushList; // 本次调度中有待写出数据的连接
+    QTimer *throttleTimer;
+    QTimer *coalesceTimer;
+    CoalescingPolicy coalescing;
+    quint64 pumpRound = 0;       // 已执行的调度次数，用于判断连接的写合并计数是否过期
+    bool coalescePending = false; // 上次写出后是否有新入队的数据
+    bool pumpScheduled = false;
+    bool pumping = false; // 是否正在调度循环中
+
+    int classWeights[TrafficClassCount] = {64, 16, 1};
+    int chunkSize = 16 * 1024;
+    qint64 quantum = 16 * 1024;
+    qint64 socketHighWater = 64 * 1024;
+    qint64 maxBytesPerPump = 1024 * 1024;
+    qint64 defaultRateLimit = 0;
+    qint64 defaultBurst = 0;
+    bool vectoredWritesEnabled = true;
+    Stats statistics;
+    EnqueueObserver enqueueObserver;
+
+    // 单次写入的最大分段数（不超过常见的IOV_MAX）
+    static const int MaxBatchSegments = 64;
+
+    void schedulePump();
+    void activate(Connection *conn);
+
+    // 把连接放入活跃队列，但不安排调度
+    void markActive(Connection *conn);
+
+    // 新数据入队后按写合并策略决定立即调度还是等待，connectionBytes为该连接累计未写出的字节数
+    void requestPump(bool urgent, qint64 connectionBytes);
+
+    // 按写合并策略设置连接的TCP_NODELAY：启用时为1，关闭时恢复为加入调度器时的值
+    void applyNoDelay(Connection *conn);
+    void applyRateLimit(Connection *conn, qint64 bytesPerSecond, qint64 burstBytes);
+
+    // 在连接内部按SCFQ选出下一个分片所属的类别，没有可发送数据时返回-1
+    int selectClass(Connection *conn) const;
+
+    // 把帧头/负载加入连接的写批次
+    void appendHeader(Connection *conn, quint8 frameType, quint8 flags, quint32 streamId,
+                      quint32 length);
+    void appendData(Connection *conn, const QByteArray &data, qint64 offset, qint64 length,
+                    const std::shared_ptr<const void> &owner = nullptr);
+
+    // 写出连接的写批次：能直接写内核时用一次sendmsg，剩余部分交给socket写缓冲区
+    void flush(Connection *conn);
+
+    // 写批次能否绕过socket写缓冲区直接写入内核
+    bool canWriteDirectly(QTcpSocket *socket) const;
+
+    // 发送长度为length的数据后推进SCFQ虚拟时间
+    void advanceVirtualTime(Connection *conn, int trafficClass, qint64 length);
+};
+
+#endif // OUTBOUNDSCHEDULER_H
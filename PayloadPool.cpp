@@ -0,0 +1,173 @@
+#include "PayloadPool.h"
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QVector>
+#include <cstring>
+
+const int PayloadPool::ChunkSize;
+
+// 处理块的专用线程池：提交到全局线程池的任务会等待块完成，块不能与之共用线程，否则可能互相等待
+static QThreadPool *chunkWorkers()
+{
+    static QThreadPool pool;
+    return &pool;
+}
+
+// 把count个块分给工作线程，调用线程处理第一块，全部完成后返回
+static void runChunks(qsizetype count, const std::function<void(qsizetype)> &work)
+{
+    QSemaphore done;
+    for (qsizetype i = 1; i < count; ++i)
+    {
+        chunkWorkers()->start([&work, &done, i]() {
+            work(i);
+            done.release();
+        });
+    }
+    work(0);
+    done.acquire(int(count - 1));
+}
+
+PayloadPool::PayloadPool(QObject *parent) : QObject(parent), shared(std::make_shared<Shared>())
+{
+    shared->pool = this;
+}
+
+PayloadPool::~PayloadPool()
+{
+    // 加锁保证正在结束的任务不会向已析构的对象投递回调；已投递的回调随对象一起删除
+    QMutexLocker locker(&shared->mutex);
+    shared->pool = nullptr;
+}
+
+void PayloadPool::submit(const Job &job, const Callback &callback, const QString &group)
+{
+    Group &entry = groups[group];
+    quint64 ticket = entry.nextTicket++;
+    entry.callbacks.insert(ticket, callback);
+    pending++;
+
+    std::shared_ptr<Shared> state = shared;
+    QThreadPool::globalInstance()->start([state, job, group, ticket]() {
+        QByteArray result = job();
+
+        QMutexLocker locker(&state->mutex);
+        PayloadPool *pool = state->pool;
+        if (pool)
+        {
+            QMetaObject::invokeMethod(
+                pool, [pool, group, ticket, result]() { pool->onFinished(group, ticket, result); },
+                Qt::QueuedConnection);
+        }
+    });
+}
+
+void PayloadPool::post(const Task &task, const QString &group)
+{
+    // 组只在有未交回的任务时存在，此时task排在最后，由之前的任务交回时一并调用
+    auto it = groups.find(group);
+    if (it == groups.end())
+    {
+        task();
+        return;
+    }
+
+    quint64 ticket = it->nextTicket++;
+    it->callbacks.insert(ticket, [task](const QByteArray &) { task(); });
+    it->finished.insert(ticket, QByteArray());
+    pending++;
+}
+
+int PayloadPool::pendingCount(const QString &group) const
+{
+    auto it = groups.constFind(group);
+    return it == groups.constEnd() ? 0 : int(it->callbacks.size());
+}
+
+void PayloadPool::onFinished(const QString &group, quint64 ticket, const QByteArray &result)
+{
+    auto it = groups.find(group);
+    if (it == groups.end())
+    {
+        return;
+    }
+    it->finished.insert(ticket, result);
+
+    // 按组内的提交顺序交回；回调中可能再次提交任务，每次都重新查找组
+    while (it != groups.end() && !it->finished.isEmpty() &&
+           it->finished.firstKey() == it->nextDelivery)
+    {
+        QByteArray ready = it->finished.take(it->nextDelivery);
+        Callback callback = it->callbacks.take(it->nextDelivery);
+        it->nextDelivery++;
+        pending--;
+        if (it->callbacks.isEmpty())
+        {
+            groups.erase(it);
+        }
+        if (callback)
+        {
+            callback(ready);
+        }
+        it = groups.find(group);
+    }
+}
+
+QByteArray PayloadPool::toBase64(const QByteArray &data, const QByteArray &prefix)
+{
+    qsizetype count = (data.size() + ChunkSize - 1) / ChunkSize;
+    if (count <= 1)
+    {
+        return prefix + data.toBase64();
+    }
+
+    // 除最后一块外每块都是3的倍数字节，编码后恰好ChunkSize / 3 * 4个字符，没有填充
+    const qsizetype textChunk = ChunkSize / 3 * 4;
+    QByteArray out(prefix.size() + (data.size() + 2) / 3 * 4, Qt::Uninitialized);
+    memcpy(out.data(), prefix.constData(), size_t(prefix.size()));
+    char *target = out.data() + prefix.size();
+    runChunks(count, [&](qsizetype i) {
+        qsizetype offset = i * ChunkSize;
+        QByteArray part = QByteArray::fromRawData(data.constData() + offset,
+                                                  qMin<qsizetype>(ChunkSize, data.size() - offset))
+                              .toBase64();
+        memcpy(target + i * textChunk, part.constData(), size_t(part.size()));
+    });
+    return out;
+}
+
+QByteArray PayloadPool::fromBase64(const QByteArray &base64)
+{
+    const qsizetype textChunk = ChunkSize / 3 * 4;
+    qsizetype count = (base64.size() + textChunk - 1) / textChunk;
+    if (count <= 1 || base64.size() % 4 != 0)
+    {
+        return QByteArray::fromBase64(base64);
+    }
+
+    QVector<QByteArray> parts(count);
+    runChunks(count, [&](qsizetype i) {
+        qsizetype offset = i * textChunk;
+        parts[i] = QByteArray::fromBase64(QByteArray::fromRawData(
+            base64.constData() + offset, qMin(textChunk, base64.size() - offset)));
+    });
+
+    // 数据中夹有换行等非Base64字符时各块不再对齐，改为整体解码
+    qsizetype size = 0;
+    for (qsizetype i = 0; i < count; ++i)
+    {
+        if (i < count - 1 && parts.at(i).size() != ChunkSize)
+        {
+            return QByteArray::fromBase64(base64);
+        }
+        size += parts.at(i).size();
+    }
+
+    QByteArray out;
+    out.reserve(size);
+    for (const QByteArray &part : parts)
+    {
+        out.append(part);
+    }
+    return out;
+}
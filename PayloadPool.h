@@ -0,0 +1,78 @@
+#ifndef PAYLOADPOOL_H
+#define PAYLOADPOOL_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <functional>
+#include <memory>
+
+// 负载准备线程池：Base64编解码等耗时的负载处理在工作线程中完成，不阻塞GUI线程，
+// 结果交回本对象所在的线程（即socket所在的线程）；同一顺序组内按提交顺序交回，
+// 不同组之间互不等待（例如每个连接一组，一个连接上的大文件不阻塞其他连接的消息）
+// 大负载的Base64按块并行处理：编码时每块为3的倍数字节，解码时每块为4的倍数个字符，各块结果直接拼接
+class PayloadPool : public QObject
+{
+    Q_OBJECT
+
+  public:
+    // 并行处理时每块的原始字节数（3的倍数），不超过一块的负载不拆分
+    static const int ChunkSize = 3 * 256 * 1024;
+
+    typedef std::function<QByteArray()> Job;
+    typedef std::function<void(const QByteArray &result)> Callback;
+    typedef std::function<void()> Task;
+
+    explicit PayloadPool(QObject *parent = nullptr);
+    ~PayloadPool();
+
+    // 在线程池中执行job，完成后在本对象所在线程按组内的提交顺序调用callback
+    // job在工作线程中运行，只能使用按值捕获的数据
+    void submit(const Job &job, const Callback &callback, const QString &group = QString());
+
+    // 在本对象所在线程调用task，排在同一组之前提交的任务之后；组内没有未交回的任务时立即调用
+    // 用于让不经过线程池的消息与之前的异步结果保持顺序
+    void post(const Task &task, const QString &group = QString());
+
+    // 已提交、尚未交回结果的任务数
+    int pendingCount() const
+    {
+        return pending;
+    }
+
+    // 组内已提交、尚未交回结果的任务数
+    int pendingCount(const QString &group) const;
+
+    // 按块并行的Base64编码/解码，在调用线程中等待所有块完成，结果与QByteArray的同名函数相同
+    // 编码结果之前加上prefix（例如消息头），省去再拼接一次的复制
+    static QByteArray toBase64(const QByteArray &data, const QByteArray &prefix = QByteArray());
+    static QByteArray fromBase64(const QByteArray &base64);
+
+  private:
+    // 与线程池中的任务共享，本对象析构后任务不再回调
+    struct Shared
+    {
+        QMutex mutex;
+        PayloadPool *pool = nullptr;
+    };
+
+    // 一个顺序组，全部交回后删除
+    struct Group
+    {
+        QHash<quint64, Callback> callbacks; // 尚未交回的任务
+        QMap<quint64, QByteArray> finished; // 已完成但排在前面的任务尚未完成
+        quint64 nextTicket = 0;
+        quint64 nextDelivery = 0;
+    };
+
+    std::shared_ptr<Shared> shared;
+    QHash<QString, Group> groups;
+    int pending = 0;
+
+    void onFinished(const QString &group, quint64 ticket, const QByteArray &result);
+};
+
+#endif // PAYLOADPOOL_H
@@ -0,0 +1,98 @@
+#include "ReusePortListener.h"
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#endif
+
+ReusePortListener::ReusePortListener(int cpu)
+    : QTcpServer(nullptr), ownerThread(QThread::currentThread()), boundCpu(cpu), accepted(0)
+{
+    thread.setObjectName(QString("listener-%1").arg(cpu));
+}
+
+ReusePortListener::~ReusePortListener()
+{
+    stop();
+}
+
+bool ReusePortListener::start(qintptr descriptor)
+{
+    if (thread.isRunning())
+    {
+        return false;
+    }
+
+    thread.start();
+    moveToThread(&thread);
+
+    bool attached = false;
+    QMetaObject::invokeMethod(
+        this, [this, descriptor]() { return attach(descriptor); },
+        Qt::BlockingQueuedConnection, &attached);
+    if (!attached)
+    {
+        stop();
+    }
+    return attached;
+}
+
+bool ReusePortListener::attach(qintptr descriptor)
+{
+#ifdef Q_OS_LINUX
+    if (boundCpu >= 0)
+    {
+        // 线程固定在一个CPU上，并通过SO_INCOMING_CPU提示内核
+        // 优先把在该CPU上处理的连接分给这个监听socket（不需要eBPF程序）
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(boundCpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#ifdef SO_INCOMING_CPU
+        int value = boundCpu;
+        ::setsockopt(int(descriptor), SOL_SOCKET, SO_INCOMING_CPU, &value,
+                     socklen_t(sizeof(value)));
+#endif
+    }
+#endif
+
+    // socket通知器在当前线程中创建，之后的accept都在这个线程中进行
+    return setSocketDescriptor(descriptor);
+}
+
+void ReusePortListener::stop()
+{
+    if (!thread.isRunning())
+    {
+        return;
+    }
+
+    // 在监听线程中关闭并把对象移回创建者线程，之后才能安全结束线程
+    QMetaObject::invokeMethod(
+        this,
+        [this]() {
+            close();
+            moveToThread(ownerThread);
+        },
+        Qt::BlockingQueuedConnection);
+    thread.quit();
+    thread.wait();
+}
+
+void ReusePortListener::pause()
+{
+    QMetaObject::invokeMethod(this, [this]() { pauseAccepting(); }, Qt::QueuedConnection);
+}
+
+void ReusePortListener::resume()
+{
+    QMetaObject::invokeMethod(this, [this]() { resumeAccepting(); }, Qt::QueuedConnection);
+}
+
+void ReusePortListener::incomingConnection(qintptr descriptor)
+{
+    // 不创建QTcpSocket，socket对象由主线程根据描述符创建
+    accepted.fetchAndAddRelaxed(1);
+    emit descriptorAccepted(descriptor);
+}
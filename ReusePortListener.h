@@ -0,0 +1,59 @@
+#ifndef REUSEPORTLISTENER_H
+#define REUSEPORTLISTENER_H
+
+#include <QAtomicInteger>
+#include <QTcpServer>
+#include <QThread>
+
+// 在独立线程中运行的附加监听socket，与主监听socket通过SO_REUSEPORT共享端口，
+// 由内核在各监听socket之间分配新连接；这里只负责accept，
+// 接受的描述符通过descriptorAccepted信号交给主线程的TCPServer处理
+class ReusePortListener : public QTcpServer
+{
+    Q_OBJECT
+
+  public:
+    // cpu为线程绑定的CPU编号，-1表示不绑定
+    explicit ReusePortListener(int cpu = -1);
+    ~ReusePortListener();
+
+    // 启动线程并在其中接管已处于监听状态的描述符，阻塞到接管完成
+    // 失败时描述符由调用者关闭
+    bool start(qintptr descriptor);
+
+    // 停止监听并结束线程，只能在创建它的线程中调用
+    void stop();
+
+    // 跨线程暂停/恢复接受新连接
+    void pause();
+    void resume();
+
+    // 已接受的连接数
+    quint64 acceptedCount() const
+    {
+        return accepted.loadRelaxed();
+    }
+
+    int cpu() const
+    {
+        return boundCpu;
+    }
+
+  signals:
+    // 接受了一个新连接（在监听线程中发出）
+    void descriptorAccepted(qintptr descriptor);
+
+  protected:
+    void incomingConnection(qintptr descriptor) override;
+
+  private:
+    QThread thread;
+    QThread *ownerThread; // 创建者所在线程，停止时移回
+    int boundCpu;
+    QAtomicInteger<quint64> accepted;
+
+    // 在监听线程中执行：绑定CPU并接管描述符
+    bool attach(qintptr descriptor);
+};
+
+#endif // REUSEPORTLISTENER_H
@@ -0,0 +1,323 @@
+#include "SocketTuning.h"
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+static void setError(QString *errorString, const QString &message)
+{
+    if (errorString)
+    {
+        *errorString = message;
+    }
+}
+
+SocketTuning::Profile SocketTuning::defaultProfile()
+{
+    Profile profile;
+    profile.name = "default";
+    return profile;
+}
+
+SocketTuning::Profile SocketTuning::lowLatency()
+{
+    Profile profile;
+    profile.name = "low-latency";
+    profile.noDelay = 1;
+    profile.quickAck = 1;
+    profile.busyPollUs = 50;
+    // 只让少量未发送数据留在内核中，新数据可以更快地按优先级排到前面
+    profile.notSentLowat = 16 * 1024;
+    return profile;
+}
+
+SocketTuning::Profile SocketTuning::bulk()
+{
+    Profile profile;
+    profile.name = "bulk";
+    profile.sendBufferSize = 4 * 1024 * 1024;
+    profile.receiveBufferSize = 4 * 1024 * 1024;
+    return profile;
+}
+
+SocketTuning::Profile SocketTuning::manyIdle()
+{
+    Profile profile;
+    profile.name = "many-idle";
+    // 小缓冲区降低每个连接占用的内核内存
+    profile.sendBufferSize = 32 * 1024;
+    profile.receiveBufferSize = 32 * 1024;
+    // 尽快发现已失效的对端
+    profile.keepAliveIdle = 60;
+    profile.keepAliveInterval = 10;
+    profile.keepAliveCount = 3;
+    return profile;
+}
+
+QStringList SocketTuning::profileNames()
+{
+    return QStringList() << "default" << "low-latency" << "bulk" << "many-idle";
+}
+
+bool SocketTuning::profileByName(const QString &name, Profile &profile)
+{
+    QString key = name.trimmed().toLower();
+    if (key == "default")
+    {
+        profile = defaultProfile();
+    }
+    else if (key == "low-latency")
+    {
+        profile = lowLatency();
+    }
+    else if (key == "bulk")
+    {
+        profile = bulk();
+    }
+    else if (key == "many-idle")
+    {
+        profile = manyIdle();
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool SocketTuning::apply(QAbstractSocket *socket, const Profile &profile, QString *errorString)
+{
+    if (profile.isDefault())
+    {
+        return true;
+    }
+    if (!socket || socket->socketDescriptor() < 0)
+    {
+        setError(errorString, QString("socket未连接"));
+        return false;
+    }
+    return apply(socket->socketDescriptor(), profile, errorString);
+}
+
+#ifdef Q_OS_UNIX
+// 设置一个整数选项，value为-1时跳过，失败时把选项名记入failed并返回false
+static bool setOption(int fd, int level, int option, int value, const char *name,
+                      QStringList &failed)
+{
+    if (value < 0)
+    {
+        return true;
+    }
+    if (::setsockopt(fd, level, option, &value, socklen_t(sizeof(value))) != 0)
+    {
+        failed.append(QString("%1(%2)").arg(name, QString::fromLocal8Bit(strerror(errno))));
+        return false;
+    }
+    return true;
+}
+
+static int getOption(int fd, int level, int option)
+{
+    int value = 0;
+    socklen_t length = socklen_t(sizeof(value));
+    if (::getsockopt(fd, level, option, &value, &length) != 0)
+    {
+        return -1;
+    }
+    return value;
+}
+#endif
+
+bool SocketTuning::apply(qintptr descriptor, const Profile &profile, QString *errorString)
+{
+    if (profile.isDefault())
+    {
+        return true;
+    }
+
+#ifdef Q_OS_UNIX
+    int fd = int(descriptor);
+    QStringList failed;
+
+    setOption(fd, SOL_SOCKET, SO_SNDBUF, profile.sendBufferSize, "SO_SNDBUF", failed);
+    setOption(fd, SOL_SOCKET, SO_RCVBUF, profile.receiveBufferSize, "SO_RCVBUF", failed);
+    setOption(fd, IPPROTO_TCP, TCP_NODELAY, profile.noDelay, "TCP_NODELAY", failed);
+
+    if (profile.keepAliveIdle > 0 || profile.keepAliveInterval > 0 || profile.keepAliveCount > 0)
+    {
+        setOption(fd, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE", failed);
+#ifdef TCP_KEEPIDLE
+        setOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, profile.keepAliveIdle, "TCP_KEEPIDLE", failed);
+#endif
+#ifdef TCP_KEEPINTVL
+        setOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, profile.keepAliveInterval, "TCP_KEEPINTVL",
+                  failed);
+#endif
+#ifdef TCP_KEEPCNT
+        setOption(fd, IPPROTO_TCP, TCP_KEEPCNT, profile.keepAliveCount, "TCP_KEEPCNT", failed);
+#endif
+    }
+
+#ifdef TCP_QUICKACK
+    setOption(fd, IPPROTO_TCP, TCP_QUICKACK, profile.quickAck, "TCP_QUICKACK", failed);
+#endif
+#ifdef SO_BUSY_POLL
+    setOption(fd, SOL_SOCKET, SO_BUSY_POLL, profile.busyPollUs, "SO_BUSY_POLL", failed);
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+    setOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, profile.notSentLowat, "TCP_NOTSENT_LOWAT",
+              failed);
+#endif
+
+    if (!failed.isEmpty())
+    {
+        setError(errorString, QString("设置socket选项失败: %1").arg(failed.join(", ")));
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(descriptor);
+    Q_UNUSED(profile);
+    setError(errorString, QString("当前平台不支持socket调优"));
+    return false;
+#endif
+}
+
+void SocketTuning::rearmQuickAck(qintptr descriptor)
+{
+#if defined(Q_OS_UNIX) && defined(TCP_QUICKACK)
+    int value = 1;
+    ::setsockopt(int(descriptor), IPPROTO_TCP, TCP_QUICKACK, &value, socklen_t(sizeof(value)));
+#else
+    Q_UNUSED(descriptor);
+#endif
+}
+
+SocketTuning::Profile SocketTuning::read(qintptr descriptor)
+{
+    Profile profile;
+#ifdef Q_OS_UNIX
+    int fd = int(descriptor);
+    profile.sendBufferSize = getOption(fd, SOL_SOCKET, SO_SNDBUF);
+    profile.receiveBufferSize = getOption(fd, SOL_SOCKET, SO_RCVBUF);
+    profile.noDelay = getOption(fd, IPPROTO_TCP, TCP_NODELAY);
+#ifdef TCP_KEEPIDLE
+    profile.keepAliveIdle = getOption(fd, IPPROTO_TCP, TCP_KEEPIDLE);
+#endif
+#ifdef TCP_KEEPINTVL
+    profile.keepAliveInterval = getOption(fd, IPPROTO_TCP, TCP_KEEPINTVL);
+#endif
+#ifdef TCP_KEEPCNT
+    profile.keepAliveCount = getOption(fd, IPPROTO_TCP, TCP_KEEPCNT);
+#endif
+#ifdef TCP_QUICKACK
+    profile.quickAck = getOption(fd, IPPROTO_TCP, TCP_QUICKACK);
+#endif
+#ifdef SO_BUSY_POLL
+    profile.busyPollUs = getOption(fd, SOL_SOCKET, SO_BUSY_POLL);
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+    profile.notSentLowat = getOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT);
+#endif
+#ifdef SO_REUSEPORT
+    profile.reusePort = getOption(fd, SOL_SOCKET, SO_REUSEPORT) > 0;
+#endif
+#else
+    Q_UNUSED(descriptor);
+#endif
+    return profile;
+}
+
+qintptr SocketTuning::createListeningSocket(quint16 port, const Profile &profile, int backlog,
+                                            QAbstractSocket::SocketError *error,
+                                            QString *errorString)
+{
+#ifdef Q_OS_UNIX
+    // 优先使用双栈IPv6 socket，与QTcpServer监听QHostAddress::Any的行为一致
+    bool ipv6 = true;
+    int fd = ::socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        ipv6 = false;
+        fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+
+    // 监听socket上除SO_REUSEPORT外的选项设置失败不影响监听
+    QStringList failed;
+    bool reusePortSet = true;
+    if (fd >= 0)
+    {
+        setOption(fd, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR", failed);
+#ifdef SO_REUSEPORT
+        reusePortSet = setOption(fd, SOL_SOCKET, SO_REUSEPORT, profile.reusePort ? 1 : -1,
+                                 "SO_REUSEPORT", failed);
+#else
+        reusePortSet = !profile.reusePort;
+#endif
+        setOption(fd, SOL_SOCKET, SO_RCVBUF, profile.receiveBufferSize, "SO_RCVBUF", failed);
+        if (ipv6)
+        {
+            setOption(fd, IPPROTO_IPV6, IPV6_V6ONLY, 0, "IPV6_V6ONLY", failed);
+        }
+    }
+
+    int result = fd < 0 || !reusePortSet ? -1 : 0;
+    if (result == 0 && ipv6)
+    {
+        struct sockaddr_in6 address;
+        memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_port = htons(port);
+        address.sin6_addr = in6addr_any;
+        result = ::bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+    }
+    else if (result == 0)
+    {
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        result = ::bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+    }
+    if (result == 0)
+    {
+        result = ::listen(fd, backlog);
+    }
+
+    // SO_REUSEPORT设置失败时多个监听socket无法共享端口，视为失败
+    if (result != 0)
+    {
+        int code = reusePortSet ? errno : ENOPROTOOPT;
+        if (error)
+        {
+            *error = code == EADDRINUSE                  ? QAbstractSocket::AddressInUseError
+                     : (code == EACCES || code == EPERM) ? QAbstractSocket::SocketAccessError
+                                                         : QAbstractSocket::UnknownSocketError;
+        }
+        setError(errorString, reusePortSet ? QString::fromLocal8Bit(strerror(code))
+                                           : QString("不支持SO_REUSEPORT"));
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return -1;
+    }
+    return fd;
+#else
+    Q_UNUSED(port);
+    Q_UNUSED(profile);
+    Q_UNUSED(backlog);
+    if (error)
+    {
+        *error = QAbstractSocket::UnsupportedSocketOperationError;
+    }
+    setError(errorString, QString("当前平台不支持自行创建监听socket"));
+    return -1;
+#endif
+}
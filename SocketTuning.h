@@ -0,0 +1,78 @@
+#ifndef SOCKETTUNING_H
+#define SOCKETTUNING_H
+
+#include <QAbstractSocket>
+#include <QString>
+#include <QStringList>
+
+// socket调优配置：在接受连接和建立连接时通过setsockopt设置内核参数
+// 提供几种预设：
+//   - low-latency：关闭Nagle、立即确认、忙轮询，小的未发送水位，适合交互消息
+//   - bulk：大的收发缓冲区，适合文件和图片传输
+//   - many-idle：小缓冲区和较短的keepalive，适合大量长期空闲的连接
+// 非Linux平台上不支持的选项会被忽略
+class SocketTuning
+{
+  public:
+    // 调优参数，各项为-1（reusePort为false）表示保持系统默认值
+    struct Profile
+    {
+        QString name;
+        int sendBufferSize = -1;    // SO_SNDBUF（字节）
+        int receiveBufferSize = -1; // SO_RCVBUF（字节）
+        int noDelay = -1;           // TCP_NODELAY（0/1）
+        int keepAliveIdle = -1;     // TCP_KEEPIDLE（秒），设置任一keepalive参数时同时打开SO_KEEPALIVE
+        int keepAliveInterval = -1; // TCP_KEEPINTVL（秒）
+        int keepAliveCount = -1;    // TCP_KEEPCNT
+        int quickAck = -1;          // TCP_QUICKACK（0/1），内核会自动复位，每次读取后需要重新设置
+        int busyPollUs = -1;        // SO_BUSY_POLL（微秒），通常需要CAP_NET_ADMIN权限
+        int notSentLowat = -1;      // TCP_NOTSENT_LOWAT（字节）
+        bool reusePort = false;     // SO_REUSEPORT，只对监听socket有效
+
+        // 是否所有选项都保持系统默认值
+        bool isDefault() const
+        {
+            return sendBufferSize < 0 && receiveBufferSize < 0 && noDelay < 0 &&
+                   keepAliveIdle < 0 && keepAliveInterval < 0 && keepAliveCount < 0 &&
+                   quickAck < 0 && busyPollUs < 0 && notSentLowat < 0 && !reusePort;
+        }
+
+        // 是否有需要在bind之前设置的选项（监听socket需要自行创建）
+        bool needsPreBind() const
+        {
+            return reusePort || receiveBufferSize > 0;
+        }
+    };
+
+    // 预设
+    static Profile defaultProfile();
+    static Profile lowLatency();
+    static Profile bulk();
+    static Profile manyIdle();
+
+    // 预设名称，顺序为default、low-latency、bulk、many-idle
+    static QStringList profileNames();
+
+    // 按名称查找预设，名称不存在时返回false
+    static bool profileByName(const QString &name, Profile &profile);
+
+    // 对已连接的socket应用配置，部分选项设置失败时返回false并通过errorString列出，其余选项仍然生效
+    static bool apply(QAbstractSocket *socket, const Profile &profile,
+                      QString *errorString = nullptr);
+    static bool apply(qintptr descriptor, const Profile &profile, QString *errorString = nullptr);
+
+    // 重新打开TCP_QUICKACK，在每次读取数据后调用
+    static void rearmQuickAck(qintptr descriptor);
+
+    // 用getsockopt读取socket当前的选项值，用于校验配置是否生效
+    // 不支持的选项为-1；Linux上读到的缓冲区大小是设置值的两倍（含内核簿记开销）
+    static Profile read(qintptr descriptor);
+
+    // 创建监听所有地址的socket，在bind之前设置SO_REUSEPORT和接收缓冲区（新连接继承该值，
+    // 窗口扩大因子才能按缓冲区大小协商），返回已处于监听状态的描述符，失败返回-1
+    static qintptr createListeningSocket(quint16 port, const Profile &profile, int backlog,
+                                         QAbstractSocket::SocketError *error = nullptr,
+                                         QString *errorString = nullptr);
+};
+
+#endif // SOCKETTUNING_H
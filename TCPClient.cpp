@@ -1,18 +1,104 @@
 #include "TCPClient.h"
+#include "MappedFile.h"
+#include "TCPDelta.h"
+#include "TCPSchema.h"
+#include "TCPTls.h"
 #include <QBuffer>
-#include <QFile>
+#include <QDeadlineTimer>
 #include <QFileInfo>
 #include <QHostAddress>
 #include <QImage>
+#include <QMutex>
+#include <QRandomGenerator>
 #include <QTextCodec>
+#include <QtEndian>
+#include <QtMath>
 
-TCPClient::TCPClient(QObject *parent) : QObject(parent), clientSocket(new QTcpSocket(this))
+// 重连后一次交给调度器的离线消息上限，其余消息等数据写出后再继续重发
+static const qint64 ReplayHighWater = 1024 * 1024;
+
+// 接收到的文件和图片在线程池中解码时使用的顺序组，与发送时的编码互不等待
+static const QString ReceiveGroup = QStringLiteral("receive");
+
+const int TCPClient::DefaultNegotiationTimeoutMs;
+const int TCPClient::PlainTextServerTtlMs;
+
+// 没有回复Hello的服务端（地址:端口）及记录的有效期，同一进程中的所有客户端共用；
+// 过期后重新探测，一次偶然的超时不会让该服务端永远使用纯文本协议
+static QMutex plainTextMutex;
+static QHash<QString, QDeadlineTimer> plainTextServers;
+
+static bool isPlainTextServer(const QString &peer)
+{
+    QMutexLocker locker(&plainTextMutex);
+    auto it = plainTextServers.find(peer);
+    if (it == plainTextServers.end())
+    {
+        return false;
+    }
+    if (it->hasExpired())
+    {
+        plainTextServers.erase(it);
+        return false;
+    }
+    return true;
+}
+
+static void setPlainTextServer(const QString &peer, bool plainText)
+{
+    QMutexLocker locker(&plainTextMutex);
+    if (plainText)
+    {
+        plainTextServers.insert(peer, QDeadlineTimer(TCPClient::PlainTextServerTtlMs));
+    }
+    else
+    {
+        plainTextServers.remove(peer);
+    }
+}
+
+// 纯文本连接只能发送文本消息和旧版格式的文件/图片消息
+static bool isTextCompatible(const OfflineQueue::Entry &entry)
+{
+    if (entry.frameType == TCPFrame::FileFrame || entry.frameType == TCPFrame::ImageFrame)
+    {
+        quint8 id;
+        return !TCPSchema::peek(entry.data, id);
+    }
+    return entry.frameType == TCPFrame::TextFrame;
+}
+
+TCPClient::TCPClient(QObject *parent)
+    : QObject(parent), clientSocket(new QSslSocket(this)), scheduler(new OutboundScheduler(this)),
+      rpcEndpoint(new TCPRpc(scheduler, this)), negotiationTimer(new QTimer(this)),
+      payloadPool(new PayloadPool(this)), reconnectTimer(new QTimer(this))
 {
+    reconnectTimer->setSingleShot(true);
+    connect(reconnectTimer, &QTimer::timeout, this, &TCPClient::onReconnectTimeout);
+    negotiationTimer->setSingleShot(true);
+    connect(negotiationTimer, &QTimer::timeout, this, &TCPClient::onNegotiationTimeout);
+
     // 连接信号和槽
     connect(clientSocket, &QTcpSocket::connected, this, &TCPClient::onSocketConnected);
     connect(clientSocket, &QTcpSocket::disconnected, this, &TCPClient::onSocketDisconnected);
     connect(clientSocket, &QTcpSocket::readyRead, this, &TCPClient::onSocketReadyRead);
     connect(clientSocket, &QTcpSocket::errorOccurred, this, &TCPClient::onSocketError);
+    // 调度器可能绕过socket直接写入内核，因此以调度器的信号判断队列是否有空间
+    connect(scheduler, &OutboundScheduler::dataWritten, this, &TCPClient::onSocketBytesWritten);
+    // 启用TLS时等握手完成后才开始发送
+    connect(clientSocket, &QSslSocket::encrypted, this, &TCPClient::onSocketConnected);
+    connect(clientSocket, QOverload<const QList<QSslError> &>::of(&QSslSocket::sslErrors), this,
+            &TCPClient::onSslErrors);
+    connect(clientSocket, &QSslSocket::newSessionTicketReceived, this,
+            &TCPClient::onSessionTicketReceived);
+
+    // 内置的应用消息类型；旧版纯文本消息按文本帧交付，仍按内容前缀区分
+    messageHandlers.setHandler(TCPFrame::TextFrame,
+                               [this](const QByteArray &payload) { processMessage(payload); });
+    messageHandlers.setHandler(TCPFrame::FileFrame,
+                               [this](const QByteArray &payload) { processFileMessage(payload); });
+    messageHandlers.setHandler(TCPFrame::ImageFrame,
+                               [this](const QByteArray &payload) { processImageMessage(payload); });
 }
 
 TCPClient::~TCPClient()
@@ -22,14 +108,24 @@ TCPClient::~TCPClient()
 
 void TCPClient::connectToServer(const QString &address, int port)
 {
+    serverAddress = address;
+    serverPort = port;
+    userDisconnected = false;
+    reconnectAttempts = 0;
+    reconnectTimer->stop();
+
     if (clientSocket->state() == QAbstractSocket::UnconnectedState)
     {
-        clientSocket->connectToHost(address, port);
+        openConnection();
     }
 }
 
 void TCPClient::disconnectFromServer()
 {
+    // 主动断开时不再重连
+    userDisconnected = true;
+    reconnectTimer->stop();
+
     if (clientSocket->state() != QAbstractSocket::UnconnectedState)
     {
         clientSocket->disconnectFromHost();
@@ -41,13 +137,333 @@ void TCPClient::disconnectFromServer()
     }
 }
 
-void TCPClient::sendMessage(const QString &message)
+void TCPClient::sendMessage(const QString &message, bool urgent)
 {
-    if (clientSocket->state() == QAbstractSocket::ConnectedState)
+    // 根据编码设置对消息进行编码
+    sendData(encodeMessage(message), OutboundScheduler::TextClass, TCPFrame::TextFrame);
+    if (urgent)
     {
-        // 根据编码设置对消息进行编码
-        QByteArray data = encodeMessage(message);
-        clientSocket->write(data);
+        scheduler->flushNow();
+    }
+}
+
+void TCPClient::setOfflineQueueLimits(int maxMessages, qint64 maxBytes, const QString &spillPath)
+{
+    offlineQueue.setLimits(maxMessages, maxBytes);
+    offlineQueue.setSpillPath(spillPath);
+}
+
+void TCPClient::sendData(const QByteArray &data, OutboundScheduler::TrafficClass trafficClass,
+                         quint8 frameType)
+{
+    OfflineQueue::Entry entry;
+    entry.frameType = frameType;
+    entry.trafficClass = quint8(trafficClass);
+    entry.data = data;
+
+    // 离线队列尚未重发完时，新消息排在后面以保持发送顺序；
+    // 协商期间纯文本格式的消息两种服务端都能处理，直接发出，其他消息先进入离线队列
+    if (isConnected() && (!negotiating || (isTextCompatible(entry) && unacked.isEmpty())) &&
+        offlineQueue.isEmpty())
+    {
+        transmit(entry);
+        return;
+    }
+
+    // 控制帧只对当前连接有意义，协商完成后会重新发送订阅
+    if (frameType == TCPFrame::ControlFrame)
+    {
+        if (isConnected() && !negotiating)
+        {
+            transmit(entry);
+        }
+        return;
+    }
+
+    if (isConnected() || reconnect.enabled)
+    {
+        if (!offlineQueue.enqueue(entry))
+        {
+            emit errorOccurred(tr("离线队列已满或无法写入溢出文件，消息被丢弃"));
+        }
+        if (isConnected())
+        {
+            replayPending();
+        }
+    }
+}
+
+void TCPClient::transmit(OfflineQueue::Entry entry)
+{
+    OutboundScheduler::TrafficClass trafficClass =
+        OutboundScheduler::TrafficClass(entry.trafficClass);
+
+    if (!scheduler->isFramed(clientSocket) && !isTextCompatible(entry))
+    {
+        // 帧格式下产生的消息（之前的连接上排队的二进制消息、发布等）无法在纯文本连接上发送
+        emit errorOccurred(tr("服务端不支持帧格式，消息被丢弃"));
+        return;
+    }
+
+    if (reliableDelivery && scheduler->isFramed(clientSocket) &&
+        entry.frameType != TCPFrame::ControlFrame)
+    {
+        // 保留消息直到服务端确认，重发时沿用原序号以便服务端识别
+        if (entry.sequence == 0)
+        {
+            entry.sequence = nextSequence++;
+        }
+        unacked.insert(entry.sequence, entry);
+        scheduler->enqueue(clientSocket,
+                           TCPFrame::encodeSequencedPayload(entry.sequence, entry.frameType,
+                                                            entry.data),
+                           trafficClass, TCPFrame::SequencedFrame);
+        return;
+    }
+
+    scheduler->enqueue(clientSocket, entry.data, trafficClass, entry.frameType);
+}
+
+void TCPClient::replayPending()
+{
+    if (negotiating)
+    {
+        return;
+    }
+
+    // 先按序号重发上一个连接上未确认的消息
+    if (!unacked.isEmpty())
+    {
+        QMap<quint64, OfflineQueue::Entry> resend;
+        resend.swap(unacked);
+        for (const OfflineQueue::Entry &entry : resend)
+        {
+            transmit(entry);
+        }
+    }
+
+    // 离线队列可能已溢出到磁盘，分批交给调度器，避免一次性全部读入内存
+    OfflineQueue::Entry entry;
+    while (scheduler->queuedBytes(clientSocket) < ReplayHighWater && offlineQueue.dequeue(entry))
+    {
+        transmit(entry);
+    }
+}
+
+void TCPClient::pumpBatches()
+{
+    // 读取始终领先socket几个批次，但只在调度器中排队的数据较少时才交出下一批
+    while (!batchTransfers.isEmpty() && isConnected() && !negotiating &&
+           (capabilities & TCPFrame::BatchCapability) &&
+           scheduler->queuedBytes(clientSocket) < ReplayHighWater)
+    {
+        FileBatchReader *reader = batchTransfers.head();
+        QByteArray payload;
+        if (!reader->takeNext(payload))
+        {
+            return;
+        }
+
+        sendData(payload, OutboundScheduler::BulkClass, TCPFrame::FileFrame);
+        if (reader->atEnd())
+        {
+            batchTransfers.dequeue();
+            reader->deleteLater();
+        }
+    }
+}
+
+void TCPClient::scheduleReconnect()
+{
+    if (!reconnect.enabled || userDisconnected || serverAddress.isEmpty() ||
+        reconnectTimer->isActive())
+    {
+        return;
+    }
+
+    if (reconnect.maxAttempts > 0 && reconnectAttempts >= reconnect.maxAttempts)
+    {
+        emit errorOccurred(tr("重连 %1 次失败，停止重连").arg(reconnectAttempts));
+        return;
+    }
+
+    // 指数退避并加入等量抖动：在[上限/2, 上限]之间随机取值，
+    // 既保证最短等待时间，又能打散同时掉线的客户端
+    double backoff = reconnect.initialDelayMs * qPow(reconnect.multiplier, reconnectAttempts);
+    int ceiling = int(qBound(1.0, backoff, double(qMax(reconnect.maxDelayMs, 1))));
+    int delay = ceiling / 2 + int(QRandomGenerator::global()->bounded(ceiling / 2 + 1));
+
+    reconnectAttempts++;
+    reconnectTimer->start(delay);
+    emit reconnecting(reconnectAttempts, delay);
+}
+
+void TCPClient::onReconnectTimeout()
+{
+    // 用户已手动发起连接，或旧连接尚未完全关闭（关闭后会重新安排重连）
+    if (clientSocket->state() != QAbstractSocket::UnconnectedState)
+    {
+        return;
+    }
+
+    openConnection();
+}
+
+void TCPClient::openConnection()
+{
+    if (!isTlsEnabled())
+    {
+        clientSocket->connectToHost(serverAddress, quint16(serverPort));
+        return;
+    }
+
+    QSslConfiguration config = tlsConfiguration;
+    QByteArray ticket = TCPTls::sessionTicket(peerName());
+    if (!ticket.isEmpty())
+    {
+        config.setSessionTicket(ticket);
+    }
+    clientSocket->setSslConfiguration(config);
+    clientSocket->connectToHostEncrypted(serverAddress, quint16(serverPort));
+}
+
+QString TCPClient::peerName() const
+{
+    return QString("%1:%2").arg(serverAddress).arg(serverPort);
+}
+
+void TCPClient::onSessionTicketReceived()
+{
+    // TLS 1.3的票据在握手之后才到达
+    TCPTls::storeSessionTicket(peerName(), clientSocket->sslConfiguration().sessionTicket());
+}
+
+void TCPClient::onSslErrors(const QList<QSslError> &errors)
+{
+    QStringList messages;
+    for (const QSslError &error : errors)
+    {
+        messages.append(error.errorString());
+    }
+    emit errorOccurred(tr("TLS证书验证失败: %1").arg(messages.join("; ")));
+}
+
+void TCPClient::onSocketBytesWritten()
+{
+    if (!offlineQueue.isEmpty() && isConnected())
+    {
+        replayPending();
+    }
+    pumpBatches();
+}
+
+quint32 TCPClient::call(const QString &method, const QByteArray &params,
+                        const TCPRpc::Callback &callback, int timeoutMs)
+{
+    return rpcEndpoint->call(clientSocket, method, params, callback, timeoutMs);
+}
+
+void TCPClient::registerRpcHandler(const QString &method, const TCPRpc::Handler &handler)
+{
+    rpcEndpoint->registerHandler(method, handler);
+}
+
+bool TCPClient::subscribe(const QString &topic)
+{
+    if (!framingEnabled || textFallback)
+    {
+        emit errorOccurred(tr("订阅主题需要启用帧格式"));
+        return false;
+    }
+
+    subscriptions.insert(topic);
+    sendControl(TCPFrame::SubscribeOpcode, topic.toUtf8());
+    return true;
+}
+
+bool TCPClient::unsubscribe(const QString &topic)
+{
+    if (!subscriptions.remove(topic))
+    {
+        return false;
+    }
+
+    sendControl(TCPFrame::UnsubscribeOpcode, topic.toUtf8());
+    return true;
+}
+
+bool TCPClient::publish(const QString &topic, const QString &message)
+{
+    // 启用自动重连时，断线期间发布的消息进入离线队列
+    if (!framingEnabled || textFallback || (!isConnected() && !reconnect.enabled))
+    {
+        return false;
+    }
+
+    sendData(TCPFrame::encodePublishPayload(topic, encodeMessage(message)),
+             OutboundScheduler::TextClass, TCPFrame::PublishFrame);
+    return true;
+}
+
+bool TCPClient::registerMessageHandler(quint8 type, const MessageHandler &handler)
+{
+    // 内置类型由客户端自己处理，不允许覆盖
+    if (type < TCPFrame::UserFrameBase)
+    {
+        return false;
+    }
+
+    messageHandlers.setHandler(type, handler);
+    return true;
+}
+
+void TCPClient::unregisterMessageHandler(quint8 type)
+{
+    if (type >= TCPFrame::UserFrameBase)
+    {
+        messageHandlers.removeHandler(type);
+    }
+}
+
+bool TCPClient::sendCustomMessage(quint8 type, const QByteArray &payload,
+                                  OutboundScheduler::TrafficClass trafficClass)
+{
+    // 自定义消息依靠帧头中的类型字节区分，只能在帧格式下发送
+    if (type < TCPFrame::UserFrameBase || !framingEnabled || textFallback ||
+        (!isConnected() && !reconnect.enabled))
+    {
+        return false;
+    }
+
+    sendData(payload, trafficClass, type);
+    return true;
+}
+
+void TCPClient::setFramingEnabled(bool enabled)
+{
+    if (enabled == framingEnabled)
+    {
+        return;
+    }
+
+    framingEnabled = enabled;
+    if (!isConnected())
+    {
+        return;
+    }
+
+    if (enabled)
+    {
+        startNegotiation();
+    }
+    else
+    {
+        negotiationTimer->stop();
+        negotiating = false;
+        textFallback = false;
+        capabilities = 0;
+        scheduler->setFramed(clientSocket, false);
+        replayPending();
     }
 }
 
@@ -72,39 +488,362 @@ QByteArray TCPClient::encodeMessage(const QString &message)
 
 bool TCPClient::isConnected() const
 {
-    return clientSocket->state() == QAbstractSocket::ConnectedState;
+    return clientSocket->state() == QAbstractSocket::ConnectedState &&
+           (!isTlsEnabled() || clientSocket->isEncrypted());
+}
+
+quint32 TCPClient::localCapabilities() const
+{
+    quint32 local = TCPFrame::SchemaCapability | TCPFrame::BatchCapability;
+    if (receivedContent.isEnabled())
+    {
+        local |= TCPFrame::ContentCacheCapability;
+    }
+    return local;
+}
+
+void TCPClient::startNegotiation()
+{
+    negotiating = true;
+    textFallback = false;
+    capabilities = 0;
+    serverMessageLimit = TCPFrameReader::DefaultMaxStreamSize;
+    scheduler->setFramed(clientSocket, false);
+
+    // 未协商的连接上调度器不加帧头，Hello编码为完整的帧，像旧版消息一样整条发出；
+    // 协商期间其他消息暂存在离线队列中，只支持纯文本的服务端只会收到这一帧
+    scheduler->enqueue(clientSocket,
+                       TCPFrame::encode(TCPFrame::ControlFrame,
+                                        TCPFrame::encodeHelloPayload(localCapabilities(),
+                                                                     quint32(maxMessageSize()))),
+                       OutboundScheduler::ControlClass, TCPFrame::ControlFrame);
+    negotiationTimer->start(negotiationTimeoutMs);
+}
+
+void TCPClient::finishNegotiation(bool framed, quint32 peerCapabilities)
+{
+    negotiationTimer->stop();
+    negotiating = false;
+    textFallback = !framed;
+    capabilities = framed ? peerCapabilities & localCapabilities() : 0;
+    scheduler->setFramed(clientSocket, framed);
+
+    if (framed)
+    {
+        setPlainTextServer(peerName(), false);
+
+        // 恢复之前的订阅
+        for (const QString &topic : subscriptions)
+        {
+            sendControl(TCPFrame::SubscribeOpcode, topic.toUtf8());
+        }
+    }
+
+    if (!(capabilities & TCPFrame::BatchCapability) && !batchTransfers.isEmpty())
+    {
+        // 批量消息只能发给支持它的服务端
+        qDeleteAll(batchTransfers);
+        batchTransfers.clear();
+        emit errorOccurred(tr("服务端不支持批量发送文件，传输已取消"));
+    }
+
+    replayPending();
+    pumpBatches();
+    emit negotiated(capabilities);
+}
+
+void TCPClient::sendControl(quint8 opcode, const QByteArray &body)
+{
+    QByteArray payload;
+    payload.reserve(1 + body.size());
+    payload.append(char(opcode));
+    payload.append(body);
+    sendData(payload, OutboundScheduler::ControlClass, TCPFrame::ControlFrame);
 }
 
 void TCPClient::onSocketConnected()
 {
+    // TCP连接建立时应用调优配置，加密完成时不再重复设置
+    if (!clientSocket->isEncrypted())
+    {
+        QString tuningError;
+        if (!SocketTuning::apply(clientSocket, tuning, &tuningError) &&
+            tuningError != lastTuningError)
+        {
+            lastTuningError = tuningError;
+            emit errorOccurred(tuningError);
+        }
+    }
+
+    // 启用TLS时connected信号只表示TCP连接建立，等encrypted信号再开始会话
+    if (isTlsEnabled() && !clientSocket->isEncrypted())
+    {
+        return;
+    }
+
+    if (isTlsEnabled())
+    {
+        // TLS 1.2的票据在握手过程中就已下发
+        TCPTls::storeSessionTicket(peerName(), clientSocket->sslConfiguration().sessionTicket());
+    }
+
+    reconnectAttempts = 0;
+    frameReader.reset();
+    scheduler->addConnection(clientSocket);
+
+    if (framingEnabled && !isPlainTextServer(peerName()))
+    {
+        // 协商在后台进行，不推迟connected信号
+        startNegotiation();
+        emit connected();
+        return;
+    }
+
+    // 已知只支持纯文本的服务端不再发送Hello
+    textFallback = framingEnabled;
+    capabilities = 0;
+    replayPending();
+    pumpBatches();
     emit connected();
+    if (framingEnabled)
+    {
+        emit negotiated(0);
+    }
+}
+
+void TCPClient::onNegotiationTimeout()
+{
+    // 服务端没有回复Hello，这个连接使用纯文本协议，有效期内再连接该服务端时不再探测
+    setPlainTextServer(peerName(), true);
+    finishNegotiation(false, 0);
+}
+
+void TCPClient::forgetPlainTextServers()
+{
+    QMutexLocker locker(&plainTextMutex);
+    plainTextServers.clear();
 }
 
 void TCPClient::onSocketDisconnected()
 {
+    // 服务端在断开时丢弃未答复的提供，重连后会重新提供
+    wantedContent.clear();
+    deltaBases.clear();
+    negotiationTimer->stop();
+    negotiating = false;
+    scheduler->removeConnection(clientSocket);
+    rpcEndpoint->connectionClosed(clientSocket);
     emit disconnected();
+    scheduleReconnect();
 }
 
 void TCPClient::onSocketReadyRead()
 {
-    QByteArray data = clientSocket->readAll();
-    QString message = tryDecodeMessage(data);
+    frameReader.readFrom(clientSocket);
+    if (tuning.quickAck > 0)
+    {
+        // 内核在延迟确认后会复位TCP_QUICKACK，读取后重新打开
+        SocketTuning::rearmQuickAck(clientSocket->socketDescriptor());
+    }
+
+    // 按流ID重组分片后逐条处理，旧版纯文本数据按原方式处理
+    TCPFrameReader::Message &frame = frameReader.scratchMessage();
+    while (frameReader.next(frame))
+    {
+        if (negotiating && frame.framed && frame.type != TCPFrame::ControlFrame)
+        {
+            // 协商之前的服务端不回复Hello，但收到Hello后以帧格式发送
+            finishNegotiation(true, TCPFrame::LegacyHelloCapabilities);
+        }
+
+        if (rpcEndpoint->processFrame(clientSocket, frame.type, frame.payload))
+        {
+            continue;
+        }
+
+        if (frame.type == TCPFrame::ControlFrame)
+        {
+            processControlFrame(frame.payload);
+        }
+        else if (frame.type == TCPFrame::PublishFrame)
+        {
+            QString topic;
+            QByteArray data;
+            if (TCPFrame::decodePublishPayload(frame.payload, topic, data))
+            {
+                emit topicMessageReceived(topic, tryDecodeMessage(data));
+            }
+        }
+        else
+        {
+            dispatchMessage(frame.type, frame.payload);
+        }
+    }
+
+    // 格式错误之后的数据无法再分帧，断开连接，重新连接时读取器被重置
+    if (frameReader.hasError())
+    {
+        QString message = tr("收到的数据格式错误: %1").arg(frameReader.errorString());
+        clientSocket->abort();
+        emit errorOccurred(message);
+    }
+}
+
+void TCPClient::processControlFrame(const QByteArray &payload)
+{
+    if (payload.isEmpty())
+    {
+        return;
+    }
+
+    switch (quint8(payload.at(0)))
+    {
+    case TCPFrame::HelloOpcode:
+        // 服务端回复了它的能力，之后按双方都支持的能力发送
+        if (negotiating)
+        {
+            if (quint32 limit = TCPFrame::decodeHelloMaxMessageSize(payload))
+            {
+                serverMessageLimit = limit;
+            }
+            finishNegotiation(true, TCPFrame::decodeHelloPayload(payload));
+        }
+        else if (textFallback)
+        {
+            // 超时之后才收到回复：服务端支持帧格式，只是回复得慢，下次连接时重新协商
+            setPlainTextServer(peerName(), false);
+        }
+        break;
+    case TCPFrame::OfferOpcode:
+        processContentOffer(payload);
+        break;
+    case TCPFrame::AckOpcode:
+        // 服务端已处理的消息不再需要重发
+        for (int offset = 1; offset + 8 <= payload.size(); offset += 8)
+        {
+            unacked.remove(qFromBigEndian<quint64>(payload.constData() + offset));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void TCPClient::processContentOffer(const QByteArray &payload)
+{
+    if (payload.size() < 1 + ContentCache::HashSize)
+    {
+        return;
+    }
+
+    QByteArray contentHash = payload.mid(1, ContentCache::HashSize);
+    TCPSchema::FileMessage message;
+    if (!TCPSchema::decode(QByteArrayView(payload).sliced(1 + ContentCache::HashSize), message))
+    {
+        // 无法识别提供的文件信息时请求完整消息
+        wantedContent.insert(contentHash);
+        sendControl(TCPFrame::WantOpcode, contentHash);
+        return;
+    }
+    QByteArray name = message.name.toByteArray();
+
+    if (receivedContent.contains(contentHash))
+    {
+        // 内容已在本地缓存中，按提供的文件名等信息交付，效果与收到完整消息相同
+        sendControl(TCPFrame::HaveOpcode, contentHash);
+        latestContent.insert(name, contentHash);
+        emit fileReceived(tryDecodeMessage(name), qint64(message.size),
+                          tryDecodeMessage(message.type.toByteArray()),
+                          receivedContent.find(contentHash));
+        return;
+    }
+
+    // 有同名文件的旧版本时发送其块签名请求增量，否则请求完整消息
+    wantedContent.insert(contentHash);
+    QByteArray base;
+    if (latestContent.contains(name))
+    {
+        base = receivedContent.find(latestContent.value(name));
+    }
+    if (base.size() >= TCPDelta::MinBlockSize)
+    {
+        deltaBases.insert(contentHash, base);
+        sendControl(TCPFrame::SignatureOpcode,
+                    contentHash + TCPDelta::signature(base, TCPDelta::blockSizeFor(base.size())));
+        return;
+    }
+    sendControl(TCPFrame::WantOpcode, contentHash);
+}
+
+void TCPClient::processDeltaMessage(const QByteArray &data)
+{
+    TCPSchema::DeltaMessage message;
+    if (!TCPSchema::decode(data, message))
+    {
+        emit errorOccurred("收到的文件消息格式错误");
+        return;
+    }
+
+    // 把增量应用到请求时使用的旧版本上，并用内容哈希校验结果；
+    // 无法还原时请求完整消息，服务端在收到确认之前保留着完整消息
+    QByteArray contentHash = message.contentHash.toByteArray();
+    QByteArray base = deltaBases.take(contentHash);
+    QByteArray fileData;
+    if (base.isNull() ||
+        !TCPDelta::patch(base, QByteArray::fromRawData(message.delta.data(), message.delta.size()),
+                         fileData) ||
+        ContentCache::hash(fileData) != contentHash)
+    {
+        sendControl(TCPFrame::WantOpcode, contentHash + char(TCPFrame::DeltaReplyMarker));
+        return;
+    }
+
+    sendControl(TCPFrame::HaveOpcode, contentHash + char(TCPFrame::DeltaReplyMarker));
+    wantedContent.remove(contentHash);
+    QByteArray name = message.name.toByteArray();
+    receivedContent.insert(contentHash, fileData);
+    latestContent.insert(name, contentHash);
+    emit fileReceived(tryDecodeMessage(name), qint64(message.size),
+                      tryDecodeMessage(message.type.toByteArray()), fileData);
+}
+
+void TCPClient::dispatchMessage(quint8 frameType, const QByteArray &payload)
+{
+    // 还有在线程池中解码的文件或图片时，排在其后处理，保持消息的接收顺序
+    if (payloadPool->pendingCount(ReceiveGroup) > 0)
+    {
+        payloadPool->post([this, frameType, payload]() { handleMessage(frameType, payload); },
+                          ReceiveGroup);
+        return;
+    }
+    handleMessage(frameType, payload);
+}
+
+void TCPClient::handleMessage(quint8 frameType, const QByteArray &payload)
+{
+    if (!messageHandlers.dispatch(frameType, payload))
+    {
+        emit errorOccurred(tr("收到未知类型的消息: %1").arg(frameType));
+    }
+}
 
-    // 检查是否是文件或图片消息
-    if (message.startsWith("[FILE]"))
+void TCPClient::processMessage(const QByteArray &data)
+{
+    // 检查是否是文件或图片消息，前缀是ASCII，在原始字节上判断即可
+    if (data.startsWith("[FILE]"))
     {
         // 处理文件消息
-        processFileMessage(message);
+        processFileMessage(data);
     }
-    else if (message.startsWith("[IMAGE]"))
+    else if (data.startsWith("[IMAGE]"))
     {
         // 处理图片消息
-        processImageMessage(message);
+        processImageMessage(data);
     }
     else
     {
         // 处理普通文本消息
-        emit messageReceived(message);
+        emit messageReceived(tryDecodeMessage(data));
     }
 }
 
@@ -165,38 +904,109 @@ void TCPClient::onSocketError(QAbstractSocket::SocketError socketError)
     case QAbstractSocket::NetworkError:
         errorMsg = tr("网络错误: %1").arg(clientSocket->errorString());
         break;
+    case QAbstractSocket::SslHandshakeFailedError:
+        // 缓存的票据可能已失效，下次重连使用完整握手
+        TCPTls::removeSessionTicket(peerName());
+        errorMsg = tr("TLS握手失败: %1").arg(clientSocket->errorString());
+        break;
     default:
         errorMsg = tr("连接错误: %1").arg(clientSocket->errorString());
         break;
     }
 
     emit errorOccurred(errorMsg);
+
+    // 连接失败时不会触发disconnected信号，在这里安排重连
+    if (clientSocket->state() == QAbstractSocket::UnconnectedState)
+    {
+        scheduleReconnect();
+    }
 }
 
 // 文件发送方法实现
 bool TCPClient::sendFile(const QString &filePath)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly))
+    // 映射文件，编码时直接从页缓存复制，不先把文件读入堆内存
+    std::shared_ptr<MappedFile> mapped = MappedFile::open(filePath);
+    if (!mapped)
     {
         emit errorOccurred(tr("无法打开文件: %1").arg(filePath));
         return false;
     }
 
     QFileInfo fileInfo(filePath);
-    QByteArray fileData = file.readAll();
-    file.close();
+    QByteArray fileData = mapped->bytes();
+
+    if (!(capabilities & TCPFrame::SchemaCapability))
+    {
+        // 构建消息: [FILE]文件名|文件大小|文件类型|Base64数据
+        QString header = QString("[FILE]%1|%2|%3|")
+                             .arg(fileInfo.fileName())
+                             .arg(fileData.size())
+                             .arg(fileInfo.suffix());
+        qint64 base64Size = (qint64(fileData.size()) + 2) / 3 * 4;
+        if (!checkMessageSize(encodeMessage(header).size() + base64Size, filePath))
+        {
+            return false;
+        }
+        sendBase64Message(header, fileData, mapped, TCPFrame::FileFrame);
+        return true;
+    }
+
+    // 协商了二进制消息的服务端，文件名中的'|'不影响解析，数据不再经过Base64
+    QByteArray name = fileInfo.fileName().toUtf8();
+    QByteArray type = fileInfo.suffix().toUtf8();
+    TCPSchema::FileMessage fileMessage;
+    fileMessage.name = name;
+    fileMessage.size = quint64(fileData.size());
+    fileMessage.type = type;
+    fileMessage.data = fileData;
+    QByteArray message = TCPSchema::encode(fileMessage);
+    if (!checkMessageSize(message.size(), filePath))
+    {
+        return false;
+    }
+
+    // 文件数据作为大块流量分片发送，之后输入的文本消息可以插队
+    sendData(message, OutboundScheduler::BulkClass, TCPFrame::FileFrame);
+    return true;
+}
+
+bool TCPClient::checkMessageSize(qint64 messageSize, const QString &filePath)
+{
+    if (messageSize <= serverMessageLimit)
+    {
+        return true;
+    }
+
+    emit errorOccurred(tr("文件 %1 超过服务端接受的消息上限（%2 MiB），请使用批量发送")
+                           .arg(QFileInfo(filePath).fileName())
+                           .arg(serverMessageLimit / (1024 * 1024)));
+    return false;
+}
 
-    // 构建消息: [FILE]文件名|文件大小|文件类型|Base64数据
-    QString message = QString("[FILE]%1|%2|%3|")
-                          .arg(fileInfo.fileName())
-                          .arg(fileData.size())
-                          .arg(fileInfo.suffix());
+bool TCPClient::sendFiles(const QStringList &paths)
+{
+    // 批量消息是二进制格式，只能发给协商了批量传输的服务端；未连接时等连接后协商
+    if (!framingEnabled ||
+        (isConnected() && !negotiating && !(capabilities & TCPFrame::BatchCapability)))
+    {
+        emit errorOccurred(tr("服务端不支持批量发送文件"));
+        return false;
+    }
 
-    message += QString(fileData.toBase64());
+    FileBatchReader *reader = new FileBatchReader(this);
+    QString error;
+    if (!reader->start(paths, &error))
+    {
+        delete reader;
+        emit errorOccurred(error);
+        return false;
+    }
 
-    // 发送消息
-    sendMessage(message);
+    connect(reader, &FileBatchReader::batchReady, this, &TCPClient::pumpBatches);
+    connect(reader, &FileBatchReader::errorOccurred, this, &TCPClient::errorOccurred);
+    batchTransfers.enqueue(reader);
     return true;
 }
 
@@ -218,58 +1028,167 @@ bool TCPClient::sendImage(const QString &imagePath)
     // 保存为PNG格式
     image.save(&buffer, "PNG");
 
-    // 构建消息: [IMAGE]图片名|图片大小|图片类型|Base64数据
-    QString message =
-        QString("[IMAGE]%1|%2|%3|").arg(fileInfo.fileName()).arg(imageData.size()).arg("PNG");
+    if (!(capabilities & TCPFrame::SchemaCapability))
+    {
+        // 构建消息: [IMAGE]图片名|图片大小|图片类型|Base64数据
+        QString header =
+            QString("[IMAGE]%1|%2|%3|").arg(fileInfo.fileName()).arg(imageData.size()).arg("PNG");
+        sendBase64Message(header, imageData, nullptr, TCPFrame::ImageFrame);
+        return true;
+    }
 
-    message += QString(imageData.toBase64());
+    QByteArray name = fileInfo.fileName().toUtf8();
+    TCPSchema::ImageMessage imageMessage;
+    imageMessage.name = name;
+    imageMessage.size = quint64(imageData.size());
+    imageMessage.type = "PNG";
+    imageMessage.data = imageData;
 
-    // 发送消息
-    sendMessage(message);
+    // 图片数据作为大块流量分片发送
+    sendData(TCPSchema::encode(imageMessage), OutboundScheduler::BulkClass, TCPFrame::ImageFrame);
     return true;
 }
 
+void TCPClient::sendBase64Message(const QString &header, const QByteArray &data,
+                                  const std::shared_ptr<const void> &owner, quint8 frameType)
+{
+    // 消息头在当前线程按发送编码转换；Base64只含ASCII字符，编码后直接拼接，不再经过编码转换
+    QByteArray prefix = encodeMessage(header);
+    payloadPool->submit([prefix, data, owner]() { return PayloadPool::toBase64(data, prefix); },
+                        [this, frameType](const QByteArray &payload) {
+                            // 作为大块流量分片发送，之后输入的文本消息可以插队
+                            sendData(payload, OutboundScheduler::BulkClass, frameType);
+                        });
+}
+
 // 添加文件消息处理方法
-void TCPClient::processFileMessage(const QString &message)
+void TCPClient::processFileMessage(const QByteArray &data)
 {
-    // 解析文件消息: [FILE]文件名|文件大小|文件类型|Base64数据
-    QString content = message.mid(6); // 去掉 [FILE] 前缀
-    QStringList parts = content.split("|", Qt::KeepEmptyParts);
+    quint8 schemaId;
+    if (TCPSchema::peek(data, schemaId))
+    {
+        processSchemaMessage(data, schemaId);
+        return;
+    }
 
-    if (parts.size() < 4)
+    // 解析文件消息: [FILE]文件名|文件大小|文件类型|Base64数据
+    TCPFrame::FileMessageFields fields;
+    if (!TCPFrame::parseFileMessage(data, 6, fields))
     {
         emit errorOccurred("收到的文件消息格式错误");
         return;
     }
 
-    QString fileName = parts[0];
-    qint64 fileSize = parts[1].toLongLong();
-    QString fileType = parts[2];
-    QString base64Data = parts[3];
-
-    // 发出文件接收信号
-    emit fileReceived(fileName, fileSize, fileType, QByteArray::fromBase64(base64Data.toLatin1()));
+    // Base64数据直接从原始消息解码，不产生中间副本；解码在线程池中进行，按接收顺序发出信号
+    QString name = tryDecodeMessage(fields.name);
+    QString type = tryDecodeMessage(fields.type);
+    qint64 size = fields.size;
+    int offset = fields.dataOffset;
+    payloadPool->submit(
+        [data, offset]() {
+            return PayloadPool::fromBase64(
+                QByteArray::fromRawData(data.constData() + offset, data.size() - offset));
+        },
+        [this, name, size, type](const QByteArray &fileData) {
+            emit fileReceived(name, size, type, fileData);
+        },
+        ReceiveGroup);
 }
 
 // 添加图片消息处理方法
-void TCPClient::processImageMessage(const QString &message)
+void TCPClient::processImageMessage(const QByteArray &data)
 {
-    // 解析图片消息: [IMAGE]图片名|图片大小|图片类型|Base64数据
-    QString content = message.mid(7); // 去掉 [IMAGE] 前缀
-    QStringList parts = content.split("|", Qt::KeepEmptyParts);
+    quint8 schemaId;
+    if (TCPSchema::peek(data, schemaId))
+    {
+        processSchemaMessage(data, schemaId);
+        return;
+    }
 
-    if (parts.size() < 4)
+    // 解析图片消息: [IMAGE]图片名|图片大小|图片类型|Base64数据
+    TCPFrame::FileMessageFields fields;
+    if (!TCPFrame::parseFileMessage(data, 7, fields))
     {
         emit errorOccurred("收到的图片消息格式错误");
         return;
     }
 
-    QString imageName = parts[0];
-    qint64 imageSize = parts[1].toLongLong();
-    QString imageType = parts[2];
-    QString base64Data = parts[3];
+    QString name = tryDecodeMessage(fields.name);
+    QString type = tryDecodeMessage(fields.type);
+    qint64 size = fields.size;
+    int offset = fields.dataOffset;
+    payloadPool->submit(
+        [data, offset]() {
+            return PayloadPool::fromBase64(
+                QByteArray::fromRawData(data.constData() + offset, data.size() - offset));
+        },
+        [this, name, size, type](const QByteArray &imageData) {
+            emit imageReceived(name, size, type, imageData);
+        },
+        ReceiveGroup);
+}
+
+void TCPClient::processSchemaMessage(const QByteArray &data, quint8 id)
+{
+    // 解码得到的字段直接指向data，只在发出信号时复制一次
+    if (id == TCPSchema::FileMessageId)
+    {
+        TCPSchema::FileMessage message;
+        if (!TCPSchema::decode(data, message))
+        {
+            emit errorOccurred("收到的文件消息格式错误");
+            return;
+        }
+
+        QByteArray fileData = message.data.toByteArray();
+        if (!wantedContent.isEmpty())
+        {
+            // 之前请求过的内容加入缓存，下次提供时不必再传输
+            QByteArray contentHash = ContentCache::hash(fileData);
+            if (wantedContent.remove(contentHash))
+            {
+                deltaBases.remove(contentHash);
+                receivedContent.insert(contentHash, fileData);
+                latestContent.insert(message.name.toByteArray(), contentHash);
+            }
+        }
+        emit fileReceived(tryDecodeMessage(message.name.toByteArray()), qint64(message.size),
+                          tryDecodeMessage(message.type.toByteArray()), fileData);
+    }
+    else if (id == TCPSchema::ImageMessageId)
+    {
+        TCPSchema::ImageMessage message;
+        if (!TCPSchema::decode(data, message))
+        {
+            emit errorOccurred("收到的图片消息格式错误");
+            return;
+        }
+        emit imageReceived(tryDecodeMessage(message.name.toByteArray()), qint64(message.size),
+                           tryDecodeMessage(message.type.toByteArray()), message.data.toByteArray());
+    }
+    else if (id == TCPSchema::DeltaMessageId)
+    {
+        processDeltaMessage(data);
+    }
+    else if (id == TCPSchema::BatchMessageId)
+    {
+        if (batchDirectory.isEmpty())
+        {
+            emit errorOccurred(tr("未设置接收目录，拒绝服务端发来的批量文件"));
+            return;
+        }
 
-    // 发出图片接收信号
-    emit imageReceived(imageName, imageSize, imageType,
-                       QByteArray::fromBase64(base64Data.toLatin1()));
-}
\ No newline at end of file
+        // 出错时已保存的文件仍然报告
+        FileBatch::Result result;
+        QString error;
+        if (!FileBatch::save(data, batchDirectory, result, &error))
+        {
+            emit errorOccurred(error);
+        }
+        emit filesReceived(result.paths, result.bytes, result.last);
+    }
+    else
+    {
+        emit errorOccurred(tr("收到未知类型的消息: %1").arg(id));
+    }
+}
@@ -1,9 +1,25 @@
 #ifndef TCPCLIENT_H
 #define TCPCLIENT_H
 
+#include "ContentCache.h"
+#include "FileBatch.h"
+#include "MessageDispatcher.h"
+#include "OfflineQueue.h"
+#include "OutboundScheduler.h"
+#include "PayloadPool.h"
+#include "SocketTuning.h"
+#include "TCPFrame.h"
+#include "TCPRpc.h"
+#include <QHash>
+#include <QMap>
 #include <QObject>
+#include <QQueue>
+#include <QSet>
+#include <QSslConfiguration>
+#include <QSslSocket>
 #include <QTcpSocket>
 #include <QTextCodec>
+#include <QTimer>
 
 class TCPClient : public QObject
 {
@@ -26,6 +42,16 @@ class TCPClient : public QObject
         ImageMessage
     };
 
+    // 自动重连策略，退避时间按指数增长并加入随机抖动，避免大量客户端同时重连
+    struct ReconnectPolicy
+    {
+        bool enabled = false;     // 启用后断线期间发送的消息进入离线队列
+        int initialDelayMs = 500; // 首次重连的退避时间
+        int maxDelayMs = 30000;   // 退避时间上限
+        double multiplier = 2.0;  // 每次失败后退避时间的增长倍数
+        int maxAttempts = 0;      // 最大连续重连次数，0表示不限制
+    };
+
     explicit TCPClient(QObject *parent = nullptr);
     ~TCPClient();
 
@@ -35,8 +61,8 @@ class TCPClient : public QObject
     // 断开连接
     void disconnectFromServer();
 
-    // 发送消息
-    void sendMessage(const QString &message);
+    // 发送消息，urgent为true时不等待写合并窗口立即写出
+    void sendMessage(const QString &message, bool urgent = false);
 
     // 获取连接状态
     bool isConnected() const;
@@ -59,23 +85,217 @@ class TCPClient : public QObject
         receiveEncoding = encoding;
     }
 
+    // 设置自动重连策略
+    void setReconnectPolicy(const ReconnectPolicy &policy)
+    {
+        reconnect = policy;
+    }
+
+    ReconnectPolicy reconnectPolicy() const
+    {
+        return reconnect;
+    }
+
+    // 设置离线队列限制，spillPath不为空时超出内存限制的消息按顺序写入该文件
+    void setOfflineQueueLimits(int maxMessages, qint64 maxBytes,
+                               const QString &spillPath = QString());
+
+    // 启用至少一次投递（需要启用帧格式）：消息带序号发送，
+    // 收到服务端确认前一直保留，重连后重发
+    void setReliableDelivery(bool enabled)
+    {
+        reliableDelivery = enabled;
+    }
+
+    bool isReliableDelivery() const
+    {
+        return reliableDelivery;
+    }
+
+    // 尚未发送或尚未被确认的消息数
+    int pendingMessageCount() const
+    {
+        return offlineQueue.size() + unacked.size();
+    }
+
+    // 设置TLS配置（见TCPTls::clientConfiguration），空配置表示不加密，下次连接时生效
+    // 握手成功后保存会话票据，之后重连同一服务端时可以走简化握手
+    void setTlsConfiguration(const QSslConfiguration &config)
+    {
+        tlsConfiguration = config;
+    }
+
+    bool isTlsEnabled() const
+    {
+        return !tlsConfiguration.isNull();
+    }
+
+    // 设置socket调优配置，下次建立连接时生效
+    // 连接建立后才设置缓冲区大小，窗口扩大因子按系统默认缓冲区协商
+    void setSocketProfile(const SocketTuning::Profile &profile)
+    {
+        tuning = profile;
+    }
+
+    SocketTuning::Profile socketProfile() const
+    {
+        return tuning;
+    }
+
+    // 设置是否尝试使用帧格式（默认关闭，Hello对只支持纯文本的服务端是一条乱码消息），
+    // 启用后文本消息可以插在文件分片之间发送，不会被大文件阻塞
+    // 每次连接时先发送Hello声明本端的能力，服务端回复Hello后按双方都支持的能力发送；
+    // 服务端在超时内没有回复（只支持纯文本的旧版服务端）时，这个连接回退到纯文本协议，
+    // 并记住该服务端PlainTextServerTtlMs，期间再连接它时不再发送Hello，直接使用纯文本协议
+    void setFramingEnabled(bool enabled);
+    bool isFramingEnabled() const
+    {
+        return framingEnabled;
+    }
+
+    // 等待服务端回复Hello的时间，默认DefaultNegotiationTimeoutMs
+    void setNegotiationTimeout(int ms)
+    {
+        negotiationTimeoutMs = qMax(ms, 1);
+    }
+
+    int negotiationTimeout() const
+    {
+        return negotiationTimeoutMs;
+    }
+
+    static const int DefaultNegotiationTimeoutMs = 2000;
+
+    // 没有回复Hello的服务端被记为只支持纯文本的时间，过期后重新探测；超时后才收到回复时立即清除
+    static const int PlainTextServerTtlMs = 10 * 60 * 1000;
+
+    // 忘记记录的纯文本服务端，之后连接时重新发送Hello探测
+    static void forgetPlainTextServers();
+
+    // 当前连接协商得到的能力（TCPFrame::Capability），回退到纯文本协议时为0
+    quint32 negotiatedCapabilities() const
+    {
+        return capabilities;
+    }
+
+    // 设置本端接受的单条消息上限（不超过TCPFrameReader::MaxStreamSizeLimit），
+    // 连接时在Hello中声明，服务端不会发送超过上限的文件
+    void setMaxMessageSize(qint64 bytes)
+    {
+        frameReader.setMaxStreamSize(qMax<qint64>(bytes, 1));
+    }
+
+    qint64 maxMessageSize() const
+    {
+        return frameReader.streamSizeLimit();
+    }
+
+    // 收到文件的缓存预算（字节），为0时不缓存，服务端每次都发送完整文件
+    // 在连接之前设置，连接时据此向服务端声明
+    void setContentCacheBudget(qint64 bytes)
+    {
+        receivedContent.setBudget(bytes);
+    }
+
+    qint64 contentCacheBudget() const
+    {
+        return receivedContent.budget();
+    }
+
+    // 收到文件的缓存统计
+    ContentCache::Stats contentCacheStats() const
+    {
+        return receivedContent.stats();
+    }
+
+    // 接收路径统计
+    TCPFrameReader::Stats receiveStats() const
+    {
+        return frameReader.stats();
+    }
+
+    // 获取出站调度器
+    OutboundScheduler *outboundScheduler() const
+    {
+        return scheduler;
+    }
+
+    // 发起RPC调用（需要启用帧格式），返回关联ID；多个调用可以同时进行，响应可乱序到达
+    quint32 call(const QString &method, const QByteArray &params,
+                 const TCPRpc::Callback &callback, int timeoutMs = 5000);
+
+    // 注册供服务端调用的RPC方法
+    void registerRpcHandler(const QString &method, const TCPRpc::Handler &handler);
+
+    // 获取RPC层
+    TCPRpc *rpc() const
+    {
+        return rpcEndpoint;
+    }
+
+    // 订阅/取消订阅主题（需要启用帧格式），重新连接后会自动恢复订阅
+    bool subscribe(const QString &topic);
+    bool unsubscribe(const QString &topic);
+
+    // 通过服务端向主题的订阅者发布消息
+    bool publish(const QString &topic, const QString &message);
+
+    // 自定义消息的处理函数
+    typedef std::function<void(const QByteArray &payload)> MessageHandler;
+
+    // 注册自定义消息类型的处理函数，type必须不小于TCPFrame::UserFrameBase
+    // 收到的消息按帧头中的类型字节直接交给处理函数，负载不做任何解码
+    bool registerMessageHandler(quint8 type, const MessageHandler &handler);
+    void unregisterMessageHandler(quint8 type);
+
+    // 发送自定义类型的消息（需要启用帧格式）
+    bool sendCustomMessage(quint8 type, const QByteArray &payload,
+                           OutboundScheduler::TrafficClass trafficClass =
+                               OutboundScheduler::TextClass);
+
     // 发送文件方法
     bool sendFile(const QString &filePath);
 
+    // 批量发送文件和目录（需要启用帧格式），目录递归发送并保留相对路径
+    // 小文件打包为批量消息，在线程池中提前读取；多次调用的传输依次进行
+    bool sendFiles(const QStringList &paths);
+
+    // 批量接收的文件保存在该目录下；默认不设置，此时拒绝对方发来的批量文件
+    // 不覆盖目录中已存在的文件，也不经由符号链接写入
+    void setReceiveDirectory(const QString &directory)
+    {
+        batchDirectory = directory;
+    }
+
+    QString receiveDirectory() const
+    {
+        return batchDirectory;
+    }
+
     // 发送图片方法
     bool sendImage(const QString &imagePath);
 
   signals:
-    // 连接状态变化信号
+    // 连接状态变化信号，连接（启用TLS时为加密）建立后立即发出；
+    // 启用帧格式时协商在后台进行，期间纯文本格式的消息直接发出，其他消息暂存到协商完成
     void connected();
     void disconnected();
 
+    // 协商完成，capabilities为协商得到的能力，回退到纯文本协议时为0
+    void negotiated(quint32 capabilities);
+
+    // 将在delayMs毫秒后进行第attempt次重连
+    void reconnecting(int attempt, int delayMs);
+
     // 接收到消息信号
     void messageReceived(const QString &message);
 
     // 错误信号
     void errorOccurred(const QString &errorMessage);
 
+    // 收到订阅主题的消息信号
+    void topicMessageReceived(const QString &topic, const QString &message);
+
     // 文件接收信号
     void fileReceived(const QString &fileName, qint64 fileSize, const QString &fileType,
                       const QByteArray &fileData);
@@ -84,18 +304,62 @@ class TCPClient : public QObject
     void imageReceived(const QString &imageName, qint64 imageSize, const QString &imageType,
                        const QByteArray &imageData);
 
+    // 批量接收的一批文件已保存，paths为保存的路径，finished表示本次传输已结束
+    void filesReceived(const QStringList &paths, qint64 totalBytes, bool finished);
+
   private slots:
     // 客户端相关槽函数
     void onSocketConnected();
     void onSocketDisconnected();
     void onSocketReadyRead();
     void onSocketError(QAbstractSocket::SocketError socketError);
+    void onSocketBytesWritten();
+    void onReconnectTimeout();
+    void onNegotiationTimeout();
+    void onSslErrors(const QList<QSslError> &errors);
+    void onSessionTicketReceived();
 
   private:
     // 客户端相关
-    QTcpSocket *clientSocket;
+    QSslSocket *clientSocket; // 未启用TLS时作为普通TCP连接使用
     EncodingType sendEncoding = GBK;     // 默认使用GBK编码发送
     EncodingType receiveEncoding = AUTO; // 默认自动检测接收编码
+    OutboundScheduler *scheduler;        // 按优先级交错发送文本和文件分片
+    TCPFrameReader frameReader;          // 接收数据的分帧和重组
+    TCPRpc *rpcEndpoint;                 // 请求/响应RPC层
+    MessageDispatcher<> messageHandlers; // 按帧类型分派应用消息
+    bool framingEnabled = false;
+    bool negotiating = false;  // 已发送Hello，等待服务端回复，期间的消息暂存在离线队列中
+    bool textFallback = false; // 服务端没有回复Hello，当前连接使用纯文本协议
+    quint32 capabilities = 0;  // 当前连接协商得到的能力
+    qint64 serverMessageLimit = TCPFrameReader::DefaultMaxStreamSize; // 服务端接受的消息上限
+    QTimer *negotiationTimer;
+    int negotiationTimeoutMs = DefaultNegotiationTimeoutMs;
+    QSet<QString> subscriptions; // 已订阅的主题
+    ContentCache receivedContent; // 按内容哈希缓存收到的文件，服务端再次提供时不必传输
+    QSet<QByteArray> wantedContent; // 已请求、尚未收到的内容哈希
+    QHash<QByteArray, QByteArray> latestContent; // 文件名 -> 最近收到的内容哈希，用于增量传输
+    QHash<QByteArray, QByteArray> deltaBases;    // 内容哈希 -> 请求增量时使用的旧版本
+    QQueue<FileBatchReader *> batchTransfers;   // 等待发送的批量传输，依次进行
+    QString batchDirectory;                     // 批量接收的文件的保存目录，为空时不接收
+    PayloadPool *payloadPool;                   // 在工作线程中进行Base64编解码
+    QSslConfiguration tlsConfiguration;
+    SocketTuning::Profile tuning;
+    QString lastTuningError; // 最近报告过的调优失败，避免每次重连重复报告
+
+    // 自动重连相关
+    QString serverAddress;
+    int serverPort = 0;
+    ReconnectPolicy reconnect;
+    QTimer *reconnectTimer;
+    int reconnectAttempts = 0;
+    bool userDisconnected = false;
+
+    // 离线队列和至少一次投递相关
+    OfflineQueue offlineQueue;
+    bool reliableDelivery = false;
+    quint64 nextSequence = 1;
+    QMap<quint64, OfflineQueue::Entry> unacked; // 已发送但未确认的消息，按序号排列
 
     // 尝试使用不同编码解码消息
     QString tryDecodeMessage(const QByteArray &data);
@@ -103,11 +367,71 @@ class TCPClient : public QObject
     // 根据设置的编码类型对消息进行编码
     QByteArray encodeMessage(const QString &message);
 
+    // 将已编码的数据交给调度器发送，断线期间放入离线队列
+    void sendData(const QByteArray &data, OutboundScheduler::TrafficClass trafficClass,
+                  quint8 frameType);
+
+    // 将消息写入调度器，启用至少一次投递时附加序号
+    void transmit(OfflineQueue::Entry entry);
+
+    // 重连后重发未确认的消息和离线队列中的消息
+    void replayPending();
+
+    // 调度器中排队的数据较少时交出下一批文件
+    void pumpBatches();
+
+    // 在线程池中把数据编码为Base64后拼接在消息头之后发送，owner在编码完成前保持data引用的内存有效
+    void sendBase64Message(const QString &header, const QByteArray &data,
+                           const std::shared_ptr<const void> &owner, quint8 frameType);
+
+    // 消息不超过服务端声明的上限时返回true，否则报告错误并返回false
+    bool checkMessageSize(qint64 messageSize, const QString &filePath);
+
+    // 按退避策略安排下一次重连
+    void scheduleReconnect();
+
+    // 按当前设置发起连接，启用TLS时携带缓存的会话票据
+    void openConnection();
+
+    // 会话票据缓存中的服务端标识
+    QString peerName() const;
+
+    // 按帧类型查表处理应用消息，还有未完成的异步解码时排在其后
+    void dispatchMessage(quint8 frameType, const QByteArray &payload);
+    void handleMessage(quint8 frameType, const QByteArray &payload);
+
+    // 处理一条完整的应用消息（文本、文件或图片）
+    void processMessage(const QByteArray &data);
+
+    // 处理控制帧
+    void processControlFrame(const QByteArray &payload);
+
+    // 本端在Hello中声明的能力
+    quint32 localCapabilities() const;
+
+    // 发送Hello控制帧，开始协商
+    void startNegotiation();
+
+    // 协商完成：framed为false时回退到纯文本协议，之后开始发送暂存的消息
+    void finishNegotiation(bool framed, quint32 peerCapabilities);
+
+    // 发送控制帧（未连接时忽略）
+    void sendControl(quint8 opcode, const QByteArray &body = QByteArray());
+
     // 文件消息处理方法
-    void processFileMessage(const QString &message);
+    void processFileMessage(const QByteArray &data);
 
     // 图片消息处理方法
-    void processImageMessage(const QString &message);
+    void processImageMessage(const QByteArray &data);
+
+    // 处理服务端提供的内容：本地已有时直接交付，否则请求发送
+    void processContentOffer(const QByteArray &payload);
+
+    // 增量文件消息处理方法
+    void processDeltaMessage(const QByteArray &data);
+
+    // 二进制格式的文件/图片消息处理方法
+    void processSchemaMessage(const QByteArray &data, quint8 id);
 };
 
 #endif // TCPCLIENT_H
\ No newline at end of file
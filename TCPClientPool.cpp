@@ -0,0 +1,399 @@
+#include "TCPClientPool.h"
+#include <QPointer>
+
+const int TCPClientPool::VirtualNodes;
+
+TCPClientPool::TCPClientPool(QObject *parent) : QObject(parent), healthTimer(new QTimer(this))
+{
+    reconnectPolicy.enabled = true;
+
+    connect(healthTimer, &QTimer::timeout, this, &TCPClientPool::onHealthCheckTimeout);
+    healthTimer->start(healthCheck.intervalMs);
+}
+
+TCPClientPool::~TCPClientPool()
+{
+    disconnectAll();
+}
+
+void TCPClientPool::setHealthCheckConfig(const HealthCheckConfig &config)
+{
+    healthCheck = config;
+    healthCheck.failureThreshold = qMax(healthCheck.failureThreshold, 1);
+
+    if (healthCheck.intervalMs > 0)
+    {
+        healthTimer->start(healthCheck.intervalMs);
+    }
+    else
+    {
+        healthTimer->stop();
+    }
+}
+
+void TCPClientPool::setReconnectPolicy(const TCPClient::ReconnectPolicy &policy)
+{
+    reconnectPolicy = policy;
+    for (const Endpoint &endpoint : endpoints)
+    {
+        for (const Member &member : endpoint.members)
+        {
+            member.client->setReconnectPolicy(policy);
+        }
+    }
+}
+
+void TCPClientPool::setTlsConfiguration(const QSslConfiguration &config)
+{
+    tlsConfiguration = config;
+    for (const Endpoint &endpoint : endpoints)
+    {
+        for (const Member &member : endpoint.members)
+        {
+            member.client->setTlsConfiguration(config);
+        }
+    }
+}
+
+bool TCPClientPool::addEndpoint(const QString &address, int port, int connections)
+{
+    if (findEndpoint(address, port) >= 0)
+    {
+        return false;
+    }
+
+    Endpoint endpoint;
+    endpoint.address = address;
+    endpoint.port = port;
+
+    for (int i = 0; i < qMax(connections, 1); ++i)
+    {
+        TCPClient *client = new TCPClient(this);
+        // 健康检查和RPC路由都依赖帧格式
+        client->setFramingEnabled(true);
+        client->setReconnectPolicy(reconnectPolicy);
+        client->setTlsConfiguration(tlsConfiguration);
+
+        connect(client, &TCPClient::connected, this, [this, client]() { setHealthy(client, true); });
+        connect(client, &TCPClient::disconnected, this,
+                [this, client]() { setHealthy(client, false); });
+        connect(client, &TCPClient::messageReceived, this,
+                [this, address, port](const QString &message) {
+                    emit messageReceived(address, port, message);
+                });
+        connect(client, &TCPClient::errorOccurred, this,
+                [this, address, port](const QString &errorMessage) {
+                    emit errorOccurred(QString("%1:%2 %3").arg(address).arg(port).arg(errorMessage));
+                });
+
+        Member member;
+        member.client = client;
+        endpoint.members.append(member);
+    }
+
+    endpoints.append(endpoint);
+    rebuildRing();
+    return true;
+}
+
+bool TCPClientPool::removeEndpoint(const QString &address, int port)
+{
+    int index = findEndpoint(address, port);
+    if (index < 0)
+    {
+        return false;
+    }
+
+    // 先从池中移除，断开时触发的回调不会再找到这些连接
+    Endpoint endpoint = endpoints.takeAt(index);
+    rebuildRing();
+
+    for (const Member &member : endpoint.members)
+    {
+        member.client->disconnect(this);
+        member.client->disconnectFromServer();
+        member.client->deleteLater();
+    }
+
+    if (endpoint.available)
+    {
+        emit endpointStateChanged(address, port, false);
+    }
+    return true;
+}
+
+void TCPClientPool::connectAll()
+{
+    for (const Endpoint &endpoint : endpoints)
+    {
+        for (const Member &member : endpoint.members)
+        {
+            if (!member.client->isConnected())
+            {
+                member.client->connectToServer(endpoint.address, endpoint.port);
+            }
+        }
+    }
+}
+
+void TCPClientPool::disconnectAll()
+{
+    for (const Endpoint &endpoint : endpoints)
+    {
+        for (const Member &member : endpoint.members)
+        {
+            member.client->disconnectFromServer();
+        }
+    }
+}
+
+bool TCPClientPool::send(const QString &message, const QString &key)
+{
+    TCPClient *client = select(key);
+    if (!client)
+    {
+        emit errorOccurred(tr("没有可用的服务端连接"));
+        return false;
+    }
+
+    client->sendMessage(message);
+    return true;
+}
+
+quint32 TCPClientPool::call(const QString &method, const QByteArray &params,
+                            const TCPRpc::Callback &callback, int timeoutMs, const QString &key)
+{
+    TCPClient *client = select(key);
+    if (!client)
+    {
+        if (callback)
+        {
+            callback(TCPRpc::ConnectionLost, QByteArray());
+        }
+        return 0;
+    }
+
+    return client->call(method, params, callback, timeoutMs);
+}
+
+int TCPClientPool::healthyConnectionCount() const
+{
+    int count = 0;
+    for (const Endpoint &endpoint : endpoints)
+    {
+        for (const Member &member : endpoint.members)
+        {
+            if (member.healthy)
+            {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+int TCPClientPool::findEndpoint(const QString &address, int port) const
+{
+    for (int i = 0; i < endpoints.size(); ++i)
+    {
+        if (endpoints.at(i).address == address && endpoints.at(i).port == port)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TCPClientPool::rebuildRing()
+{
+    // 虚拟节点的位置只取决于服务端地址，增删服务端不会移动其他服务端的节点
+    ring.clear();
+    for (int i = 0; i < endpoints.size(); ++i)
+    {
+        QString name = QString("%1:%2").arg(endpoints.at(i).address).arg(endpoints.at(i).port);
+        for (int node = 0; node < VirtualNodes; ++node)
+        {
+            ring.insert(uint(qHash(QString("%1#%2").arg(name).arg(node), 0)), i);
+        }
+    }
+}
+
+TCPClient *TCPClientPool::select(const QString &key)
+{
+    if (routing == ConsistentHash && !key.isEmpty() && !ring.isEmpty())
+    {
+        // 从键的位置顺时针查找第一个可用的服务端，不可用时自然切换到环上的下一个
+        QMap<uint, int>::const_iterator it = ring.lowerBound(uint(qHash(key, 0)));
+        for (int visited = 0; visited < ring.size(); ++visited, ++it)
+        {
+            if (it == ring.constEnd())
+            {
+                it = ring.constBegin();
+            }
+
+            TCPClient *client = leastLoaded(endpoints.at(it.value()));
+            if (client)
+            {
+                return client;
+            }
+        }
+        return nullptr;
+    }
+
+    TCPClient *best = nullptr;
+    qint64 bestLoad = 0;
+    for (const Endpoint &endpoint : endpoints)
+    {
+        TCPClient *client = leastLoaded(endpoint);
+        if (!client)
+        {
+            continue;
+        }
+
+        qint64 clientLoad = load(client);
+        if (!best || clientLoad < bestLoad)
+        {
+            best = client;
+            bestLoad = clientLoad;
+        }
+    }
+    return best;
+}
+
+TCPClient *TCPClientPool::leastLoaded(const Endpoint &endpoint) const
+{
+    TCPClient *best = nullptr;
+    qint64 bestLoad = 0;
+    for (const Member &member : endpoint.members)
+    {
+        if (!member.healthy || !member.client->isConnected())
+        {
+            continue;
+        }
+
+        qint64 clientLoad = load(member.client);
+        if (!best || clientLoad < bestLoad)
+        {
+            best = member.client;
+            bestLoad = clientLoad;
+        }
+    }
+    return best;
+}
+
+qint64 TCPClientPool::load(TCPClient *client)
+{
+    // 优先比较未完成的RPC调用数，相同时比较待发送的字节数
+    qint64 queued = client->outboundScheduler()->queuedBytes(client->getSocket());
+    return (qint64(client->rpc()->pendingCount()) << 32) + qMin<qint64>(queued, 0xFFFFFFFF);
+}
+
+bool TCPClientPool::locate(TCPClient *client, int &endpointIndex, int &memberIndex) const
+{
+    for (int i = 0; i < endpoints.size(); ++i)
+    {
+        const QVector<Member> &members = endpoints.at(i).members;
+        for (int j = 0; j < members.size(); ++j)
+        {
+            if (members.at(j).client == client)
+            {
+                endpointIndex = i;
+                memberIndex = j;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TCPClientPool::setHealthy(TCPClient *client, bool healthy)
+{
+    int endpointIndex, memberIndex;
+    if (!locate(client, endpointIndex, memberIndex))
+    {
+        return;
+    }
+
+    Endpoint &endpoint = endpoints[endpointIndex];
+    Member &member = endpoint.members[memberIndex];
+    member.healthy = healthy;
+    member.failures = 0;
+
+    bool available = false;
+    for (const Member &other : endpoint.members)
+    {
+        available = available || other.healthy;
+    }
+
+    if (available != endpoint.available)
+    {
+        endpoint.available = available;
+        emit endpointStateChanged(endpoint.address, endpoint.port, available);
+    }
+}
+
+void TCPClientPool::recordProbe(TCPClient *client, bool success)
+{
+    int endpointIndex, memberIndex;
+    if (!locate(client, endpointIndex, memberIndex))
+    {
+        return;
+    }
+
+    Member &member = endpoints[endpointIndex].members[memberIndex];
+    member.probing = false;
+
+    if (success)
+    {
+        if (!member.healthy)
+        {
+            setHealthy(client, true);
+        }
+        member.failures = 0;
+        return;
+    }
+
+    if (++member.failures < healthCheck.failureThreshold)
+    {
+        return;
+    }
+
+    // 连接已失去响应：不再参与路由，并断开连接交给自动重连恢复
+    setHealthy(client, false);
+    client->getSocket()->abort();
+}
+
+void TCPClientPool::onHealthCheckTimeout()
+{
+    // 先收集需要检查的连接，检查回调可能同步触发并修改连接状态
+    QVector<TCPClient *> targets;
+    for (Endpoint &endpoint : endpoints)
+    {
+        for (Member &member : endpoint.members)
+        {
+            if (!member.probing && member.client->isConnected())
+            {
+                member.probing = true;
+                targets.append(member.client);
+            }
+        }
+    }
+
+    for (TCPClient *client : targets)
+    {
+        QPointer<TCPClient> target(client);
+        client->call(
+            healthCheck.method, QByteArray(),
+            [this, target](int status, const QByteArray &) {
+                if (!target)
+                {
+                    return;
+                }
+                // 对端能回复就说明连接可用，不要求注册了检查方法
+                bool success = status != TCPRpc::Timeout && status != TCPRpc::ConnectionLost &&
+                               status != TCPRpc::NotSupported;
+                recordProbe(target, success);
+            },
+            healthCheck.timeoutMs);
+    }
+}
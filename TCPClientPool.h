@@ -0,0 +1,149 @@
+#ifndef TCPCLIENTPOOL_H
+#define TCPCLIENTPOOL_H
+
+#include "TCPClient.h"
+#include <QMap>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+// 客户端连接池：向一个或多个服务端各建立若干连接，由send()/call()自动选择连接
+// 支持两种路由策略：
+//   - 最少未完成请求：选择未完成RPC调用和待发送数据最少的连接
+//   - 一致性哈希：按键映射到固定的服务端，服务端增减时只影响少量键
+// 定时对每个连接做健康检查，连续失败的连接不参与路由，所在服务端不可用时自动切换到其他服务端
+class TCPClientPool : public QObject
+{
+    Q_OBJECT
+
+  public:
+    // 路由策略
+    enum Strategy
+    {
+        LeastOutstanding,
+        ConsistentHash
+    };
+
+    // 健康检查配置
+    // 检查通过RPC调用完成，对端回复任何状态（包括方法不存在）都说明连接可用
+    struct HealthCheckConfig
+    {
+        int intervalMs = 5000;     // 检查间隔，0表示不检查
+        int timeoutMs = 2000;      // 单次检查超时
+        int failureThreshold = 2;  // 连续失败多少次后判定为不健康
+        QString method = "health"; // 检查使用的RPC方法名
+    };
+
+    explicit TCPClientPool(QObject *parent = nullptr);
+    ~TCPClientPool();
+
+    // 设置路由策略
+    void setStrategy(Strategy strategy)
+    {
+        routing = strategy;
+    }
+
+    Strategy strategy() const
+    {
+        return routing;
+    }
+
+    // 设置健康检查配置
+    void setHealthCheckConfig(const HealthCheckConfig &config);
+
+    // 设置池中所有连接的自动重连策略（默认启用）
+    void setReconnectPolicy(const TCPClient::ReconnectPolicy &policy);
+
+    // 设置池中所有连接的TLS配置，同一服务端的连接共享缓存的会话票据
+    void setTlsConfiguration(const QSslConfiguration &config);
+
+    // 添加服务端，connections为到该服务端的连接数；已存在时返回false
+    bool addEndpoint(const QString &address, int port, int connections = 1);
+
+    // 移除服务端并断开到它的所有连接
+    bool removeEndpoint(const QString &address, int port);
+
+    // 连接/断开所有服务端
+    void connectAll();
+    void disconnectAll();
+
+    // 选择一个连接发送消息，key不为空且使用一致性哈希时按key路由
+    // 没有可用连接时返回false
+    bool send(const QString &message, const QString &key = QString());
+
+    // 选择一个连接发起RPC调用，没有可用连接时立即以ConnectionLost回调并返回0
+    quint32 call(const QString &method, const QByteArray &params,
+                 const TCPRpc::Callback &callback, int timeoutMs = 5000,
+                 const QString &key = QString());
+
+    // 服务端数
+    int endpointCount() const
+    {
+        return endpoints.size();
+    }
+
+    // 当前可参与路由的连接数
+    int healthyConnectionCount() const;
+
+  signals:
+    // 服务端可用状态变化（至少有一个健康连接即为可用）
+    void endpointStateChanged(const QString &address, int port, bool available);
+
+    // 任一连接收到消息
+    void messageReceived(const QString &address, int port, const QString &message);
+
+    // 错误信号
+    void errorOccurred(const QString &errorMessage);
+
+  private slots:
+    void onHealthCheckTimeout();
+
+  private:
+    // 池中的一个连接
+    struct Member
+    {
+        TCPClient *client = nullptr;
+        int failures = 0; // 连续失败的健康检查次数
+        bool healthy = false;
+        bool probing = false; // 健康检查进行中
+    };
+
+    // 一个服务端
+    struct Endpoint
+    {
+        QString address;
+        int port = 0;
+        QVector<Member> members;
+        bool available = false;
+    };
+
+    // 每个服务端在哈希环上的虚拟节点数，使键分布更均匀
+    static const int VirtualNodes = 64;
+
+    Strategy routing = LeastOutstanding;
+    HealthCheckConfig healthCheck;
+    TCPClient::ReconnectPolicy reconnectPolicy;
+    QSslConfiguration tlsConfiguration;
+    QVector<Endpoint> endpoints;
+    QMap<uint, int> ring; // 哈希值 -> 服务端下标
+    QTimer *healthTimer;
+
+    int findEndpoint(const QString &address, int port) const;
+    void rebuildRing();
+
+    // 选择连接，没有可用连接时返回nullptr
+    TCPClient *select(const QString &key);
+
+    // 服务端内负载最低的健康连接
+    TCPClient *leastLoaded(const Endpoint &endpoint) const;
+
+    // 连接的负载：未完成的RPC调用和待发送的数据
+    static qint64 load(TCPClient *client);
+
+    // 更新连接健康状态，必要时发出服务端状态变化信号
+    void setHealthy(TCPClient *client, bool healthy);
+    void recordProbe(TCPClient *client, bool success);
+    bool locate(TCPClient *client, int &endpointIndex, int &memberIndex) const;
+};
+
+#endif // TCPCLIENTPOOL_H
@@ -0,0 +1,201 @@
+#include "TCPConnection.h"
+
+const qint64 TCPConnection::WriteHighWater;
+
+TCPConnection::TCPConnection(QTcpSocket *socket)
+    : sock(socket ? socket : new QTcpSocket), ownsSocket(!socket), alive(new bool(true))
+{
+    connectTimer.setSingleShot(true);
+
+    // 以socket为上下文，socket删除后连接自动断开
+    connections.append(QObject::connect(sock, &QTcpSocket::readyRead, sock,
+                                        [this]() { onReadyRead(); }));
+    connections.append(QObject::connect(sock, &QTcpSocket::bytesWritten, sock,
+                                        [this]() { onBytesWritten(); }));
+    connections.append(QObject::connect(sock, &QTcpSocket::connected, sock,
+                                        [this]() { onConnectFinished(); }));
+    connections.append(QObject::connect(sock, &QTcpSocket::errorOccurred, sock,
+                                        [this]() { onConnectFinished(); }));
+    connections.append(QObject::connect(sock, &QTcpSocket::disconnected, sock,
+                                        [this]() { onClosed(); }));
+    connections.append(QObject::connect(&connectTimer, &QTimer::timeout, sock, [this]() {
+        // abort()可能同步发出信号并恢复协程，之后连接对象可能已被析构
+        std::shared_ptr<bool> guard = alive;
+        sock->abort();
+        if (*guard)
+        {
+            onConnectFinished();
+        }
+    }));
+}
+
+TCPConnection::~TCPConnection()
+{
+    *alive = false;
+    for (const QMetaObject::Connection &connection : connections)
+    {
+        QObject::disconnect(connection);
+    }
+
+    if (ownsSocket && sock)
+    {
+        sock->abort();
+        delete sock;
+    }
+}
+
+TCPConnection::ConnectAwaiter TCPConnection::connect(const QString &host, quint16 port,
+                                                     int timeoutMs)
+{
+    if (sock->state() == QAbstractSocket::UnconnectedState)
+    {
+        reader.reset();
+        frameReady = false;
+        sock->connectToHost(host, port);
+        if (timeoutMs > 0)
+        {
+            connectTimer.start(timeoutMs);
+        }
+    }
+
+    bool done = sock->state() == QAbstractSocket::ConnectedState ||
+                sock->state() == QAbstractSocket::UnconnectedState;
+    return ConnectAwaiter(this, done);
+}
+
+TCPConnection::WriteAwaiter TCPConnection::write(quint8 frameType, const QByteArray &payload)
+{
+    if (!isConnected())
+    {
+        return WriteAwaiter(this, false);
+    }
+
+    // 帧头和负载分两次写入socket缓冲区，负载不与帧头拼接复制
+    char header[TCPFrame::HeaderSize];
+    TCPFrame::writeHeader(header, frameType, TCPFrame::EndOfStream, 0, quint32(payload.size()));
+    sock->write(header, TCPFrame::HeaderSize);
+    sock->write(payload);
+    return WriteAwaiter(this, true);
+}
+
+void TCPConnection::close()
+{
+    if (sock && sock->state() != QAbstractSocket::UnconnectedState)
+    {
+        // disconnected信号会恢复等待中的协程
+        sock->disconnectFromHost();
+    }
+}
+
+bool TCPConnection::tryRead()
+{
+    if (frameReady)
+    {
+        return true;
+    }
+
+    // 先取已缓存的数据，不够时再从socket读取；出现格式错误后不再读取
+    if (!reader.next(frame))
+    {
+        if (reader.hasError() || !sock || sock->bytesAvailable() <= 0)
+        {
+            return false;
+        }
+        reader.readFrom(sock);
+        if (!reader.next(frame))
+        {
+            return false;
+        }
+    }
+    frameReady = true;
+    return true;
+}
+
+std::optional<TCPFrameReader::Message> TCPConnection::takeFrame()
+{
+    if (!frameReady)
+    {
+        // 格式错误之后的数据无法再分帧，断开连接；abort()可能同步恢复其他协程，之后不再访问成员
+        if (reader.hasError() && sock && sock->state() != QAbstractSocket::UnconnectedState)
+        {
+            sock->abort();
+        }
+        return std::nullopt;
+    }
+
+    frameReady = false;
+    return frame;
+}
+
+bool TCPConnection::resume(std::coroutine_handle<> &waiter)
+{
+    // 协程恢复后可能析构连接对象，先取出句柄，恢复后不再访问成员
+    std::coroutine_handle<> handle = waiter;
+    waiter = nullptr;
+    std::shared_ptr<bool> guard = alive;
+    handle.resume();
+    return *guard;
+}
+
+void TCPConnection::onReadyRead()
+{
+    if (readWaiter && (tryRead() || reader.hasError()))
+    {
+        resume(readWaiter);
+    }
+}
+
+void TCPConnection::onBytesWritten()
+{
+    if (writeWaiter && sock->bytesToWrite() <= WriteHighWater / 2)
+    {
+        resume(writeWaiter);
+    }
+}
+
+void TCPConnection::onConnectFinished()
+{
+    // connected、errorOccurred和超时都表示本次连接尝试已结束
+    connectTimer.stop();
+    if (connectWaiter)
+    {
+        resume(connectWaiter);
+    }
+}
+
+void TCPConnection::onClosed()
+{
+    // 连接断开时所有等待中的协程以失败恢复，读等待先取走socket中剩余的消息
+    if (readWaiter)
+    {
+        tryRead();
+    }
+    if (readWaiter && !resume(readWaiter))
+    {
+        return;
+    }
+    if (writeWaiter && !resume(writeWaiter))
+    {
+        return;
+    }
+    if (connectWaiter)
+    {
+        resume(connectWaiter);
+    }
+}
+
+void TCPConnection::AcceptAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    // 只恢复一次：恢复前断开两个信号连接
+    auto connections = std::make_shared<QList<QMetaObject::Connection>>();
+    auto resumeOnce = [handle, connections]() {
+        for (const QMetaObject::Connection &connection : *connections)
+        {
+            QObject::disconnect(connection);
+        }
+        handle.resume();
+    };
+    connections->append(
+        QObject::connect(server.data(), &QTcpServer::newConnection, server.data(), resumeOnce));
+    connections->append(QObject::connect(server.data(), &QObject::destroyed, resumeOnce));
+}
@@ -0,0 +1,243 @@
+#ifndef TCPCONNECTION_H
+#define TCPCONNECTION_H
+
+#include "TCPFrame.h"
+#include <QList>
+#include <QMetaObject>
+#include <QPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+
+// 即发即弃的协程返回类型：协程立即开始执行，执行结束后自动释放
+// 示例：
+//     TCPTask session(TCPConnection &conn)
+//     {
+//         if (!co_await conn.connect("127.0.0.1", 8888))
+//             co_return;
+//         co_await conn.write(TCPFrame::TextFrame, "hello");
+//         while (auto frame = co_await conn.readFrame())
+//             ...
+//     }
+struct TCPTask
+{
+    struct promise_type
+    {
+        TCPTask get_return_object()
+        {
+            return TCPTask();
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+};
+
+// 基于QTcpSocket的协程接口，在Qt事件循环中恢复协程
+// 数据已经就绪时co_await不挂起直接返回，只有需要等待网络时才挂起，
+// 因此连续读写时的开销与回调方式相当
+// 每种操作（连接、读、写）同一时间只能有一个协程在等待；
+// 连接对象析构时仍在等待的协程不会再被恢复
+class TCPConnection
+{
+  public:
+    // socket为空时自行创建socket（用于主动连接），否则接管已建立的连接（如服务端接受的连接）
+    explicit TCPConnection(QTcpSocket *socket = nullptr);
+    ~TCPConnection();
+
+    TCPConnection(const TCPConnection &) = delete;
+    TCPConnection &operator=(const TCPConnection &) = delete;
+
+    QTcpSocket *socket() const
+    {
+        return sock;
+    }
+
+    bool isConnected() const
+    {
+        return sock && sock->state() == QAbstractSocket::ConnectedState;
+    }
+
+    // 写缓冲区超过该值时co_await write()挂起，降到一半以下时恢复
+    static const qint64 WriteHighWater = 1024 * 1024;
+
+    // co_await connect(...)：连接成功返回true，失败或超时返回false
+    class ConnectAwaiter
+    {
+      public:
+        bool await_ready() const
+        {
+            return done;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            conn->connectWaiter = handle;
+        }
+
+        bool await_resume() const
+        {
+            return conn->isConnected();
+        }
+
+      private:
+        friend class TCPConnection;
+        ConnectAwaiter(TCPConnection *conn, bool done) : conn(conn), done(done)
+        {
+        }
+
+        TCPConnection *conn;
+        bool done; // 连接已建立或已失败，无需等待
+    };
+
+    // co_await readFrame()：返回下一条完整消息，连接断开时返回空；
+    // 收到格式错误的数据时返回空并断开连接，errorString()返回原因
+    class ReadAwaiter
+    {
+      public:
+        bool await_ready()
+        {
+            return conn->tryRead() || conn->reader.hasError() || !conn->isConnected();
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            conn->readWaiter = handle;
+        }
+
+        std::optional<TCPFrameReader::Message> await_resume()
+        {
+            return conn->takeFrame();
+        }
+
+      private:
+        friend class TCPConnection;
+        explicit ReadAwaiter(TCPConnection *conn) : conn(conn)
+        {
+        }
+
+        TCPConnection *conn;
+    };
+
+    // co_await write(...)：数据交给socket后返回true，写缓冲区积压过多时先等待写出
+    class WriteAwaiter
+    {
+      public:
+        bool await_ready() const
+        {
+            return !accepted || conn->sock->bytesToWrite() <= WriteHighWater;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            conn->writeWaiter = handle;
+        }
+
+        bool await_resume() const
+        {
+            return accepted && conn->isConnected();
+        }
+
+      private:
+        friend class TCPConnection;
+        WriteAwaiter(TCPConnection *conn, bool accepted) : conn(conn), accepted(accepted)
+        {
+        }
+
+        TCPConnection *conn;
+        bool accepted;
+    };
+
+    // co_await TCPConnection::accept(server)：返回下一个新连接，服务端被删除时返回nullptr
+    class AcceptAwaiter
+    {
+      public:
+        bool await_ready() const
+        {
+            return !server || server->hasPendingConnections();
+        }
+
+        void await_suspend(std::coroutine_handle<> handle);
+
+        QTcpSocket *await_resume()
+        {
+            return server ? server->nextPendingConnection() : nullptr;
+        }
+
+      private:
+        friend class TCPConnection;
+        explicit AcceptAwaiter(QTcpServer *server) : server(server)
+        {
+        }
+
+        QPointer<QTcpServer> server;
+    };
+
+    ConnectAwaiter connect(const QString &host, quint16 port, int timeoutMs = 5000);
+    ReadAwaiter readFrame()
+    {
+        return ReadAwaiter(this);
+    }
+    WriteAwaiter write(quint8 frameType, const QByteArray &payload);
+    static AcceptAwaiter accept(QTcpServer *server)
+    {
+        return AcceptAwaiter(server);
+    }
+
+    // 主动断开连接，等待中的协程以失败恢复
+    void close();
+
+    // 读取到格式错误的数据时的错误信息，重新连接后清空
+    QString errorString() const
+    {
+        return reader.errorString();
+    }
+
+  private:
+    QPointer<QTcpSocket> sock;
+    bool ownsSocket;
+    TCPFrameReader reader;
+    TCPFrameReader::Message frame;
+    bool frameReady = false;
+    QTimer connectTimer;
+    QList<QMetaObject::Connection> connections;
+    std::shared_ptr<bool> alive; // 恢复协程后据此判断连接对象是否已被析构
+
+    std::coroutine_handle<> connectWaiter;
+    std::coroutine_handle<> readWaiter;
+    std::coroutine_handle<> writeWaiter;
+
+    // 尝试取出一条消息，已有消息时返回true
+    bool tryRead();
+    std::optional<TCPFrameReader::Message> takeFrame();
+
+    void onReadyRead();
+    void onBytesWritten();
+    void onConnectFinished();
+    void onClosed();
+
+    // 恢复并清空一个等待中的协程，返回连接对象是否仍然存在
+    bool resume(std::coroutine_handle<> &waiter);
+};
+
+#endif // TCPCONNECTION_H
@@ -0,0 +1,303 @@
+#include "TCPDelta.h"
+#include <QBitArray>
+#include <QCryptographicHash>
+#include <QHash>
+#include <QVector>
+#include <QtEndian>
+#include <QtMath>
+#include <cstring>
+
+const int TCPDelta::MinBlockSize;
+const int TCPDelta::MaxBlockSize;
+const int TCPDelta::StrongSize;
+
+// 每块签名的长度：弱校验和 + 强校验和
+static const int SignatureEntrySize = 4 + TCPDelta::StrongSize;
+
+static void setError(QString *errorString, const QString &message)
+{
+    if (errorString)
+    {
+        *errorString = message;
+    }
+}
+
+// 弱校验和的16位标签，用于查哈希表之前的快速过滤
+static inline int checksumTag(quint32 weak)
+{
+    return int((weak ^ (weak >> 16)) & 0xFFFF);
+}
+
+int TCPDelta::blockSizeFor(qint64 size)
+{
+    // 取8的倍数，限制在[MinBlockSize, MaxBlockSize]之内
+    qint64 blockSize = qint64(qSqrt(double(qMax<qint64>(size, 0)))) & ~qint64(7);
+    return int(qBound<qint64>(MinBlockSize, blockSize, MaxBlockSize));
+}
+
+quint32 TCPDelta::weakChecksum(const uchar *data, int length)
+{
+    // a为字节和，b为按位置加权的字节和，各取低16位
+    quint32 a = 0;
+    quint32 b = 0;
+    for (int i = 0; i < length; ++i)
+    {
+        a += data[i];
+        b += quint32(length - i) * data[i];
+    }
+    return (a & 0xFFFF) | (b << 16);
+}
+
+QByteArray TCPDelta::strongChecksum(const char *data, int length)
+{
+    return QCryptographicHash::hash(QByteArrayView(data, length), QCryptographicHash::Md5)
+        .left(StrongSize);
+}
+
+QByteArray TCPDelta::signature(const QByteArray &base, int blockSize)
+{
+    blockSize = qBound(MinBlockSize, blockSize, MaxBlockSize);
+    quint32 blockCount = quint32(base.size() / blockSize);
+
+    QByteArray out(8 + qsizetype(blockCount) * SignatureEntrySize, Qt::Uninitialized);
+    char *cursor = out.data();
+    qToBigEndian<quint32>(quint32(blockSize), cursor);
+    qToBigEndian<quint32>(blockCount, cursor + 4);
+    cursor += 8;
+
+    const char *data = base.constData();
+    for (quint32 block = 0; block < blockCount; ++block, data += blockSize)
+    {
+        qToBigEndian<quint32>(weakChecksum(reinterpret_cast<const uchar *>(data), blockSize),
+                              cursor);
+        memcpy(cursor + 4, strongChecksum(data, blockSize).constData(), StrongSize);
+        cursor += SignatureEntrySize;
+    }
+    return out;
+}
+
+void TCPDelta::appendCopy(QByteArray &delta, quint32 firstBlock, quint32 blockCount)
+{
+    char instruction[9];
+    instruction[0] = char(CopyInstruction);
+    qToBigEndian<quint32>(firstBlock, instruction + 1);
+    qToBigEndian<quint32>(blockCount, instruction + 5);
+    delta.append(instruction, sizeof(instruction));
+}
+
+void TCPDelta::appendData(QByteArray &delta, const char *data, int length)
+{
+    if (length <= 0)
+    {
+        return;
+    }
+
+    char instruction[5];
+    instruction[0] = char(DataInstruction);
+    qToBigEndian<quint32>(quint32(length), instruction + 1);
+    delta.append(instruction, sizeof(instruction));
+    delta.append(data, length);
+}
+
+QByteArray TCPDelta::diff(const QByteArray &signature, const QByteArray &target)
+{
+    if (signature.size() < 8)
+    {
+        return QByteArray();
+    }
+
+    const char *entries = signature.constData();
+    quint32 blockSize = qFromBigEndian<quint32>(entries);
+    quint32 blockCount = qFromBigEndian<quint32>(entries + 4);
+    entries += 8;
+    if (blockSize < quint32(MinBlockSize) || blockSize > quint32(MaxBlockSize) ||
+        quint64(signature.size()) != 8 + quint64(blockCount) * SignatureEntrySize)
+    {
+        return QByteArray();
+    }
+
+    // 弱校验和 -> 块号；另用65536位的标签表预先过滤，大多数位置只需一次位测试
+    QHash<quint32, QVector<quint32>> blocks;
+    blocks.reserve(int(blockCount));
+    QBitArray tags(65536);
+    for (quint32 block = 0; block < blockCount; ++block)
+    {
+        quint32 weak = qFromBigEndian<quint32>(entries + qsizetype(block) * SignatureEntrySize);
+        blocks[weak].append(block);
+        tags.setBit(checksumTag(weak));
+    }
+
+    QByteArray delta(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(blockSize, delta.data());
+
+    const int length = int(blockSize);
+    const char *text = target.constData();
+    const uchar *data = reinterpret_cast<const uchar *>(text);
+    const qsizetype size = target.size();
+
+    qsizetype pos = 0;
+    qsizetype dataStart = 0; // 尚未输出的数据起点
+    quint32 copyFirst = 0;   // 尚未输出的连续复制块
+    quint32 copyCount = 0;
+    quint32 a = 0;
+    quint32 b = 0;
+    bool fresh = true; // 窗口跳过一整块后需要重新计算校验和
+
+    while (blockCount > 0 && pos + length <= size)
+    {
+        if (fresh)
+        {
+            a = 0;
+            b = 0;
+            for (int i = 0; i < length; ++i)
+            {
+                a += data[pos + i];
+                b += quint32(length - i) * data[pos + i];
+            }
+            fresh = false;
+        }
+
+        quint32 weak = (a & 0xFFFF) | (b << 16);
+        qint64 matched = -1;
+        if (tags.testBit(checksumTag(weak)))
+        {
+            QHash<quint32, QVector<quint32>>::const_iterator candidates = blocks.constFind(weak);
+            if (candidates != blocks.constEnd())
+            {
+                QByteArray strong = strongChecksum(text + pos, length);
+                for (quint32 block : *candidates)
+                {
+                    if (memcmp(entries + qsizetype(block) * SignatureEntrySize + 4,
+                               strong.constData(), StrongSize) == 0)
+                    {
+                        matched = block;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (matched >= 0)
+        {
+            // 先输出之前的数据，相邻的复制块合并为一条指令
+            if (pos > dataStart)
+            {
+                if (copyCount > 0)
+                {
+                    appendCopy(delta, copyFirst, copyCount);
+                    copyCount = 0;
+                }
+                appendData(delta, text + dataStart, int(pos - dataStart));
+            }
+            if (copyCount > 0 && copyFirst + copyCount == quint32(matched))
+            {
+                copyCount++;
+            }
+            else
+            {
+                if (copyCount > 0)
+                {
+                    appendCopy(delta, copyFirst, copyCount);
+                }
+                copyFirst = quint32(matched);
+                copyCount = 1;
+            }
+
+            pos += length;
+            dataStart = pos;
+            fresh = true;
+            continue;
+        }
+
+        // 窗口后移一个字节，校验和增量更新
+        if (pos + length < size)
+        {
+            quint32 out = data[pos];
+            quint32 in = data[pos + length];
+            a = a - out + in;
+            b = b - quint32(length) * out + a;
+        }
+        pos++;
+    }
+
+    if (copyCount > 0)
+    {
+        appendCopy(delta, copyFirst, copyCount);
+    }
+    // 数据指令的长度为4字节，超长的数据分段输出
+    while (dataStart < size)
+    {
+        int chunk = int(qMin<qsizetype>(size - dataStart, 1 << 30));
+        appendData(delta, text + dataStart, chunk);
+        dataStart += chunk;
+    }
+    return delta;
+}
+
+bool TCPDelta::patch(const QByteArray &base, const QByteArray &delta, QByteArray &target,
+                     QString *errorString)
+{
+    if (delta.size() < 4)
+    {
+        setError(errorString, QString("增量数据过短"));
+        return false;
+    }
+
+    const char *data = delta.constData();
+    qint64 blockSize = qFromBigEndian<quint32>(data);
+    if (blockSize < MinBlockSize || blockSize > MaxBlockSize)
+    {
+        setError(errorString, QString("无效的块大小: %1").arg(blockSize));
+        return false;
+    }
+
+    QByteArray result;
+    result.reserve(base.size());
+    qsizetype pos = 4;
+    while (pos < delta.size())
+    {
+        quint8 instruction = quint8(data[pos++]);
+        if (instruction == CopyInstruction)
+        {
+            if (delta.size() - pos < 8)
+            {
+                setError(errorString, QString("复制指令不完整"));
+                return false;
+            }
+            qint64 offset = qint64(qFromBigEndian<quint32>(data + pos)) * blockSize;
+            qint64 length = qint64(qFromBigEndian<quint32>(data + pos + 4)) * blockSize;
+            pos += 8;
+            if (offset + length > base.size())
+            {
+                setError(errorString, QString("复制范围超出旧版本"));
+                return false;
+            }
+            result.append(base.constData() + offset, qsizetype(length));
+        }
+        else if (instruction == DataInstruction)
+        {
+            if (delta.size() - pos < 4)
+            {
+                setError(errorString, QString("数据指令不完整"));
+                return false;
+            }
+            quint32 length = qFromBigEndian<quint32>(data + pos);
+            pos += 4;
+            if (quint64(delta.size() - pos) < length)
+            {
+                setError(errorString, QString("数据指令不完整"));
+                return false;
+            }
+            result.append(data + pos, qsizetype(length));
+            pos += length;
+        }
+        else
+        {
+            setError(errorString, QString("未知的增量指令: %1").arg(instruction));
+            return false;
+        }
+    }
+
+    target = result;
+    return true;
+}
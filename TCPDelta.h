@@ -0,0 +1,47 @@
+#ifndef TCPDELTA_H
+#define TCPDELTA_H
+
+#include <QByteArray>
+#include <QString>
+
+// rsync式的增量传输：接收端对已有的旧版本按块计算签名，发送端据此只发送变化的部分
+// 签名: [块大小 4B][块数 4B][每块: 弱校验和 4B][强校验和 8B]...
+// 增量: [块大小 4B][指令...]
+//     复制指令: [0x01][起始块号 4B][块数 4B]，从旧版本复制连续的若干块
+//     数据指令: [0x02][长度 4B][数据]，旧版本中没有的数据
+// 弱校验和可以随窗口滑动逐字节更新，只有弱校验和命中时才计算强校验和（MD5前8字节）
+class TCPDelta
+{
+  public:
+    static const int MinBlockSize = 1024;
+    static const int MaxBlockSize = 64 * 1024;
+    static const int StrongSize = 8;
+
+    // 按文件大小选择块大小：约为大小的平方根，块数和每块开销之间折中
+    static int blockSizeFor(qint64 size);
+
+    // 计算旧版本的块签名，最后不满一块的数据不参与匹配
+    static QByteArray signature(const QByteArray &base, int blockSize);
+
+    // 根据旧版本的签名计算把旧版本变为target所需的增量，签名格式错误时返回空
+    static QByteArray diff(const QByteArray &signature, const QByteArray &target);
+
+    // 把增量应用到旧版本上，格式错误时返回false并通过errorString返回原因
+    static bool patch(const QByteArray &base, const QByteArray &delta, QByteArray &target,
+                      QString *errorString = nullptr);
+
+  private:
+    enum Instruction
+    {
+        CopyInstruction = 1,
+        DataInstruction = 2
+    };
+
+    static quint32 weakChecksum(const uchar *data, int length);
+    static QByteArray strongChecksum(const char *data, int length);
+
+    static void appendCopy(QByteArray &delta, quint32 firstBlock, quint32 blockCount);
+    static void appendData(QByteArray &delta, const char *data, int length);
+};
+
+#endif // TCPDELTA_H
@@ -1,10 +1,42 @@
+#include "SocketTuning.h"
 #include "mainwindow.h"
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption profileOption(
+        "socket-profile",
+        QString("socket调优预设: %1").arg(SocketTuning::profileNames().join(", ")), "name",
+        "default");
+    parser.addOption(profileOption);
+    QCommandLineOption backendOption("server-backend", QString("服务端后端: qt, epoll"), "name",
+                                     "qt");
+    parser.addOption(backendOption);
+    QCommandLineOption captureOption(
+        "capture", QString("把服务端收发的流量捕获到文件，可以用TCPReplay回放"), "file");
+    parser.addOption(captureOption);
+    parser.process(app);
+
     MainWindow window;
+    if (!window.setSocketProfile(parser.value(profileOption)))
+    {
+        qWarning("未知的socket调优预设: %s", qPrintable(parser.value(profileOption)));
+    }
+    if (!window.setServerBackend(parser.value(backendOption)))
+    {
+        qWarning("未知的服务端后端: %s", qPrintable(parser.value(backendOption)));
+    }
+    QString captureError;
+    if (parser.isSet(captureOption) &&
+        !window.startCapture(parser.value(captureOption), &captureError))
+    {
+        qWarning("%s", qPrintable(captureError));
+    }
     window.show();
     return app.exec();
-}
\ No newline at end of file
+}
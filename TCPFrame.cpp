@@ -0,0 +1,473 @@
+#include "TCPFrame.h"
+#include <QtEndian>
+#include <climits>
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+const quint8 TCPFrame::ProtocolVersion;
+const quint32 TCPFrame::LegacyHelloCapabilities;
+const quint8 TCPFrame::DeltaReplyMarker;
+const int TCPFrame::HeaderSize;
+const quint8 TCPFrame::Magic0;
+const quint8 TCPFrame::Magic1;
+const int TCPFrame::DefaultChunkSize;
+const int TCPFrameReader::DescriptorReadSize;
+const qint64 TCPFrameReader::DefaultMaxStreamSize;
+const qint64 TCPFrameReader::MaxStreamSizeLimit;
+const int TCPFrameReader::DefaultMaxPartialStreams;
+const qint64 TCPFrameReader::DefaultMaxPartialBytes;
+
+void TCPFrame::writeHeader(char *out, quint8 type, quint8 flags, quint32 streamId,
+                           quint32 length)
+{
+    uchar *data = reinterpret_cast<uchar *>(out);
+    data[0] = Magic0;
+    data[1] = Magic1;
+    data[2] = type;
+    data[3] = flags;
+    qToBigEndian<quint32>(streamId, data + 4);
+    qToBigEndian<quint32>(length, data + 8);
+}
+
+QByteArray TCPFrame::encodeHeader(quint8 type, quint8 flags, quint32 streamId, quint32 length)
+{
+    QByteArray header(HeaderSize, Qt::Uninitialized);
+    writeHeader(header.data(), type, flags, streamId, length);
+    return header;
+}
+
+QByteArray TCPFrame::encode(quint8 type, const QByteArray &payload, quint32 streamId)
+{
+    QByteArray frame = encodeHeader(type, EndOfStream, streamId, quint32(payload.size()));
+    frame.append(payload);
+    return frame;
+}
+
+QByteArray TCPFrame::encodeControl(quint8 opcode, const QByteArray &body)
+{
+    QByteArray payload;
+    payload.reserve(1 + body.size());
+    payload.append(char(opcode));
+    payload.append(body);
+    return encode(ControlFrame, payload);
+}
+
+QByteArray TCPFrame::encodeHelloPayload(quint32 capabilities, quint32 maxMessageSize)
+{
+    QByteArray payload(maxMessageSize > 0 ? 10 : 6, Qt::Uninitialized);
+    payload[0] = char(HelloOpcode);
+    payload[1] = char(ProtocolVersion);
+    qToBigEndian<quint32>(capabilities, payload.data() + 2);
+    if (maxMessageSize > 0)
+    {
+        qToBigEndian<quint32>(maxMessageSize, payload.data() + 6);
+    }
+    return payload;
+}
+
+quint32 TCPFrame::decodeHelloPayload(const QByteArray &payload)
+{
+    if (payload.size() < 6)
+    {
+        return LegacyHelloCapabilities;
+    }
+    return qFromBigEndian<quint32>(payload.constData() + 2);
+}
+
+quint32 TCPFrame::decodeHelloMaxMessageSize(const QByteArray &payload)
+{
+    if (payload.size() < 10)
+    {
+        return 0;
+    }
+    return qFromBigEndian<quint32>(payload.constData() + 6);
+}
+
+QByteArray TCPFrame::encodePublishPayload(const QString &topic, const QByteArray &data)
+{
+    QByteArray topicName = topic.toUtf8();
+    QByteArray payload(2, Qt::Uninitialized);
+    qToBigEndian<quint16>(quint16(topicName.size()), payload.data());
+    payload.reserve(2 + topicName.size() + data.size());
+    payload.append(topicName);
+    payload.append(data);
+    return payload;
+}
+
+bool TCPFrame::decodePublishPayload(const QByteArray &payload, QString &topic, QByteArray &data)
+{
+    if (payload.size() < 2)
+    {
+        return false;
+    }
+
+    int topicLength = qFromBigEndian<quint16>(payload.constData());
+    if (payload.size() < 2 + topicLength)
+    {
+        return false;
+    }
+
+    topic = QString::fromUtf8(payload.constData() + 2, topicLength);
+    data = payload.mid(2 + topicLength);
+    return true;
+}
+
+QByteArray TCPFrame::encodeSequencedPayload(quint64 sequence, quint8 frameType,
+                                            const QByteArray &data)
+{
+    QByteArray payload(9, Qt::Uninitialized);
+    qToBigEndian<quint64>(sequence, payload.data());
+    payload[8] = char(frameType);
+    payload.append(data);
+    return payload;
+}
+
+bool TCPFrame::decodeSequencedPayload(const QByteArray &payload, quint64 &sequence,
+                                      quint8 &frameType, QByteArray &data)
+{
+    if (payload.size() < 9)
+    {
+        return false;
+    }
+
+    sequence = qFromBigEndian<quint64>(payload.constData());
+    frameType = quint8(payload.at(8));
+    data = payload.mid(9);
+    return true;
+}
+
+bool TCPFrame::parseFileMessage(const QByteArray &data, int prefixLength,
+                                FileMessageFields &fields)
+{
+    // GBK编码的名称中可能出现'|'字节，以"|数字|"作为名称结束的标志
+    int from = prefixLength;
+    while (true)
+    {
+        int nameEnd = data.indexOf('|', from);
+        if (nameEnd < 0)
+        {
+            return false;
+        }
+
+        int sizeEnd = data.indexOf('|', nameEnd + 1);
+        if (sizeEnd < 0)
+        {
+            return false;
+        }
+
+        bool ok = false;
+        qint64 size = QByteArray::fromRawData(data.constData() + nameEnd + 1, sizeEnd - nameEnd - 1)
+                          .toLongLong(&ok);
+        if (!ok)
+        {
+            from = nameEnd + 1;
+            continue;
+        }
+
+        int typeEnd = data.indexOf('|', sizeEnd + 1);
+        if (typeEnd < 0)
+        {
+            return false;
+        }
+
+        fields.name = data.mid(prefixLength, nameEnd - prefixLength);
+        fields.size = size;
+        fields.type = data.mid(sizeEnd + 1, typeEnd - sizeEnd - 1);
+        fields.dataOffset = typeEnd + 1;
+        return true;
+    }
+}
+
+TCPFrameReader::~TCPFrameReader()
+{
+    if (bufferPool)
+    {
+        bufferPool->release(buffer);
+    }
+}
+
+void TCPFrameReader::append(const QByteArray &data)
+{
+    reserveTail(data.size());
+    buffer.append(data);
+    counters.bytesRead += data.size();
+}
+
+qint64 TCPFrameReader::readFrom(QIODevice *device)
+{
+    qint64 available = device->bytesAvailable();
+    if (available <= 0)
+    {
+        return 0;
+    }
+
+    reserveTail(available);
+    int oldSize = buffer.size();
+    buffer.resize(oldSize + available);
+    qint64 count = device->read(buffer.data() + oldSize, available);
+    buffer.resize(oldSize + qMax<qint64>(count, 0));
+
+    counters.bytesRead += qMax<qint64>(count, 0);
+    return count;
+}
+
+qint64 TCPFrameReader::readFromDescriptor(qintptr descriptor, bool *closed, bool *drained)
+{
+    *closed = false;
+    if (drained)
+    {
+        *drained = false;
+    }
+    qint64 total = 0;
+#ifdef Q_OS_UNIX
+    // 边沿触发时必须一直读到EAGAIN，否则剩余数据不会再触发通知；
+    // 任何一条完整消息都不超过这个上限，达到上限时先交给调用者取出消息
+    const qint64 limit = maxStreamSize + TCPFrame::HeaderSize;
+    for (;;)
+    {
+        qint64 unread = buffer.size() - readPos;
+        if (unread >= limit)
+        {
+            break;
+        }
+
+        reserveTail(qMin<qint64>(DescriptorReadSize, limit - unread));
+        int oldSize = buffer.size();
+        int room = int(qMin<qint64>(buffer.capacity() - oldSize, limit - unread));
+        buffer.resize(oldSize + room);
+        ssize_t count = ::read(int(descriptor), buffer.data() + oldSize, size_t(room));
+        buffer.resize(oldSize + int(qMax<ssize_t>(count, 0)));
+
+        if (count > 0)
+        {
+            total += count;
+            continue;
+        }
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            // 对端关闭或连接出错
+            *closed = true;
+        }
+        else if (drained)
+        {
+            *drained = true;
+        }
+        break;
+    }
+#else
+    Q_UNUSED(descriptor);
+    *closed = true;
+#endif
+
+    counters.bytesRead += total;
+    return total;
+}
+
+void TCPFrameReader::reserveTail(qint64 extra)
+{
+    qint64 needed = qint64(buffer.size()) + extra;
+    if (buffer.isDetached() && buffer.capacity() >= needed)
+    {
+        return;
+    }
+
+    // 已消费的数据不再复制，只搬移尚未处理的部分
+    qint64 unread = buffer.size() - readPos;
+    needed = unread + extra;
+
+    // 预留一倍余量，避免数据持续到达时每次都更换缓冲区
+    int target = int(qMin<qint64>(needed + qMin<qint64>(needed, BufferPool::MaxClassSize), INT_MAX));
+    QByteArray grown;
+    if (bufferPool)
+    {
+        quint64 allocatedBefore = bufferPool->stats().allocated;
+        grown = bufferPool->acquire(target);
+        if (bufferPool->stats().allocated != allocatedBefore)
+        {
+            counters.bufferAllocations++;
+        }
+    }
+    else
+    {
+        counters.bufferAllocations++;
+        grown.reserve(target);
+    }
+
+    grown.append(buffer.constData() + readPos, unread);
+    if (bufferPool)
+    {
+        bufferPool->release(buffer);
+    }
+    buffer = grown;
+    readPos = 0;
+}
+
+void TCPFrameReader::assignPayload(QByteArray &payload, const char *data, int length)
+{
+    if (!payload.isDetached() || payload.capacity() < length)
+    {
+        // 上一条消息的负载仍被使用者持有，或容量不足
+        counters.payloadAllocations++;
+        payload = QByteArray(data, length);
+        return;
+    }
+
+    payload.resize(length);
+    memcpy(payload.data(), data, length);
+}
+
+bool TCPFrameReader::next(Message &message)
+{
+    while (readPos < buffer.size() && error.isEmpty())
+    {
+        const uchar *data = reinterpret_cast<const uchar *>(buffer.constData()) + readPos;
+        qint64 available = buffer.size() - readPos;
+
+        if (data[0] != TCPFrame::Magic0)
+        {
+            // 旧版纯文本消息：取到下一个帧起始字节之前的全部数据
+            int end = buffer.indexOf(char(TCPFrame::Magic0), readPos);
+            if (end < 0)
+            {
+                end = buffer.size();
+            }
+
+            message.type = TCPFrame::TextFrame;
+            message.streamId = 0;
+            message.framed = false;
+            assignPayload(message.payload, buffer.constData() + readPos, end - readPos);
+            readPos = end;
+            counters.messages++;
+            compact();
+            return true;
+        }
+
+        if (available < 2)
+        {
+            return false;
+        }
+
+        if (data[1] != TCPFrame::Magic1)
+        {
+            error = QString("无效的帧头");
+            return false;
+        }
+
+        if (available < TCPFrame::HeaderSize)
+        {
+            return false;
+        }
+
+        quint8 type = data[2];
+        quint8 flags = data[3];
+        quint32 streamId = qFromBigEndian<quint32>(data + 4);
+        quint32 length = qFromBigEndian<quint32>(data + 8);
+
+        // 解析出帧头后立即检查长度，不为声明了超长负载的帧继续缓冲数据
+        QHash<quint32, QByteArray>::iterator partial = partialStreams.find(streamId);
+        qint64 received = partial != partialStreams.end() ? partial->size() : 0;
+        if (received + qint64(length) > maxStreamSize)
+        {
+            error = QString("流 %1 超过最大长度限制").arg(streamId);
+            return false;
+        }
+
+        // 单流上限之外还限制未完成流的个数和合计字节数，防止对端同时打开大量流耗尽内存
+        bool last = flags & TCPFrame::EndOfStream;
+        if (partial == partialStreams.end() && !last &&
+            partialStreams.size() >= maxPartialStreams)
+        {
+            error = QString("未完成的流超过 %1 个").arg(maxPartialStreams);
+            return false;
+        }
+        if ((partial != partialStreams.end() || !last) &&
+            partialBytes + qint64(length) > maxPartialBytes)
+        {
+            error = QString("未完成的流合计超过最大长度限制");
+            return false;
+        }
+
+        if (available < TCPFrame::HeaderSize + qint64(length))
+        {
+            return false;
+        }
+
+        framed = true;
+        const char *chunk = buffer.constData() + readPos + TCPFrame::HeaderSize;
+
+        // 负载直接从接收缓冲区复制到目标位置，之后才能移动缓冲区
+        if (!last)
+        {
+            // 中间分片，继续等待同一个流的后续分片
+            if (partial == partialStreams.end())
+            {
+                partial = partialStreams.insert(streamId, QByteArray());
+            }
+            partial->append(chunk, length);
+            partialBytes += length;
+            readPos += TCPFrame::HeaderSize + length;
+            compact();
+            continue;
+        }
+
+        message.type = type;
+        message.streamId = streamId;
+        message.framed = true;
+        if (partial != partialStreams.end())
+        {
+            partialBytes -= partial->size();
+            partial->append(chunk, length);
+            message.payload = *partial;
+            partialStreams.erase(partial);
+        }
+        else
+        {
+            assignPayload(message.payload, chunk, length);
+        }
+        readPos += TCPFrame::HeaderSize + length;
+        compact();
+        counters.messages++;
+        return true;
+    }
+
+    return false;
+}
+
+void TCPFrameReader::compact()
+{
+    // 已消费的数据过半时才整体前移，避免每帧都搬移缓冲区
+    if (readPos >= buffer.size())
+    {
+        // resize(0)保留容量，下次读取直接复用
+        buffer.resize(0);
+        readPos = 0;
+    }
+    else if (readPos > buffer.size() / 2)
+    {
+        buffer.remove(0, readPos);
+        readPos = 0;
+    }
+}
+
+void TCPFrameReader::reset()
+{
+    if (bufferPool)
+    {
+        bufferPool->release(buffer);
+    }
+    else
+    {
+        buffer.resize(0);
+    }
+    readPos = 0;
+    partialStreams.clear();
+    partialBytes = 0;
+    error.clear();
+}
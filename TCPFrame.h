@@ -0,0 +1,266 @@
+#ifndef TCPFRAME_H
+#define TCPFRAME_H
+
+#include "BufferPool.h"
+#include <QByteArray>
+#include <QHash>
+#include <QIODevice>
+#include <QString>
+#include <climits>
+
+// 二进制帧格式（大端序，共12字节帧头）:
+// [魔数 0xFF 0xA5][类型 1B][标志 1B][流ID 4B][负载长度 4B][负载]
+// 0xFF在UTF-8和GBK文本中都不会出现，接收端据此区分帧和旧版纯文本消息
+class TCPFrame
+{
+  public:
+    // 帧类型
+    enum FrameType
+    {
+        TextFrame = 1,
+        FileFrame = 2,
+        ImageFrame = 3,
+        ControlFrame = 4,
+        RpcRequestFrame = 5,
+        RpcResponseFrame = 6,
+        PublishFrame = 7,
+        SequencedFrame = 8, // 带序号的消息，接收端处理后需要确认
+        UserFrameBase = 0x80 // 0x80及以上留给自定义消息类型
+    };
+
+    // 帧标志
+    enum FrameFlag
+    {
+        EndOfStream = 0x01 // 流的最后一个分片
+    };
+
+    // 控制帧操作码（控制帧负载的第一个字节）
+    enum ControlOpcode
+    {
+        HelloOpcode = 1,        // 声明本端使用帧格式：[协议版本 1B][能力 4B][可选：消息上限 4B]
+        SubscribeOpcode = 2,    // 订阅主题，负载为主题名
+        UnsubscribeOpcode = 3,  // 取消订阅主题，负载为主题名
+        AckOpcode = 4,          // 确认已处理的消息，负载为若干个8字节序号
+        ContentCacheOpcode = 5, // 旧版客户端声明缓存收到的内容，现已并入Hello的能力
+        OfferOpcode = 6,        // 提供内容：[内容哈希 32B][不含数据的文件/图片消息]
+        WantOpcode = 7,         // 本端没有提供的内容，请求发送：[内容哈希 32B][可选标记 1B]
+        HaveOpcode = 8,         // 本端已有提供的内容，不必发送：[内容哈希 32B][可选标记 1B]
+        SignatureOpcode = 9     // 本端有同名文件的旧版本，请求增量：[内容哈希 32B][旧版本的块签名]
+    };
+
+    // Want/Have在内容哈希之后带有该标记时答复的是增量消息：Have表示已还原，
+    // Want表示无法还原、需要完整消息；不带标记时答复的是提供
+    static const quint8 DeltaReplyMarker = 1;
+
+    // 能力位：双方在Hello中声明各自支持的能力，连接只使用双方都支持的部分
+    enum Capability
+    {
+        SchemaCapability = 0x01,       // 二进制文件/图片消息（TCPSchema）
+        ContentCacheCapability = 0x02, // 缓存收到的内容，可以按内容哈希跳过重复传输
+        BatchCapability = 0x04         // 批量文件消息
+    };
+
+    // Hello中声明的协议版本，新版本只在Hello末尾追加字段
+    static const quint8 ProtocolVersion = 1;
+
+    // 协商之前的版本发送不带内容的Hello，这些版本已支持二进制消息和批量消息
+    static const quint32 LegacyHelloCapabilities = SchemaCapability | BatchCapability;
+
+    static const int HeaderSize = 12;
+    static const quint8 Magic0 = 0xFF;
+    static const quint8 Magic1 = 0xA5;
+
+    // 默认分片大小，大负载会被拆成多个分片与其他流交错发送
+    static const int DefaultChunkSize = 16 * 1024;
+
+    // 编码帧头，writeHeader写入调用者提供的HeaderSize字节缓冲区
+    static void writeHeader(char *out, quint8 type, quint8 flags, quint32 streamId,
+                            quint32 length);
+    static QByteArray encodeHeader(quint8 type, quint8 flags, quint32 streamId, quint32 length);
+
+    // 编码一个完整的单帧消息
+    static QByteArray encode(quint8 type, const QByteArray &payload, quint32 streamId = 0);
+
+    // 编码控制帧
+    static QByteArray encodeControl(quint8 opcode, const QByteArray &body = QByteArray());
+
+    // Hello控制帧负载（含操作码）的编码和解析，不带内容的旧版Hello解析为LegacyHelloCapabilities
+    // maxMessageSize是本端接受的单条消息上限，为0时不声明，对端按默认上限处理
+    static QByteArray encodeHelloPayload(quint32 capabilities, quint32 maxMessageSize = 0);
+    static quint32 decodeHelloPayload(const QByteArray &payload);
+
+    // 对端在Hello中声明的单条消息上限，没有声明时返回0
+    static quint32 decodeHelloMaxMessageSize(const QByteArray &payload);
+
+    // 发布帧负载: [主题长度 2B][主题 UTF-8][消息]
+    static QByteArray encodePublishPayload(const QString &topic, const QByteArray &data);
+    static bool decodePublishPayload(const QByteArray &payload, QString &topic, QByteArray &data);
+
+    // 带序号帧负载: [序号 8B][内层帧类型 1B][消息]
+    static QByteArray encodeSequencedPayload(quint64 sequence, quint8 frameType,
+                                             const QByteArray &data);
+    static bool decodeSequencedPayload(const QByteArray &payload, quint64 &sequence,
+                                       quint8 &frameType, QByteArray &data);
+
+    // 文件/图片消息的字段: [前缀]名称|大小|类型|Base64数据
+    struct FileMessageFields
+    {
+        QByteArray name;
+        qint64 size = 0;
+        QByteArray type;
+        int dataOffset = 0; // Base64数据在消息中的起始位置
+    };
+
+    // 直接在原始字节上查找分隔符，不把整条消息（主要是Base64数据）解码成QString再拆分
+    static bool parseFileMessage(const QByteArray &data, int prefixLength,
+                                 FileMessageFields &fields);
+};
+
+// 帧读取器：累积接收到的数据，按流ID重组分片，并兼容旧版纯文本消息
+class TCPFrameReader
+{
+  public:
+    // 重组完成的消息
+    struct Message
+    {
+        quint8 type = TCPFrame::TextFrame;
+        quint32 streamId = 0;
+        QByteArray payload;
+        bool framed = false; // false表示旧版纯文本消息
+    };
+
+    // 接收路径统计
+    struct Stats
+    {
+        quint64 messages = 0;           // 取出的完整消息数
+        quint64 bytesRead = 0;          // 读取的字节数
+        quint64 bufferAllocations = 0;  // 接收缓冲区扩容时的新分配次数
+        quint64 payloadAllocations = 0; // 消息负载无法复用上一条的内存时的分配次数
+    };
+
+    TCPFrameReader() = default;
+    ~TCPFrameReader();
+
+    // 设置接收缓冲区池，缓冲区扩容和reset()时与池交换
+    void setBufferPool(BufferPool *pool)
+    {
+        bufferPool = pool;
+    }
+
+    // 追加接收到的数据
+    void append(const QByteArray &data);
+
+    // 直接把设备中可读的数据读入接收缓冲区，省去readAll()的临时对象
+    qint64 readFrom(QIODevice *device);
+
+    // 从非阻塞描述符读取数据直到没有更多数据（EAGAIN），返回读取的字节数
+    // 对端关闭或出错时closed为true；缓冲区中未处理的数据超过单流上限加一个帧头时停止读取，
+    // 此时drained为false，调用者取出消息后应再次读取
+    qint64 readFromDescriptor(qintptr descriptor, bool *closed, bool *drained = nullptr);
+
+    // 取出下一条完整消息，没有完整消息时返回false
+    // 循环中复用同一个Message时，负载会复用上一条消息的内存（未被共享时）
+    bool next(Message &message);
+
+    // 是否收到过帧格式的数据
+    bool isFramed() const
+    {
+        return framed;
+    }
+
+    // 协议错误
+    bool hasError() const
+    {
+        return !error.isEmpty();
+    }
+
+    QString errorString() const
+    {
+        return error;
+    }
+
+    // 单个流允许重组的最大字节数，不超过MaxStreamSizeLimit
+    void setMaxStreamSize(qint64 bytes)
+    {
+        maxStreamSize = qBound<qint64>(0, bytes, MaxStreamSizeLimit);
+    }
+
+    qint64 streamSizeLimit() const
+    {
+        return maxStreamSize;
+    }
+
+    // 同时未收完的流的个数上限
+    void setMaxPartialStreams(int streams)
+    {
+        maxPartialStreams = qMax(streams, 1);
+    }
+
+    int partialStreamsLimit() const
+    {
+        return maxPartialStreams;
+    }
+
+    // 所有未收完的流合计的最大字节数，应不小于单流上限
+    void setMaxPartialBytes(qint64 bytes)
+    {
+        maxPartialBytes = qMax<qint64>(bytes, 0);
+    }
+
+    qint64 partialBytesLimit() const
+    {
+        return maxPartialBytes;
+    }
+
+    // 默认的单流上限
+    static const qint64 DefaultMaxStreamSize = 512 * 1024 * 1024;
+
+    // 默认的未完成流个数上限和合计字节上限，合计上限不小于MaxStreamSizeLimit
+    static const int DefaultMaxPartialStreams = 64;
+    static const qint64 DefaultMaxPartialBytes = 2 * DefaultMaxStreamSize;
+
+    // 单流上限的最大值：接收缓冲区的读取位置是int，留出一帧和扩容余量
+    static const qint64 MaxStreamSizeLimit = INT_MAX / 2;
+
+    // 供读取循环复用的消息对象，负载内存可以跨多次读取复用
+    Message &scratchMessage()
+    {
+        return scratch;
+    }
+
+    Stats stats() const
+    {
+        return counters;
+    }
+
+    // 清空缓冲区和错误状态
+    void reset();
+
+  private:
+    // 从描述符读取时每次至少预留的空间
+    static const int DescriptorReadSize = 16 * 1024;
+
+    QByteArray buffer;
+    BufferPool *bufferPool = nullptr;
+    Stats counters;
+    Message scratch;
+    int readPos = 0;                           // 缓冲区中已消费的位置
+    QHash<quint32, QByteArray> partialStreams; // 尚未收完的流
+    qint64 maxStreamSize = DefaultMaxStreamSize;
+    qint64 partialBytes = 0; // 未完成流已缓存的字节数合计
+    int maxPartialStreams = DefaultMaxPartialStreams;
+    qint64 maxPartialBytes = DefaultMaxPartialBytes;
+    bool framed = false;
+    QString error;
+
+    // 回收缓冲区中已消费的空间
+    void compact();
+
+    // 确保缓冲区能容纳extra字节的新数据
+    void reserveTail(qint64 extra);
+
+    // 把数据复制到消息负载，尽量复用负载已有的内存
+    void assignPayload(QByteArray &payload, const char *data, int length);
+};
+
+#endif // TCPFRAME_H
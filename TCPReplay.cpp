@@ -0,0 +1,366 @@
+#include "TCPFrame.h"
+#include "TrafficCapture.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QTcpSocket>
+#include <QTimer>
+
+// 回放工具：按捕获文件中记录的时间重新建立各连接并发送客户端当时发出的消息，
+// 连接的建立和断开与原会话同序，同时存在的连接数与原会话相同；服务端的回复只接收并计数
+// 有记录未能保存的会话（Lost记录、版本1文件中被截断的消息、未完整写出的文件中没有断开记录的会话）
+// 整个跳过，回放的结果只取决于文件中完整的会话
+class TrafficReplayer : public QObject
+{
+  public:
+    // speed为回放速度倍数，0表示不等待记录的时间间隔，尽快发送
+    TrafficReplayer(const QString &host, quint16 port, double speed)
+        : host(host), port(port), speed(speed)
+    {
+        timer.setSingleShot(true);
+        connect(&timer, &QTimer::timeout, this, [this]() { step(); });
+    }
+
+    bool open(const QString &path, QString *errorString)
+    {
+        if (!scan(path, errorString) || !reader.open(path, errorString))
+        {
+            return false;
+        }
+        hasPending = reader.next(pending);
+        return true;
+    }
+
+    void start()
+    {
+        clock.start();
+        step();
+    }
+
+  private:
+    // 所有连接尚未写出的数据超过该值时暂停回放，等数据写出后继续
+    static const qint64 HighWater = 4 * 1024 * 1024;
+
+    struct Session
+    {
+        QTcpSocket *socket = nullptr;
+        QByteArray unsent; // 连接建立之前要发送的数据
+    };
+
+    QString host;
+    quint16 port;
+    double speed;
+    TrafficCaptureReader reader;
+    TrafficCapture::Record pending;
+    bool hasPending = false;
+    QHash<quint32, Session> sessions;
+    QSet<quint32> incomplete; // 回放时跳过的会话
+    QTimer timer;
+    QElapsedTimer clock;
+    int openSockets = 0;
+    bool stepping = false;
+    bool finished = false;
+
+    // 统计
+    int sessionCount = 0;
+    int skippedCount = 0;
+    int maxConcurrent = 0;
+    quint64 messagesSent = 0;
+    quint64 bytesSent = 0;
+    quint64 bytesReceived = 0;
+    quint64 capturedReplies = 0; // 原会话中服务端发出的字节数
+
+    // 预先读一遍文件，找出不完整的会话
+    bool scan(const QString &path, QString *errorString)
+    {
+        TrafficCaptureReader scanner;
+        if (!scanner.open(path, errorString))
+        {
+            return false;
+        }
+
+        QSet<quint32> open;
+        TrafficCapture::Record record;
+        while (scanner.next(record))
+        {
+            if (record.event == TrafficCapture::Opened)
+            {
+                open.insert(record.session);
+            }
+            else if (record.event == TrafficCapture::Closed)
+            {
+                open.remove(record.session);
+            }
+            else if (record.event == TrafficCapture::Lost ||
+                     quint32(record.data.size()) != record.originalLength)
+            {
+                incomplete.insert(record.session);
+            }
+        }
+
+        // 文件没有正常结束时，尚未断开的会话之后的记录可能没有写出
+        if (!scanner.isComplete())
+        {
+            qWarning("捕获文件没有正常结束，跳过结束时仍在连接的会话");
+            incomplete.unite(open);
+        }
+        skippedCount = int(incomplete.size());
+        return true;
+    }
+
+    qint64 unwrittenBytes() const
+    {
+        qint64 bytes = 0;
+        for (const Session &session : sessions)
+        {
+            bytes += session.unsent.size() + session.socket->bytesToWrite();
+        }
+        return bytes;
+    }
+
+    void step()
+    {
+        // 写入或断开时socket可能同步发出信号，不能在回放过程中重入
+        if (stepping)
+        {
+            return;
+        }
+        stepping = true;
+
+        while (hasPending)
+        {
+            if (speed > 0)
+            {
+                qint64 wait = qint64(double(pending.timeUs) / speed / 1000) - clock.elapsed();
+                if (wait > 0)
+                {
+                    timer.start(int(qMin<qint64>(wait, 1000)));
+                    stepping = false;
+                    return;
+                }
+            }
+
+            // 数据写出后由bytesWritten信号继续回放，保持记录的顺序
+            if (unwrittenBytes() > HighWater)
+            {
+                stepping = false;
+                return;
+            }
+
+            apply(pending);
+            hasPending = reader.next(pending);
+        }
+
+        // 回放结束，断开仍在连接的会话
+        QHash<quint32, Session> remaining;
+        remaining.swap(sessions);
+        for (Session &session : remaining)
+        {
+            close(session);
+        }
+        stepping = false;
+        finishIfDone();
+    }
+
+    void resume()
+    {
+        if (hasPending && !timer.isActive())
+        {
+            step();
+        }
+    }
+
+    void apply(const TrafficCapture::Record &record)
+    {
+        if (incomplete.contains(record.session))
+        {
+            return;
+        }
+
+        switch (record.event)
+        {
+        case TrafficCapture::Opened:
+            openSession(record.session);
+            break;
+        case TrafficCapture::Inbound:
+            send(record);
+            break;
+        case TrafficCapture::Outbound:
+            capturedReplies += record.originalLength;
+            break;
+        case TrafficCapture::Closed:
+            if (sessions.contains(record.session))
+            {
+                Session session = sessions.take(record.session);
+                close(session);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void openSession(quint32 id)
+    {
+        QTcpSocket *socket = new QTcpSocket(this);
+        Session &session = sessions[id];
+        session.socket = socket;
+        sessionCount++;
+        openSockets++;
+        maxConcurrent = qMax(maxConcurrent, openSockets);
+
+        connect(socket, &QTcpSocket::connected, this, [this, id]() {
+            // 会话可能已在连接建立之前结束，此时socket已不在表中，由close()处理
+            QHash<quint32, Session>::iterator it = sessions.find(id);
+            if (it != sessions.end())
+            {
+                it->socket->write(it->unsent);
+                it->unsent.clear();
+            }
+        });
+        connect(socket, &QTcpSocket::readyRead, this,
+                [this, socket]() { bytesReceived += quint64(socket->readAll().size()); });
+        connect(socket, &QTcpSocket::bytesWritten, this, [this]() { resume(); });
+        connect(socket, &QTcpSocket::errorOccurred, this, [socket](QAbstractSocket::SocketError) {
+            if (socket->error() != QAbstractSocket::RemoteHostClosedError)
+            {
+                qWarning("%s", qPrintable(socket->errorString()));
+            }
+        });
+        // 连接失败时不会发出disconnected，统一按回到未连接状态处理
+        connect(socket, &QTcpSocket::stateChanged, this,
+                [this, socket, id](QAbstractSocket::SocketState state) {
+                    if (state != QAbstractSocket::UnconnectedState)
+                    {
+                        return;
+                    }
+                    QHash<quint32, Session>::iterator it = sessions.find(id);
+                    if (it != sessions.end() && it->socket == socket)
+                    {
+                        sessions.erase(it);
+                    }
+                    socket->deleteLater();
+                    openSockets--;
+                    resume();
+                    finishIfDone();
+                });
+        socket->connectToHost(host, port);
+    }
+
+    void send(const TrafficCapture::Record &record)
+    {
+        QHash<quint32, Session>::iterator it = sessions.find(record.session);
+        if (it == sessions.end())
+        {
+            return;
+        }
+
+        QByteArray data = record.data;
+        if (record.flags & TrafficCapture::FramedRecord)
+        {
+            data = TCPFrame::encode(record.frameType, data);
+        }
+
+        if (it->socket->state() == QAbstractSocket::ConnectedState)
+        {
+            it->socket->write(data);
+        }
+        else
+        {
+            it->unsent.append(data);
+        }
+        messagesSent++;
+        bytesSent += quint64(data.size());
+    }
+
+    void close(const Session &session)
+    {
+        QTcpSocket *socket = session.socket;
+        if (socket->state() == QAbstractSocket::ConnectedState)
+        {
+            // 写缓冲区中的数据写出后才断开
+            socket->disconnectFromHost();
+            return;
+        }
+
+        // 连接尚未建立时，建立后发送暂存的数据再断开
+        QByteArray unsent = session.unsent;
+        connect(socket, &QTcpSocket::connected, this, [socket, unsent]() {
+            socket->write(unsent);
+            socket->disconnectFromHost();
+        });
+    }
+
+    void finishIfDone()
+    {
+        if (finished || stepping || hasPending || openSockets > 0)
+        {
+            return;
+        }
+        finished = true;
+
+        double seconds = qMax<qint64>(clock.elapsed(), 1) / 1000.0;
+        qInfo("回放完成: %d 个连接（最多同时 %d 个，跳过不完整的会话 %d 个），"
+              "发送 %llu 条消息 %llu 字节，收到 %llu 字节（原会话 %llu 字节），"
+              "用时 %.3f 秒，%.1f 条/秒，%.2f MB/秒",
+              sessionCount, maxConcurrent, skippedCount, messagesSent, bytesSent, bytesReceived,
+              capturedReplies, seconds, double(messagesSent) / seconds,
+              double(bytesSent) / seconds / (1024 * 1024));
+        QCoreApplication::quit();
+    }
+};
+
+const qint64 TrafficReplayer::HighWater;
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("按捕获文件回放客户端流量");
+    parser.addHelpOption();
+    parser.addPositionalArgument("capture", "TCPServer::startCapture()写出的捕获文件");
+    QCommandLineOption hostOption("host", "服务端地址", "address", "127.0.0.1");
+    parser.addOption(hostOption);
+    QCommandLineOption portOption("port", "服务端端口", "port", "8888");
+    parser.addOption(portOption);
+    QCommandLineOption speedOption("speed", "回放速度: 1为原速，N为N倍速，max为尽快发送", "speed",
+                                   "1");
+    parser.addOption(speedOption);
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1)
+    {
+        parser.showHelp(1);
+    }
+
+    double speed = 0;
+    bool speedOk = true;
+    QString speedText = parser.value(speedOption).trimmed().toLower();
+    if (speedText != "max")
+    {
+        speed = speedText.toDouble(&speedOk);
+        speedOk = speedOk && speed > 0;
+    }
+    bool portOk = false;
+    quint16 port = parser.value(portOption).toUShort(&portOk);
+    if (!speedOk || !portOk || port == 0)
+    {
+        qWarning("参数无效");
+        return 1;
+    }
+
+    TrafficReplayer replayer(parser.value(hostOption), port, speed);
+    QString error;
+    if (!replayer.open(parser.positionalArguments().first(), &error))
+    {
+        qWarning("%s", qPrintable(error));
+        return 1;
+    }
+
+    // 在事件循环中开始，回放结束后退出
+    QTimer::singleShot(0, &replayer, [&replayer]() { replayer.start(); });
+    return app.exec();
+}
@@ -0,0 +1,201 @@
+#include "TCPRpc.h"
+#include "TCPFrame.h"
+#include <QtEndian>
+
+TCPRpc::TCPRpc(OutboundScheduler *scheduler, QObject *parent)
+    : QObject(parent), scheduler(scheduler), timeoutTimer(new QTimer(this))
+{
+    clock.start();
+    timeoutTimer->setSingleShot(true);
+    connect(timeoutTimer, &QTimer::timeout, this, &TCPRpc::onTimeout);
+}
+
+void TCPRpc::registerHandler(const QString &method, const Handler &handler)
+{
+    handlers.insert(method, handler);
+}
+
+void TCPRpc::unregisterHandler(const QString &method)
+{
+    handlers.remove(method);
+}
+
+quint32 TCPRpc::call(QTcpSocket *socket, const QString &method, const QByteArray &params,
+                     const Callback &callback, int timeoutMs)
+{
+    // RPC帧无法在旧版纯文本连接上传输
+    if (!socket || !scheduler->isFramed(socket))
+    {
+        if (callback)
+        {
+            callback(NotSupported, QByteArray());
+        }
+        return 0;
+    }
+
+    quint32 id = nextId++;
+    if (nextId == 0)
+    {
+        nextId = 1;
+    }
+
+    QByteArray methodName = method.toUtf8();
+    QByteArray payload(6, Qt::Uninitialized);
+    qToBigEndian<quint32>(id, payload.data());
+    qToBigEndian<quint16>(quint16(methodName.size()), payload.data() + 4);
+    payload.append(methodName);
+    payload.append(params);
+
+    PendingCall pending;
+    pending.callback = callback;
+    pending.socket = socket;
+    pending.deadline = clock.elapsed() + timeoutMs;
+    pendingCalls.insert(id, pending);
+    deadlines.insert(pending.deadline, id);
+    rearmTimer();
+
+    // 不等待前一个调用的响应，多个请求在同一连接上流水线发送
+    scheduler->enqueue(socket, payload, OutboundScheduler::TextClass, TCPFrame::RpcRequestFrame);
+    return id;
+}
+
+bool TCPRpc::processFrame(QTcpSocket *socket, quint8 frameType, const QByteArray &payload)
+{
+    switch (frameType)
+    {
+    case TCPFrame::RpcRequestFrame:
+        handleRequest(socket, payload);
+        return true;
+    case TCPFrame::RpcResponseFrame:
+        handleResponse(socket, payload);
+        return true;
+    default:
+        return false;
+    }
+}
+
+void TCPRpc::handleRequest(QTcpSocket *socket, const QByteArray &payload)
+{
+    if (payload.size() < 6)
+    {
+        return;
+    }
+
+    const char *data = payload.constData();
+    Request request;
+    request.id = qFromBigEndian<quint32>(data);
+    int methodLength = qFromBigEndian<quint16>(data + 4);
+    if (payload.size() < 6 + methodLength)
+    {
+        return;
+    }
+    request.method = QString::fromUtf8(data + 6, methodLength);
+    request.params = payload.mid(6 + methodLength);
+    request.socket = socket;
+
+    QHash<QString, Handler>::const_iterator handler = handlers.constFind(request.method);
+    if (handler == handlers.constEnd())
+    {
+        sendResponse(socket, request.id, MethodNotFound, QByteArray());
+        return;
+    }
+
+    // 处理函数可以稍后再调用reply，连接可能已经断开，用QPointer保护
+    QPointer<QTcpSocket> peer(socket);
+    quint32 id = request.id;
+    (*handler)(request, [this, peer, id](int status, const QByteArray &result) {
+        if (peer)
+        {
+            sendResponse(peer, id, status, result);
+        }
+    });
+}
+
+void TCPRpc::handleResponse(QTcpSocket *socket, const QByteArray &payload)
+{
+    if (payload.size() < 5)
+    {
+        return;
+    }
+
+    // 关联ID在所有连接之间共用，只接受发起调用的连接返回的响应
+    quint32 id = qFromBigEndian<quint32>(payload.constData());
+    QHash<quint32, PendingCall>::const_iterator it = pendingCalls.constFind(id);
+    if (it == pendingCalls.constEnd() || it.value().socket != socket)
+    {
+        return;
+    }
+    int status = quint8(payload.at(4));
+    finishCall(id, status, payload.mid(5));
+}
+
+void TCPRpc::sendResponse(QTcpSocket *socket, quint32 id, int status, const QByteArray &result)
+{
+    QByteArray payload(5, Qt::Uninitialized);
+    qToBigEndian<quint32>(id, payload.data());
+    payload[4] = char(status);
+    payload.append(result);
+    scheduler->enqueue(socket, payload, OutboundScheduler::TextClass, TCPFrame::RpcResponseFrame);
+}
+
+void TCPRpc::finishCall(quint32 id, int status, const QByteArray &result)
+{
+    QHash<quint32, PendingCall>::iterator it = pendingCalls.find(id);
+    if (it == pendingCalls.end())
+    {
+        // 已超时或未知的响应
+        return;
+    }
+
+    PendingCall pending = it.value();
+    pendingCalls.erase(it);
+    deadlines.remove(pending.deadline, id);
+
+    if (pending.callback)
+    {
+        pending.callback(status, result);
+    }
+}
+
+void TCPRpc::connectionClosed(QTcpSocket *socket)
+{
+    QList<quint32> ids;
+    for (QHash<quint32, PendingCall>::const_iterator it = pendingCalls.constBegin();
+         it != pendingCalls.constEnd(); ++it)
+    {
+        if (it.value().socket == socket)
+        {
+            ids.append(it.key());
+        }
+    }
+
+    for (quint32 id : ids)
+    {
+        finishCall(id, ConnectionLost, QByteArray());
+    }
+    rearmTimer();
+}
+
+void TCPRpc::onTimeout()
+{
+    qint64 now = clock.elapsed();
+    while (!deadlines.isEmpty() && deadlines.firstKey() <= now)
+    {
+        quint32 id = deadlines.first();
+        deadlines.erase(deadlines.begin());
+        finishCall(id, Timeout, QByteArray());
+    }
+    rearmTimer();
+}
+
+void TCPRpc::rearmTimer()
+{
+    if (deadlines.isEmpty())
+    {
+        timeoutTimer->stop();
+        return;
+    }
+
+    qint64 wait = qMax<qint64>(deadlines.firstKey() - clock.elapsed(), 0);
+    timeoutTimer->start(static_cast<int>(wait));
+}
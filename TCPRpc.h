@@ -0,0 +1,105 @@
+#ifndef TCPRPC_H
+#define TCPRPC_H
+
+#include "OutboundScheduler.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMultiMap>
+#include <QObject>
+#include <QPointer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <functional>
+
+// 请求/响应RPC层，基于帧格式连接
+// 每个请求带有关联ID，同一连接上可以同时有多个未完成的请求（流水线），
+// 响应可以乱序返回，每个调用有独立的超时时间
+//
+// 请求帧负载: [关联ID 4B][方法名长度 2B][方法名 UTF-8][参数]
+// 响应帧负载: [关联ID 4B][状态 1B][结果]
+class TCPRpc : public QObject
+{
+    Q_OBJECT
+
+  public:
+    // 调用状态
+    enum Status
+    {
+        Ok = 0,
+        Error = 1,          // 处理函数返回错误
+        MethodNotFound = 2, // 对端没有注册该方法
+        Timeout = 3,        // 调用超时
+        ConnectionLost = 4, // 连接断开
+        NotSupported = 5    // 连接未使用帧格式，无法发起RPC
+    };
+
+    // 收到的请求
+    struct Request
+    {
+        quint32 id = 0;
+        QString method;
+        QByteArray params;
+        QTcpSocket *socket = nullptr; // 请求来自的连接
+    };
+
+    // 调用完成回调
+    typedef std::function<void(int status, const QByteArray &result)> Callback;
+
+    // 处理函数通过reply返回结果，可以在之后异步调用
+    typedef std::function<void(int status, const QByteArray &result)> Reply;
+    typedef std::function<void(const Request &request, const Reply &reply)> Handler;
+
+    explicit TCPRpc(OutboundScheduler *scheduler, QObject *parent = nullptr);
+
+    // 注册/注销方法处理函数
+    void registerHandler(const QString &method, const Handler &handler);
+    void unregisterHandler(const QString &method);
+
+    // 在指定连接上发起调用，返回关联ID
+    quint32 call(QTcpSocket *socket, const QString &method, const QByteArray &params,
+                 const Callback &callback, int timeoutMs = 5000);
+
+    // 处理收到的RPC帧，非RPC帧返回false
+    bool processFrame(QTcpSocket *socket, quint8 frameType, const QByteArray &payload);
+
+    // 连接断开时结束该连接上所有未完成的调用
+    void connectionClosed(QTcpSocket *socket);
+
+    // 未完成的调用数
+    int pendingCount() const
+    {
+        return pendingCalls.size();
+    }
+
+  private slots:
+    void onTimeout();
+
+  private:
+    // 未完成的调用
+    struct PendingCall
+    {
+        Callback callback;
+        QTcpSocket *socket = nullptr;
+        qint64 deadline = 0;
+    };
+
+    OutboundScheduler *scheduler;
+    QHash<QString, Handler> handlers;
+    QHash<quint32, PendingCall> pendingCalls;
+    QMultiMap<qint64, quint32> deadlines; // 截止时间 -> 关联ID，按时间排序
+    QElapsedTimer clock;
+    QTimer *timeoutTimer;
+    quint32 nextId = 1;
+
+    void handleRequest(QTcpSocket *socket, const QByteArray &payload);
+    void handleResponse(QTcpSocket *socket, const QByteArray &payload);
+    void sendResponse(QTcpSocket *socket, quint32 id, int status, const QByteArray &result);
+
+    // 结束一个调用并触发回调
+    void finishCall(quint32 id, int status, const QByteArray &result);
+
+    // 根据最早的截止时间重新设置定时器
+    void rearmTimer();
+};
+
+#endif // TCPRPC_H
@@ -0,0 +1,243 @@
+#ifndef TCPSCHEMA_H
+#define TCPSCHEMA_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QtEndian>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+// 带版本的二进制消息格式，编码器和解码器在编译期由各消息类型的字段表生成
+// 消息: [标记 0xFE][消息ID 1B][版本 1B][字段...]
+// 字段按字段表顺序依次编码（大端序）：整数为固定宽度，QByteArrayView为[长度 4B][字节]
+// 版本演进只允许在末尾追加字段：旧版本消息缺少的末尾字段保持默认值，新版本消息多出的末尾字段被忽略
+// 解码得到的QByteArrayView字段直接指向被解码的缓冲区，不复制数据，使用期间缓冲区必须保持不变
+class TCPSchema
+{
+  public:
+    static constexpr quint8 Marker = 0xFE;
+    static constexpr int HeaderSize = 3;
+
+    // 消息ID
+    enum MessageId
+    {
+        FileMessageId = 1,
+        ImageMessageId = 2,
+        DeltaMessageId = 3,
+        BatchMessageId = 4
+    };
+
+    // 文件/图片消息，名称和类型为UTF-8，数据为原始字节（不再使用Base64）
+    template <quint8 MessageId> struct FileMessageT
+    {
+        static constexpr quint8 Id = MessageId;
+        static constexpr quint8 Version = 1;
+
+        QByteArrayView name;
+        quint64 size = 0;
+        QByteArrayView type;
+        QByteArrayView data;
+
+        static constexpr auto fields()
+        {
+            return std::make_tuple(&FileMessageT::name, &FileMessageT::size, &FileMessageT::type,
+                                   &FileMessageT::data);
+        }
+    };
+
+    typedef FileMessageT<FileMessageId> FileMessage;
+    typedef FileMessageT<ImageMessageId> ImageMessage;
+
+    // 增量文件消息：接收端把增量应用到同名文件的旧版本上，contentHash为结果的内容哈希，用于校验
+    struct DeltaMessage
+    {
+        static constexpr quint8 Id = DeltaMessageId;
+        static constexpr quint8 Version = 1;
+
+        QByteArrayView name;
+        quint64 size = 0;
+        QByteArrayView type;
+        QByteArrayView contentHash;
+        QByteArrayView delta;
+
+        static constexpr auto fields()
+        {
+            return std::make_tuple(&DeltaMessage::name, &DeltaMessage::size, &DeltaMessage::type,
+                                   &DeltaMessage::contentHash, &DeltaMessage::delta);
+        }
+    };
+
+    // 批量文件消息：清单为每个文件的[路径长度 2B][相对路径 UTF-8][大小 8B]，数据为各文件内容的拼接
+    // 版本2追加分段表，按清单顺序为每项记录[文件总大小 8B][本段在文件中的偏移 8B]，
+    // 大文件拆成多段分别放在连续的批次中；没有分段表时每项都是完整的文件
+    struct BatchMessage
+    {
+        static constexpr quint8 Id = BatchMessageId;
+        static constexpr quint8 Version = 2;
+
+        quint8 last = 0; // 是否是本次传输的最后一批
+        QByteArrayView manifest;
+        QByteArrayView data;
+        QByteArrayView pieces;
+
+        static constexpr auto fields()
+        {
+            return std::make_tuple(&BatchMessage::last, &BatchMessage::manifest,
+                                   &BatchMessage::data, &BatchMessage::pieces);
+        }
+    };
+
+    // 是否是本格式的消息，是时通过id返回消息ID
+    static bool peek(QByteArrayView data, quint8 &id)
+    {
+        if (data.size() < HeaderSize || quint8(data.at(0)) != Marker || quint8(data.at(2)) == 0)
+        {
+            return false;
+        }
+        id = quint8(data.at(1));
+        return true;
+    }
+
+    // 编码消息，先计算总长度，只分配一次内存
+    template <typename Message> static QByteArray encode(const Message &message)
+    {
+        qsizetype size = HeaderSize;
+        std::apply(
+            [&](auto... field) {
+                ((size += fieldSize<FieldType<Message, decltype(field)>>(message.*field)), ...);
+            },
+            Message::fields());
+
+        QByteArray out(size, Qt::Uninitialized);
+        char *cursor = out.data();
+        *cursor++ = char(Marker);
+        *cursor++ = char(Message::Id);
+        *cursor++ = char(Message::Version);
+        std::apply(
+            [&](auto... field) {
+                (writeField<FieldType<Message, decltype(field)>>(cursor, message.*field), ...);
+            },
+            Message::fields());
+        return out;
+    }
+
+    // 只编码消息头：最后一个字段为字节串时只写出其长度tailSize，内容由调用者紧接着单独发送，
+    // 例如直接发送映射的文件，大块数据不复制到消息中
+    template <typename Message>
+    static QByteArray encodeHead(const Message &message, quint32 tailSize)
+    {
+        constexpr auto fields = Message::fields();
+        constexpr auto tail = std::get<std::tuple_size_v<decltype(fields)> - 1>(fields);
+        static_assert(std::is_same_v<FieldType<Message, decltype(tail)>, QByteArrayView>,
+                      "最后一个字段必须是字节串");
+
+        Message head = message;
+        head.*tail = QByteArrayView();
+        QByteArray out = encode(head);
+        qToBigEndian<quint32>(tailSize, out.data() + out.size() - 4);
+        return out;
+    }
+
+    // 解码消息，格式错误或消息ID不符时返回false
+    template <typename Message> static bool decode(QByteArrayView data, Message &message)
+    {
+        quint8 id;
+        if (!peek(data, id) || id != Message::Id)
+        {
+            return false;
+        }
+
+        bool older = quint8(data.at(2)) < Message::Version;
+        const char *cursor = data.data() + HeaderSize;
+        const char *end = data.data() + data.size();
+        bool ok = true;
+        bool truncated = false;
+        std::apply(
+            [&](auto... field) {
+                ((ok = ok && readField(cursor, end, message.*field, older, truncated)), ...);
+            },
+            Message::fields());
+        return ok;
+    }
+
+  private:
+    template <typename Message, typename Member>
+    using FieldType = std::remove_cv_t<std::remove_reference_t<
+        decltype(std::declval<const Message &>().*std::declval<Member>())>>;
+
+    // 字段编码后的长度：整数为固定宽度，字节串为长度前缀加内容
+    template <typename T> static qsizetype fieldSize(const T &value)
+    {
+        if constexpr (std::is_same_v<T, QByteArrayView>)
+        {
+            return 4 + value.size();
+        }
+        else
+        {
+            static_assert(std::is_integral_v<T>, "不支持的字段类型");
+            return qsizetype(sizeof(T));
+        }
+    }
+
+    template <typename T> static void writeField(char *&cursor, const T &value)
+    {
+        if constexpr (std::is_same_v<T, QByteArrayView>)
+        {
+            qToBigEndian<quint32>(quint32(value.size()), cursor);
+            cursor += 4;
+            if (!value.isEmpty())
+            {
+                memcpy(cursor, value.data(), size_t(value.size()));
+            }
+            cursor += value.size();
+        }
+        else
+        {
+            qToBigEndian<T>(value, cursor);
+            cursor += sizeof(T);
+        }
+    }
+
+    // 读取一个字段，字节串字段指向原缓冲区
+    // 旧版本消息在字段边界处结束时，剩余字段保持默认值
+    template <typename T>
+    static bool readField(const char *&cursor, const char *end, T &value, bool older,
+                          bool &truncated)
+    {
+        if (truncated || (older && cursor == end))
+        {
+            truncated = true;
+            return true;
+        }
+
+        if constexpr (std::is_same_v<T, QByteArrayView>)
+        {
+            if (end - cursor < 4)
+            {
+                return false;
+            }
+            quint32 length = qFromBigEndian<quint32>(cursor);
+            cursor += 4;
+            if (quint64(end - cursor) < length)
+            {
+                return false;
+            }
+            value = QByteArrayView(cursor, qsizetype(length));
+            cursor += length;
+        }
+        else
+        {
+            if (end - cursor < qsizetype(sizeof(T)))
+            {
+                return false;
+            }
+            value = qFromBigEndian<T>(cursor);
+            cursor += sizeof(T);
+        }
+        return true;
+    }
+};
+
+#endif // TCPSCHEMA_H
@@ -1,38 +1,106 @@
 #include "TCPServer.h"
+#include "MappedFile.h"
+#include "TCPDelta.h"
+#include "TCPSchema.h"
 #include <QBuffer>
-#include <QFile>
 #include <QFileInfo>
 #include <QHostAddress>
 #include <QImage>
+#include <QPointer>
+#include <QSslServer>
+#include <QSslSocket>
 #include <QTextCodec>
+#include <QtEndian>
 
-TCPServer::TCPServer(QObject *parent) : QObject(parent), server(new QTcpServer(this))
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+TCPServer::TCPServer(QObject *parent)
+    : QObject(parent), server(new QTcpServer(this)), epollBackend(new EpollServer(this)),
+      scheduler(new OutboundScheduler(this)), rpcEndpoint(new TCPRpc(scheduler, this)),
+      payloadPool(new PayloadPool(this)), idleSweepTimer(new QTimer(this)),
+      resumeAcceptTimer(new QTimer(this))
 {
+    resumeAcceptTimer->setSingleShot(true);
+    connect(idleSweepTimer, &QTimer::timeout, this, &TCPServer::onIdleSweep);
+
+    // 调度器写出数据后继续交出批量传输的下一批
+    connect(scheduler, &OutboundScheduler::dataWritten, this,
+            [this](QTcpSocket *socket) { pumpBatches(socket); });
+
     // 连接信号和槽
     connect(server, &QTcpServer::newConnection, this, &TCPServer::onNewConnection);
+    connect(resumeAcceptTimer, &QTimer::timeout, this, &TCPServer::onResumeAcceptTimeout);
+
+    // epoll后端的连接事件直接转发为相同的信号
+    connect(epollBackend, &EpollServer::clientConnected, this, &TCPServer::clientConnected);
+    connect(epollBackend, &EpollServer::clientDisconnected, this, &TCPServer::clientDisconnected);
+    connect(epollBackend, &EpollServer::errorOccurred, this, &TCPServer::errorOccurred);
+    connect(epollBackend, &EpollServer::messageReceived, this, &TCPServer::onBackendMessage);
+
+    // 内置的应用消息类型；旧版纯文本消息按文本帧交付，仍按内容前缀区分
+    messageHandlers.setHandler(TCPFrame::TextFrame,
+                               [this](const QString &clientInfo, const QByteArray &payload) {
+                                   processMessage(clientInfo, payload);
+                               });
+    messageHandlers.setHandler(TCPFrame::FileFrame,
+                               [this](const QString &clientInfo, const QByteArray &payload) {
+                                   processFileMessage(clientInfo, payload);
+                               });
+    messageHandlers.setHandler(TCPFrame::ImageFrame,
+                               [this](const QString &clientInfo, const QByteArray &payload) {
+                                   processImageMessage(clientInfo, payload);
+                               });
 }
 
 TCPServer::~TCPServer()
 {
     stopServer();
+    stopCapture();
 }
 
 bool TCPServer::startServer(int port)
 {
-    if (server->isListening())
+    if (isRunning())
     {
         stopServer();
     }
 
-    if (server->listen(QHostAddress::Any, port))
+    createListener();
+
+    // 应用准入控制配置
+    server->setMaxPendingConnections(admission.maxPendingConnections);
+    acceptBucket.configure(admission.acceptRate,
+                           admission.acceptBurst > 0 ? admission.acceptBurst : admission.acceptRate);
+    acceptingPaused = false;
+    lastTuningError.clear();
+    mainListenerAccepted = 0;
+
+    QAbstractSocket::SocketError error;
+    QString errorString;
+    bool listening;
+    if (activeBackend == EpollBackend)
+    {
+        listening = epollBackend->start(quint16(port), tuning, server->listenBacklogSize(), &error,
+                                        &errorString);
+    }
+    else
+    {
+        listening = listenOn(port, error, errorString) && startListeners(error, errorString);
+    }
+
+    if (listening)
     {
         emit serverStarted(port);
         return true;
     }
     else
     {
+        server->close();
+
         QString errorMsg;
-        switch (server->serverError())
+        switch (error)
         {
         case QAbstractSocket::AddressInUseError:
             errorMsg = tr("端口 %1 已被占用。请尝试其他端口或等待片刻后重试。").arg(port);
@@ -41,7 +109,7 @@ bool TCPServer::startServer(int port)
             errorMsg = tr("权限不足，无法绑定端口 %1。请尝试使用大于1024的端口。").arg(port);
             break;
         default:
-            errorMsg = tr("无法启动服务器: %1").arg(server->errorString());
+            errorMsg = tr("无法启动服务器: %1").arg(errorString);
             break;
         }
 
@@ -50,176 +118,1141 @@ bool TCPServer::startServer(int port)
     }
 }
 
+bool TCPServer::listenOn(int port, QAbstractSocket::SocketError &error, QString &errorString)
+{
+    // 多个监听socket共享端口时，主监听socket也必须设置SO_REUSEPORT
+    SocketTuning::Profile profile = tuning;
+    if (extraListenerCount() > 0)
+    {
+        profile.reusePort = true;
+    }
+
+    if (!profile.needsPreBind())
+    {
+        bool listening = server->listen(QHostAddress::Any, port);
+        error = server->serverError();
+        errorString = server->errorString();
+        return listening;
+    }
+
+    qintptr descriptor = SocketTuning::createListeningSocket(
+        quint16(port), profile, server->listenBacklogSize(), &error, &errorString);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+
+    // QTcpServer接管已处于监听状态的描述符，停止时由它关闭
+    if (!server->setSocketDescriptor(descriptor))
+    {
+        error = server->serverError();
+        errorString = server->errorString();
+#ifdef Q_OS_UNIX
+        ::close(int(descriptor));
+#endif
+        return false;
+    }
+    return true;
+}
+
+bool TCPServer::startListeners(QAbstractSocket::SocketError &error, QString &errorString)
+{
+    SocketTuning::Profile profile = tuning;
+    profile.reusePort = true;
+    int cpuCount = QThread::idealThreadCount();
+
+    for (int i = 0; i < extraListenerCount(); ++i)
+    {
+        // 主监听socket在主线程中，附加监听线程从1号CPU开始依次绑定
+        int cpu = listenerAffinity && cpuCount > 0 ? (i + 1) % cpuCount : -1;
+        qintptr descriptor = SocketTuning::createListeningSocket(
+            server->serverPort(), profile, server->listenBacklogSize(), &error, &errorString);
+        if (descriptor < 0)
+        {
+            stopListeners();
+            return false;
+        }
+
+        ReusePortListener *listener = new ReusePortListener(cpu);
+        connect(listener, &ReusePortListener::descriptorAccepted, this,
+                &TCPServer::onDescriptorAccepted, Qt::QueuedConnection);
+        if (!listener->start(descriptor))
+        {
+            error = listener->serverError();
+            errorString = listener->errorString();
+            delete listener;
+#ifdef Q_OS_UNIX
+            ::close(int(descriptor));
+#endif
+            stopListeners();
+            return false;
+        }
+        listeners.append(listener);
+    }
+    return true;
+}
+
+void TCPServer::stopListeners()
+{
+    for (ReusePortListener *listener : listeners)
+    {
+        listener->stop();
+        delete listener;
+    }
+    listeners.clear();
+
+    // 已接受但尚未处理的连接直接关闭
+    while (!acceptedDescriptors.isEmpty())
+    {
+        qintptr descriptor = acceptedDescriptors.dequeue();
+#ifdef Q_OS_UNIX
+        ::close(int(descriptor));
+#else
+        Q_UNUSED(descriptor);
+#endif
+    }
+}
+
+QVector<quint64> TCPServer::acceptedPerListener() const
+{
+    QVector<quint64> counts;
+    counts.append(mainListenerAccepted);
+    for (const ReusePortListener *listener : listeners)
+    {
+        counts.append(listener->acceptedCount());
+    }
+    return counts;
+}
+
+void TCPServer::onDescriptorAccepted(qintptr descriptor)
+{
+    // 服务器已停止时监听线程可能还有在途的连接
+    if (!server->isListening())
+    {
+#ifdef Q_OS_UNIX
+        ::close(int(descriptor));
+#endif
+        return;
+    }
+
+    acceptedDescriptors.enqueue(descriptor);
+    // 暂停期间连接留在队列中，恢复时统一处理
+    if (!acceptingPaused)
+    {
+        onNewConnection();
+    }
+}
+
+QTcpSocket *TCPServer::takePendingConnection()
+{
+    if (server->hasPendingConnections())
+    {
+        mainListenerAccepted++;
+        return server->nextPendingConnection();
+    }
+
+    qintptr descriptor = acceptedDescriptors.dequeue();
+    QTcpSocket *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(descriptor))
+    {
+        delete socket;
+#ifdef Q_OS_UNIX
+        ::close(int(descriptor));
+#endif
+        return nullptr;
+    }
+    return socket;
+}
+
+void TCPServer::createListener()
+{
+    QSslServer *sslServer = qobject_cast<QSslServer *>(server);
+    if (isTlsEnabled() == (sslServer != nullptr))
+    {
+        if (sslServer)
+        {
+            sslServer->setSslConfiguration(tlsConfiguration);
+        }
+        return;
+    }
+
+    delete server;
+    if (isTlsEnabled())
+    {
+        sslServer = new QSslServer(this);
+        sslServer->setSslConfiguration(tlsConfiguration);
+
+        // QSslServer在握手完成后才把连接放入待处理队列，
+        // 因此准入检查发生在握手之后，握手开销由接受速率限制间接约束
+        connect(sslServer, &QSslServer::pendingConnectionAvailable, this,
+                &TCPServer::onNewConnection);
+        connect(sslServer, &QSslServer::errorOccurred, this,
+                [this](QSslSocket *socket, QAbstractSocket::SocketError) {
+                    emit connectionRejected(getClientInfo(socket),
+                                            tr("TLS握手失败: %1").arg(socket->errorString()));
+                });
+        server = sslServer;
+    }
+    else
+    {
+        server = new QTcpServer(this);
+        connect(server, &QTcpServer::newConnection, this, &TCPServer::onNewConnection);
+    }
+}
+
 void TCPServer::stopServer()
 {
+    if (epollBackend->isRunning())
+    {
+        epollBackend->stop();
+        emit serverStopped();
+    }
+
     if (server->isListening())
     {
         // 断开所有客户端连接
-        for (QTcpSocket *client : clients)
+        for (quint32 id = 0; id < connections.slotCount(); ++id)
         {
-            if (client->state() == QAbstractSocket::ConnectedState)
+            QTcpSocket *client = connections.socket(id);
+            if (client && client->state() == QAbstractSocket::ConnectedState)
             {
+                connections.setState(id, ConnectionTable::Closing);
                 client->disconnectFromHost();
-                if (!client->waitForDisconnected(1000))
+                if (client->state() != QAbstractSocket::UnconnectedState &&
+                    !client->waitForDisconnected(1000))
                 {
                     client->abort();
                 }
             }
         }
 
-        clients.clear();
+        for (QTcpSocket *socket : batchTransfers.keys())
+        {
+            cancelBatches(socket);
+        }
+        for (quint32 session : captureSessions)
+        {
+            capture.closeSession(session);
+        }
+        captureSessions.clear();
+        scheduler->clear();
+        for (TCPFrameReader *reader : connections.clear())
+        {
+            retireFrameReader(reader);
+        }
+        topicIndex.clear();
+        connectionsPerIp.clear();
+        resumeAcceptTimer->stop();
+        acceptingPaused = false;
+        stopListeners();
         server->close();
         emit serverStopped();
     }
 }
 
-void TCPServer::broadcastMessage(const QString &message)
+void TCPServer::broadcastMessage(const QString &message, bool urgent)
+{
+    if (!isRunning() || clientCount() == 0)
+    {
+        return;
+    }
+
+    // 根据编码设置对消息进行编码
+    broadcastData(encodeMessage(message), OutboundScheduler::TextClass);
+    if (urgent)
+    {
+        scheduler->flushNow();
+    }
+}
+
+void TCPServer::broadcastData(const QByteArray &data, OutboundScheduler::TrafficClass trafficClass,
+                              quint8 frameType)
+{
+    if (epollBackend->isRunning())
+    {
+        epollBackend->broadcast(data, frameType);
+        return;
+    }
+
+    // 编码只做一次，各连接的队列共享同一份数据
+    for (quint32 id = 0; id < connections.slotCount(); ++id)
+    {
+        if (connections.state(id) == ConnectionTable::Active)
+        {
+            scheduler->enqueue(connections.socket(id), data, trafficClass, frameType);
+        }
+    }
+}
+
+void TCPServer::sendMessageToClient(QTcpSocket *client, const QString &message, bool urgent)
+{
+    if (!server->isListening() || !client || client->state() != QAbstractSocket::ConnectedState)
+    {
+        return;
+    }
+
+    // 根据编码设置对消息进行编码
+    sendDataToClient(client, encodeMessage(message), OutboundScheduler::TextClass);
+    if (urgent)
+    {
+        scheduler->flushNow();
+    }
+}
+
+void TCPServer::sendDataToClient(QTcpSocket *client, const QByteArray &data,
+                                 OutboundScheduler::TrafficClass trafficClass, quint8 frameType)
+{
+    if (!server->isListening() || !client || client->state() != QAbstractSocket::ConnectedState)
+    {
+        return;
+    }
+
+    scheduler->enqueue(client, data, trafficClass, frameType);
+}
+
+void TCPServer::sendDataToClient(const QString &clientInfo, const QByteArray &data,
+                                 OutboundScheduler::TrafficClass trafficClass, quint8 frameType)
+{
+    if (epollBackend->isRunning())
+    {
+        epollBackend->send(clientInfo, data, frameType);
+        return;
+    }
+
+    sendDataToClient(findClientByInfo(clientInfo), data, trafficClass, frameType);
+}
+
+bool TCPServer::isFramedClient(const QString &clientInfo) const
+{
+    if (epollBackend->isRunning())
+    {
+        return epollBackend->isFramed(clientInfo);
+    }
+    return scheduler->isFramed(findClientByInfo(clientInfo));
+}
+
+quint32 TCPServer::clientCapabilities(const QString &clientInfo) const
+{
+    if (epollBackend->isRunning())
+    {
+        return epollBackend->capabilities(clientInfo);
+    }
+
+    quint32 id = connections.findByInfo(clientInfo);
+    if (id == ConnectionTable::InvalidId)
+    {
+        return 0;
+    }
+    return connections.capabilities(id) & localCapabilities();
+}
+
+bool TCPServer::startCapture(const QString &path, QString *errorString)
+{
+    stopCapture();
+
+    // 写入线程中报告的失败交回本线程处理：停止捕获，已写出的记录保留在文件中
+    capture.setFailureHandler([this](const QString &reason) {
+        QMetaObject::invokeMethod(
+            this, [this, reason]() {
+                if (capture.hasFailed())
+                {
+                    stopCapture();
+                    emit errorOccurred(reason);
+                }
+            },
+            Qt::QueuedConnection);
+    });
+    if (!capture.start(path, errorString))
+    {
+        return false;
+    }
+
+    // 出站消息在入队时记录，广播给多个客户端的消息按连接分别记录
+    scheduler->setEnqueueObserver([this](QTcpSocket *socket, quint8 frameType, bool framed,
+                                         const QByteArray &head, const QByteArray &data) {
+        capture.record(captureSession(socket), TrafficCapture::Outbound, frameType, framed, head,
+                       data);
+    });
+
+    // 已有的连接从现在开始记录
+    for (quint32 id = 0; id < connections.slotCount(); ++id)
+    {
+        if (connections.state(id) != ConnectionTable::Free)
+        {
+            captureSession(connections.socket(id));
+        }
+    }
+    return true;
+}
+
+void TCPServer::stopCapture()
+{
+    scheduler->setEnqueueObserver(nullptr);
+    capture.stop();
+    captureSessions.clear();
+}
+
+quint32 TCPServer::captureSession(QTcpSocket *socket)
+{
+    QHash<QTcpSocket *, quint32>::const_iterator it = captureSessions.constFind(socket);
+    if (it != captureSessions.constEnd())
+    {
+        return it.value();
+    }
+
+    quint32 session = capture.openSession(getClientInfo(socket));
+    captureSessions.insert(socket, session);
+    return session;
+}
+
+quint32 TCPServer::localCapabilities() const
+{
+    quint32 capabilities = TCPFrame::SchemaCapability | TCPFrame::BatchCapability;
+    if (contentCache.isEnabled())
+    {
+        capabilities |= TCPFrame::ContentCacheCapability;
+    }
+    return capabilities;
+}
+
+void TCPServer::sendMessageToClient(const QString &clientInfo, const QString &message,
+                                    bool urgent)
+{
+    if (epollBackend->isRunning())
+    {
+        epollBackend->send(clientInfo, encodeMessage(message), TCPFrame::TextFrame);
+        return;
+    }
+
+    QTcpSocket *client = findClientByInfo(clientInfo);
+    if (client)
+    {
+        sendMessageToClient(client, message, urgent);
+    }
+}
+
+quint32 TCPServer::callClient(const QString &clientInfo, const QString &method,
+                              const QByteArray &params, const TCPRpc::Callback &callback,
+                              int timeoutMs)
+{
+    return rpcEndpoint->call(findClientByInfo(clientInfo), method, params, callback, timeoutMs);
+}
+
+void TCPServer::registerRpcHandler(const QString &method, const TCPRpc::Handler &handler)
+{
+    rpcEndpoint->registerHandler(method, handler);
+}
+
+bool TCPServer::registerMessageHandler(quint8 type, const MessageHandler &handler)
+{
+    // 内置类型由服务端自己处理，不允许覆盖
+    if (type < TCPFrame::UserFrameBase)
+    {
+        return false;
+    }
+
+    messageHandlers.setHandler(type, handler);
+    return true;
+}
+
+void TCPServer::unregisterMessageHandler(quint8 type)
+{
+    if (type >= TCPFrame::UserFrameBase)
+    {
+        messageHandlers.removeHandler(type);
+    }
+}
+
+bool TCPServer::sendCustomMessage(const QString &clientInfo, quint8 type,
+                                  const QByteArray &payload,
+                                  OutboundScheduler::TrafficClass trafficClass)
+{
+    // 自定义消息依靠帧头中的类型字节区分，只能发给使用帧格式的客户端
+    if (type < TCPFrame::UserFrameBase || !isFramedClient(clientInfo))
+    {
+        return false;
+    }
+
+    sendDataToClient(clientInfo, payload, trafficClass, type);
+    return true;
+}
+
+int TCPServer::publish(const QString &topic, const QString &message)
+{
+    if (!server->isListening())
+    {
+        return 0;
+    }
+
+    // 编码一次，所有订阅者共享同一份负载
+    return fanOut(topic, TCPFrame::encodePublishPayload(topic, encodeMessage(message)));
+}
+
+int TCPServer::fanOut(const QString &topic, const QByteArray &payload)
+{
+    const QVector<quint32> &subscribers = topicIndex.subscribers(topic);
+    for (quint32 id : subscribers)
+    {
+        scheduler->enqueue(connections.socket(id), payload, OutboundScheduler::TextClass,
+                           TCPFrame::PublishFrame);
+    }
+    return subscribers.size();
+}
+
+QTcpSocket *TCPServer::findClientByInfo(const QString &clientInfo) const
+{
+    quint32 id = connections.findByInfo(clientInfo);
+    return id == ConnectionTable::InvalidId ? nullptr : connections.socket(id);
+}
+
+QList<QPair<QString, QTcpSocket *>> TCPServer::getClientList() const
+{
+    QList<QPair<QString, QTcpSocket *>> clientList;
+    for (quint32 id = 0; id < connections.slotCount(); ++id)
+    {
+        if (connections.state(id) != ConnectionTable::Free)
+        {
+            clientList.append(qMakePair(connections.info(id), connections.socket(id)));
+        }
+    }
+
+    // epoll后端的连接没有QTcpSocket对象
+    for (const QString &info : epollBackend->clients())
+    {
+        clientList.append(qMakePair(info, static_cast<QTcpSocket *>(nullptr)));
+    }
+    return clientList;
+}
+
+QByteArray TCPServer::encodeMessage(const QString &message)
+{
+    switch (sendEncoding)
+    {
+    case GBK: {
+        QTextCodec *gbkCodec = QTextCodec::codecForName("GBK");
+        if (gbkCodec)
+        {
+            return gbkCodec->fromUnicode(message);
+        }
+        // 如果没有GBK编码支持，回退到UTF-8
+        return message.toUtf8();
+    }
+    case UTF8:
+    default:
+        return message.toUtf8();
+    }
+}
+
+bool TCPServer::isRunning() const
+{
+    return server->isListening() || epollBackend->isRunning();
+}
+
+int TCPServer::clientCount() const
+{
+    return connections.size() + epollBackend->connectionCount();
+}
+
+void TCPServer::setIdleTimeout(int ms)
+{
+    idleTimeoutMs = qMax(ms, 0);
+    if (idleTimeoutMs > 0)
+    {
+        // 按超时时间的四分之一扫描，连接最多在超时后多停留这么久
+        idleSweepTimer->start(qMax(idleTimeoutMs / 4, 100));
+    }
+    else
+    {
+        idleSweepTimer->stop();
+    }
+}
+
+void TCPServer::setMaxMessageSize(qint64 bytes)
+{
+    messageSizeLimit = qBound<qint64>(1, bytes, TCPFrameReader::MaxStreamSizeLimit);
+}
+
+void TCPServer::onIdleSweep()
+{
+    // 扫描只访问状态和最后活动时间两个连续数组
+    for (quint32 id : connections.idleConnections(idleTimeoutMs))
+    {
+        connections.setState(id, ConnectionTable::Closing);
+        connections.socket(id)->disconnectFromHost();
+    }
+}
+
+void TCPServer::setAdmissionConfig(const AdmissionConfig &config)
+{
+    admission = config;
+    acceptBucket.configure(admission.acceptRate,
+                           admission.acceptBurst > 0 ? admission.acceptBurst : admission.acceptRate);
+    server->setMaxPendingConnections(admission.maxPendingConnections);
+
+    // 限制可能已放宽，重新评估是否可以继续接受连接
+    if (acceptingPaused)
+    {
+        resumeAcceptTimer->stop();
+        resumeAccepting();
+    }
+}
+
+void TCPServer::setMaxPendingConnections(int count)
+{
+    admission.maxPendingConnections = count;
+    server->setMaxPendingConnections(count);
+}
+
+bool TCPServer::admitConnection(QTcpSocket *socket)
+{
+    QString reason;
+    if (admission.maxConnections > 0 && connections.size() >= admission.maxConnections)
+    {
+        stats.rejectedMaxConnections++;
+        reason = tr("已达到最大连接数 %1").arg(admission.maxConnections);
+    }
+    else if (admission.maxConnectionsPerIp > 0 &&
+             connectionsPerIp.value(getClientAddress(socket)) >= admission.maxConnectionsPerIp)
+    {
+        stats.rejectedPerIp++;
+        reason = tr("已达到单IP连接上限 %1").arg(admission.maxConnectionsPerIp);
+    }
+    else
+    {
+        return true;
+    }
+
+    QString clientInfo = getClientInfo(socket);
+    socket->abort();
+    socket->deleteLater();
+
+    emit connectionRejected(clientInfo, reason);
+    return false;
+}
+
+void TCPServer::pauseAccepting(qint64 resumeAfterMs)
+{
+    if (!acceptingPaused)
+    {
+        server->pauseAccepting();
+        for (ReusePortListener *listener : listeners)
+        {
+            listener->pause();
+        }
+        acceptingPaused = true;
+        stats.acceptPauses++;
+    }
+
+    // 小于0表示等待客户端断开后再恢复
+    if (resumeAfterMs >= 0)
+    {
+        resumeAcceptTimer->start(static_cast<int>(qMax<qint64>(resumeAfterMs, 1)));
+    }
+}
+
+void TCPServer::resumeAccepting()
+{
+    if (!acceptingPaused || !server->isListening())
+    {
+        return;
+    }
+
+    acceptingPaused = false;
+    server->resumeAccepting();
+    for (ReusePortListener *listener : listeners)
+    {
+        listener->resume();
+    }
+
+    // 暂停期间已进入待处理队列的连接不会再次触发newConnection，需要主动处理
+    onNewConnection();
+}
+
+void TCPServer::onResumeAcceptTimeout()
+{
+    resumeAccepting();
+}
+
+void TCPServer::onNewConnection()
+{
+    while (hasPendingConnection())
+    {
+        // 接受速率受限时暂停监听，剩余连接留在待处理队列中稍后处理
+        if (!acceptBucket.tryConsume())
+        {
+            stats.rateLimited++;
+            pauseAccepting(acceptBucket.msUntilAvailable());
+            return;
+        }
+
+        QTcpSocket *clientSocket = takePendingConnection();
+        if (!clientSocket || !admitConnection(clientSocket))
+        {
+            continue;
+        }
+
+        // 客户端信息只在连接建立时计算一次
+        QString address = getClientAddress(clientSocket);
+        QString clientInfo = QString("%1:%2").arg(address).arg(clientSocket->peerPort());
+        // 调度器在加入连接时可能按写合并策略再设置TCP_NODELAY
+        // 同样的失败（如SO_BUSY_POLL缺少权限）每次启动只报告一次
+        QString tuningError;
+        if (!SocketTuning::apply(clientSocket, tuning, &tuningError) &&
+            tuningError != lastTuningError)
+        {
+            lastTuningError = tuningError;
+            emit errorOccurred(tr("客户端 %1 %2").arg(clientInfo, tuningError));
+        }
+
+        TCPFrameReader *reader = new TCPFrameReader;
+        reader->setBufferPool(&receivePool);
+        reader->setMaxStreamSize(messageSizeLimit);
+        connections.add(clientSocket, address, clientInfo, reader);
+        scheduler->addConnection(clientSocket);
+        if (capture.isRunning())
+        {
+            captureSession(clientSocket);
+        }
+        connectionsPerIp[address]++;
+        stats.accepted++;
+
+        // 连接客户端信号
+        connect(clientSocket, &QTcpSocket::disconnected, this, &TCPServer::onClientDisconnected);
+        connect(clientSocket, &QTcpSocket::readyRead, this, &TCPServer::onClientReadyRead);
+
+        emit clientConnected(clientInfo);
+    }
+
+    // 达到最大连接数时暂停监听，新连接留在内核队列中，直到有客户端断开
+    if (admission.maxConnections > 0 && connections.size() >= admission.maxConnections)
+    {
+        pauseAccepting(-1);
+    }
+}
+
+void TCPServer::onClientDisconnected()
+{
+    QTcpSocket *clientSocket = qobject_cast<QTcpSocket *>(sender());
+    if (clientSocket)
+    {
+        QString clientInfo = getClientInfo(clientSocket);
+        quint32 id = connections.idOf(clientSocket);
+        if (id != ConnectionTable::InvalidId)
+        {
+            QString address = connections.address(id);
+            if (--connectionsPerIp[address] <= 0)
+            {
+                connectionsPerIp.remove(address);
+            }
+            topicIndex.removeConnection(id);
+            retireFrameReader(connections.remove(id));
+        }
+
+        cancelBatches(clientSocket);
+        scheduler->removeConnection(clientSocket);
+        rpcEndpoint->connectionClosed(clientSocket);
+        quint32 session = captureSessions.take(clientSocket);
+        if (session != 0)
+        {
+            capture.closeSession(session);
+        }
+        clientSocket->deleteLater();
+
+        emit clientDisconnected(clientInfo);
+
+        // 因连接数已满而暂停时，有客户端断开后恢复监听
+        if (acceptingPaused && !resumeAcceptTimer->isActive())
+        {
+            resumeAccepting();
+        }
+    }
+}
+
+void TCPServer::onClientReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    quint32 id = connections.idOf(socket);
+    if (id == ConnectionTable::InvalidId)
+    {
+        return;
+    }
+
+    TCPFrameReader *reader = connections.reader(id);
+    connections.touch(id, qMax<qint64>(reader->readFrom(socket), 0));
+    if (tuning.quickAck > 0)
+    {
+        // 内核在延迟确认后会复位TCP_QUICKACK，读取后重新打开
+        SocketTuning::rearmQuickAck(socket->socketDescriptor());
+    }
+
+    // 按流ID重组分片后逐条处理，旧版纯文本数据按原方式处理
+    TCPFrameReader::Message &frame = reader->scratchMessage();
+    QByteArray acks;
+    while (reader->next(frame))
+    {
+        if (capture.isRunning())
+        {
+            capture.record(captureSession(socket), TrafficCapture::Inbound, frame.type,
+                           frame.framed, frame.payload);
+        }
+
+        if (frame.framed && !scheduler->isFramed(socket))
+        {
+            // 对端使用帧格式，之后发给它的数据也使用帧格式
+            scheduler->setFramed(socket, true);
+        }
+
+        if (frame.type == TCPFrame::SequencedFrame)
+        {
+            // 至少一次投递：处理内层消息后确认序号
+            quint64 sequence;
+            quint8 innerType;
+            QByteArray data;
+            if (TCPFrame::decodeSequencedPayload(frame.payload, sequence, innerType, data))
+            {
+                processFrame(socket, innerType, data);
+                if (!isReading(socket, id, reader))
+                {
+                    return;
+                }
+
+                // 高优先级消息可能先于之前的大消息到达，因此逐条确认而不是累计确认
+                char ackSequence[8];
+                qToBigEndian<quint64>(sequence, ackSequence);
+                acks.append(ackSequence, 8);
+            }
+            continue;
+        }
+
+        processFrame(socket, frame.type, frame.payload);
+        if (!isReading(socket, id, reader))
+        {
+            return;
+        }
+    }
+
+    // 同一批数据的确认合并到一个控制帧中发送
+    if (!acks.isEmpty())
+    {
+        acks.prepend(char(TCPFrame::AckOpcode));
+        scheduler->enqueue(socket, acks, OutboundScheduler::ControlClass, TCPFrame::ControlFrame);
+    }
+
+    // 格式错误之后的数据无法再分帧，继续读取会把帧的剩余部分当作纯文本消息，断开连接
+    // abort()会同步处理断开，读取器随连接一起删除，之后不再访问
+    if (reader->hasError())
+    {
+        QString message = tr("来自 %1 的数据格式错误: %2")
+                              .arg(getClientInfo(socket))
+                              .arg(reader->errorString());
+        socket->abort();
+        emit errorOccurred(message);
+    }
+}
+
+bool TCPServer::isReading(QTcpSocket *socket, quint32 id, TCPFrameReader *reader) const
+{
+    // 处理函数中可能断开了连接或停止了服务器，此时读取器和其中的消息已被删除
+    return connections.idOf(socket) == id && connections.reader(id) == reader;
+}
+
+void TCPServer::retireFrameReader(TCPFrameReader *reader)
+{
+    if (!reader)
+    {
+        return;
+    }
+
+    TCPFrameReader::Stats readerStats = reader->stats();
+    retiredReceiveStats.messages += readerStats.messages;
+    retiredReceiveStats.bytesRead += readerStats.bytesRead;
+    retiredReceiveStats.bufferAllocations += readerStats.bufferAllocations;
+    retiredReceiveStats.payloadAllocations += readerStats.payloadAllocations;
+    delete reader;
+}
+
+TCPFrameReader::Stats TCPServer::receiveStats() const
+{
+    TCPFrameReader::Stats total = retiredReceiveStats;
+    for (quint32 id = 0; id < connections.slotCount(); ++id)
+    {
+        if (connections.state(id) == ConnectionTable::Free)
+        {
+            continue;
+        }
+        TCPFrameReader::Stats readerStats = connections.reader(id)->stats();
+        total.messages += readerStats.messages;
+        total.bytesRead += readerStats.bytesRead;
+        total.bufferAllocations += readerStats.bufferAllocations;
+        total.payloadAllocations += readerStats.payloadAllocations;
+    }
+    return total;
+}
+
+void TCPServer::processFrame(QTcpSocket *socket, quint8 frameType, const QByteArray &payload)
+{
+    if (rpcEndpoint->processFrame(socket, frameType, payload))
+    {
+        return;
+    }
+
+    if (frameType == TCPFrame::ControlFrame)
+    {
+        processControlFrame(socket, payload);
+    }
+    else if (frameType == TCPFrame::PublishFrame)
+    {
+        // 客户端发布的消息原样转发给订阅者，无需重新编码
+        QString topic;
+        QByteArray data;
+        if (TCPFrame::decodePublishPayload(payload, topic, data))
+        {
+            emit topicMessageReceived(getClientInfo(socket), topic, tryDecodeMessage(data));
+            fanOut(topic, payload);
+        }
+    }
+    else
+    {
+        dispatchMessage(getClientInfo(socket), frameType, payload);
+    }
+}
+
+void TCPServer::processControlFrame(QTcpSocket *socket, const QByteArray &payload)
 {
-    if (!server->isListening() || clients.isEmpty())
+    if (payload.isEmpty())
     {
         return;
     }
 
-    // 根据编码设置对消息进行编码
-    QByteArray data = encodeMessage(message);
-
-    for (QTcpSocket *client : clients)
+    switch (quint8(payload.at(0)))
     {
-        if (client->state() == QAbstractSocket::ConnectedState)
+    case TCPFrame::HelloOpcode: {
+        // 记录客户端的能力和消息上限并回复本端的，客户端收到回复后才以帧格式发送
+        quint32 id = connections.idOf(socket);
+        if (id != ConnectionTable::InvalidId)
+        {
+            connections.setCapabilities(id, TCPFrame::decodeHelloPayload(payload));
+            qint64 limit = TCPFrame::decodeHelloMaxMessageSize(payload);
+            connections.setMessageLimit(id,
+                                        limit > 0 ? limit : TCPFrameReader::DefaultMaxStreamSize);
+        }
+        scheduler->setFramed(socket, true);
+        scheduler->enqueue(socket,
+                           TCPFrame::encodeHelloPayload(localCapabilities(),
+                                                        quint32(messageSizeLimit)),
+                           OutboundScheduler::ControlClass, TCPFrame::ControlFrame);
+        break;
+    }
+    case TCPFrame::SubscribeOpcode:
+        topicIndex.subscribe(QString::fromUtf8(payload.mid(1)), connections.idOf(socket));
+        break;
+    case TCPFrame::UnsubscribeOpcode:
+        topicIndex.unsubscribe(QString::fromUtf8(payload.mid(1)), connections.idOf(socket));
+        break;
+    case TCPFrame::ContentCacheOpcode: {
+        // 协商之前的客户端单独声明缓存内容
+        quint32 id = connections.idOf(socket);
+        if (id != ConnectionTable::InvalidId)
         {
-            client->write(data);
+            connections.setCapabilities(id, connections.capabilities(id) |
+                                                TCPFrame::ContentCacheCapability);
         }
+        break;
+    }
+    case TCPFrame::WantOpcode:
+    case TCPFrame::HaveOpcode:
+    case TCPFrame::SignatureOpcode:
+        processOfferReply(socket, quint8(payload.at(0)), payload);
+        break;
+    default:
+        break;
     }
 }
 
-void TCPServer::sendMessageToClient(QTcpSocket *client, const QString &message)
+void TCPServer::processOfferReply(QTcpSocket *socket, quint8 opcode, const QByteArray &payload)
 {
-    if (!server->isListening() || !client || client->state() != QAbstractSocket::ConnectedState)
+    quint32 id = connections.idOf(socket);
+    if (id == ConnectionTable::InvalidId || payload.size() < 1 + ContentCache::HashSize)
     {
         return;
     }
 
-    // 根据编码设置对消息进行编码
-    QByteArray data = encodeMessage(message);
-    client->write(data);
-}
+    // 控制帧按顺序到达，同一内容的多次提供按顺序答复；答复增量的Want/Have带有标记，
+    // 对应最早发出增量的一份，其余答复对应最早尚未答复的一份
+    QByteArray contentHash = payload.mid(1, ContentCache::HashSize);
+    bool deltaReply = opcode != TCPFrame::SignatureOpcode &&
+                      payload.size() > 1 + ContentCache::HashSize &&
+                      quint8(payload.at(1 + ContentCache::HashSize)) == TCPFrame::DeltaReplyMarker;
+    ConnectionTable::Offer::State state =
+        deltaReply ? ConnectionTable::Offer::DeltaSent : ConnectionTable::Offer::Offered;
+    QHash<QByteArray, QList<ConnectionTable::Offer>> &offers = connections.offers(id);
+    QHash<QByteArray, QList<ConnectionTable::Offer>>::iterator offer = offers.find(contentHash);
+    if (offer == offers.end())
+    {
+        return;
+    }
+    int index = 0;
+    while (index < offer->size() && offer->at(index).state != state)
+    {
+        index++;
+    }
+    if (index == offer->size())
+    {
+        return;
+    }
 
-void TCPServer::sendMessageToClient(const QString &clientInfo, const QString &message)
-{
-    QTcpSocket *client = findClientByInfo(clientInfo);
-    if (client)
+    if (opcode == TCPFrame::SignatureOpcode)
     {
-        sendMessageToClient(client, message);
+        // 完整消息保留到客户端确认还原为止；增量在线程池中计算，结果按提交顺序交回
+        (*offer)[index].state = ConnectionTable::Offer::Diffing;
+        QByteArray message = offer->at(index).message;
+        QByteArray signature = payload.mid(1 + ContentCache::HashSize);
+        QPointer<QTcpSocket> owner(socket);
+        payloadPool->submit(
+            [message, signature]() {
+                TCPSchema::FileMessage fileMessage;
+                if (!TCPSchema::decode(message, fileMessage))
+                {
+                    return QByteArray();
+                }
+                QByteArray fileData = QByteArray::fromRawData(fileMessage.data.data(),
+                                                              fileMessage.data.size());
+                return TCPDelta::diff(signature, fileData);
+            },
+            [this, owner, id, contentHash](const QByteArray &delta) {
+                if (owner && connections.idOf(owner) == id)
+                {
+                    sendDelta(owner, id, contentHash, delta);
+                }
+            });
+        return;
     }
-}
 
-QTcpSocket *TCPServer::findClientByInfo(const QString &clientInfo) const
-{
-    for (QTcpSocket *client : clients)
+    ConnectionTable::Offer entry = offer->takeAt(index);
+    if (offer->isEmpty())
+    {
+        offers.erase(offer);
+    }
+
+    if (opcode == TCPFrame::HaveOpcode)
     {
-        if (getClientInfo(client) == clientInfo)
+        // 客户端已有内容或已用增量还原出内容
+        TCPSchema::FileMessage fileMessage;
+        if (TCPSchema::decode(entry.message, fileMessage))
         {
-            return client;
+            skippedContentBytes += quint64(fileMessage.data.size() - entry.deltaBytes);
         }
+        return;
     }
-    return nullptr;
+
+    // 客户端没有内容或无法还原增量时发送完整消息
+    scheduler->enqueue(socket, entry.message, OutboundScheduler::BulkClass, TCPFrame::FileFrame);
 }
 
-QList<QPair<QString, QTcpSocket *>> TCPServer::getClientList() const
+void TCPServer::sendDelta(QTcpSocket *socket, quint32 id, const QByteArray &contentHash,
+                          const QByteArray &delta)
 {
-    QList<QPair<QString, QTcpSocket *>> clientList;
-    for (QTcpSocket *client : clients)
+    QHash<QByteArray, QList<ConnectionTable::Offer>> &offers = connections.offers(id);
+    QHash<QByteArray, QList<ConnectionTable::Offer>>::iterator offer = offers.find(contentHash);
+    if (offer == offers.end())
     {
-        clientList.append(qMakePair(getClientInfo(client), client));
+        return;
+    }
+    int index = 0;
+    while (index < offer->size() && offer->at(index).state != ConnectionTable::Offer::Diffing)
+    {
+        index++;
+    }
+    if (index == offer->size())
+    {
+        return;
     }
-    return clientList;
-}
 
-QByteArray TCPServer::encodeMessage(const QString &message)
-{
-    switch (sendEncoding)
+    TCPSchema::FileMessage fileMessage;
+    if (!TCPSchema::decode(offer->at(index).message, fileMessage))
     {
-    case GBK: {
-        QTextCodec *gbkCodec = QTextCodec::codecForName("GBK");
-        if (gbkCodec)
+        offer->removeAt(index);
+        if (offer->isEmpty())
         {
-            return gbkCodec->fromUnicode(message);
+            offers.erase(offer);
         }
-        // 如果没有GBK编码支持，回退到UTF-8
-        return message.toUtf8();
+        return;
     }
-    case UTF8:
-    default:
-        return message.toUtf8();
+
+    // 增量不比完整数据小时直接发送完整消息，不再等待客户端确认
+    if (delta.isEmpty() || delta.size() >= fileMessage.data.size())
+    {
+        QByteArray message = offer->takeAt(index).message;
+        if (offer->isEmpty())
+        {
+            offers.erase(offer);
+        }
+        scheduler->enqueue(socket, message, OutboundScheduler::BulkClass, TCPFrame::FileFrame);
+        return;
     }
-}
 
-bool TCPServer::isRunning() const
-{
-    return server->isListening();
+    (*offer)[index].state = ConnectionTable::Offer::DeltaSent;
+    (*offer)[index].deltaBytes = delta.size();
+    TCPSchema::DeltaMessage deltaMessage;
+    deltaMessage.name = fileMessage.name;
+    deltaMessage.size = fileMessage.size;
+    deltaMessage.type = fileMessage.type;
+    deltaMessage.contentHash = contentHash;
+    deltaMessage.delta = delta;
+    scheduler->enqueue(socket, TCPSchema::encode(deltaMessage), OutboundScheduler::BulkClass,
+                       TCPFrame::FileFrame);
 }
 
-int TCPServer::clientCount() const
+void TCPServer::onBackendMessage(const QString &clientInfo, quint8 frameType,
+                                 const QByteArray &payload)
 {
-    return clients.size();
+    // epoll后端只交付应用消息，与Qt后端使用同一张处理表
+    dispatchMessage(clientInfo, frameType, payload);
 }
 
-void TCPServer::onNewConnection()
+void TCPServer::dispatchMessage(const QString &clientInfo, quint8 frameType,
+                                const QByteArray &payload)
 {
-    while (server->hasPendingConnections())
+    // 该连接还有在线程池中解码的文件或图片时，排在其后处理，保持同一连接上的消息顺序
+    if (payloadPool->pendingCount(clientInfo) > 0)
     {
-        QTcpSocket *clientSocket = server->nextPendingConnection();
-        clients.append(clientSocket);
-
-        // 连接客户端信号
-        connect(clientSocket, &QTcpSocket::disconnected, this, &TCPServer::onClientDisconnected);
-        connect(clientSocket, &QTcpSocket::readyRead, this, &TCPServer::onClientReadyRead);
-
-        emit clientConnected(getClientInfo(clientSocket));
+        payloadPool->post(
+            [this, clientInfo, frameType, payload]() {
+                handleMessage(clientInfo, frameType, payload);
+            },
+            clientInfo);
+        return;
     }
+    handleMessage(clientInfo, frameType, payload);
 }
 
-void TCPServer::onClientDisconnected()
+void TCPServer::handleMessage(const QString &clientInfo, quint8 frameType,
+                              const QByteArray &payload)
 {
-    QTcpSocket *clientSocket = qobject_cast<QTcpSocket *>(sender());
-    if (clientSocket)
+    if (!messageHandlers.dispatch(frameType, clientInfo, payload))
     {
-        QString clientInfo = getClientInfo(clientSocket);
-
-        clients.removeAll(clientSocket);
-        clientSocket->deleteLater();
-
-        emit clientDisconnected(clientInfo);
+        emit errorOccurred(tr("来自 %1 的未知类型消息: %2").arg(clientInfo).arg(frameType));
     }
 }
 
-void TCPServer::onClientReadyRead()
+void TCPServer::processMessage(const QString &clientInfo, const QByteArray &data)
 {
-    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
-    if (!socket)
-    {
-        return;
-    }
-
-    QByteArray data = socket->readAll();
-    QString message = tryDecodeMessage(data);
-    QString clientInfo = getClientInfo(socket);
-
-    // 检查是否是文件或图片消息
-    if (message.startsWith("[FILE]"))
+    // 检查是否是文件或图片消息，前缀是ASCII，在原始字节上判断即可，
+    // 文件和图片消息不必把整条Base64数据解码成QString
+    if (data.startsWith("[FILE]"))
     {
         // 处理文件消息
-        processFileMessage(socket, message);
+        processFileMessage(clientInfo, data);
     }
-    else if (message.startsWith("[IMAGE]"))
+    else if (data.startsWith("[IMAGE]"))
     {
         // 处理图片消息
-        processImageMessage(socket, message);
+        processImageMessage(clientInfo, data);
     }
     else
     {
         // 处理普通文本消息
-        emit messageReceived(clientInfo, message);
+        emit messageReceived(clientInfo, tryDecodeMessage(data));
     }
 }
 
@@ -263,79 +1296,312 @@ QString TCPServer::tryDecodeMessage(const QByteArray &data)
     return QString::fromLocal8Bit(data);
 }
 
-QString TCPServer::getClientInfo(QTcpSocket *socket) const
+QString TCPServer::getClientAddress(QTcpSocket *socket) const
 {
-    QHostAddress address = socket->peerAddress();
-    QString addressStr;
+    QString address = socket->peerAddress().toString();
 
     // 检查是否是IPv4映射地址
-    if (address.toString().startsWith("::ffff:"))
+    if (address.startsWith("::ffff:"))
     {
         // 直接从字符串中提取IPv4部分
-        addressStr = address.toString().mid(7); // 去掉"::ffff:"前缀
+        return address.mid(7); // 去掉"::ffff:"前缀
     }
-    else
+    return address;
+}
+
+QString TCPServer::getClientInfo(QTcpSocket *socket) const
+{
+    // 已建立的连接直接使用缓存的客户端信息
+    quint32 id = connections.idOf(socket);
+    if (id != ConnectionTable::InvalidId)
     {
-        addressStr = address.toString();
+        return connections.info(id);
     }
-
-    return QString("%1:%2").arg(addressStr).arg(socket->peerPort());
+    return QString("%1:%2").arg(getClientAddress(socket)).arg(socket->peerPort());
 }
 
 // 文件发送方法实现 - 广播给所有客户端
 bool TCPServer::sendFile(const QString &filePath)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly))
+    // 映射文件，编码时直接从页缓存复制，不先把文件读入堆内存
+    std::shared_ptr<MappedFile> mapped = MappedFile::open(filePath);
+    if (!mapped)
+    {
+        emit errorOccurred(tr("无法打开文件: %1").arg(filePath));
+        return false;
+    }
+
+    QFileInfo fileInfo(filePath);
+    QByteArray fileData = mapped->bytes();
+
+    // 构建消息: [FILE]文件名|文件大小|文件类型|Base64数据，广播给所有客户端
+    QString header = QString("[FILE]%1|%2|%3|")
+                         .arg(fileInfo.fileName())
+                         .arg(fileData.size())
+                         .arg(fileInfo.suffix());
+    sendBase64Message(QString(), header, fileData, mapped, TCPFrame::FileFrame, filePath);
+    return true;
+}
+
+// 文件发送方法实现 - 发送给特定客户端
+bool TCPServer::sendFileToClient(const QString &clientInfo, const QString &filePath)
+{
+    if (clientSupports(clientInfo, TCPFrame::SchemaCapability))
+    {
+        if (contentCache.isEnabled())
+        {
+            return sendCachedFile(clientInfo, filePath);
+        }
+        if (!epollBackend->isRunning() && QFileInfo(filePath).size() >= MappedFile::MinMappedSize)
+        {
+            return sendMappedFile(clientInfo, filePath);
+        }
+    }
+
+    // 映射文件，编码时直接从页缓存复制，不先把文件读入堆内存
+    std::shared_ptr<MappedFile> mapped = MappedFile::open(filePath);
+    if (!mapped)
     {
         emit errorOccurred(tr("无法打开文件: %1").arg(filePath));
         return false;
     }
 
     QFileInfo fileInfo(filePath);
-    QByteArray fileData = file.readAll();
-    file.close();
+    QByteArray fileData = mapped->bytes();
 
-    // 构建消息: [FILE]文件名|文件大小|文件类型|Base64数据
-    QString message = QString("[FILE]%1|%2|%3|")
-                          .arg(fileInfo.fileName())
-                          .arg(fileData.size())
-                          .arg(fileInfo.suffix());
+    if (!clientSupports(clientInfo, TCPFrame::SchemaCapability))
+    {
+        // 构建消息: [FILE]文件名|文件大小|文件类型|Base64数据
+        QString header = QString("[FILE]%1|%2|%3|")
+                             .arg(fileInfo.fileName())
+                             .arg(fileData.size())
+                             .arg(fileInfo.suffix());
+        qint64 base64Size = (qint64(fileData.size()) + 2) / 3 * 4;
+        if (!checkMessageSize(clientInfo, encodeMessage(header).size() + base64Size, filePath))
+        {
+            return false;
+        }
+        sendBase64Message(clientInfo, header, fileData, mapped, TCPFrame::FileFrame, filePath);
+        return true;
+    }
 
-    message += QString(fileData.toBase64());
+    // 使用帧格式的客户端支持二进制消息，文件名中的'|'不影响解析，数据不再经过Base64
+    QByteArray name = fileInfo.fileName().toUtf8();
+    QByteArray type = fileInfo.suffix().toUtf8();
+    TCPSchema::FileMessage fileMessage;
+    fileMessage.name = name;
+    fileMessage.size = quint64(fileData.size());
+    fileMessage.type = type;
+    fileMessage.data = fileData;
+    QByteArray message = TCPSchema::encode(fileMessage);
+    if (!checkMessageSize(clientInfo, message.size(), filePath))
+    {
+        return false;
+    }
 
-    // 广播消息给所有客户端
-    broadcastMessage(message);
+    // 文件数据作为大块流量发送给特定客户端
+    sendDataToClient(clientInfo, message, OutboundScheduler::BulkClass, TCPFrame::FileFrame);
     return true;
 }
 
-// 文件发送方法实现 - 发送给特定客户端
-bool TCPServer::sendFileToClient(const QString &clientInfo, const QString &filePath)
+QByteArray TCPServer::prepareFile(const QString &filePath, QByteArray &contentHash)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly))
+    QFileInfo fileInfo(filePath);
+    QString path = fileInfo.absoluteFilePath();
+    QByteArray name = fileInfo.fileName().toUtf8();
+
+    // 文件未修改时直接使用缓存的消息，不再读取文件和计算哈希
+    QHash<QString, CachedFile>::const_iterator cached = cachedFiles.constFind(path);
+    if (cached != cachedFiles.constEnd() && cached->size == fileInfo.size() &&
+        cached->modified == fileInfo.lastModified())
+    {
+        QByteArray message = contentCache.find(cached->contentHash + name);
+        if (!message.isNull())
+        {
+            contentHash = cached->contentHash;
+            return message;
+        }
+    }
+
+    std::shared_ptr<MappedFile> mapped = MappedFile::open(filePath);
+    if (!mapped)
     {
         emit errorOccurred(tr("无法打开文件: %1").arg(filePath));
+        return QByteArray();
+    }
+    QByteArray fileData = mapped->bytes();
+
+    // 消息中包含文件名，缓存键为内容哈希加文件名；内容相同、名称不同的文件各自缓存
+    contentHash = ContentCache::hash(fileData);
+    QByteArray type = fileInfo.suffix().toUtf8();
+    TCPSchema::FileMessage fileMessage;
+    fileMessage.name = name;
+    fileMessage.size = quint64(fileData.size());
+    fileMessage.type = type;
+    fileMessage.data = fileData;
+    QByteArray message = TCPSchema::encode(fileMessage);
+
+    contentCache.insert(contentHash + name, message);
+    CachedFile &entry = cachedFiles[path];
+    entry.size = fileInfo.size();
+    entry.modified = fileInfo.lastModified();
+    entry.contentHash = contentHash;
+    return message;
+}
+
+bool TCPServer::sendCachedFile(const QString &clientInfo, const QString &filePath)
+{
+    QByteArray contentHash;
+    QByteArray message = prepareFile(filePath, contentHash);
+    if (message.isNull() || !checkMessageSize(clientInfo, message.size(), filePath))
+    {
+        return false;
+    }
+
+    // epoll后端和不缓存内容的客户端直接发送完整消息
+    quint32 id = connections.findByInfo(clientInfo);
+    if (id == ConnectionTable::InvalidId || connections.state(id) != ConnectionTable::Active ||
+        !clientSupports(clientInfo, TCPFrame::ContentCacheCapability))
+    {
+        sendDataToClient(clientInfo, message, OutboundScheduler::BulkClass, TCPFrame::FileFrame);
+        return true;
+    }
+
+    // 先只发送内容哈希和不含数据的消息，客户端答复WantOpcode后才发送数据
+    TCPSchema::FileMessage fileMessage;
+    TCPSchema::decode(message, fileMessage);
+    fileMessage.data = QByteArrayView();
+    QByteArray offer;
+    offer.append(char(TCPFrame::OfferOpcode));
+    offer.append(contentHash);
+    offer.append(TCPSchema::encode(fileMessage));
+
+    ConnectionTable::Offer entry;
+    entry.message = message;
+    connections.offers(id)[contentHash].append(entry);
+    scheduler->enqueue(connections.socket(id), offer, OutboundScheduler::ControlClass,
+                       TCPFrame::ControlFrame);
+    return true;
+}
+
+bool TCPServer::sendMappedFile(const QString &clientInfo, const QString &filePath)
+{
+    QTcpSocket *client = findClientByInfo(clientInfo);
+    if (!server->isListening() || !client || client->state() != QAbstractSocket::ConnectedState)
+    {
+        emit errorOccurred(tr("客户端未连接: %1").arg(clientInfo));
+        return false;
+    }
+
+    QString error;
+    std::shared_ptr<MappedFile> mapped = MappedFile::open(filePath, &error);
+    if (!mapped)
+    {
+        emit errorOccurred(error);
         return false;
     }
 
     QFileInfo fileInfo(filePath);
-    QByteArray fileData = file.readAll();
-    file.close();
+    QByteArray name = fileInfo.fileName().toUtf8();
+    QByteArray type = fileInfo.suffix().toUtf8();
+    TCPSchema::FileMessage fileMessage;
+    fileMessage.name = name;
+    fileMessage.size = quint64(mapped->size());
+    fileMessage.type = type;
+    QByteArray head = TCPSchema::encodeHead(fileMessage, quint32(mapped->size()));
+
+    // 数据长度字段只有32位，客户端的上限远小于4GiB，先检查上限，超过上限的文件不会被截断发送
+    if (!checkMessageSize(clientInfo, head.size() + mapped->size(), filePath))
+    {
+        return false;
+    }
+
+    // 文件数据直接引用映射区，调度器写出最后一个分片后才解除映射
+    scheduler->enqueue(client, head, mapped->bytes(), mapped, OutboundScheduler::BulkClass,
+                       TCPFrame::FileFrame);
+    return true;
+}
+
+bool TCPServer::checkMessageSize(const QString &clientInfo, qint64 messageSize,
+                                 const QString &filePath)
+{
+    // epoll后端的连接和没有声明上限的客户端按默认上限检查
+    quint32 id = connections.findByInfo(clientInfo);
+    qint64 limit = id != ConnectionTable::InvalidId ? connections.messageLimit(id)
+                                                    : TCPFrameReader::DefaultMaxStreamSize;
+    if (messageSize <= limit)
+    {
+        return true;
+    }
+
+    emit errorOccurred(tr("文件 %1 超过客户端 %2 接受的消息上限（%3 MiB），请使用批量发送")
+                           .arg(QFileInfo(filePath).fileName(), clientInfo)
+                           .arg(limit / (1024 * 1024)));
+    return false;
+}
 
-    // 构建消息: [FILE]文件名|文件大小|文件类型|Base64数据
-    QString message = QString("[FILE]%1|%2|%3|")
-                          .arg(fileInfo.fileName())
-                          .arg(fileData.size())
-                          .arg(fileInfo.suffix());
+bool TCPServer::sendFilesToClient(const QString &clientInfo, const QStringList &paths)
+{
+    // 批量消息是二进制格式，并且按调度队列的长度控制读取进度，只支持Qt后端中协商了批量传输的客户端
+    QTcpSocket *client = epollBackend->isRunning() ? nullptr : findClientByInfo(clientInfo);
+    if (!client || !clientSupports(clientInfo, TCPFrame::BatchCapability))
+    {
+        emit errorOccurred(tr("客户端不支持批量发送文件: %1").arg(clientInfo));
+        return false;
+    }
 
-    message += QString(fileData.toBase64());
+    FileBatchReader *reader = new FileBatchReader(this);
+    QString error;
+    if (!reader->start(paths, &error))
+    {
+        delete reader;
+        emit errorOccurred(error);
+        return false;
+    }
 
-    // 发送消息给特定客户端
-    sendMessageToClient(clientInfo, message);
+    connect(reader, &FileBatchReader::batchReady, this, [this, client]() { pumpBatches(client); });
+    connect(reader, &FileBatchReader::errorOccurred, this, &TCPServer::errorOccurred);
+    batchTransfers[client].enqueue(reader);
     return true;
 }
 
+void TCPServer::pumpBatches(QTcpSocket *socket)
+{
+    QHash<QTcpSocket *, QQueue<FileBatchReader *>>::iterator transfers =
+        batchTransfers.find(socket);
+    while (transfers != batchTransfers.end() &&
+           scheduler->queuedBytes(socket) < FileBatch::MaxBatchBytes)
+    {
+        FileBatchReader *reader = transfers->head();
+        QByteArray payload;
+        if (!reader->takeNext(payload))
+        {
+            return;
+        }
+
+        sendDataToClient(socket, payload, OutboundScheduler::BulkClass, TCPFrame::FileFrame);
+        if (reader->atEnd())
+        {
+            transfers->dequeue();
+            reader->deleteLater();
+            if (transfers->isEmpty())
+            {
+                batchTransfers.erase(transfers);
+                return;
+            }
+        }
+    }
+}
+
+void TCPServer::cancelBatches(QTcpSocket *socket)
+{
+    for (FileBatchReader *reader : batchTransfers.take(socket))
+    {
+        // 线程池中尚未完成的读取结束后自行丢弃
+        delete reader;
+    }
+}
+
 // 图片发送方法实现 - 广播给所有客户端
 bool TCPServer::sendImage(const QString &imagePath)
 {
@@ -354,14 +1620,10 @@ bool TCPServer::sendImage(const QString &imagePath)
     // 保存为PNG格式
     image.save(&buffer, "PNG");
 
-    // 构建消息: [IMAGE]图片名|图片大小|图片类型|Base64数据
-    QString message =
+    // 构建消息: [IMAGE]图片名|图片大小|图片类型|Base64数据，广播给所有客户端
+    QString header =
         QString("[IMAGE]%1|%2|%3|").arg(fileInfo.fileName()).arg(imageData.size()).arg("PNG");
-
-    message += QString(imageData.toBase64());
-
-    // 广播消息给所有客户端
-    broadcastMessage(message);
+    sendBase64Message(QString(), header, imageData, nullptr, TCPFrame::ImageFrame, imagePath);
     return true;
 }
 
@@ -383,59 +1645,190 @@ bool TCPServer::sendImageToClient(const QString &clientInfo, const QString &imag
     // 保存为PNG格式
     image.save(&buffer, "PNG");
 
-    // 构建消息: [IMAGE]图片名|图片大小|图片类型|Base64数据
-    QString message =
-        QString("[IMAGE]%1|%2|%3|").arg(fileInfo.fileName()).arg(imageData.size()).arg("PNG");
+    if (!clientSupports(clientInfo, TCPFrame::SchemaCapability))
+    {
+        // 构建消息: [IMAGE]图片名|图片大小|图片类型|Base64数据
+        QString header =
+            QString("[IMAGE]%1|%2|%3|").arg(fileInfo.fileName()).arg(imageData.size()).arg("PNG");
+        sendBase64Message(clientInfo, header, imageData, nullptr, TCPFrame::ImageFrame,
+                          imagePath);
+        return true;
+    }
 
-    message += QString(imageData.toBase64());
+    QByteArray name = fileInfo.fileName().toUtf8();
+    TCPSchema::ImageMessage imageMessage;
+    imageMessage.name = name;
+    imageMessage.size = quint64(imageData.size());
+    imageMessage.type = "PNG";
+    imageMessage.data = imageData;
 
-    // 发送消息给特定客户端
-    sendMessageToClient(clientInfo, message);
+    // 图片数据作为大块流量发送给特定客户端
+    sendDataToClient(clientInfo, TCPSchema::encode(imageMessage), OutboundScheduler::BulkClass,
+                     TCPFrame::ImageFrame);
     return true;
 }
 
+void TCPServer::sendBase64Message(const QString &clientInfo, const QString &header,
+                                  const QByteArray &data, const std::shared_ptr<const void> &owner,
+                                  quint8 frameType, const QString &filePath)
+{
+    // 消息头在当前线程按发送编码转换；Base64只含ASCII字符，编码后直接拼接，不再经过编码转换
+    QByteArray prefix = encodeMessage(header);
+    payloadPool->submit(
+        [prefix, data, owner]() { return PayloadPool::toBase64(data, prefix); },
+        [this, clientInfo, frameType, filePath](const QByteArray &payload) {
+            // 作为大块流量发送，不阻塞其他消息
+            if (!clientInfo.isEmpty())
+            {
+                sendDataToClient(clientInfo, payload, OutboundScheduler::BulkClass, frameType);
+            }
+            else if (isRunning())
+            {
+                broadcastFile(payload, frameType, filePath);
+            }
+        });
+}
+
+void TCPServer::broadcastFile(const QByteArray &message, quint8 frameType, const QString &filePath)
+{
+    // 各客户端声明的消息上限不同，逐个检查，超过上限的客户端不发送
+    if (epollBackend->isRunning())
+    {
+        for (const QString &info : epollBackend->clients())
+        {
+            if (checkMessageSize(info, message.size(), filePath))
+            {
+                epollBackend->send(info, message, frameType);
+            }
+        }
+        return;
+    }
+
+    for (quint32 id = 0; id < connections.slotCount(); ++id)
+    {
+        if (connections.state(id) == ConnectionTable::Active &&
+            checkMessageSize(connections.info(id), message.size(), filePath))
+        {
+            scheduler->enqueue(connections.socket(id), message, OutboundScheduler::BulkClass,
+                               frameType);
+        }
+    }
+}
+
 // 添加文件消息处理方法
-void TCPServer::processFileMessage(QTcpSocket *socket, const QString &message)
+void TCPServer::processFileMessage(const QString &clientInfo, const QByteArray &data)
 {
-    // 解析文件消息: [FILE]文件名|文件大小|文件类型|Base64数据
-    QString content = message.mid(6); // 去掉 [FILE] 前缀
-    QStringList parts = content.split("|", Qt::KeepEmptyParts);
+    quint8 schemaId;
+    if (TCPSchema::peek(data, schemaId))
+    {
+        processSchemaMessage(clientInfo, data, schemaId);
+        return;
+    }
 
-    if (parts.size() < 4)
+    // 解析文件消息: [FILE]文件名|文件大小|文件类型|Base64数据
+    TCPFrame::FileMessageFields fields;
+    if (!TCPFrame::parseFileMessage(data, 6, fields))
     {
         emit errorOccurred("收到的文件消息格式错误");
         return;
     }
 
-    QString fileName = parts[0];
-    qint64 fileSize = parts[1].toLongLong();
-    QString fileType = parts[2];
-    QString base64Data = parts[3];
-
-    // 发出文件接收信号
-    emit fileReceived(getClientInfo(socket), fileName, fileSize, fileType,
-                      QByteArray::fromBase64(base64Data.toLatin1()));
+    // Base64数据直接从原始消息解码，不产生中间副本；解码在线程池中进行，
+    // 以连接为顺序组，与该连接上之后的消息按接收顺序发出信号
+    QString name = tryDecodeMessage(fields.name);
+    QString type = tryDecodeMessage(fields.type);
+    qint64 size = fields.size;
+    int offset = fields.dataOffset;
+    payloadPool->submit(
+        [data, offset]() {
+            return PayloadPool::fromBase64(
+                QByteArray::fromRawData(data.constData() + offset, data.size() - offset));
+        },
+        [this, clientInfo, name, size, type](const QByteArray &fileData) {
+            emit fileReceived(clientInfo, name, size, type, fileData);
+        },
+        clientInfo);
 }
 
 // 添加图片消息处理方法
-void TCPServer::processImageMessage(QTcpSocket *socket, const QString &message)
+void TCPServer::processImageMessage(const QString &clientInfo, const QByteArray &data)
 {
-    // 解析图片消息: [IMAGE]图片名|图片大小|图片类型|Base64数据
-    QString content = message.mid(7); // 去掉 [IMAGE] 前缀
-    QStringList parts = content.split("|", Qt::KeepEmptyParts);
+    quint8 schemaId;
+    if (TCPSchema::peek(data, schemaId))
+    {
+        processSchemaMessage(clientInfo, data, schemaId);
+        return;
+    }
 
-    if (parts.size() < 4)
+    // 解析图片消息: [IMAGE]图片名|图片大小|图片类型|Base64数据
+    TCPFrame::FileMessageFields fields;
+    if (!TCPFrame::parseFileMessage(data, 7, fields))
     {
         emit errorOccurred("收到的图片消息格式错误");
         return;
     }
 
-    QString imageName = parts[0];
-    qint64 imageSize = parts[1].toLongLong();
-    QString imageType = parts[2];
-    QString base64Data = parts[3];
+    QString name = tryDecodeMessage(fields.name);
+    QString type = tryDecodeMessage(fields.type);
+    qint64 size = fields.size;
+    int offset = fields.dataOffset;
+    payloadPool->submit(
+        [data, offset]() {
+            return PayloadPool::fromBase64(
+                QByteArray::fromRawData(data.constData() + offset, data.size() - offset));
+        },
+        [this, clientInfo, name, size, type](const QByteArray &imageData) {
+            emit imageReceived(clientInfo, name, size, type, imageData);
+        },
+        clientInfo);
+}
+
+void TCPServer::processSchemaMessage(const QString &clientInfo, const QByteArray &data, quint8 id)
+{
+    // 解码得到的字段直接指向data，只在发出信号时复制一次
+    if (id == TCPSchema::FileMessageId)
+    {
+        TCPSchema::FileMessage message;
+        if (!TCPSchema::decode(data, message))
+        {
+            emit errorOccurred("收到的文件消息格式错误");
+            return;
+        }
+        emit fileReceived(clientInfo, tryDecodeMessage(message.name.toByteArray()),
+                          qint64(message.size), tryDecodeMessage(message.type.toByteArray()),
+                          message.data.toByteArray());
+    }
+    else if (id == TCPSchema::ImageMessageId)
+    {
+        TCPSchema::ImageMessage message;
+        if (!TCPSchema::decode(data, message))
+        {
+            emit errorOccurred("收到的图片消息格式错误");
+            return;
+        }
+        emit imageReceived(clientInfo, tryDecodeMessage(message.name.toByteArray()),
+                           qint64(message.size), tryDecodeMessage(message.type.toByteArray()),
+                           message.data.toByteArray());
+    }
+    else if (id == TCPSchema::BatchMessageId)
+    {
+        if (batchDirectory.isEmpty())
+        {
+            emit errorOccurred(tr("未设置接收目录，拒绝来自 %1 的批量文件").arg(clientInfo));
+            return;
+        }
 
-    // 发出图片接收信号
-    emit imageReceived(getClientInfo(socket), imageName, imageSize, imageType,
-                       QByteArray::fromBase64(base64Data.toLatin1()));
-}
\ No newline at end of file
+        // 出错时已保存的文件仍然报告
+        FileBatch::Result result;
+        QString error;
+        if (!FileBatch::save(data, batchDirectory, result, &error))
+        {
+            emit errorOccurred(error);
+        }
+        emit filesReceived(clientInfo, result.paths, result.bytes, result.last);
+    }
+    else
+    {
+        emit errorOccurred(tr("收到未知类型的消息: %1").arg(id));
+    }
+}
@@ -1,12 +1,33 @@
 #ifndef TCPSERVER_H
 #define TCPSERVER_H
 
+#include "BufferPool.h"
+#include "ConnectionTable.h"
+#include "ContentCache.h"
+#include "EpollServer.h"
+#include "FileBatch.h"
+#include "MessageDispatcher.h"
+#include "OutboundScheduler.h"
+#include "PayloadPool.h"
+#include "ReusePortListener.h"
+#include "SocketTuning.h"
+#include "TCPFrame.h"
+#include "TCPRpc.h"
+#include "TokenBucket.h"
+#include "TopicIndex.h"
+#include "TrafficCapture.h"
+#include <QDateTime>
+#include <QHash>
 #include <QList>
 #include <QObject>
 #include <QPair>
+#include <QQueue>
+#include <QSslConfiguration>
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QTextCodec>
+#include <QTimer>
+#include <QVector>
 
 class TCPServer : public QObject
 {
@@ -29,6 +50,33 @@ class TCPServer : public QObject
         ImageMessage
     };
 
+    // 服务端后端
+    enum Backend
+    {
+        QtBackend,   // 每个连接一个QTcpSocket，支持全部功能
+        EpollBackend // 基于epoll边沿触发，只支持文本、文件和图片消息，仅Linux可用
+    };
+
+    // 连接准入控制配置，各项为0表示不限制
+    struct AdmissionConfig
+    {
+        int maxConnections = 0;         // 最大并发连接数
+        int maxConnectionsPerIp = 0;    // 单个IP的最大连接数
+        double acceptRate = 0;          // 每秒允许接受的新连接数（令牌桶速率）
+        int acceptBurst = 0;            // 允许的突发连接数（令牌桶容量）
+        int maxPendingConnections = 30; // QTcpServer待处理连接队列长度
+    };
+
+    // 连接准入统计
+    struct AdmissionStats
+    {
+        quint64 accepted = 0;               // 已接受的连接
+        quint64 rejectedMaxConnections = 0; // 因超过最大连接数被拒绝
+        quint64 rejectedPerIp = 0;          // 因超过单IP连接数被拒绝
+        quint64 rateLimited = 0;            // 因接受速率受限而延后处理的次数
+        quint64 acceptPauses = 0;           // 暂停监听的次数
+    };
+
     explicit TCPServer(QObject *parent = nullptr);
     ~TCPServer();
 
@@ -38,12 +86,13 @@ class TCPServer : public QObject
     // 停止服务器
     void stopServer();
 
-    // 发送消息给所有客户端
-    void broadcastMessage(const QString &message);
+    // 发送消息给所有客户端，urgent为true时不等待写合并窗口立即写出
+    void broadcastMessage(const QString &message, bool urgent = false);
 
     // 发送消息给特定客户端
-    void sendMessageToClient(QTcpSocket *client, const QString &message);
-    void sendMessageToClient(const QString &clientInfo, const QString &message);
+    void sendMessageToClient(QTcpSocket *client, const QString &message, bool urgent = false);
+    void sendMessageToClient(const QString &clientInfo, const QString &message,
+                             bool urgent = false);
 
     // 获取服务器状态
     bool isRunning() const;
@@ -66,10 +115,227 @@ class TCPServer : public QObject
         receiveEncoding = encoding;
     }
 
+    // 设置连接准入控制，服务器运行时也可调整
+    void setAdmissionConfig(const AdmissionConfig &config);
+    AdmissionConfig admissionConfig() const
+    {
+        return admission;
+    }
+
+    // 设置TLS配置（见TCPTls::serverConfiguration），空配置表示不加密，下次启动时生效
+    void setTlsConfiguration(const QSslConfiguration &config)
+    {
+        tlsConfiguration = config;
+    }
+
+    bool isTlsEnabled() const
+    {
+        return !tlsConfiguration.isNull();
+    }
+
+    // 设置服务端后端，下次启动时生效，两种后端发出相同的信号
+    void setBackend(Backend backend)
+    {
+        activeBackend = backend;
+    }
+
+    Backend backend() const
+    {
+        return activeBackend;
+    }
+
+    // epoll后端的统计
+    EpollServer::Stats epollStats() const
+    {
+        return epollBackend->stats();
+    }
+
+    // 设置socket调优配置，对之后接受的连接生效，监听相关的选项在下次启动时生效
+    void setSocketProfile(const SocketTuning::Profile &profile)
+    {
+        tuning = profile;
+    }
+
+    SocketTuning::Profile socketProfile() const
+    {
+        return tuning;
+    }
+
+    // 设置监听socket数，大于1时各附加监听socket运行在自己的线程中，
+    // 通过SO_REUSEPORT共享端口，由内核分配新连接，连接建立后仍在主线程中处理
+    // 启用TLS时只使用一个监听socket；下次启动时生效
+    void setListenerCount(int count)
+    {
+        listenerTarget = qMax(count, 1);
+    }
+
+    int listenerCount() const
+    {
+        return listenerTarget;
+    }
+
+    // 设置是否把附加监听线程依次绑定到各CPU上，下次启动时生效
+    void setListenerAffinity(bool enabled)
+    {
+        listenerAffinity = enabled;
+    }
+
+    // 各监听socket已接受的连接数，第一个为主监听socket
+    QVector<quint64> acceptedPerListener() const;
+
+    // 设置待处理连接队列长度
+    void setMaxPendingConnections(int count);
+
+    // 获取准入统计
+    AdmissionStats admissionStats() const
+    {
+        return stats;
+    }
+
+    // 当前是否因压力暂停了接受新连接
+    bool isAcceptingPaused() const
+    {
+        return acceptingPaused;
+    }
+
+    // 设置空闲超时，超过该时间没有收到数据的连接会被断开，0表示不检查
+    void setIdleTimeout(int ms);
+    int idleTimeout() const
+    {
+        return idleTimeoutMs;
+    }
+
+    // 当前连接收到的总字节数
+    quint64 totalBytesReceived() const
+    {
+        return connections.totalBytesReceived();
+    }
+
+    // 接收路径统计（包含已断开的连接），只统计读取和分帧；
+    // messageReceived发出的文本每条消息仍新建一个QString，不在统计范围内
+    TCPFrameReader::Stats receiveStats() const;
+
+    // 接收缓冲区池统计
+    BufferPool::Stats receiveBufferStats() const
+    {
+        return receivePool.stats();
+    }
+
+    // 设置本端接受的单条消息上限（不超过TCPFrameReader::MaxStreamSizeLimit），
+    // 对之后建立的连接生效，并在Hello中声明给客户端；
+    // 向客户端发送文件前按客户端声明的上限检查，超过时报错而不发送
+    void setMaxMessageSize(qint64 bytes);
+    qint64 maxMessageSize() const
+    {
+        return messageSizeLimit;
+    }
+
+    // 获取出站调度器，用于设置限速和权重
+    OutboundScheduler *outboundScheduler() const
+    {
+        return scheduler;
+    }
+
+    // 向指定客户端发起RPC调用（客户端需使用帧格式），返回关联ID
+    quint32 callClient(const QString &clientInfo, const QString &method, const QByteArray &params,
+                       const TCPRpc::Callback &callback, int timeoutMs = 5000);
+
+    // 注册供客户端调用的RPC方法
+    void registerRpcHandler(const QString &method, const TCPRpc::Handler &handler);
+
+    // 自定义消息的处理函数
+    typedef std::function<void(const QString &clientInfo, const QByteArray &payload)>
+        MessageHandler;
+
+    // 注册自定义消息类型的处理函数，type必须不小于TCPFrame::UserFrameBase
+    // 收到的消息按帧头中的类型字节直接交给处理函数，负载不做任何解码
+    bool registerMessageHandler(quint8 type, const MessageHandler &handler);
+    void unregisterMessageHandler(quint8 type);
+
+    // 向使用帧格式的客户端发送自定义类型的消息
+    bool sendCustomMessage(const QString &clientInfo, quint8 type, const QByteArray &payload,
+                           OutboundScheduler::TrafficClass trafficClass =
+                               OutboundScheduler::TextClass);
+
+    // 获取RPC层
+    TCPRpc *rpc() const
+    {
+        return rpcEndpoint;
+    }
+
+    // 向订阅了主题的客户端发布消息，消息只编码一次，返回订阅者数量
+    int publish(const QString &topic, const QString &message);
+
+    // 获取主题的订阅者数量
+    int subscriberCount(const QString &topic) const
+    {
+        return topicIndex.subscribers(topic).size();
+    }
+
     // 发送文件方法
+    // 发给使用帧格式的客户端时，编码后的文件消息按内容缓存，同一文件只读取和编码一次；
+    // 客户端也缓存内容时先只发送内容哈希，客户端没有该内容才发送数据，
+    // 客户端有同名文件的旧版本时只发送变化的部分
     bool sendFile(const QString &filePath);
     bool sendFileToClient(const QString &clientInfo, const QString &filePath);
 
+    // 文件内容缓存的内存预算（字节），为0时不缓存
+    void setContentCacheBudget(qint64 bytes)
+    {
+        contentCache.setBudget(bytes);
+    }
+
+    qint64 contentCacheBudget() const
+    {
+        return contentCache.budget();
+    }
+
+    // 文件内容缓存统计
+    ContentCache::Stats contentCacheStats() const
+    {
+        return contentCache.stats();
+    }
+
+    // 因客户端已有内容（或旧版本）而省去发送的字节数
+    quint64 contentBytesSkipped() const
+    {
+        return skippedContentBytes;
+    }
+
+    // 与客户端协商得到的能力（TCPFrame::Capability），旧版纯文本客户端为0
+    quint32 clientCapabilities(const QString &clientInfo) const;
+
+    // 流量捕获：把各连接收发的消息连同时间戳写入path，可以用TCPReplay回放（仅Qt后端）
+    // 记录经由无锁环形缓冲区交给写入线程，收发路径上只多一次内存复制
+    bool startCapture(const QString &path, QString *errorString = nullptr);
+    void stopCapture();
+
+    bool isCapturing() const
+    {
+        return capture.isRunning();
+    }
+
+    TrafficCapture::Stats captureStats() const
+    {
+        return capture.stats();
+    }
+
+    // 批量发送文件和目录（仅Qt后端、使用帧格式的客户端），目录递归发送并保留相对路径
+    // 小文件打包为批量消息，在线程池中提前读取；发给同一客户端的多次传输依次进行
+    bool sendFilesToClient(const QString &clientInfo, const QStringList &paths);
+
+    // 批量接收的文件保存在该目录下；默认不设置，此时拒绝对方发来的批量文件
+    // 不覆盖目录中已存在的文件，也不经由符号链接写入
+    void setReceiveDirectory(const QString &directory)
+    {
+        batchDirectory = directory;
+    }
+
+    QString receiveDirectory() const
+    {
+        return batchDirectory;
+    }
+
     // 发送图片方法
     bool sendImage(const QString &imagePath);
     bool sendImageToClient(const QString &clientInfo, const QString &imagePath);
@@ -89,6 +355,13 @@ class TCPServer : public QObject
     // 错误信号
     void errorOccurred(const QString &errorMessage);
 
+    // 收到客户端发布的主题消息信号
+    void topicMessageReceived(const QString &clientInfo, const QString &topic,
+                              const QString &message);
+
+    // 连接被准入控制拒绝信号
+    void connectionRejected(const QString &clientInfo, const QString &reason);
+
     // 文件接收信号
     void fileReceived(const QString &clientInfo, const QString &fileName, qint64 fileSize,
                       const QString &fileType, const QByteArray &fileData);
@@ -97,22 +370,106 @@ class TCPServer : public QObject
     void imageReceived(const QString &clientInfo, const QString &imageName, qint64 imageSize,
                        const QString &imageType, const QByteArray &imageData);
 
+    // 批量接收的一批文件已保存，paths为保存的路径，finished表示本次传输已结束
+    void filesReceived(const QString &clientInfo, const QStringList &paths, qint64 totalBytes,
+                       bool finished);
+
   private slots:
     // 服务端相关槽函数
     void onNewConnection();
     void onClientDisconnected();
     void onClientReadyRead();
+    void onResumeAcceptTimeout();
+    void onIdleSweep();
+    void onDescriptorAccepted(qintptr descriptor);
+    void onBackendMessage(const QString &clientInfo, quint8 frameType, const QByteArray &payload);
 
   private:
+    // 已读取过的文件，大小和修改时间不变时认为内容未变
+    struct CachedFile
+    {
+        qint64 size = 0;
+        QDateTime modified;
+        QByteArray contentHash;
+    };
+
     // 服务端相关
-    QTcpServer *server;
-    QList<QTcpSocket *> clients;
+    QTcpServer *server; // 启用TLS时为QSslServer
+    EpollServer *epollBackend;
+    Backend activeBackend = QtBackend;
+    QSslConfiguration tlsConfiguration;
+    SocketTuning::Profile tuning; // 对监听socket和接受的连接应用的调优配置
+    QString lastTuningError;      // 最近报告过的调优失败，避免每个连接重复报告
+    QVector<ReusePortListener *> listeners; // 附加监听socket
+    QQueue<qintptr> acceptedDescriptors;    // 附加监听socket接受、尚未处理的连接
+    quint64 mainListenerAccepted = 0;
+    int listenerTarget = 1;
+    bool listenerAffinity = false;
+    ConnectionTable connections; // 按连续连接ID索引的连接状态，ID断开后回收复用
     EncodingType sendEncoding = GBK;     // 默认使用GBK编码发送
     EncodingType receiveEncoding = AUTO; // 默认自动检测接收编码
+    OutboundScheduler *scheduler;        // 所有出站数据都经由调度器发送
+    BufferPool receivePool;                    // 各连接共享的接收缓冲区池
+    TCPFrameReader::Stats retiredReceiveStats; // 已断开连接的接收统计
+    TCPRpc *rpcEndpoint;                       // 请求/响应RPC层
+    MessageDispatcher<const QString &> messageHandlers; // 按帧类型分派应用消息
+    TopicIndex topicIndex;                     // 按连接ID记录订阅关系
+    ContentCache contentCache; // 按内容哈希和文件名索引已编码的文件消息
+    QHash<QString, CachedFile> cachedFiles; // 按路径记录文件的内容哈希，文件未修改时不再读取
+    quint64 skippedContentBytes = 0;
+    QHash<QTcpSocket *, QQueue<FileBatchReader *>> batchTransfers; // 各连接等待发送的批量传输
+    QString batchDirectory; // 批量接收的文件的保存目录，为空时不接收
+    TrafficCapture capture;
+    QHash<QTcpSocket *, quint32> captureSessions; // 各连接在捕获文件中的会话ID
+    PayloadPool *payloadPool; // 在工作线程中进行Base64编解码
+    QTimer *idleSweepTimer;
+    int idleTimeoutMs = 0;
+    qint64 messageSizeLimit = TCPFrameReader::DefaultMaxStreamSize;
+
+    // 准入控制相关
+    AdmissionConfig admission;
+    AdmissionStats stats;
+    TokenBucket acceptBucket;
+    QHash<QString, int> connectionsPerIp; // 每个IP当前的连接数
+    QTimer *resumeAcceptTimer;            // 速率受限时用于恢复监听
+    bool acceptingPaused = false;
+
+    // 按是否启用TLS创建监听对象
+    void createListener();
+
+    // 开始监听，调优配置需要在bind之前设置选项时自行创建监听socket
+    bool listenOn(int port, QAbstractSocket::SocketError &error, QString &errorString);
+
+    // 实际启动的附加监听socket数
+    int extraListenerCount() const
+    {
+        return isTlsEnabled() ? 0 : listenerTarget - 1;
+    }
+
+    // 启动/停止附加监听socket
+    bool startListeners(QAbstractSocket::SocketError &error, QString &errorString);
+    void stopListeners();
+
+    // 取出下一个待处理连接，主监听socket的队列优先
+    bool hasPendingConnection() const
+    {
+        return server->hasPendingConnections() || !acceptedDescriptors.isEmpty();
+    }
+    QTcpSocket *takePendingConnection();
 
     // 获取客户端信息
     QString getClientInfo(QTcpSocket *socket) const;
 
+    // 获取客户端地址（不含端口）
+    QString getClientAddress(QTcpSocket *socket) const;
+
+    // 对待处理连接执行准入检查，返回false表示应拒绝
+    bool admitConnection(QTcpSocket *socket);
+
+    // 暂停/恢复接受新连接
+    void pauseAccepting(qint64 resumeAfterMs);
+    void resumeAccepting();
+
     // 根据客户端信息查找对应的socket
     QTcpSocket *findClientByInfo(const QString &clientInfo) const;
 
@@ -122,11 +479,95 @@ class TCPServer : public QObject
     // 根据设置的编码类型对消息进行编码
     QByteArray encodeMessage(const QString &message);
 
+    // 将已编码的数据交给调度器发送
+    void broadcastData(const QByteArray &data, OutboundScheduler::TrafficClass trafficClass,
+                       quint8 frameType = TCPFrame::TextFrame);
+    void sendDataToClient(QTcpSocket *client, const QByteArray &data,
+                          OutboundScheduler::TrafficClass trafficClass,
+                          quint8 frameType = TCPFrame::TextFrame);
+    void sendDataToClient(const QString &clientInfo, const QByteArray &data,
+                          OutboundScheduler::TrafficClass trafficClass,
+                          quint8 frameType = TCPFrame::TextFrame);
+
+    // 客户端是否使用帧格式
+    bool isFramedClient(const QString &clientInfo) const;
+
+    // 本端在Hello中声明的能力
+    quint32 localCapabilities() const;
+
+    // 客户端是否支持capability，支持二进制消息时文件和图片不再经过Base64
+    bool clientSupports(const QString &clientInfo, quint32 capability) const
+    {
+        return (clientCapabilities(clientInfo) & capability) == capability;
+    }
+
+    // 取得编码后的文件消息，文件未修改且仍在缓存中时不再读取；失败时返回空
+    QByteArray prepareFile(const QString &filePath, QByteArray &contentHash);
+
+    // 经由内容缓存发送文件
+    bool sendCachedFile(const QString &clientInfo, const QString &filePath);
+
+    // 映射文件后直接发送，文件数据不读入内存也不复制到消息中（仅Qt后端）
+    bool sendMappedFile(const QString &clientInfo, const QString &filePath);
+
+    // 消息不超过客户端声明的上限时返回true，否则报告错误并返回false
+    bool checkMessageSize(const QString &clientInfo, qint64 messageSize, const QString &filePath);
+
+    // 在线程池中把数据编码为Base64后拼接在消息头之后发送，clientInfo为空时广播
+    // owner在编码完成前保持data引用的内存有效，filePath用于报告超过上限的错误
+    void sendBase64Message(const QString &clientInfo, const QString &header,
+                           const QByteArray &data, const std::shared_ptr<const void> &owner,
+                           quint8 frameType, const QString &filePath);
+
+    // 广播文件或图片消息，只发给消息上限不小于消息长度的客户端
+    void broadcastFile(const QByteArray &message, quint8 frameType, const QString &filePath);
+
+    // 连接的调度队列较短时交出下一批文件
+    void pumpBatches(QTcpSocket *socket);
+
+    // 放弃连接上尚未发送完的批量传输
+    void cancelBatches(QTcpSocket *socket);
+
+    // 连接在捕获文件中的会话ID，第一次记录时分配
+    quint32 captureSession(QTcpSocket *socket);
+
+    // 处理客户端对提供内容的答复
+    void processOfferReply(QTcpSocket *socket, quint8 opcode, const QByteArray &payload);
+
+    // 增量计算完成后发送增量，增量不比完整数据小时发送完整消息
+    void sendDelta(QTcpSocket *socket, quint32 id, const QByteArray &contentHash,
+                   const QByteArray &delta);
+
+    // 处理一条完整的应用消息（文本、文件或图片）
+    void processMessage(const QString &clientInfo, const QByteArray &data);
+
+    // 按帧类型分发一条完整的帧
+    void processFrame(QTcpSocket *socket, quint8 frameType, const QByteArray &payload);
+
+    // 按帧类型查表处理应用消息，同一连接上还有未完成的异步解码时排在其后
+    void dispatchMessage(const QString &clientInfo, quint8 frameType, const QByteArray &payload);
+    void handleMessage(const QString &clientInfo, quint8 frameType, const QByteArray &payload);
+
+    // 处理控制帧
+    void processControlFrame(QTcpSocket *socket, const QByteArray &payload);
+
+    // 读取循环中处理一条消息后，连接是否仍在使用同一个读取器
+    bool isReading(QTcpSocket *socket, quint32 id, TCPFrameReader *reader) const;
+
+    // 删除帧读取器，缓冲区归还到池中
+    void retireFrameReader(TCPFrameReader *reader);
+
+    // 将已编码的发布帧负载发给主题的所有订阅者
+    int fanOut(const QString &topic, const QByteArray &payload);
+
     // 文件消息处理方法
-    void processFileMessage(QTcpSocket *socket, const QString &message);
+    void processFileMessage(const QString &clientInfo, const QByteArray &data);
 
     // 图片消息处理方法
-    void processImageMessage(QTcpSocket *socket, const QString &message);
+    void processImageMessage(const QString &clientInfo, const QByteArray &data);
+
+    // 二进制格式的文件/图片消息处理方法
+    void processSchemaMessage(const QString &clientInfo, const QByteArray &data, quint8 id);
 };
 
 #endif // TCPSERVER_H
\ No newline at end of file
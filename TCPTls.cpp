@@ -0,0 +1,152 @@
+#include "TCPTls.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QSslCertificate>
+#include <QSslCipher>
+#include <QSslKey>
+
+const int TCPTls::MaxCachedSessions;
+QMutex TCPTls::cacheMutex;
+QHash<QString, QByteArray> TCPTls::tickets;
+QList<QString> TCPTls::insertionOrder;
+
+static void setError(QString *errorString, const QString &message)
+{
+    if (errorString)
+    {
+        *errorString = message;
+    }
+}
+
+bool TCPTls::applyCiphers(QSslConfiguration &config, const QString &ciphers,
+                          QString *errorString)
+{
+    if (ciphers.isEmpty())
+    {
+        return true;
+    }
+
+    config.setCiphers(ciphers);
+    if (config.ciphers().isEmpty())
+    {
+        setError(errorString, QString("没有可用的密码套件: %1").arg(ciphers));
+        return false;
+    }
+    return true;
+}
+
+QSslConfiguration TCPTls::serverConfiguration(const QString &certificatePath,
+                                              const QString &keyPath, const QString &ciphers,
+                                              QString *errorString)
+{
+    QList<QSslCertificate> chain = QSslCertificate::fromPath(certificatePath, QSsl::Pem);
+    if (chain.isEmpty())
+    {
+        setError(errorString, QString("无法读取证书: %1").arg(certificatePath));
+        return QSslConfiguration();
+    }
+
+    QFile keyFile(keyPath);
+    if (!keyFile.open(QIODevice::ReadOnly))
+    {
+        setError(errorString, QString("无法打开私钥文件: %1").arg(keyPath));
+        return QSslConfiguration();
+    }
+
+    // 私钥可能是RSA或EC
+    QByteArray keyData = keyFile.readAll();
+    QSslKey key(keyData, QSsl::Rsa, QSsl::Pem);
+    if (key.isNull())
+    {
+        key = QSslKey(keyData, QSsl::Ec, QSsl::Pem);
+    }
+    if (key.isNull())
+    {
+        setError(errorString, QString("无法读取私钥: %1").arg(keyPath));
+        return QSslConfiguration();
+    }
+
+    QSslConfiguration config = QSslConfiguration::defaultConfiguration();
+    config.setLocalCertificateChain(chain);
+    config.setPrivateKey(key);
+    config.setPeerVerifyMode(QSslSocket::VerifyNone);
+    config.setProtocol(QSsl::TlsV1_2OrLater);
+    // 服务端签发会话票据，客户端重连时可以恢复会话
+    config.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+
+    if (!applyCiphers(config, ciphers, errorString))
+    {
+        return QSslConfiguration();
+    }
+    return config;
+}
+
+QSslConfiguration TCPTls::clientConfiguration(const QString &caCertificatePath,
+                                              const QString &ciphers, QString *errorString)
+{
+    QSslConfiguration config = QSslConfiguration::defaultConfiguration();
+    config.setProtocol(QSsl::TlsV1_2OrLater);
+
+    if (!caCertificatePath.isEmpty())
+    {
+        QList<QSslCertificate> certificates =
+            QSslCertificate::fromPath(caCertificatePath, QSsl::Pem);
+        if (certificates.isEmpty())
+        {
+            setError(errorString, QString("无法读取CA证书: %1").arg(caCertificatePath));
+            return QSslConfiguration();
+        }
+        config.setCaCertificates(certificates);
+    }
+
+    // 允许导出会话票据，握手后存入缓存
+    config.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+
+    if (!applyCiphers(config, ciphers, errorString))
+    {
+        return QSslConfiguration();
+    }
+    return config;
+}
+
+QByteArray TCPTls::sessionTicket(const QString &peer)
+{
+    QMutexLocker locker(&cacheMutex);
+    return tickets.value(peer);
+}
+
+void TCPTls::storeSessionTicket(const QString &peer, const QByteArray &ticket)
+{
+    if (ticket.isEmpty())
+    {
+        return;
+    }
+
+    QMutexLocker locker(&cacheMutex);
+    if (!tickets.contains(peer))
+    {
+        insertionOrder.append(peer);
+        if (insertionOrder.size() > MaxCachedSessions)
+        {
+            tickets.remove(insertionOrder.takeFirst());
+        }
+    }
+    tickets.insert(peer, ticket);
+}
+
+void TCPTls::removeSessionTicket(const QString &peer)
+{
+    QMutexLocker locker(&cacheMutex);
+    if (tickets.remove(peer))
+    {
+        insertionOrder.removeOne(peer);
+    }
+}
+
+void TCPTls::clearSessionTickets()
+{
+    QMutexLocker locker(&cacheMutex);
+    tickets.clear();
+    insertionOrder.clear();
+}
@@ -0,0 +1,48 @@
+#ifndef TCPTLS_H
+#define TCPTLS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSslConfiguration>
+#include <QString>
+
+// TLS辅助函数：生成服务端/客户端配置，并缓存会话票据
+// 客户端重连时携带上次的会话票据，服务端可走简化握手，避免重连风暴时大量完整握手
+class TCPTls
+{
+  public:
+    // 从PEM格式的证书和私钥文件生成服务端配置
+    // ciphers为OpenSSL格式的密码套件列表（冒号分隔），为空时使用默认列表
+    // 失败时返回空配置并通过errorString返回原因
+    static QSslConfiguration serverConfiguration(const QString &certificatePath,
+                                                 const QString &keyPath,
+                                                 const QString &ciphers = QString(),
+                                                 QString *errorString = nullptr);
+
+    // 生成客户端配置，caCertificatePath为空时使用系统CA证书
+    // 配置允许导出会话票据，供会话缓存使用
+    static QSslConfiguration clientConfiguration(const QString &caCertificatePath = QString(),
+                                                 const QString &ciphers = QString(),
+                                                 QString *errorString = nullptr);
+
+    // 会话票据缓存，按"地址:端口"区分服务端，所有客户端共享
+    static QByteArray sessionTicket(const QString &peer);
+    static void storeSessionTicket(const QString &peer, const QByteArray &ticket);
+    static void removeSessionTicket(const QString &peer);
+    static void clearSessionTickets();
+
+    // 缓存的服务端数上限，超出时淘汰最早加入的
+    static const int MaxCachedSessions = 256;
+
+  private:
+    static QMutex cacheMutex;
+    static QHash<QString, QByteArray> tickets;
+    static QList<QString> insertionOrder;
+
+    static bool applyCiphers(QSslConfiguration &config, const QString &ciphers,
+                             QString *errorString);
+};
+
+#endif // TCPTLS_H
@@ -0,0 +1,67 @@
+#include "TokenBucket.h"
+#include <QtMath>
+
+TokenBucket::TokenBucket(double rate, double burst)
+{
+    configure(rate, burst);
+}
+
+void TokenBucket::configure(double rate, double burst)
+{
+    ratePerSecond = rate;
+    // 容量至少为1，否则速率大于0时永远无法消耗令牌
+    capacity = qMax(burst, 1.0);
+    tokens = capacity;
+    clock.start();
+    lastRefillNs = 0;
+}
+
+void TokenBucket::refill()
+{
+    qint64 now = clock.nsecsElapsed();
+    double elapsedSeconds = (now - lastRefillNs) / 1e9;
+    lastRefillNs = now;
+    tokens = qMin(capacity, tokens + elapsedSeconds * ratePerSecond);
+}
+
+bool TokenBucket::tryConsume(double count)
+{
+    if (isUnlimited())
+    {
+        return true;
+    }
+
+    refill();
+    if (tokens >= count)
+    {
+        tokens -= count;
+        return true;
+    }
+    return false;
+}
+
+qint64 TokenBucket::msUntilAvailable(double count)
+{
+    if (isUnlimited())
+    {
+        return 0;
+    }
+
+    refill();
+    if (tokens >= count)
+    {
+        return 0;
+    }
+    return static_cast<qint64>(qCeil((count - tokens) * 1000.0 / ratePerSecond));
+}
+
+double TokenBucket::available()
+{
+    if (isUnlimited())
+    {
+        return capacity;
+    }
+
+    refill();
+    return tokens;
+}
@@ -0,0 +1,43 @@
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include <QElapsedTimer>
+#include <QtGlobal>
+
+// 令牌桶：按固定速率补充令牌，桶容量决定允许的突发量
+class TokenBucket
+{
+  public:
+    // rate为每秒补充的令牌数，burst为桶容量；rate <= 0 表示不限速
+    explicit TokenBucket(double rate = 0, double burst = 0);
+
+    // 重新设置速率和容量，桶会被重新填满
+    void configure(double rate, double burst);
+
+    // 尝试消耗令牌，成功返回true
+    bool tryConsume(double count = 1);
+
+    // 距离可以消耗指定数量令牌还需等待的毫秒数
+    qint64 msUntilAvailable(double count = 1);
+
+    // 当前可用令牌数
+    double available();
+
+    // 是否不限速
+    bool isUnlimited() const
+    {
+        return ratePerSecond <= 0;
+    }
+
+  private:
+    double ratePerSecond;
+    double capacity;
+    double tokens;
+    qint64 lastRefillNs = 0;
+    QElapsedTimer clock;
+
+    // 根据流逝的时间补充令牌
+    void refill();
+};
+
+#endif // TOKENBUCKET_H
@@ -0,0 +1,140 @@
+#include "TopicIndex.h"
+#include <algorithm>
+
+bool TopicIndex::insertSorted(QVector<quint32> &values, quint32 value)
+{
+    QVector<quint32>::iterator it = std::lower_bound(values.begin(), values.end(), value);
+    if (it != values.end() && *it == value)
+    {
+        return false;
+    }
+    values.insert(it, value);
+    return true;
+}
+
+bool TopicIndex::removeSorted(QVector<quint32> &values, quint32 value)
+{
+    QVector<quint32>::iterator it = std::lower_bound(values.begin(), values.end(), value);
+    if (it == values.end() || *it != value)
+    {
+        return false;
+    }
+    values.erase(it);
+    return true;
+}
+
+bool TopicIndex::subscribe(const QString &topic, quint32 connectionId)
+{
+    quint32 topicId;
+    QHash<QString, quint32>::const_iterator found = topicIds.constFind(topic);
+    if (found != topicIds.constEnd())
+    {
+        topicId = found.value();
+    }
+    else if (!freeTopicIds.isEmpty())
+    {
+        topicId = freeTopicIds.takeLast();
+        topicIds.insert(topic, topicId);
+        topicNames[topicId] = topic;
+    }
+    else
+    {
+        topicId = quint32(subscribersByTopic.size());
+        topicIds.insert(topic, topicId);
+        topicNames.append(topic);
+        subscribersByTopic.append(QVector<quint32>());
+    }
+
+    if (!insertSorted(subscribersByTopic[topicId], connectionId))
+    {
+        return false;
+    }
+
+    if (int(connectionId) >= topicsByConnection.size())
+    {
+        topicsByConnection.resize(connectionId + 1);
+    }
+    insertSorted(topicsByConnection[connectionId], topicId);
+    return true;
+}
+
+bool TopicIndex::unsubscribe(const QString &topic, quint32 connectionId)
+{
+    QHash<QString, quint32>::const_iterator found = topicIds.constFind(topic);
+    if (found == topicIds.constEnd())
+    {
+        return false;
+    }
+
+    quint32 topicId = found.value();
+    if (!removeSorted(subscribersByTopic[topicId], connectionId))
+    {
+        return false;
+    }
+
+    if (int(connectionId) < topicsByConnection.size())
+    {
+        removeSorted(topicsByConnection[connectionId], topicId);
+    }
+    releaseIfEmpty(topicId);
+    return true;
+}
+
+void TopicIndex::removeConnection(quint32 connectionId)
+{
+    if (int(connectionId) >= topicsByConnection.size())
+    {
+        return;
+    }
+
+    // 连接ID会被复用，必须清空反向索引
+    QVector<quint32> topics;
+    topics.swap(topicsByConnection[connectionId]);
+    for (quint32 topicId : topics)
+    {
+        removeSorted(subscribersByTopic[topicId], connectionId);
+        releaseIfEmpty(topicId);
+    }
+}
+
+void TopicIndex::releaseIfEmpty(quint32 topicId)
+{
+    // 主题名由客户端决定，不删除空主题时主题表会随客户端用过的主题名无限增长
+    if (!subscribersByTopic.at(topicId).isEmpty())
+    {
+        return;
+    }
+
+    topicIds.remove(topicNames.at(topicId));
+    topicNames[topicId] = QString();
+    subscribersByTopic[topicId] = QVector<quint32>();
+    freeTopicIds.append(topicId);
+}
+
+const QVector<quint32> &TopicIndex::subscribers(const QString &topic) const
+{
+    QHash<QString, quint32>::const_iterator found = topicIds.constFind(topic);
+    if (found == topicIds.constEnd())
+    {
+        return emptySubscribers;
+    }
+    return subscribersByTopic.at(found.value());
+}
+
+int TopicIndex::subscriptionCount(quint32 connectionId) const
+{
+    if (int(connectionId) >= topicsByConnection.size())
+    {
+        return 0;
+    }
+    return topicsByConnection.at(connectionId).size();
+}
+
+void TopicIndex::clear()
+{
+    topicIds.clear();
+    topicNames.clear();
+    subscribersByTopic.clear();
+    topicsByConnection.clear();
+    freeTopicIds.clear();
+}
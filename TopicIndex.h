@@ -0,0 +1,52 @@
+#ifndef TOPICINDEX_H
+#define TOPICINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// 主题订阅索引：主题 -> 订阅者集合
+// 主题名被映射为连续的主题ID，订阅者集合是按连接ID排序的紧凑数组，
+// 同时维护连接 -> 主题的反向索引，连接断开时无需扫描所有主题；
+// 主题的最后一个订阅者离开时删除主题，主题ID留给之后的新主题复用
+class TopicIndex
+{
+  public:
+    // 订阅/取消订阅，状态发生变化时返回true
+    bool subscribe(const QString &topic, quint32 connectionId);
+    bool unsubscribe(const QString &topic, quint32 connectionId);
+
+    // 移除连接的所有订阅
+    void removeConnection(quint32 connectionId);
+
+    // 获取主题的订阅者（按连接ID升序），主题不存在时返回空数组
+    const QVector<quint32> &subscribers(const QString &topic) const;
+
+    // 连接订阅的主题数
+    int subscriptionCount(quint32 connectionId) const;
+
+    // 主题数
+    int topicCount() const
+    {
+        return topicIds.size();
+    }
+
+    void clear();
+
+  private:
+    QHash<QString, quint32> topicIds;             // 主题名 -> 主题ID
+    QVector<QString> topicNames;                  // 主题ID -> 主题名，删除主题时使用
+    QVector<QVector<quint32>> subscribersByTopic; // 主题ID -> 有序的连接ID
+    QVector<QVector<quint32>> topicsByConnection; // 连接ID -> 有序的主题ID
+    QVector<quint32> freeTopicIds;                // 已删除主题的ID
+    QVector<quint32> emptySubscribers;
+
+    // 主题没有订阅者时删除主题并回收ID
+    void releaseIfEmpty(quint32 topicId);
+
+    // 在有序数组中插入/删除，已存在或不存在时返回false
+    static bool insertSorted(QVector<quint32> &values, quint32 value);
+    static bool removeSorted(QVector<quint32> &values, quint32 value);
+};
+
+#endif // TOPICINDEX_H
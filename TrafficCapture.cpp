@@ -0,0 +1,318 @@
+#include "TrafficCapture.h"
+#include <QDateTime>
+#include <QtEndian>
+#include <cstring>
+
+const int TrafficCapture::FileHeaderSize;
+const int TrafficCapture::RecordHeaderSize;
+const quint16 TrafficCapture::Version;
+const qint64 TrafficCapture::DefaultRingSize;
+const int TrafficCapture::IdleSleepMs;
+
+static const char Magic[4] = {'T', 'C', 'A', 'P'};
+
+static void setError(QString *errorString, const QString &message)
+{
+    if (errorString)
+    {
+        *errorString = message;
+    }
+}
+
+// 按文件格式填写记录头
+static void encodeRecordHeader(char *header, qint64 timeUs, quint32 session, quint8 event,
+                               quint8 frameType, quint8 flags, qint64 originalLength,
+                               qint64 length)
+{
+    qToBigEndian<qint64>(timeUs, header);
+    qToBigEndian<quint32>(session, header + 8);
+    header[12] = char(event);
+    header[13] = char(frameType);
+    header[14] = char(flags);
+    qToBigEndian<quint32>(quint32(qMin<qint64>(originalLength, 0xFFFFFFFF)), header + 15);
+    qToBigEndian<quint32>(quint32(length), header + 19);
+}
+
+TrafficCapture::TrafficCapture(qint64 ringSize)
+    : writePos(0), readPos(0), stopping(0), failed(0)
+{
+    qint64 size = 4096;
+    while (size < ringSize)
+    {
+        size *= 2;
+    }
+    ring = new char[size_t(size)];
+    ringMask = size - 1;
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    stop();
+    delete[] ring;
+}
+
+bool TrafficCapture::start(const QString &path, QString *errorString)
+{
+    stop();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+    {
+        setError(errorString, QString("无法创建捕获文件: %1").arg(path));
+        return false;
+    }
+
+    char header[FileHeaderSize];
+    memcpy(header, Magic, sizeof(Magic));
+    qToBigEndian<quint16>(Version, header + 4);
+    qToBigEndian<quint16>(0, header + 6);
+    qToBigEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), header + 8);
+    if (file.write(header, FileHeaderSize) != FileHeaderSize)
+    {
+        setError(errorString, QString("无法写入捕获文件: %1").arg(path));
+        file.close();
+        return false;
+    }
+
+    writePos.storeRelaxed(0);
+    readPos.storeRelaxed(0);
+    stopping.storeRelaxed(0);
+    failed.storeRelaxed(0);
+    nextSession = 1;
+    statistics = Stats();
+    lostSessions.clear();
+    clock.start();
+
+    writer = QThread::create([this]() { drain(); });
+    writer->start();
+    return true;
+}
+
+void TrafficCapture::stop()
+{
+    if (!writer)
+    {
+        return;
+    }
+
+    stopping.storeRelease(1);
+    writer->wait();
+    delete writer;
+    writer = nullptr;
+
+    // 写入线程已退出，剩余的Lost记录直接写入文件，全部写出后才标记文件完整
+    if (!hasFailed())
+    {
+        bool ok = true;
+        for (quint32 session : std::as_const(lostSessions))
+        {
+            char header[RecordHeaderSize];
+            encodeRecordHeader(header, clock.nsecsElapsed() / 1000, session, Lost, 0, 0, 0, 0);
+            ok = ok && file.write(header, RecordHeaderSize) == RecordHeaderSize;
+        }
+
+        char flags[2];
+        qToBigEndian<quint16>(CompleteFile, flags);
+        if (ok && file.seek(6))
+        {
+            file.write(flags, 2);
+        }
+    }
+    lostSessions.clear();
+    file.close();
+}
+
+quint32 TrafficCapture::openSession(const QString &info)
+{
+    quint32 session = nextSession++;
+    QByteArray name = info.toUtf8();
+    record(session, Opened, 0, false, name);
+    return session;
+}
+
+void TrafficCapture::closeSession(quint32 session)
+{
+    record(session, Closed, 0, false, QByteArrayView());
+}
+
+void TrafficCapture::record(quint32 session, Event event, quint8 frameType, bool framed,
+                            QByteArrayView head, QByteArrayView data)
+{
+    if (!writer || hasFailed())
+    {
+        return;
+    }
+
+    // 先补写之前因缓冲区已满而未能写入的Lost记录，保证它们最终出现在文件中
+    if (!lostSessions.isEmpty())
+    {
+        flushLost();
+    }
+
+    // 单条记录最多占缓冲区的1/4，更大的消息不保存，只记录丢失，回放时不会发出不完整的数据
+    qint64 originalLength = head.size() + data.size();
+    if (originalLength > (ringMask + 1) / 4 - RecordHeaderSize)
+    {
+        statistics.oversized++;
+        if (!append(session, Lost, frameType, 0, originalLength, {}, {}))
+        {
+            lostSessions.insert(session);
+        }
+        return;
+    }
+
+    quint8 flags = framed ? FramedRecord : 0;
+    if (!append(session, event, frameType, flags, originalLength, head, data))
+    {
+        statistics.dropped++;
+        lostSessions.insert(session);
+    }
+}
+
+bool TrafficCapture::append(quint32 session, Event event, quint8 frameType, quint8 flags,
+                            qint64 originalLength, QByteArrayView head, QByteArrayView data)
+{
+    qint64 length = event == Lost ? 0 : head.size() + data.size();
+    qint64 needed = RecordHeaderSize + length;
+
+    // 只有本线程修改writePos；写入线程在写出后才推进readPos
+    quint64 position = writePos.loadRelaxed();
+    if (qint64(position - readPos.loadAcquire()) + needed > ringMask + 1)
+    {
+        return false;
+    }
+
+    char header[RecordHeaderSize];
+    encodeRecordHeader(header, clock.nsecsElapsed() / 1000, session, quint8(event), frameType,
+                       flags, originalLength, length);
+
+    copyIn(position, header, RecordHeaderSize);
+    if (length > 0)
+    {
+        copyIn(position + RecordHeaderSize, head.data(), head.size());
+        copyIn(position + RecordHeaderSize + quint64(head.size()), data.data(), data.size());
+    }
+    writePos.storeRelease(position + quint64(needed));
+
+    statistics.records++;
+    statistics.bytes += quint64(needed);
+    return true;
+}
+
+void TrafficCapture::flushLost()
+{
+    QSet<quint32>::iterator it = lostSessions.begin();
+    while (it != lostSessions.end())
+    {
+        if (!append(*it, Lost, 0, 0, 0, {}, {}))
+        {
+            return;
+        }
+        it = lostSessions.erase(it);
+    }
+}
+
+void TrafficCapture::copyIn(quint64 position, const char *data, qint64 length)
+{
+    if (length <= 0)
+    {
+        return;
+    }
+
+    // 跨越缓冲区末尾时分两段复制
+    qint64 offset = qint64(position & quint64(ringMask));
+    qint64 first = qMin(length, ringMask + 1 - offset);
+    memcpy(ring + offset, data, size_t(first));
+    if (first < length)
+    {
+        memcpy(ring, data + first, size_t(length - first));
+    }
+}
+
+void TrafficCapture::drain()
+{
+    quint64 position = readPos.loadRelaxed();
+    for (;;)
+    {
+        // 先读停止标志再读写入位置，停止之前写入的记录都能写出
+        bool finishing = stopping.loadAcquire() != 0;
+        quint64 end = writePos.loadAcquire();
+        if (end == position)
+        {
+            if (finishing)
+            {
+                break;
+            }
+            QThread::msleep(IdleSleepMs);
+            continue;
+        }
+
+        // 一次写出所有可用的数据，跨越缓冲区末尾时分两次写
+        while (position != end)
+        {
+            qint64 offset = qint64(position & quint64(ringMask));
+            qint64 length = qMin(qint64(end - position), ringMask + 1 - offset);
+            if (file.write(ring + offset, length) != length)
+            {
+                // 之后的记录不再写入，生产者看到失败标志后停止记录
+                QString reason = QString("无法写入捕获文件: %1").arg(file.errorString());
+                failed.storeRelease(1);
+                if (failureHandler)
+                {
+                    failureHandler(reason);
+                }
+                return;
+            }
+            position += quint64(length);
+        }
+        readPos.storeRelease(position);
+    }
+}
+
+bool TrafficCaptureReader::open(const QString &path, QString *errorString)
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        setError(errorString, QString("无法打开捕获文件: %1").arg(path));
+        return false;
+    }
+
+    // 也接受版本1的文件，其中的标志字段为保留的0
+    QByteArray header = file.read(TrafficCapture::FileHeaderSize);
+    quint16 version = header.size() == TrafficCapture::FileHeaderSize
+                          ? qFromBigEndian<quint16>(header.constData() + 4)
+                          : 0;
+    if (version < 1 || version > TrafficCapture::Version ||
+        memcmp(header.constData(), Magic, sizeof(Magic)) != 0)
+    {
+        setError(errorString, QString("不是支持的捕获文件: %1").arg(path));
+        file.close();
+        return false;
+    }
+
+    quint16 flags = qFromBigEndian<quint16>(header.constData() + 6);
+    complete = version == 1 || (flags & TrafficCapture::CompleteFile) != 0;
+    startMs = qFromBigEndian<qint64>(header.constData() + 8);
+    return true;
+}
+
+bool TrafficCaptureReader::next(TrafficCapture::Record &record)
+{
+    char header[TrafficCapture::RecordHeaderSize];
+    if (file.read(header, TrafficCapture::RecordHeaderSize) != TrafficCapture::RecordHeaderSize)
+    {
+        return false;
+    }
+
+    record.timeUs = qFromBigEndian<qint64>(header);
+    record.session = qFromBigEndian<quint32>(header + 8);
+    record.event = quint8(header[12]);
+    record.frameType = quint8(header[13]);
+    record.flags = quint8(header[14]);
+    record.originalLength = qFromBigEndian<quint32>(header + 15);
+
+    quint32 length = qFromBigEndian<quint32>(header + 19);
+    record.data = file.read(qint64(length));
+    return record.data.size() == qsizetype(length);
+}
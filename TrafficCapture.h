@@ -0,0 +1,176 @@
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+#include <QSet>
+#include <QThread>
+#include <functional>
+
+// 流量捕获：把各连接收发的消息连同时间戳追加写入二进制文件，供回放工具重现会话
+// 文件: [魔数 "TCAP" 4B][版本 2B][文件标志 2B][开始时间 8B，自纪元起的毫秒数][记录...]
+// 记录: [时间 8B，自开始起的微秒数][会话ID 4B][事件 1B][帧类型 1B][标志 1B]
+//       [原始长度 4B][数据长度 4B][数据]（大端序）
+// 记录先复制到单生产者单消费者的无锁环形缓冲区，由写入线程批量写入文件，产生记录的线程不等待磁盘；
+// 缓冲区已满或消息超过单条记录上限时不阻塞收发，而是为该会话写一条Lost记录，回放时跳过这个会话；
+// 正常停止时在文件标志中置CompleteFile，写入失败或进程异常退出的文件没有该标志
+class TrafficCapture
+{
+  public:
+    // 记录的事件
+    enum Event
+    {
+        Opened = 1,  // 连接建立，数据为客户端信息（UTF-8）
+        Closed = 2,  // 连接断开
+        Inbound = 3, // 收到的消息
+        Outbound = 4, // 发出的消息
+        Lost = 5      // 该会话有记录未能保存，原始长度为丢失的消息长度（未知时为0）
+    };
+
+    // 记录标志
+    enum RecordFlag
+    {
+        FramedRecord = 0x01 // 消息以帧格式收发，回放时按帧类型加帧头
+    };
+
+    // 文件标志
+    enum FileFlag
+    {
+        CompleteFile = 0x0001 // 捕获正常停止，文件中的记录完整
+    };
+
+    static const int FileHeaderSize = 16;
+    static const int RecordHeaderSize = 23;
+    static const quint16 Version = 2;
+
+    // 默认的环形缓冲区大小，必须是2的幂
+    static const qint64 DefaultRingSize = 16 * 1024 * 1024;
+
+    // 捕获统计
+    struct Stats
+    {
+        quint64 records = 0;   // 写入缓冲区的记录数
+        quint64 bytes = 0;     // 写入缓冲区的字节数（含记录头）
+        quint64 dropped = 0;   // 缓冲区已满时丢弃的记录数
+        quint64 oversized = 0; // 数据超过单条记录上限（缓冲区的1/4）未保存的记录数
+    };
+
+    // 从捕获文件中读出的一条记录
+    struct Record
+    {
+        qint64 timeUs = 0;
+        quint32 session = 0;
+        quint8 event = 0;
+        quint8 frameType = 0;
+        quint8 flags = 0;
+        quint32 originalLength = 0; // 消息的数据长度，版本1的文件中可能大于data的长度（被截断）
+        QByteArray data;
+    };
+
+    // ringSize会向上取整到2的幂
+    explicit TrafficCapture(qint64 ringSize = DefaultRingSize);
+    ~TrafficCapture();
+
+    TrafficCapture(const TrafficCapture &) = delete;
+    TrafficCapture &operator=(const TrafficCapture &) = delete;
+
+    // 创建捕获文件并启动写入线程，失败时通过errorString返回原因
+    bool start(const QString &path, QString *errorString = nullptr);
+
+    // 写出缓冲区中剩余的记录和尚未写入的Lost记录，标记文件完整后关闭文件
+    void stop();
+
+    bool isRunning() const
+    {
+        return writer != nullptr;
+    }
+
+    // 写入文件失败后不再记录，handler在写入线程中被调用一次，参数为失败原因，须在start()之前设置；
+    // 这时文件中已有的记录仍可回放，但文件不会被标记为完整
+    void setFailureHandler(std::function<void(const QString &)> handler)
+    {
+        failureHandler = std::move(handler);
+    }
+
+    bool hasFailed() const
+    {
+        return failed.loadAcquire() != 0;
+    }
+
+    // 以下函数只能在同一个线程中调用（单生产者）
+    // 分配会话ID并记录连接建立
+    quint32 openSession(const QString &info);
+    void closeSession(quint32 session);
+
+    // 记录一条消息，数据由head和data两部分拼接而成（例如出站消息的消息头和映射的文件数据）
+    void record(quint32 session, Event event, quint8 frameType, bool framed, QByteArrayView head,
+                QByteArrayView data = QByteArrayView());
+
+    Stats stats() const
+    {
+        return statistics;
+    }
+
+  private:
+    // 写入线程没有数据可写时的休眠时间
+    static const int IdleSleepMs = 2;
+
+    char *ring = nullptr;
+    qint64 ringMask = 0;
+    QAtomicInteger<quint64> writePos; // 生产者写入的位置
+    QAtomicInteger<quint64> readPos;  // 写入线程已写出到文件的位置
+    QAtomicInteger<int> stopping;
+    QAtomicInteger<int> failed;
+    QThread *writer = nullptr;
+    QFile file;
+    QElapsedTimer clock;
+    quint32 nextSession = 1;
+    Stats statistics;
+    QSet<quint32> lostSessions; // 缓冲区已满而尚未写入Lost记录的会话
+    std::function<void(const QString &)> failureHandler;
+
+    // 把一条记录写入缓冲区，空间不足时返回false
+    bool append(quint32 session, Event event, quint8 frameType, quint8 flags,
+                qint64 originalLength, QByteArrayView head, QByteArrayView data);
+
+    // 为lostSessions中的会话写入Lost记录，直到缓冲区空间不足
+    void flushLost();
+
+    void copyIn(quint64 position, const char *data, qint64 length);
+
+    // 写入线程：把缓冲区中的记录写入文件，直到stop()且缓冲区为空
+    void drain();
+};
+
+// 捕获文件的顺序读取器
+class TrafficCaptureReader
+{
+  public:
+    bool open(const QString &path, QString *errorString = nullptr);
+
+    // 读出下一条记录，文件结束或记录不完整时返回false
+    bool next(TrafficCapture::Record &record);
+
+    // 捕获正常停止，文件中的记录完整；版本1的文件没有该标志，视为完整
+    bool isComplete() const
+    {
+        return complete;
+    }
+
+    // 捕获开始时间（自纪元起的毫秒数）
+    qint64 startTime() const
+    {
+        return startMs;
+    }
+
+  private:
+    QFile file;
+    qint64 startMs = 0;
+    bool complete = false;
+};
+
+#endif // TRAFFICCAPTURE_H
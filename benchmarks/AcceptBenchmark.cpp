@@ -0,0 +1,160 @@
+#include "TCPServer.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
+#include <arpa/inet.h>
+#include <atomic>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// 连接风暴测试：多个客户端线程在本机回环上不停地建立连接并立即关闭，
+// 分别用1个和N个SO_REUSEPORT监听socket运行服务端，比较每秒accept的连接数、
+// 服务端每秒处理完的连接数以及各监听socket之间的分布；仅Linux可用
+
+struct Result
+{
+    bool ok = false;
+    double acceptsPerSecond = 0;  // 各监听socket合计每秒accept的连接数
+    double admittedPerSecond = 0; // 服务端每秒处理完的连接数
+    quint64 attempts = 0;         // 客户端发起的连接数
+    QVector<quint64> perListener;
+};
+
+// 连接到本机port端口后立即关闭，直到stop为true；
+// SO_LINGER为0时关闭发送RST，客户端端口不进入TIME_WAIT，长时间运行也不会耗尽临时端口
+static void storm(quint16 port, const std::atomic<bool> &stop, std::atomic<quint64> &attempts)
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    struct linger linger;
+    linger.l_onoff = 1;
+    linger.l_linger = 0;
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            continue;
+        }
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        if (::connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == 0)
+        {
+            attempts.fetch_add(1, std::memory_order_relaxed);
+        }
+        ::close(fd);
+    }
+}
+
+static quint64 sum(const QVector<quint64> &values)
+{
+    quint64 total = 0;
+    for (quint64 value : values)
+    {
+        total += value;
+    }
+    return total;
+}
+
+static Result run(quint16 port, int listeners, int clients, int durationMs)
+{
+    Result result;
+    TCPServer server;
+    server.setListenerCount(listeners);
+    TCPServer::AdmissionConfig admission = server.admissionConfig();
+    admission.maxPendingConnections = 1024;
+    server.setAdmissionConfig(admission);
+    if (!server.startServer(port))
+    {
+        return result;
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<quint64> attempts{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i)
+    {
+        threads.emplace_back(storm, port, std::cref(stop), std::ref(attempts));
+    }
+
+    // 服务端在主线程处理新连接，附加监听socket在各自的线程中accept
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < durationMs)
+    {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    QVector<quint64> accepted = server.acceptedPerListener();
+    quint64 admitted = server.admissionStats().accepted;
+    qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+
+    stop.store(true);
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    server.stopServer();
+
+    result.ok = true;
+    result.perListener = accepted;
+    result.attempts = attempts.load();
+    result.acceptsPerSecond = sum(accepted) * 1000.0 / elapsed;
+    result.admittedPerSecond = admitted * 1000.0 / elapsed;
+    return result;
+}
+
+static void report(int listeners, const Result &result)
+{
+    if (!result.ok)
+    {
+        qWarning("%d 个监听socket: 无法启动服务端", listeners);
+        return;
+    }
+
+    QStringList distribution;
+    for (quint64 count : result.perListener)
+    {
+        distribution << QString::number(count);
+    }
+    qInfo("%d 个监听socket: 每秒accept %.0f 个，每秒处理完 %.0f 个，客户端发起 %llu 个，"
+          "分布 [%s]",
+          listeners, result.acceptsPerSecond, result.admittedPerSecond, result.attempts,
+          qPrintable(distribution.join(", ")));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("比较1个和N个SO_REUSEPORT监听socket的每秒accept数");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "测试使用的端口", "port", "18894");
+    parser.addOption(portOption);
+    QCommandLineOption listenersOption("listeners", "多监听socket时的数量（默认为CPU核数）",
+                                       "count", QString::number(QThread::idealThreadCount()));
+    parser.addOption(listenersOption);
+    QCommandLineOption clientsOption("clients", "发起连接的客户端线程数", "count", "8");
+    parser.addOption(clientsOption);
+    QCommandLineOption durationOption("duration", "每种情况运行的毫秒数", "ms", "5000");
+    parser.addOption(durationOption);
+    parser.process(app);
+
+    quint16 port = parser.value(portOption).toUShort();
+    int listeners = qMax(parser.value(listenersOption).toInt(), 2);
+    int clients = qMax(parser.value(clientsOption).toInt(), 1);
+    int duration = qMax(parser.value(durationOption).toInt(), 100);
+
+    report(1, run(port, 1, clients, duration));
+    report(listeners, run(port, listeners, clients, duration));
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include "BufferPool.h"
+#include "TCPFrame.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <atomic>
+#include <functional>
+#include <stdlib.h>
+
+// 接收路径内存分配测试：在本机回环连接上持续发送消息，统计接收端读取处理函数中
+// 每条消息的堆分配次数。分别测试旧的readAll()、解码为QString再split("|")的方式，
+// 和TCPFrameReader配合缓冲区池、复用消息负载的方式；先预热，再统计稳定状态下的数值。
+// 通过替换glibc的malloc统计分配次数，Qt容器的内存也能计入；仅Linux（glibc）可用
+
+// 每轮写入的消息数，写完等接收端全部处理后再开始下一轮
+static const int MessagesPerRound = 256;
+
+static std::atomic<quint64> heapAllocations{0};
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *pointer, size_t size);
+
+    void *malloc(size_t size)
+    {
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *pointer, size_t size)
+    {
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(pointer, size);
+    }
+}
+
+struct Result
+{
+    bool ok = false;
+    double heapPerMessage = 0;    // 读取处理函数中每条消息的堆分配次数
+    double bufferPerMessage = 0;  // 接收缓冲区扩容的新分配
+    double payloadPerMessage = 0; // 消息负载无法复用时的分配
+};
+
+// 处理事件直到done返回true，超时返回false
+static bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done())
+    {
+        if (timer.elapsed() > timeoutMs)
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+    }
+    return true;
+}
+
+// 发送端按轮写入，framed为false时接收端按旧方式处理，否则用TCPFrameReader取出消息
+static Result run(bool framed, int warmup, int messages, int size)
+{
+    Result result;
+    QTcpServer listener;
+    QTcpSocket sender;
+    if (!listener.listen(QHostAddress::LocalHost))
+    {
+        return result;
+    }
+    sender.connectToHost(QHostAddress::LocalHost, listener.serverPort());
+    if (!listener.waitForNewConnection(3000) || !sender.waitForConnected(3000))
+    {
+        return result;
+    }
+    QTcpSocket *receiver = listener.nextPendingConnection();
+
+    // 旧版的文件消息格式：FILE|文件名|内容
+    QByteArray text = "FILE|bench.bin|" + QByteArray(qMax(size, 1), 'x');
+    QByteArray round = (framed ? TCPFrame::encode(TCPFrame::FileFrame, text) : text)
+                           .repeated(MessagesPerRound);
+
+    BufferPool pool;
+    TCPFrameReader reader;
+    reader.setBufferPool(&pool);
+    quint64 received = 0;
+    quint64 legacyBytes = 0;
+    quint64 allocations = 0;
+    QObject::connect(receiver, &QTcpSocket::readyRead, receiver, [&]() {
+        quint64 before = heapAllocations.load(std::memory_order_relaxed);
+        if (framed)
+        {
+            reader.readFrom(receiver);
+            TCPFrameReader::Message &frame = reader.scratchMessage();
+            while (reader.next(frame))
+            {
+                received++;
+            }
+        }
+        else
+        {
+            // 旧版纯文本没有消息边界，按收到的字节数折算消息数
+            QByteArray data = receiver->readAll();
+            QStringList parts = QString::fromUtf8(data).split("|");
+            legacyBytes += quint64(data.size());
+            received = legacyBytes / quint64(text.size());
+            Q_UNUSED(parts);
+        }
+        allocations += heapAllocations.load(std::memory_order_relaxed) - before;
+    });
+
+    quint64 target = 0;
+    auto sendRounds = [&](int count) {
+        for (int sent = 0; sent < count; sent += MessagesPerRound)
+        {
+            sender.write(round);
+            target += MessagesPerRound;
+            if (!waitFor([&]() { return received >= target; }, 30000))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    if (!sendRounds(warmup))
+    {
+        return result;
+    }
+    allocations = 0;
+    TCPFrameReader::Stats before = reader.stats();
+    quint64 start = received;
+    if (!sendRounds(messages))
+    {
+        return result;
+    }
+
+    double count = double(received - start);
+    TCPFrameReader::Stats after = reader.stats();
+    result.ok = true;
+    result.heapPerMessage = allocations / count;
+    result.bufferPerMessage = (after.bufferAllocations - before.bufferAllocations) / count;
+    result.payloadPerMessage = (after.payloadAllocations - before.payloadAllocations) / count;
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("统计接收路径上每条消息的堆分配次数");
+    parser.addHelpOption();
+    QCommandLineOption messagesOption("messages", "统计的消息数", "count", "200000");
+    parser.addOption(messagesOption);
+    QCommandLineOption warmupOption("warmup", "预热的消息数", "count", "20000");
+    parser.addOption(warmupOption);
+    parser.process(app);
+
+    int messages = qMax(parser.value(messagesOption).toInt(), MessagesPerRound);
+    int warmup = qMax(parser.value(warmupOption).toInt(), MessagesPerRound);
+
+    qInfo("方式          消息字节  堆分配/消息  缓冲区分配/消息  负载分配/消息");
+    for (int size : {64, 1024, 16 * 1024})
+    {
+        Result legacy = run(false, warmup, messages, size);
+        Result framed = run(true, warmup, messages, size);
+        if (!legacy.ok || !framed.ok)
+        {
+            qWarning("消息字节 %d: 测试未完成（无法建立连接或消息未全部送达）", size);
+            continue;
+        }
+        qInfo("readAll+split %-9d %-12.3f -                -", size, legacy.heapPerMessage);
+        qInfo("TCPFrameReader %-8d %-12.3f %-16.4f %.4f", size, framed.heapPerMessage,
+              framed.bufferPerMessage, framed.payloadPerMessage);
+    }
+    return 0;
+}
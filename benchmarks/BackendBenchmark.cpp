@@ -0,0 +1,215 @@
+#include "EpollServer.h"
+#include "TCPFrame.h"
+#include "TCPServer.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QVector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <functional>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// 服务端后端性能测试：在本机回环上分别用Qt后端和epoll后端建立大量空闲连接，
+// 比较每个空闲连接占用的内存，再让部分连接持续发送短消息，比较每秒处理的消息数。
+// 客户端使用原始socket，不创建QObject，测得的内存增量基本都来自服务端；仅Linux可用
+
+// 每个发送连接每轮写入的消息数
+static const int MessagesPerBurst = 64;
+
+// 服务端每次等待监听队列被取空之前，客户端最多发起的连接数（小于默认的待处理连接队列长度）
+static const int ConnectBatch = 25;
+
+struct Result
+{
+    bool ok = false;
+    int connections = 0;
+    double bytesPerConnection = 0;
+    double messagesPerSecond = 0;
+};
+
+// 当前进程的常驻内存
+static qint64 residentBytes()
+{
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly))
+    {
+        return 0;
+    }
+
+    for (const QByteArray &line : status.readAll().split('\n'))
+    {
+        if (line.startsWith("VmRSS:"))
+        {
+            return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+        }
+    }
+    return 0;
+}
+
+// 发起到本机port端口的非阻塞连接，失败时返回-1
+static int connectTo(quint16 port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 &&
+        errno != EINPROGRESS)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 处理事件直到done返回true，超时返回false
+static bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done())
+    {
+        if (timer.elapsed() > timeoutMs)
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    return true;
+}
+
+static Result run(TCPServer::Backend backend, quint16 port, int idle, int senders, int messages,
+                  int size)
+{
+    Result result;
+    TCPServer server;
+    server.setBackend(backend);
+    quint64 received = 0;
+    QObject::connect(&server, &TCPServer::messageReceived, &server, [&received]() { received++; });
+    if (!server.startServer(port))
+    {
+        return result;
+    }
+
+    // 空闲连接：比较建立连接前后的常驻内存
+    qint64 before = residentBytes();
+    QVector<int> fds;
+    for (int i = 0; i < idle; ++i)
+    {
+        int fd = connectTo(port);
+        if (fd >= 0)
+        {
+            fds.append(fd);
+        }
+        if (fds.size() % ConnectBatch == 0)
+        {
+            waitFor([&]() { return server.clientCount() >= fds.size(); }, 5000);
+        }
+    }
+    waitFor([&]() { return server.clientCount() >= fds.size(); }, 10000);
+    result.connections = server.clientCount();
+    if (result.connections > 0)
+    {
+        result.bytesPerConnection = double(residentBytes() - before) / result.connections;
+    }
+
+    // 消息吞吐：每轮每个发送连接写入一批帧格式文本消息，等服务端全部处理后再开始下一轮，
+    // 每批数据远小于回环socket的缓冲区，非阻塞写入总能一次写完
+    QByteArray burst =
+        TCPFrame::encode(TCPFrame::TextFrame, QByteArray(size, 'x')).repeated(MessagesPerBurst);
+    int active = qMin(senders, fds.size());
+    quint64 sent = 0;
+    QElapsedTimer timer;
+    timer.start();
+    while (active > 0 && sent < quint64(messages))
+    {
+        for (int i = 0; i < active && sent < quint64(messages); ++i)
+        {
+            if (::send(fds.at(i), burst.constData(), size_t(burst.size()), MSG_NOSIGNAL) ==
+                burst.size())
+            {
+                sent += MessagesPerBurst;
+            }
+        }
+        if (!waitFor([&]() { return received >= sent; }, 10000))
+        {
+            break;
+        }
+    }
+    qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+    result.messagesPerSecond = received * 1000.0 / elapsed;
+    result.ok = received >= sent && sent > 0;
+
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    server.stopServer();
+    return result;
+}
+
+static void report(const char *name, const Result &result)
+{
+    if (!result.ok)
+    {
+        qWarning("%s: 测试未完成（无法启动服务器或消息未全部送达）", name);
+        return;
+    }
+    qInfo("%s: %d 个连接，每个空闲连接约 %.0f 字节，%.0f 条消息/秒", name, result.connections,
+          result.bytesPerConnection, result.messagesPerSecond);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("比较Qt后端和epoll后端的空闲连接内存和消息吞吐");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "测试使用的端口", "port", "18888");
+    parser.addOption(portOption);
+    QCommandLineOption connectionsOption("connections", "空闲连接数", "count", "1000");
+    parser.addOption(connectionsOption);
+    QCommandLineOption sendersOption("senders", "发送消息的连接数", "count", "50");
+    parser.addOption(sendersOption);
+    QCommandLineOption messagesOption("messages", "发送的消息总数", "count", "500000");
+    parser.addOption(messagesOption);
+    QCommandLineOption sizeOption("size", "每条消息的字节数", "bytes", "64");
+    parser.addOption(sizeOption);
+    parser.process(app);
+
+    // 客户端和服务端两侧的描述符都在本进程中，把描述符上限提高到系统允许的最大值
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    quint16 port = parser.value(portOption).toUShort();
+    int connections = qMax(parser.value(connectionsOption).toInt(), 1);
+    int senders = qMax(parser.value(sendersOption).toInt(), 1);
+    int messages = qMax(parser.value(messagesOption).toInt(), MessagesPerBurst);
+    int size = qMax(parser.value(sizeOption).toInt(), 1);
+
+    report("Qt后端", run(TCPServer::QtBackend, port, connections, senders, messages, size));
+    if (EpollServer::isSupported())
+    {
+        report("epoll后端",
+               run(TCPServer::EpollBackend, port, connections, senders, messages, size));
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "PayloadPool.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QThread>
+
+// Base64编解码测试：比较QByteArray::toBase64/fromBase64（单线程）和PayloadPool的按块并行编解码，
+// 负载从1 MiB开始每次乘以4，直到上限（默认1 GiB），输出MB/s（按原始数据字节计）；
+// 只测编解码本身，不经过网络。1 GiB时编码结果和解码结果同时存在，需要约4 GiB内存
+
+// 防止编译器把结果未被使用的编解码优化掉
+static volatile qint64 sink = 0;
+
+// 重复运行直到至少minMs毫秒（最少一次），返回每秒处理的MB数
+template <typename Function> static double measure(Function run, qint64 bytes, int minMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    qint64 count = 0;
+    do
+    {
+        run();
+        count++;
+    } while (timer.elapsed() < minMs);
+    qint64 elapsed = qMax<qint64>(timer.nsecsElapsed(), 1);
+    return double(bytes) * count / (1024 * 1024) / (elapsed / 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("比较QByteArray和PayloadPool按块并行的Base64编解码速度");
+    parser.addHelpOption();
+    QCommandLineOption maxOption("max", "最大的负载大小（MiB）", "MiB", "1024");
+    parser.addOption(maxOption);
+    QCommandLineOption timeOption("time", "每种情况至少运行的毫秒数", "ms", "500");
+    parser.addOption(timeOption);
+    parser.process(app);
+
+    qint64 maxBytes = qint64(qMax(parser.value(maxOption).toInt(), 1)) * 1024 * 1024;
+    int minMs = qMax(parser.value(timeOption).toInt(), 1);
+
+    qInfo("CPU核数 %d，并行块大小 %d 字节", QThread::idealThreadCount(), PayloadPool::ChunkSize);
+    qInfo("负载(MiB)  QByteArray编码  PayloadPool编码  QByteArray解码  PayloadPool解码  (MB/s)");
+    for (qint64 size = 1024 * 1024; size <= maxBytes; size *= 4)
+    {
+        QByteArray data(size, Qt::Uninitialized);
+        for (qint64 i = 0; i < size; ++i)
+        {
+            data[i] = char(i * 131);
+        }
+        QByteArray base64 = data.toBase64();
+        if (PayloadPool::toBase64(data) != base64 || PayloadPool::fromBase64(base64) != data)
+        {
+            qWarning("%lld MiB: PayloadPool的结果与QByteArray不一致", size / (1024 * 1024));
+            return 1;
+        }
+
+        double qtEncode = measure([&]() { sink = sink + data.toBase64().size(); }, size, minMs);
+        double poolEncode =
+            measure([&]() { sink = sink + PayloadPool::toBase64(data).size(); }, size, minMs);
+        double qtDecode =
+            measure([&]() { sink = sink + QByteArray::fromBase64(base64).size(); }, size, minMs);
+        double poolDecode =
+            measure([&]() { sink = sink + PayloadPool::fromBase64(base64).size(); }, size, minMs);
+        qInfo("%-10lld %-15.0f %-16.0f %-15.0f %.0f", size / (1024 * 1024), qtEncode, poolEncode,
+              qtDecode, poolDecode);
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include "TCPClient.h"
+#include "TCPServer.h"
+#include "TrafficCapture.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <functional>
+
+// 流量捕获的开销测试：
+// 1. 直接调用TrafficCapture::record()，比较未开启和开启捕获时每条记录的耗时，
+//    以及写入线程写完全部记录的时间
+// 2. 客户端经本机回环连接向服务端发送消息，比较服务端未开启和开启捕获时每秒收到的消息数
+
+// 处理事件直到done返回true，超时返回false
+static bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done())
+    {
+        if (timer.elapsed() > timeoutMs)
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+    }
+    return true;
+}
+
+// 记录count条size字节的入站消息，path为空时不开启捕获
+static void recordOnly(const QString &path, int count, int size)
+{
+    TrafficCapture capture;
+    QString error;
+    if (!path.isEmpty() && !capture.start(path, &error))
+    {
+        qWarning("%s", qPrintable(error));
+        return;
+    }
+
+    QByteArray payload(size, 'x');
+    quint32 session = capture.openSession("127.0.0.1:1");
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < count; ++i)
+    {
+        capture.record(session, TrafficCapture::Inbound, 0, true, payload);
+    }
+    double recordNs = double(timer.nsecsElapsed()) / count;
+    capture.closeSession(session);
+    capture.stop();
+    double totalMs = timer.nsecsElapsed() / 1e6;
+
+    TrafficCapture::Stats stats = capture.stats();
+    if (path.isEmpty())
+    {
+        qInfo("  %6d 字节，未开启捕获: 每条 %.1f ns", size, recordNs);
+    }
+    else
+    {
+        qInfo("  %6d 字节，开启捕获: 每条 %.1f ns，写完共 %.1f ms，丢弃 %llu 条，超长 %llu 条",
+              size, recordNs, totalMs, stats.dropped, stats.oversized);
+    }
+}
+
+// 客户端发送count条size字节的消息，返回服务端每秒收到的消息数，失败时返回0
+static double roundTrip(quint16 port, const QString &path, int count, int size)
+{
+    TCPServer server;
+    int received = 0;
+    QObject::connect(&server, &TCPServer::messageReceived, &server,
+                     [&received](const QString &, const QString &) { received++; });
+    if (!server.startServer(port))
+    {
+        qWarning("无法启动服务端");
+        return 0;
+    }
+    QString error;
+    if (!path.isEmpty() && !server.startCapture(path, &error))
+    {
+        qWarning("%s", qPrintable(error));
+        return 0;
+    }
+
+    // 使用帧格式，协商完成后再开始发送
+    TCPClient client;
+    client.setFramingEnabled(true);
+    bool connected = false;
+    QObject::connect(&client, &TCPClient::negotiated, &client,
+                     [&connected]() { connected = true; });
+    client.connectToServer("127.0.0.1", port);
+    if (!waitFor([&connected]() { return connected; }, 10000))
+    {
+        qWarning("无法连接服务端");
+        return 0;
+    }
+
+    QString message(size, 'x');
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < count; ++i)
+    {
+        client.sendMessage(message);
+    }
+    bool done = waitFor([&received, count]() { return received >= count; }, 60000);
+    double seconds = qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9;
+
+    TrafficCapture::Stats stats = server.captureStats();
+    client.disconnectFromServer();
+    server.stopServer();
+    if (!done)
+    {
+        qWarning("服务端只收到 %d/%d 条消息", received, count);
+        return 0;
+    }
+    if (!path.isEmpty() && (stats.dropped > 0 || stats.oversized > 0))
+    {
+        qInfo("  捕获丢弃 %llu 条，超长 %llu 条", stats.dropped, stats.oversized);
+    }
+    return count / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("测量开启流量捕获对收发的影响");
+    parser.addHelpOption();
+    QCommandLineOption recordsOption("records", "直接记录的条数", "count", "200000");
+    parser.addOption(recordsOption);
+    QCommandLineOption messagesOption("messages", "经连接发送的消息数", "count", "20000");
+    parser.addOption(messagesOption);
+    QCommandLineOption portOption("port", "服务端使用的端口", "port", "18891");
+    parser.addOption(portOption);
+    parser.process(app);
+
+    int records = qMax(parser.value(recordsOption).toInt(), 1);
+    int messages = qMax(parser.value(messagesOption).toInt(), 1);
+    quint16 port = parser.value(portOption).toUShort();
+
+    QTemporaryDir directory;
+    if (!directory.isValid())
+    {
+        qWarning("无法创建临时目录");
+        return 1;
+    }
+    QString path = directory.filePath("benchmark.tcap");
+
+    qInfo("直接记录 %d 条:", records);
+    for (int size : {64, 1024, 16384})
+    {
+        recordOnly(QString(), records, size);
+        recordOnly(path, records, size);
+    }
+
+    qInfo("经连接发送 %d 条消息:", messages);
+    for (int size : {64, 1024, 16384})
+    {
+        double plain = roundTrip(port, QString(), messages, size);
+        double captured = roundTrip(port, path, messages, size);
+        double overhead = plain > 0 && captured > 0 ? (plain / captured - 1) * 100 : 0;
+        qInfo("  %6d 字节: 未开启 %.0f 条/秒，开启 %.0f 条/秒，开销 %.1f%%", size, plain,
+              captured, overhead);
+    }
+    return 0;
+}
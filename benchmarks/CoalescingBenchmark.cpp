@@ -0,0 +1,209 @@
+#include "OutboundScheduler.h"
+#include "TCPFrame.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtEndian>
+#include <algorithm>
+#include <functional>
+
+// 写合并策略测试：在本机回环连接上，按不同的等待时间和字节上限发送短消息，
+// 分别测量连续发送时的每秒消息数和每条消息的写入次数，以及按固定间隔发送时的单向延迟分布，
+// 得到吞吐和延迟随策略变化的曲线
+
+// 吞吐测试中每次事件循环入队的消息数，模拟持续产生消息的应用
+static const int MessagesPerTurn = 8;
+
+struct Result
+{
+    double messagesPerSecond = 0;
+    double writesPerMessage = 0;
+    double p50Us = 0;
+    double p99Us = 0;
+};
+
+// 发送端用调度器写出，接收端解析帧，消息的前8字节为发送时的时间戳
+struct Link
+{
+    QTcpServer listener;
+    QTcpSocket sender;
+    QTcpSocket *receiver = nullptr;
+    OutboundScheduler scheduler;
+    TCPFrameReader reader;
+    QElapsedTimer clock;
+    int received = 0;
+    QVector<qint64> latenciesNs;
+
+    bool open()
+    {
+        if (!listener.listen(QHostAddress::LocalHost))
+        {
+            return false;
+        }
+        sender.connectToHost(QHostAddress::LocalHost, listener.serverPort());
+        if (!listener.waitForNewConnection(3000) || !sender.waitForConnected(3000))
+        {
+            return false;
+        }
+        receiver = listener.nextPendingConnection();
+        scheduler.addConnection(&sender);
+        scheduler.setFramed(&sender, true);
+        clock.start();
+
+        QObject::connect(receiver, &QTcpSocket::readyRead, receiver, [this]() {
+            reader.readFrom(receiver);
+            TCPFrameReader::Message &frame = reader.scratchMessage();
+            while (reader.next(frame))
+            {
+                received++;
+                if (frame.payload.size() >= 8)
+                {
+                    qint64 sent = qFromBigEndian<qint64>(frame.payload.constData());
+                    latenciesNs.append(clock.nsecsElapsed() - sent);
+                }
+            }
+        });
+        return true;
+    }
+
+    void send(QByteArray &message)
+    {
+        qToBigEndian<qint64>(clock.nsecsElapsed(), message.data());
+        scheduler.enqueue(&sender, message, OutboundScheduler::TextClass);
+    }
+};
+
+// 处理事件直到done返回true，超时返回false
+static bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done())
+    {
+        if (timer.elapsed() > timeoutMs)
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+    }
+    return true;
+}
+
+static double percentile(QVector<qint64> values, double fraction)
+{
+    if (values.isEmpty())
+    {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    qsizetype index = qMin(values.size() - 1, qsizetype(fraction * values.size()));
+    return values[index] / 1000.0;
+}
+
+static Result run(Link &link, const OutboundScheduler::CoalescingPolicy &policy, int messages,
+                  int paced, int size)
+{
+    Result result;
+    link.scheduler.setCoalescingPolicy(policy);
+    QByteArray message(qMax(size, 8), 'x');
+
+    // 连续发送：每次事件循环入队MessagesPerTurn条
+    link.received = 0;
+    OutboundScheduler::Stats before = link.scheduler.stats();
+    int sent = 0;
+    QTimer producer;
+    QObject::connect(&producer, &QTimer::timeout, &producer, [&]() {
+        for (int i = 0; i < MessagesPerTurn && sent < messages; ++i, ++sent)
+        {
+            link.send(message);
+        }
+        if (sent == messages)
+        {
+            producer.stop();
+        }
+    });
+    QElapsedTimer timer;
+    timer.start();
+    producer.start(0);
+    if (!waitFor([&]() { return link.received >= messages; }, 60000))
+    {
+        qWarning("只收到 %d/%d 条消息", link.received, messages);
+        return result;
+    }
+    result.messagesPerSecond = messages / (qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9);
+    OutboundScheduler::Stats after = link.scheduler.stats();
+    quint64 writes = after.vectoredWrites - before.vectoredWrites + after.bufferedWrites -
+                     before.bufferedWrites;
+    result.writesPerMessage = double(writes) / messages;
+
+    // 按固定间隔发送，测量单向延迟
+    link.received = 0;
+    link.latenciesNs.clear();
+    sent = 0;
+    QTimer ticker;
+    ticker.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&ticker, &QTimer::timeout, &ticker, [&]() {
+        link.send(message);
+        if (++sent == paced)
+        {
+            ticker.stop();
+        }
+    });
+    ticker.start(1);
+    if (!waitFor([&]() { return link.received >= paced; }, 60000))
+    {
+        qWarning("只收到 %d/%d 条消息", link.received, paced);
+    }
+    result.p50Us = percentile(link.latenciesNs, 0.5);
+    result.p99Us = percentile(link.latenciesNs, 0.99);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("测量写合并策略对吞吐和延迟的影响");
+    parser.addHelpOption();
+    QCommandLineOption messagesOption("messages", "连续发送的消息数", "count", "200000");
+    parser.addOption(messagesOption);
+    QCommandLineOption pacedOption("paced", "按1毫秒间隔发送的消息数", "count", "1000");
+    parser.addOption(pacedOption);
+    QCommandLineOption sizeOption("size", "消息字节数（至少8）", "bytes", "64");
+    parser.addOption(sizeOption);
+    parser.process(app);
+
+    int messages = qMax(parser.value(messagesOption).toInt(), 1);
+    int paced = qMax(parser.value(pacedOption).toInt(), 1);
+    int size = parser.value(sizeOption).toInt();
+
+    Link link;
+    if (!link.open())
+    {
+        qWarning("无法建立回环连接");
+        return 1;
+    }
+
+    qInfo("等待(us)  字节上限  消息/秒      写入/消息  延迟p50(us)  延迟p99(us)");
+    for (int delayUs : {0, 1000, 2000, 5000})
+    {
+        for (int maxBytes : {4 * 1024, 64 * 1024})
+        {
+            OutboundScheduler::CoalescingPolicy policy;
+            policy.delayUs = delayUs;
+            policy.maxBytes = maxBytes;
+            Result result = run(link, policy, messages, paced, size);
+            qInfo("%-9d %-9d %-12.0f %-10.3f %-12.1f %.1f", delayUs, maxBytes,
+                  result.messagesPerSecond, result.writesPerMessage, result.p50Us, result.p99Us);
+            if (delayUs == 0)
+            {
+                break; // 不等待时字节上限不起作用
+            }
+        }
+    }
+    return 0;
+}
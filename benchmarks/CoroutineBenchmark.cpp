@@ -0,0 +1,195 @@
+#include "TCPConnection.h"
+#include "TCPFrame.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <memory>
+
+// 协程接口性能测试：连接本机的回显服务端，分别用回调方式（readyRead信号）和TCPConnection协程
+// 收发相同的帧，比较每秒往返的消息数；窗口为1时是逐条往返，窗口更大时为流水线
+
+// 回显服务端：把收到的每一帧原样发回
+static void startEcho(QTcpServer *listener)
+{
+    QObject::connect(listener, &QTcpServer::newConnection, listener, [listener]() {
+        while (QTcpSocket *socket = listener->nextPendingConnection())
+        {
+            std::shared_ptr<TCPFrameReader> reader = std::make_shared<TCPFrameReader>();
+            QObject::connect(socket, &QTcpSocket::readyRead, socket, [socket, reader]() {
+                reader->readFrom(socket);
+                TCPFrameReader::Message &frame = reader->scratchMessage();
+                while (reader->next(frame))
+                {
+                    socket->write(TCPFrame::encode(frame.type, frame.payload));
+                }
+            });
+        }
+    });
+}
+
+static QTcpSocket *connectClient(quint16 port)
+{
+    QTcpSocket *socket = new QTcpSocket;
+    socket->connectToHost(QHostAddress::LocalHost, port);
+    if (!socket->waitForConnected(3000))
+    {
+        delete socket;
+        return nullptr;
+    }
+    return socket;
+}
+
+// 与TCPConnection::write相同：帧头和负载分两次写入socket
+static void writeFrame(QTcpSocket *socket, const QByteArray &payload)
+{
+    char header[TCPFrame::HeaderSize];
+    TCPFrame::writeHeader(header, TCPFrame::TextFrame, TCPFrame::EndOfStream, 0,
+                          quint32(payload.size()));
+    socket->write(header, TCPFrame::HeaderSize);
+    socket->write(payload);
+}
+
+// 回调方式：先发出window条消息，之后每收到一条回显再发一条，返回每秒往返的消息数
+static double runCallback(quint16 port, int count, int window, const QByteArray &payload)
+{
+    QTcpSocket *socket = connectClient(port);
+    if (!socket)
+    {
+        return 0;
+    }
+
+    TCPFrameReader reader;
+    QEventLoop loop;
+    int sent = 0;
+    int received = 0;
+    QObject::connect(socket, &QTcpSocket::readyRead, socket, [&]() {
+        reader.readFrom(socket);
+        TCPFrameReader::Message &frame = reader.scratchMessage();
+        while (reader.next(frame))
+        {
+            if (++received == count)
+            {
+                loop.quit();
+                return;
+            }
+            if (sent < count)
+            {
+                writeFrame(socket, payload);
+                sent++;
+            }
+        }
+    });
+    QObject::connect(socket, &QTcpSocket::disconnected, &loop, &QEventLoop::quit);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (; sent < qMin(window, count); ++sent)
+    {
+        writeFrame(socket, payload);
+    }
+    loop.exec();
+    qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+    delete socket;
+    return received == count ? count * 1000.0 / elapsed : 0;
+}
+
+// 协程方式：与回调方式相同的收发顺序
+static TCPTask echoSession(TCPConnection *conn, int count, int window, QByteArray payload,
+                           int *received, bool *finished, QEventLoop *loop)
+{
+    int sent = 0;
+    for (; sent < qMin(window, count); ++sent)
+    {
+        co_await conn->write(TCPFrame::TextFrame, payload);
+    }
+    while (*received < count)
+    {
+        std::optional<TCPFrameReader::Message> frame = co_await conn->readFrame();
+        if (!frame)
+        {
+            break;
+        }
+        ++*received;
+        if (sent < count)
+        {
+            co_await conn->write(TCPFrame::TextFrame, payload);
+            sent++;
+        }
+    }
+    *finished = true;
+    loop->quit();
+}
+
+static double runCoroutine(quint16 port, int count, int window, const QByteArray &payload)
+{
+    QTcpSocket *socket = connectClient(port);
+    if (!socket)
+    {
+        return 0;
+    }
+
+    QEventLoop loop;
+    int received = 0;
+    bool finished = false;
+    double rate = 0;
+    {
+        TCPConnection conn(socket);
+        QElapsedTimer timer;
+        timer.start();
+        echoSession(&conn, count, window, payload, &received, &finished, &loop);
+        if (!finished)
+        {
+            loop.exec();
+        }
+        qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+        rate = received == count ? count * 1000.0 / elapsed : 0;
+    }
+    delete socket;
+    return rate;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("比较回调方式和协程方式的收发性能");
+    parser.addHelpOption();
+    QCommandLineOption countOption("count", "每项测试往返的消息数", "count", "50000");
+    parser.addOption(countOption);
+    QCommandLineOption windowOption("window", "流水线测试中同时未返回的消息数", "count", "64");
+    parser.addOption(windowOption);
+    QCommandLineOption sizeOption("size", "每条消息的字节数", "bytes", "64");
+    parser.addOption(sizeOption);
+    parser.process(app);
+
+    int count = qMax(parser.value(countOption).toInt(), 1);
+    int window = qMax(parser.value(windowOption).toInt(), 1);
+    QByteArray payload(qMax(parser.value(sizeOption).toInt(), 1), 'x');
+
+    QTcpServer listener;
+    if (!listener.listen(QHostAddress::LocalHost))
+    {
+        qWarning("%s", qPrintable(listener.errorString()));
+        return 1;
+    }
+    startEcho(&listener);
+    quint16 port = listener.serverPort();
+
+    // 预热一轮，排除建立缓冲区等一次性开销
+    runCallback(port, qMin(count, 1000), window, payload);
+    runCoroutine(port, qMin(count, 1000), window, payload);
+
+    const int windows[2] = {1, window};
+    for (int w : windows)
+    {
+        double callback = runCallback(port, count, w, payload);
+        double coroutine = runCoroutine(port, count, w, payload);
+        qInfo("窗口 %d: 回调 %.0f 条/秒，协程 %.0f 条/秒，协程/回调 %.3f", w, callback, coroutine,
+              callback > 0 ? coroutine / callback : 0);
+    }
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include "MappedFile.h"
+#include "OutboundScheduler.h"
+#include "TCPFrame.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <functional>
+
+// 映射文件传输测试：在本机回环连接上用调度器发送一个大文件，接收端重组后写入输出文件，
+// 比较读入堆内存（QFile::readAll + QFile::write）和映射文件（MappedFile）两种方式的
+// 端到端MB/s，以及传输期间匿名内存和文件映射内存的常驻峰值（读取/proc/self/status，仅Linux）
+
+struct Result
+{
+    bool ok = false;
+    double megabytesPerSecond = 0;
+    qint64 peakAnonymous = 0; // 相对开始前增加的匿名常驻内存峰值
+    qint64 peakFile = 0;      // 相对开始前增加的文件映射常驻内存峰值
+};
+
+// /proc/self/status中的一项（字节），不可用时返回0
+static qint64 statusBytes(const QByteArray &name)
+{
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly))
+    {
+        return 0;
+    }
+
+    for (const QByteArray &line : status.readAll().split('\n'))
+    {
+        if (line.startsWith(name + ':'))
+        {
+            return line.mid(name.size() + 1).trimmed().split(' ').first().toLongLong() * 1024;
+        }
+    }
+    return 0;
+}
+
+// 处理事件直到done返回true，超时返回false
+static bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done())
+    {
+        if (timer.elapsed() > timeoutMs)
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+    }
+    return true;
+}
+
+// 生成size字节的测试文件
+static bool createFile(const QString &path, qint64 size)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    QByteArray block(1024 * 1024, Qt::Uninitialized);
+    for (int i = 0; i < block.size(); ++i)
+    {
+        block[i] = char(i * 131);
+    }
+    for (qint64 written = 0; written < size; written += block.size())
+    {
+        qint64 length = qMin<qint64>(block.size(), size - written);
+        if (file.write(block.constData(), length) != length)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static Result run(bool mapped, const QString &source, const QString &target)
+{
+    Result result;
+    QTcpServer listener;
+    QTcpSocket sender;
+    if (!listener.listen(QHostAddress::LocalHost))
+    {
+        return result;
+    }
+    sender.connectToHost(QHostAddress::LocalHost, listener.serverPort());
+    if (!listener.waitForNewConnection(3000) || !sender.waitForConnected(3000))
+    {
+        return result;
+    }
+    QTcpSocket *receiver = listener.nextPendingConnection();
+
+    OutboundScheduler scheduler;
+    scheduler.addConnection(&sender);
+    scheduler.setFramed(&sender, true);
+
+    // 接收端重组出完整的文件后写入输出文件
+    TCPFrameReader reader;
+    reader.setMaxStreamSize(TCPFrameReader::MaxStreamSizeLimit);
+    bool done = false;
+    bool saved = false;
+    QObject::connect(receiver, &QTcpSocket::readyRead, receiver, [&]() {
+        reader.readFrom(receiver);
+        TCPFrameReader::Message &frame = reader.scratchMessage();
+        while (reader.next(frame))
+        {
+            if (mapped)
+            {
+                saved = MappedFile::write(target, frame.payload);
+            }
+            else
+            {
+                QFile file(target);
+                saved = file.open(QIODevice::WriteOnly) &&
+                        file.write(frame.payload) == frame.payload.size();
+            }
+            frame.payload = QByteArray();
+            done = true;
+        }
+    });
+
+    // 定时采样常驻内存，记录峰值
+    qint64 baseAnonymous = statusBytes("RssAnon");
+    qint64 baseFile = statusBytes("RssFile");
+    QTimer sampler;
+    QObject::connect(&sampler, &QTimer::timeout, &sampler, [&]() {
+        result.peakAnonymous = qMax(result.peakAnonymous, statusBytes("RssAnon") - baseAnonymous);
+        result.peakFile = qMax(result.peakFile, statusBytes("RssFile") - baseFile);
+    });
+    sampler.start(10);
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 size = 0;
+    if (mapped)
+    {
+        // 负载直接引用映射区，调度器写出最后一个分片后才解除映射
+        std::shared_ptr<MappedFile> file = MappedFile::open(source);
+        if (!file)
+        {
+            return result;
+        }
+        size = file->size();
+        scheduler.enqueue(&sender, QByteArray(), file->bytes(), file,
+                          OutboundScheduler::BulkClass, TCPFrame::FileFrame);
+    }
+    else
+    {
+        QFile file(source);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            return result;
+        }
+        QByteArray data = file.readAll();
+        size = data.size();
+        scheduler.enqueue(&sender, data, OutboundScheduler::BulkClass, TCPFrame::FileFrame);
+    }
+
+    result.ok = waitFor([&done]() { return done; }, 600000) && saved;
+    qint64 elapsed = qMax<qint64>(timer.nsecsElapsed(), 1);
+    result.megabytesPerSecond = double(size) / (1024 * 1024) / (elapsed / 1e9);
+    return result;
+}
+
+static void report(const char *name, const Result &result)
+{
+    if (!result.ok)
+    {
+        qWarning("%s: 测试未完成（无法读写文件或传输未完成）", name);
+        return;
+    }
+    qInfo("%s: %.0f MB/s，匿名内存峰值 +%.1f MiB，文件映射内存峰值 +%.1f MiB", name,
+          result.megabytesPerSecond, result.peakAnonymous / 1048576.0,
+          result.peakFile / 1048576.0);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("比较读入内存和映射文件两种方式的文件传输速度和内存占用");
+    parser.addHelpOption();
+    QCommandLineOption sizeOption("size", "生成的测试文件大小（MiB）", "MiB", "256");
+    parser.addOption(sizeOption);
+    QCommandLineOption fileOption("file", "使用已有的文件，不生成测试文件", "path");
+    parser.addOption(fileOption);
+    parser.process(app);
+
+    QTemporaryDir directory;
+    if (!directory.isValid())
+    {
+        qWarning("无法创建临时目录");
+        return 1;
+    }
+
+    QString source = parser.value(fileOption);
+    if (source.isEmpty())
+    {
+        source = directory.filePath("source.bin");
+        qint64 size = qint64(qMax(parser.value(sizeOption).toInt(), 1)) * 1024 * 1024;
+        if (!createFile(source, size))
+        {
+            qWarning("无法生成测试文件");
+            return 1;
+        }
+    }
+
+    // 先运行一次，让两种方式都从页缓存读取源文件
+    QString target = directory.filePath("target.bin");
+    run(false, source, target);
+    report("读入内存", run(false, source, target));
+    report("映射文件", run(true, source, target));
+    return 0;
+}
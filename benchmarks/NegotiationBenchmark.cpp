@@ -0,0 +1,203 @@
+#include "TCPClient.h"
+#include "TCPFrame.h"
+#include "TCPServer.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <functional>
+
+// 混合部署下的协议协商测试：同一进程中运行一个只支持纯文本的旧版服务端和一个本项目的服务端，
+// 客户端依次新建连接、连接成功后立即发送一条文本消息，测量从发起连接到服务端收到消息的时间，
+// 并统计旧版服务端收到的Hello次数（协商探测注入的二进制数据）；
+// 客户端默认不使用帧格式，默认设置下旧版服务端不应收到Hello
+
+static const QByteArray Probe = "mixed-fleet-probe";
+
+struct Result
+{
+    int delivered = 0;
+    double averageMs = 0;
+    double maxMs = 0;
+    int hellos = 0; // 旧版服务端收到的Hello次数
+};
+
+// 只支持纯文本的旧版服务端：记录收到的数据，看到测试消息时调用delivered
+class LegacyServer : public QObject
+{
+  public:
+    std::function<void()> delivered;
+    int hellos = 0;
+
+    bool listen()
+    {
+        connect(&listener, &QTcpServer::newConnection, this, [this]() {
+            while (QTcpSocket *socket = listener.nextPendingConnection())
+            {
+                connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+                connect(socket, &QTcpSocket::readyRead, socket, [this, socket]() {
+                    QByteArray data = socket->property("received").toByteArray();
+                    bool seen = data.contains(Probe);
+                    data += socket->readAll();
+                    socket->setProperty("received", data);
+                    static const char magic[2] = {char(TCPFrame::Magic0), char(TCPFrame::Magic1)};
+                    if (!socket->property("hello").toBool() &&
+                        data.contains(QByteArrayView(magic, 2)))
+                    {
+                        socket->setProperty("hello", true);
+                        hellos++;
+                    }
+                    if (!seen && data.contains(Probe) && delivered)
+                    {
+                        delivered();
+                    }
+                });
+            }
+        });
+        return listener.listen(QHostAddress::LocalHost);
+    }
+
+    quint16 port() const
+    {
+        return listener.serverPort();
+    }
+
+  private:
+    QTcpServer listener;
+};
+
+// 处理事件直到done返回true，超时返回false
+static bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done())
+    {
+        if (timer.elapsed() > timeoutMs)
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+    }
+    return true;
+}
+
+// 依次建立count个连接，每个连接发出一条文本消息，等协商结束后断开，
+// 这样首次连接旧版服务端时客户端能记下探测结果；framing为false时保持客户端的默认设置
+static Result run(quint16 port, bool framing, int count, std::function<void()> &delivered)
+{
+    Result result;
+    double totalMs = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        TCPClient client;
+        if (framing)
+        {
+            client.setFramingEnabled(true);
+        }
+        QObject::connect(&client, &TCPClient::connected, &client,
+                         [&client]() { client.sendMessage(QString::fromLatin1(Probe), true); });
+
+        bool done = false;
+        bool negotiated = !framing;
+        QObject::connect(&client, &TCPClient::negotiated, &client,
+                         [&negotiated]() { negotiated = true; });
+        delivered = [&done]() { done = true; };
+        QElapsedTimer timer;
+        timer.start();
+        client.connectToServer("127.0.0.1", port);
+        if (waitFor([&done]() { return done; }, 10000))
+        {
+            double ms = timer.nsecsElapsed() / 1e6;
+            totalMs += ms;
+            result.maxMs = qMax(result.maxMs, ms);
+            result.delivered++;
+        }
+        delivered = nullptr;
+        waitFor([&negotiated]() { return negotiated; }, client.negotiationTimeout() + 1000);
+        client.disconnectFromServer();
+    }
+    result.averageMs = result.delivered > 0 ? totalMs / result.delivered : 0;
+    return result;
+}
+
+static void report(const char *name, const Result &result, int count, bool legacy)
+{
+    if (legacy)
+    {
+        qInfo("%s: 送达 %d/%d，平均 %.2f ms，最长 %.2f ms，旧版服务端收到Hello %d 次", name,
+              result.delivered, count, result.averageMs, result.maxMs, result.hellos);
+    }
+    else
+    {
+        qInfo("%s: 送达 %d/%d，平均 %.2f ms，最长 %.2f ms", name, result.delivered, count,
+              result.averageMs, result.maxMs);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("测量第一条消息送到旧版纯文本服务端和本项目服务端的时间");
+    parser.addHelpOption();
+    QCommandLineOption connectionsOption("connections", "每种情况建立的连接数", "count", "20");
+    parser.addOption(connectionsOption);
+    QCommandLineOption portOption("port", "本项目服务端使用的端口", "port", "18890");
+    parser.addOption(portOption);
+    parser.process(app);
+
+    int count = qMax(parser.value(connectionsOption).toInt(), 1);
+    quint16 framedPort = parser.value(portOption).toUShort();
+
+    std::function<void()> delivered;
+    LegacyServer legacy;
+    legacy.delivered = [&delivered]() {
+        if (delivered)
+        {
+            delivered();
+        }
+    };
+    if (!legacy.listen())
+    {
+        qWarning("无法启动旧版服务端");
+        return 1;
+    }
+
+    TCPServer framed;
+    QObject::connect(&framed, &TCPServer::messageReceived, &framed,
+                     [&delivered](const QString &, const QString &message) {
+                         if (message == QString::fromLatin1(Probe) && delivered)
+                         {
+                             delivered();
+                         }
+                     });
+    if (!framed.startServer(framedPort))
+    {
+        qWarning("无法启动服务端");
+        return 1;
+    }
+
+    // 旧版服务端：默认设置（不使用帧格式）作为基准；启用帧格式时第一次连接需要探测，
+    // 之后在记录的有效期内使用记录的结果
+    Result result = run(legacy.port(), false, count, delivered);
+    result.hellos = legacy.hellos;
+    report("旧版服务端，默认设置", result, count, true);
+
+    TCPClient::forgetPlainTextServers();
+    int hellos = legacy.hellos;
+    result = run(legacy.port(), true, 1, delivered);
+    result.hellos = legacy.hellos - hellos;
+    report("旧版服务端，启用帧格式，首次连接", result, 1, true);
+
+    hellos = legacy.hellos;
+    result = run(legacy.port(), true, count, delivered);
+    result.hellos = legacy.hellos - hellos;
+    report("旧版服务端，启用帧格式，之后的连接", result, count, true);
+
+    report("本项目服务端，默认设置", run(framedPort, false, count, delivered), count, false);
+    report("本项目服务端，启用帧格式", run(framedPort, true, count, delivered), count, false);
+    return 0;
+}
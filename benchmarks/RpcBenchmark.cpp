@@ -0,0 +1,129 @@
+#include "OutboundScheduler.h"
+#include "TCPFrame.h"
+#include "TCPRpc.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <functional>
+
+// RPC性能测试：在本机回环连接上比较逐个等待响应和流水线两种调用方式的每秒调用数
+
+// 连接的一端：读取帧并交给TCPRpc处理
+struct Endpoint
+{
+    OutboundScheduler scheduler;
+    TCPRpc rpc{&scheduler};
+    TCPFrameReader reader;
+    QTcpSocket *socket = nullptr;
+
+    void attach(QTcpSocket *peer)
+    {
+        socket = peer;
+        scheduler.addConnection(peer);
+        scheduler.setFramed(peer, true);
+        QObject::connect(peer, &QTcpSocket::readyRead, &scheduler, [this]() {
+            reader.readFrom(socket);
+            TCPFrameReader::Message &frame = reader.scratchMessage();
+            while (reader.next(frame))
+            {
+                rpc.processFrame(socket, frame.type, frame.payload);
+            }
+        });
+    }
+};
+
+// 发起calls次调用，同时最多window个未完成，返回每秒完成的调用数
+static double run(Endpoint &client, int calls, int window, const QByteArray &params)
+{
+    QEventLoop loop;
+    int sent = 0;
+    int done = 0;
+    int failed = 0;
+    std::function<void()> issue;
+    issue = [&]() {
+        while (sent < calls && sent - done < window)
+        {
+            sent++;
+            client.rpc.call(
+                client.socket, "echo", params,
+                [&](int status, const QByteArray &) {
+                    failed += status != TCPRpc::Ok;
+                    if (++done == calls)
+                    {
+                        loop.quit();
+                    }
+                    else
+                    {
+                        issue();
+                    }
+                },
+                30000);
+        }
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    issue();
+    loop.exec();
+    qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+    if (failed > 0)
+    {
+        qWarning("%d 次调用失败", failed);
+    }
+    return calls * 1000.0 / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("比较逐个调用和流水线调用的RPC吞吐");
+    parser.addHelpOption();
+    QCommandLineOption callsOption("calls", "每种方式的调用次数", "count", "20000");
+    parser.addOption(callsOption);
+    QCommandLineOption windowOption("window", "流水线方式同时未完成的调用数", "count", "64");
+    parser.addOption(windowOption);
+    QCommandLineOption sizeOption("size", "参数字节数", "bytes", "64");
+    parser.addOption(sizeOption);
+    parser.process(app);
+
+    int calls = qMax(parser.value(callsOption).toInt(), 1);
+    int window = qMax(parser.value(windowOption).toInt(), 1);
+    QByteArray params(qMax(parser.value(sizeOption).toInt(), 0), 'x');
+
+    QTcpServer listener;
+    if (!listener.listen(QHostAddress::LocalHost))
+    {
+        qWarning("%s", qPrintable(listener.errorString()));
+        return 1;
+    }
+
+    Endpoint client;
+    Endpoint server;
+    QTcpSocket *socket = new QTcpSocket(&app);
+    socket->connectToHost(QHostAddress::LocalHost, listener.serverPort());
+    if (!listener.waitForNewConnection(3000) || !socket->waitForConnected(3000))
+    {
+        qWarning("无法建立回环连接");
+        return 1;
+    }
+    client.attach(socket);
+    server.attach(listener.nextPendingConnection());
+    server.rpc.registerHandler("echo",
+                               [](const TCPRpc::Request &request, const TCPRpc::Reply &reply) {
+                                   reply(TCPRpc::Ok, request.params);
+                               });
+
+    // 先预热一轮，排除建立缓冲区等一次性开销
+    run(client, qMin(calls, 1000), window, params);
+
+    double lockStep = run(client, calls, 1, params);
+    double pipelined = run(client, calls, window, params);
+    qInfo("逐个调用: %.0f 次/秒", lockStep);
+    qInfo("流水线（窗口 %d）: %.0f 次/秒，%.2f 倍", window, pipelined, pipelined / lockStep);
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "TCPSchema.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+
+// 文件消息解码测试：比较原来的processFileMessage（解码为QString、按"|"拆分、Base64解码）
+// 和二进制消息格式的解码（字段为指向接收缓冲区的视图），以及解码后复制出数据的耗时，
+// 输出每条消息的纳秒数；只测解码本身，不经过网络
+
+// 防止编译器把结果未被使用的解码优化掉
+static volatile qint64 sink = 0;
+
+// 原来的文本格式: [FILE]文件名|文件大小|文件类型|Base64数据
+static void decodeText(const QByteArray &raw)
+{
+    QString message = QString::fromUtf8(raw);
+    QString content = message.mid(6);
+    QStringList parts = content.split("|", Qt::KeepEmptyParts);
+    if (parts.size() < 4)
+    {
+        return;
+    }
+    qint64 size = parts[1].toLongLong();
+    QByteArray data = QByteArray::fromBase64(parts[3].toLatin1());
+    sink = sink + size + parts[0].size() + parts[2].size() + data.size();
+}
+
+static void decodeSchema(const QByteArray &raw, bool copy)
+{
+    TCPSchema::FileMessage message;
+    if (!TCPSchema::decode(raw, message))
+    {
+        return;
+    }
+    if (copy)
+    {
+        // 发出信号时复制一次数据
+        QByteArray data = message.data.toByteArray();
+        sink = sink + data.size();
+    }
+    sink = sink + qint64(message.size) + message.name.size() + message.type.size() +
+           message.data.size();
+}
+
+// 重复解码直到至少运行minMs毫秒，返回每条消息的纳秒数
+template <typename Function> static double measure(Function decode, int minMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    qint64 count = 0;
+    do
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            decode();
+        }
+        count += 16;
+    } while (timer.elapsed() < minMs);
+    return double(timer.nsecsElapsed()) / count;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("比较文本格式和二进制格式文件消息的解码耗时");
+    parser.addHelpOption();
+    QCommandLineOption timeOption("time", "每种情况至少运行的毫秒数", "ms", "500");
+    parser.addOption(timeOption);
+    parser.process(app);
+
+    int minMs = qMax(parser.value(timeOption).toInt(), 1);
+
+    qInfo("数据字节   文本格式(ns/条)  二进制视图(ns/条)  二进制+复制(ns/条)");
+    for (int size : {64, 4 * 1024, 64 * 1024, 1024 * 1024})
+    {
+        QByteArray data(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i)
+        {
+            data[i] = char(i * 131);
+        }
+
+        QByteArray text = "[FILE]report.bin|" + QByteArray::number(size) +
+                          "|application/octet-stream|" + data.toBase64();
+
+        TCPSchema::FileMessage message;
+        message.name = "report.bin";
+        message.size = quint64(size);
+        message.type = "application/octet-stream";
+        message.data = data;
+        QByteArray binary = TCPSchema::encode(message);
+
+        double textNs = measure([&]() { decodeText(text); }, minMs);
+        double viewNs = measure([&]() { decodeSchema(binary, false); }, minMs);
+        double copyNs = measure([&]() { decodeSchema(binary, true); }, minMs);
+        qInfo("%-10d %-16.0f %-18.1f %.0f", size, textNs, viewNs, copyNs);
+    }
+    return 0;
+}
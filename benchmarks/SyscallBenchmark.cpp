@@ -0,0 +1,201 @@
+#include "OutboundScheduler.h"
+#include "TCPFrame.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <atomic>
+#include <dlfcn.h>
+#include <functional>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// 发送路径系统调用测试：在本机回环连接上发送帧，统计每条消息的写系统调用次数。
+// 比较三种方式：每条消息拼接帧头后直接调用socket的write（原来的方式）；
+// 经调度器按连接合并后交给socket写缓冲区；经调度器用一次sendmsg写入帧头和负载。
+// 通过替换libc的write、writev、send、sendto和sendmsg统计调用次数；仅Linux可用
+
+// 每次事件循环入队的消息数，模拟持续产生消息的应用
+static const int MessagesPerTurn = 16;
+
+static std::atomic<quint64> writeCalls{0};
+
+template <typename Function> static Function nextSymbol(const char *name)
+{
+    return reinterpret_cast<Function>(::dlsym(RTLD_NEXT, name));
+}
+
+extern "C"
+{
+    ssize_t write(int fd, const void *data, size_t size)
+    {
+        static auto real = nextSymbol<ssize_t (*)(int, const void *, size_t)>("write");
+        writeCalls.fetch_add(1, std::memory_order_relaxed);
+        return real(fd, data, size);
+    }
+
+    ssize_t writev(int fd, const struct iovec *vectors, int count)
+    {
+        static auto real = nextSymbol<ssize_t (*)(int, const struct iovec *, int)>("writev");
+        writeCalls.fetch_add(1, std::memory_order_relaxed);
+        return real(fd, vectors, count);
+    }
+
+    ssize_t send(int fd, const void *data, size_t size, int flags)
+    {
+        static auto real = nextSymbol<ssize_t (*)(int, const void *, size_t, int)>("send");
+        writeCalls.fetch_add(1, std::memory_order_relaxed);
+        return real(fd, data, size, flags);
+    }
+
+    ssize_t sendto(int fd, const void *data, size_t size, int flags,
+                   const struct sockaddr *address, socklen_t length)
+    {
+        static auto real =
+            nextSymbol<ssize_t (*)(int, const void *, size_t, int, const struct sockaddr *,
+                                   socklen_t)>("sendto");
+        writeCalls.fetch_add(1, std::memory_order_relaxed);
+        return real(fd, data, size, flags, address, length);
+    }
+
+    ssize_t sendmsg(int fd, const struct msghdr *message, int flags)
+    {
+        static auto real = nextSymbol<ssize_t (*)(int, const struct msghdr *, int)>("sendmsg");
+        writeCalls.fetch_add(1, std::memory_order_relaxed);
+        return real(fd, message, flags);
+    }
+}
+
+enum Mode
+{
+    DirectWrite, // 拼接帧头后逐条write
+    Buffered,    // 调度器合并后交给socket写缓冲区
+    Vectored     // 调度器用sendmsg直接写入
+};
+
+struct Result
+{
+    bool ok = false;
+    double syscallsPerMessage = 0;
+    double messagesPerSecond = 0;
+};
+
+// 处理事件直到done返回true，超时返回false
+static bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done())
+    {
+        if (timer.elapsed() > timeoutMs)
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+    }
+    return true;
+}
+
+static Result run(Mode mode, int messages, int size)
+{
+    Result result;
+    QTcpServer listener;
+    QTcpSocket sender;
+    if (!listener.listen(QHostAddress::LocalHost))
+    {
+        return result;
+    }
+    sender.connectToHost(QHostAddress::LocalHost, listener.serverPort());
+    if (!listener.waitForNewConnection(3000) || !sender.waitForConnected(3000))
+    {
+        return result;
+    }
+    QTcpSocket *receiver = listener.nextPendingConnection();
+
+    OutboundScheduler scheduler;
+    scheduler.setVectoredWrites(mode == Vectored);
+    scheduler.addConnection(&sender);
+    scheduler.setFramed(&sender, true);
+
+    TCPFrameReader reader;
+    int received = 0;
+    QObject::connect(receiver, &QTcpSocket::readyRead, receiver, [&]() {
+        reader.readFrom(receiver);
+        TCPFrameReader::Message &frame = reader.scratchMessage();
+        while (reader.next(frame))
+        {
+            received++;
+        }
+    });
+
+    QByteArray payload(size, 'x');
+    int sent = 0;
+    QTimer producer;
+    QObject::connect(&producer, &QTimer::timeout, &producer, [&]() {
+        for (int i = 0; i < MessagesPerTurn && sent < messages; ++i, ++sent)
+        {
+            if (mode == DirectWrite)
+            {
+                sender.write(TCPFrame::encode(TCPFrame::FileFrame, payload));
+            }
+            else
+            {
+                scheduler.enqueue(&sender, payload, OutboundScheduler::BulkClass,
+                                  TCPFrame::FileFrame);
+            }
+        }
+        if (sent == messages)
+        {
+            producer.stop();
+        }
+    });
+
+    quint64 before = writeCalls.load(std::memory_order_relaxed);
+    QElapsedTimer timer;
+    timer.start();
+    producer.start(0);
+    result.ok = waitFor([&]() { return received >= messages; }, 120000);
+    qint64 elapsed = qMax<qint64>(timer.nsecsElapsed(), 1);
+    quint64 calls = writeCalls.load(std::memory_order_relaxed) - before;
+    result.syscallsPerMessage = double(calls) / qMax(received, 1);
+    result.messagesPerSecond = received / (elapsed / 1e9);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("统计发送路径上每条消息的写系统调用次数");
+    parser.addHelpOption();
+    QCommandLineOption messagesOption("messages", "每种情况发送的消息数", "count", "100000");
+    parser.addOption(messagesOption);
+    parser.process(app);
+
+    int messages = qMax(parser.value(messagesOption).toInt(), MessagesPerTurn);
+    const char *names[] = {"逐条write", "调度器+写缓冲区", "调度器+sendmsg"};
+
+    QList<QPair<int, int>> cases;
+    cases << qMakePair(64, messages) << qMakePair(4 * 1024, messages)
+          << qMakePair(256 * 1024, qMax(messages / 100, MessagesPerTurn));
+    for (const QPair<int, int> &item : std::as_const(cases))
+    {
+        for (Mode mode : {DirectWrite, Buffered, Vectored})
+        {
+            // 先统计再输出，输出本身的write不计入
+            Result result = run(mode, item.second, item.first);
+            if (!result.ok)
+            {
+                qWarning("%s，%d 字节: 消息未全部送达", names[mode], item.first);
+                continue;
+            }
+            qInfo("%-16s %8d 字节  %.3f 次系统调用/消息  %.0f 条消息/秒", names[mode],
+                  item.first, result.syscallsPerMessage, result.messagesPerSecond);
+        }
+    }
+    return 0;
+}
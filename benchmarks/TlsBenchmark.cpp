@@ -0,0 +1,231 @@
+#include "TCPClient.h"
+#include "TCPServer.h"
+#include "TCPTls.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QSslSocket>
+#include <QTemporaryDir>
+#include <functional>
+
+// TLS性能测试：在本机回环上比较纯TCP、TLS完整握手和TLS会话票据恢复三种情况下
+// 每秒完成的连接数，以及纯TCP和TLS连接上发送文本消息的吞吐量。
+// 未指定证书时用openssl命令行生成一个只在本次运行中使用的自签名证书
+
+struct HandshakeResult
+{
+    int connected = 0;
+    double perSecond = 0;
+};
+
+struct ThroughputResult
+{
+    bool ok = false;
+    double messagesPerSecond = 0;
+    double megabytesPerSecond = 0;
+};
+
+// 处理事件直到done返回true，超时返回false
+static bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done())
+    {
+        if (timer.elapsed() > timeoutMs)
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+    }
+    return true;
+}
+
+// 生成127.0.0.1的自签名证书和私钥，失败时返回false
+static bool generateCertificate(const QString &certificatePath, const QString &keyPath)
+{
+    QProcess openssl;
+    openssl.start("openssl",
+                  QStringList() << "req" << "-x509" << "-newkey" << "ec" << "-pkeyopt"
+                                << "ec_paramgen_curve:prime256v1" << "-nodes" << "-days" << "1"
+                                << "-subj" << "/CN=127.0.0.1" << "-addext"
+                                << "subjectAltName=IP:127.0.0.1" << "-keyout" << keyPath
+                                << "-out" << certificatePath);
+    return openssl.waitForFinished(30000) && openssl.exitStatus() == QProcess::NormalExit &&
+           openssl.exitCode() == 0;
+}
+
+// 依次建立count个连接，每个连接在connected（启用TLS时为握手完成）之后立即断开
+// resume为false时每次连接前清空会话票据缓存，强制完整握手
+static HandshakeResult handshakes(quint16 port, const QSslConfiguration &config, int count,
+                                  bool resume)
+{
+    HandshakeResult result;
+    QString peer = QString("127.0.0.1:%1").arg(port);
+    TCPTls::clearSessionTickets();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < count; ++i)
+    {
+        if (!resume)
+        {
+            TCPTls::clearSessionTickets();
+        }
+
+        TCPClient client;
+        client.setTlsConfiguration(config);
+        bool connected = false;
+        QObject::connect(&client, &TCPClient::connected, &client,
+                         [&connected]() { connected = true; });
+        client.connectToServer("127.0.0.1", port);
+        if (waitFor([&connected]() { return connected; }, 10000))
+        {
+            result.connected++;
+        }
+
+        // TLS 1.3的会话票据在握手之后才到达，恢复握手时等它进入缓存
+        if (resume && !config.isNull())
+        {
+            waitFor([&peer]() { return !TCPTls::sessionTicket(peer).isEmpty(); }, 1000);
+        }
+        client.disconnectFromServer();
+    }
+    qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+    result.perSecond = result.connected * 1000.0 / elapsed;
+    return result;
+}
+
+// 一个连接上发送messages条size字节的文本消息，等服务端全部收到
+static ThroughputResult throughput(TCPServer &server, quint16 port,
+                                   const QSslConfiguration &config, int messages, int size)
+{
+    ThroughputResult result;
+    int received = 0;
+    QMetaObject::Connection counter = QObject::connect(
+        &server, &TCPServer::messageReceived, &server, [&received]() { received++; });
+
+    TCPClient client;
+    client.setTlsConfiguration(config);
+    bool connected = false;
+    QObject::connect(&client, &TCPClient::connected, &client,
+                     [&connected]() { connected = true; });
+    client.connectToServer("127.0.0.1", port);
+    if (waitFor([&connected]() { return connected; }, 10000))
+    {
+        QString message(size, 'x');
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < messages; ++i)
+        {
+            client.sendMessage(message);
+        }
+        result.ok = waitFor([&]() { return received >= messages; }, 120000);
+        qint64 elapsed = qMax<qint64>(timer.nsecsElapsed(), 1);
+        result.messagesPerSecond = received / (elapsed / 1e9);
+        result.megabytesPerSecond = double(received) * size / (1024 * 1024) / (elapsed / 1e9);
+    }
+
+    client.disconnectFromServer();
+    QObject::disconnect(counter);
+    return result;
+}
+
+static void reportHandshakes(const char *name, const HandshakeResult &result, int count)
+{
+    qInfo("%s: 建立 %d/%d 个连接，%.0f 次/秒", name, result.connected, count,
+          result.perSecond);
+}
+
+static void reportThroughput(const char *name, const ThroughputResult &result)
+{
+    if (!result.ok)
+    {
+        qWarning("%s: 测试未完成（无法连接或消息未全部送达）", name);
+        return;
+    }
+    qInfo("%s: %.0f 条消息/秒，%.1f MB/s", name, result.messagesPerSecond,
+          result.megabytesPerSecond);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("比较纯TCP和TLS的握手速度和吞吐量");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "测试使用的端口（TLS使用下一个端口）", "port",
+                                  "18892");
+    parser.addOption(portOption);
+    QCommandLineOption connectionsOption("connections", "每种情况建立的连接数", "count", "500");
+    parser.addOption(connectionsOption);
+    QCommandLineOption messagesOption("messages", "吞吐测试发送的消息数", "count", "100000");
+    parser.addOption(messagesOption);
+    QCommandLineOption sizeOption("size", "每条消息的字节数", "bytes", "1024");
+    parser.addOption(sizeOption);
+    QCommandLineOption certOption("cert", "服务端证书（PEM），客户端也用它作为CA证书", "file");
+    parser.addOption(certOption);
+    QCommandLineOption keyOption("key", "服务端私钥（PEM）", "file");
+    parser.addOption(keyOption);
+    QCommandLineOption ciphersOption("ciphers", "密码套件（OpenSSL格式）", "list");
+    parser.addOption(ciphersOption);
+    parser.process(app);
+
+    if (!QSslSocket::supportsSsl())
+    {
+        qWarning("当前Qt没有可用的TLS后端");
+        return 1;
+    }
+
+    quint16 plainPort = parser.value(portOption).toUShort();
+    quint16 tlsPort = plainPort + 1;
+    int count = qMax(parser.value(connectionsOption).toInt(), 1);
+    int messages = qMax(parser.value(messagesOption).toInt(), 1);
+    int size = qMax(parser.value(sizeOption).toInt(), 1);
+    QString ciphers = parser.value(ciphersOption);
+
+    QTemporaryDir directory;
+    QString certificatePath = parser.value(certOption);
+    QString keyPath = parser.value(keyOption);
+    if (certificatePath.isEmpty() || keyPath.isEmpty())
+    {
+        certificatePath = directory.filePath("cert.pem");
+        keyPath = directory.filePath("key.pem");
+        if (!directory.isValid() || !generateCertificate(certificatePath, keyPath))
+        {
+            qWarning("无法生成测试证书，请用--cert和--key指定");
+            return 1;
+        }
+    }
+
+    QString error;
+    QSslConfiguration serverConfig =
+        TCPTls::serverConfiguration(certificatePath, keyPath, ciphers, &error);
+    QSslConfiguration clientConfig =
+        serverConfig.isNull() ? QSslConfiguration()
+                              : TCPTls::clientConfiguration(certificatePath, ciphers, &error);
+    if (serverConfig.isNull() || clientConfig.isNull())
+    {
+        qWarning("TLS配置无效: %s", qPrintable(error));
+        return 1;
+    }
+
+    TCPServer plainServer;
+    TCPServer tlsServer;
+    tlsServer.setTlsConfiguration(serverConfig);
+    if (!plainServer.startServer(plainPort) || !tlsServer.startServer(tlsPort))
+    {
+        qWarning("无法启动服务端");
+        return 1;
+    }
+
+    reportHandshakes("纯TCP", handshakes(plainPort, QSslConfiguration(), count, false), count);
+    reportHandshakes("TLS完整握手", handshakes(tlsPort, clientConfig, count, false), count);
+    reportHandshakes("TLS会话恢复", handshakes(tlsPort, clientConfig, count, true), count);
+
+    reportThroughput("纯TCP吞吐",
+                     throughput(plainServer, plainPort, QSslConfiguration(), messages, size));
+    reportThroughput("TLS吞吐", throughput(tlsServer, tlsPort, clientConfig, messages, size));
+    return 0;
+}
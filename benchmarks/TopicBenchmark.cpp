@@ -0,0 +1,316 @@
+#include "TCPFrame.h"
+#include "TCPServer.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QVector>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <functional>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// 发布/订阅性能测试：在本机回环上建立大量客户端连接，每个客户端订阅若干主题，
+// 测量从调用publish到所有订阅者都收到完整消息的延迟，分别测试订阅者较少的普通主题
+// 和所有客户端都订阅的热门主题。客户端使用原始socket，不创建QObject；仅Unix可用
+
+// 服务端每次等待监听队列被取空之前，客户端最多发起的连接数（小于默认的待处理连接队列长度）
+static const int ConnectBatch = 25;
+
+// 所有客户端都订阅的主题
+static const char HotTopic[] = "hot";
+
+struct Result
+{
+    int publishes = 0;
+    double averageSubscribers = 0;
+    double callUs = 0; // publish调用本身（查找订阅者、编码和入队）的平均耗时
+    double p50Us = 0;
+    double p99Us = 0;
+};
+
+// 发起到本机port端口的非阻塞连接，失败时返回-1
+static int connectTo(quint16 port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 &&
+        errno != EINPROGRESS)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 处理事件直到done返回true，超时返回false
+static bool waitFor(const std::function<bool()> &done, int timeoutMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!done())
+    {
+        if (timer.elapsed() > timeoutMs)
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    return true;
+}
+
+static QString topicName(int index)
+{
+    return QString("topic-%1").arg(index);
+}
+
+// 处理事件并从订阅者读取数据，直到每个订阅者都收到bytes字节，超时返回false
+static bool receiveAll(const QVector<int> &fds, qint64 bytes, int timeoutMs)
+{
+    QVector<qint64> remaining(fds.size(), bytes);
+    QVector<struct pollfd> pending;
+    QVector<int> pendingIndex; // pending中每一项对应的fds下标
+    int done = 0;
+    char buffer[4096];
+    QElapsedTimer timer;
+    timer.start();
+    while (done < fds.size())
+    {
+        if (timer.elapsed() > timeoutMs)
+        {
+            return false;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents);
+
+        pending.clear();
+        pendingIndex.clear();
+        for (int i = 0; i < fds.size(); ++i)
+        {
+            if (remaining.at(i) > 0)
+            {
+                pending.append({fds.at(i), POLLIN, 0});
+                pendingIndex.append(i);
+            }
+        }
+        if (::poll(pending.data(), nfds_t(pending.size()), 0) <= 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < pending.size(); ++i)
+        {
+            if (!(pending.at(i).revents & POLLIN))
+            {
+                continue;
+            }
+            int index = pendingIndex.at(i);
+            ssize_t count;
+            while (remaining.at(index) > 0 &&
+                   (count = ::recv(fds.at(index), buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+            {
+                remaining[index] -= count;
+            }
+            if (remaining.at(index) <= 0)
+            {
+                done++;
+            }
+        }
+    }
+    return true;
+}
+
+static double percentile(QVector<qint64> values, double fraction)
+{
+    if (values.isEmpty())
+    {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    qsizetype index = qMin(values.size() - 1, qsizetype(fraction * values.size()));
+    return values[index] / 1000.0;
+}
+
+// 依次向给定主题发布消息，每次等所有订阅者收到后再发布下一条
+static Result measure(TCPServer &server, const QVector<QString> &topics,
+                      const QHash<QString, QVector<int>> &subscribers, const QString &message)
+{
+    Result result;
+    QVector<qint64> latenciesNs;
+    qint64 callNs = 0;
+    qint64 subscriberTotal = 0;
+    QElapsedTimer timer;
+    for (const QString &topic : topics)
+    {
+        const QVector<int> fds = subscribers.value(topic);
+        qint64 bytes =
+            TCPFrame::encode(TCPFrame::PublishFrame,
+                             TCPFrame::encodePublishPayload(topic, message.toUtf8()))
+                .size();
+
+        timer.start();
+        int count = server.publish(topic, message);
+        callNs += timer.nsecsElapsed();
+        if (count != fds.size() || !receiveAll(fds, bytes, 30000))
+        {
+            qWarning("主题 %s 的消息未全部送达（%d/%lld 个订阅者）", qPrintable(topic), count,
+                     qint64(fds.size()));
+            break;
+        }
+        latenciesNs.append(timer.nsecsElapsed());
+        subscriberTotal += count;
+    }
+
+    result.publishes = latenciesNs.size();
+    if (result.publishes > 0)
+    {
+        result.averageSubscribers = double(subscriberTotal) / result.publishes;
+        result.callUs = callNs / 1000.0 / result.publishes;
+    }
+    result.p50Us = percentile(latenciesNs, 0.5);
+    result.p99Us = percentile(latenciesNs, 0.99);
+    return result;
+}
+
+static void report(const char *name, const Result &result)
+{
+    qInfo("%s: %d 次发布，平均 %.0f 个订阅者，publish调用 %.1f us，送达延迟 p50 %.1f us，"
+          "p99 %.1f us",
+          name, result.publishes, result.averageSubscribers, result.callUs, result.p50Us,
+          result.p99Us);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("测量大量主题和客户端下的发布延迟");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "测试使用的端口", "port", "18888");
+    parser.addOption(portOption);
+    QCommandLineOption clientsOption("clients", "客户端连接数", "count", "10000");
+    parser.addOption(clientsOption);
+    QCommandLineOption topicsOption("topics", "主题数", "count", "10000");
+    parser.addOption(topicsOption);
+    QCommandLineOption perClientOption("per-client", "每个客户端订阅的普通主题数", "count",
+                                       "10");
+    parser.addOption(perClientOption);
+    QCommandLineOption publishesOption("publishes", "普通主题的发布次数", "count", "1000");
+    parser.addOption(publishesOption);
+    QCommandLineOption hotOption("hot", "热门主题的发布次数", "count", "20");
+    parser.addOption(hotOption);
+    QCommandLineOption sizeOption("size", "每条消息的字节数", "bytes", "64");
+    parser.addOption(sizeOption);
+    parser.process(app);
+
+    // 客户端和服务端两侧的描述符都在本进程中，把描述符上限提高到系统允许的最大值
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    quint16 port = parser.value(portOption).toUShort();
+    int clients = qMax(parser.value(clientsOption).toInt(), 1);
+    int topicCount = qMax(parser.value(topicsOption).toInt(), 1);
+    int perClient = qBound(1, parser.value(perClientOption).toInt(), topicCount);
+    int publishes = qMax(parser.value(publishesOption).toInt(), 1);
+    int hot = qMax(parser.value(hotOption).toInt(), 0);
+    QString message(qMax(parser.value(sizeOption).toInt(), 1), 'x');
+
+    TCPServer server;
+    if (!server.startServer(port))
+    {
+        qWarning("无法在端口 %u 上启动服务器", port);
+        return 1;
+    }
+
+    QVector<int> fds;
+    for (int i = 0; i < clients; ++i)
+    {
+        int fd = connectTo(port);
+        if (fd >= 0)
+        {
+            fds.append(fd);
+        }
+        if (fds.size() % ConnectBatch == 0)
+        {
+            waitFor([&]() { return server.clientCount() >= fds.size(); }, 5000);
+        }
+    }
+    if (!waitFor([&]() { return server.clientCount() >= fds.size(); }, 10000))
+    {
+        qWarning("只建立了 %d/%lld 个连接", server.clientCount(), qint64(fds.size()));
+    }
+
+    // 客户端i订阅连续的perClient个普通主题和热门主题，每个普通主题的订阅者数大致相同
+    QHash<QString, QVector<int>> subscribers;
+    int subscriptions = 0;
+    for (int i = 0; i < fds.size(); ++i)
+    {
+        QByteArray frames;
+        QStringList topics;
+        for (int k = 0; k < perClient; ++k)
+        {
+            topics << topicName(int((qint64(i) * perClient + k) % topicCount));
+        }
+        topics << HotTopic;
+        for (const QString &topic : std::as_const(topics))
+        {
+            frames += TCPFrame::encode(
+                TCPFrame::ControlFrame,
+                TCPFrame::encodeControl(TCPFrame::SubscribeOpcode, topic.toUtf8()));
+            subscribers[topic].append(fds.at(i));
+        }
+        if (::send(fds.at(i), frames.constData(), size_t(frames.size()), MSG_NOSIGNAL) ==
+            frames.size())
+        {
+            subscriptions += topics.size();
+        }
+    }
+
+    QList<QString> topicNames = subscribers.keys();
+    waitFor(
+        [&]() {
+            int total = 0;
+            for (const QString &topic : std::as_const(topicNames))
+            {
+                total += server.subscriberCount(topic);
+            }
+            return total >= subscriptions;
+        },
+        30000);
+    qInfo("%lld 个连接，%lld 个主题，%d 个订阅", qint64(fds.size()), qint64(topicNames.size()),
+          subscriptions);
+
+    QVector<QString> normal;
+    for (int i = 0; i < publishes; ++i)
+    {
+        normal.append(topicName(int(qint64(i) * 7919 % topicCount)));
+    }
+    report("普通主题", measure(server, normal, subscribers, message));
+    QVector<QString> hotTopics(hot, QString(HotTopic));
+    report("热门主题", measure(server, hotTopics, subscribers, message));
+
+    for (int fd : std::as_const(fds))
+    {
+        ::close(fd);
+    }
+    server.stopServer();
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "MappedFile.h"
 #include <QBuffer>
 #include <QDateTime>
 #include <QDir>
@@ -27,6 +28,7 @@ MainWindow::MainWindow(QWidget *parent)
 
     // 初始化编码设置
     updateEncodingSettings();
+    updateSocketProfile();
 
     setupConnections();
 }
@@ -40,11 +42,13 @@ void MainWindow::setupConnections()
 {
     // 客户端信号连接
     connect(client, &TCPClient::connected, this, &MainWindow::onClientConnected);
+    connect(client, &TCPClient::negotiated, this, &MainWindow::onClientNegotiated);
     connect(client, &TCPClient::disconnected, this, &MainWindow::onClientDisconnected);
     connect(client, &TCPClient::messageReceived, this, &MainWindow::onClientMessageReceived);
     connect(client, &TCPClient::errorOccurred, this, &MainWindow::onClientError);
     connect(client, &TCPClient::fileReceived, this, &MainWindow::onClientFileReceived);
     connect(client, &TCPClient::imageReceived, this, &MainWindow::onClientImageReceived);
+    connect(client, &TCPClient::filesReceived, this, &MainWindow::onClientFilesReceived);
 
     // 服务端信号连接
     connect(server, &TCPServer::serverStarted, this, &MainWindow::onServerStarted);
@@ -53,8 +57,11 @@ void MainWindow::setupConnections()
     connect(server, &TCPServer::clientDisconnected, this, &MainWindow::onServerClientDisconnected);
     connect(server, &TCPServer::messageReceived, this, &MainWindow::onServerMessageReceived);
     connect(server, &TCPServer::errorOccurred, this, &MainWindow::onServerError);
+    connect(server, &TCPServer::connectionRejected, this,
+            &MainWindow::onServerConnectionRejected);
     connect(server, &TCPServer::fileReceived, this, &MainWindow::onServerFileReceived);
     connect(server, &TCPServer::imageReceived, this, &MainWindow::onServerImageReceived);
+    connect(server, &TCPServer::filesReceived, this, &MainWindow::onServerFilesReceived);
 }
 
 void MainWindow::on_modeComboBox_currentTextChanged(const QString &mode)
@@ -122,6 +129,12 @@ void MainWindow::on_actionNewWindow_triggered()
 {
     MainWindow *newWindow = new MainWindow();
     newWindow->setAttribute(Qt::WA_DeleteOnClose);
+    // 新窗口沿用当前的socket调优预设、服务端后端和帧格式设置
+    newWindow->ui->socketProfileComboBox->setCurrentIndex(
+        ui->socketProfileComboBox->currentIndex());
+    newWindow->ui->serverBackendComboBox->setCurrentIndex(
+        ui->serverBackendComboBox->currentIndex());
+    newWindow->ui->framingCheckBox->setChecked(ui->framingCheckBox->isChecked());
     newWindow->show();
 }
 
@@ -169,6 +182,19 @@ void MainWindow::onClientConnected()
     updateUI();
 }
 
+void MainWindow::onClientNegotiated(quint32 capabilities)
+{
+    // 服务端没有回复Hello时连接回退到纯文本协议
+    if (capabilities != 0)
+    {
+        appendToLog(tr("使用帧格式"));
+    }
+    else
+    {
+        appendToLog(tr("服务端只支持纯文本协议"));
+    }
+}
+
 void MainWindow::onClientDisconnected()
 {
     appendToLog(tr("已断开连接"));
@@ -229,6 +255,11 @@ void MainWindow::onServerError(const QString &errorMessage)
     appendToLog(tr("服务器错误: %1").arg(errorMessage));
 }
 
+void MainWindow::onServerConnectionRejected(const QString &clientInfo, const QString &reason)
+{
+    appendToLog(tr("拒绝客户端连接 %1: %2").arg(clientInfo).arg(reason));
+}
+
 void MainWindow::updateUI()
 {
     bool isServerMode = (currentMode == ServerMode);
@@ -242,6 +273,7 @@ void MainWindow::updateUI()
     ui->startButton->setVisible(isServerMode);
     ui->stopButton->setVisible(isServerMode);
     ui->connectButton->setVisible(isClientMode);
+    ui->framingCheckBox->setVisible(isClientMode);
 
     // 客户端选择相关控件
     ui->targetClientLabel->setVisible(isServerMode);
@@ -411,6 +443,70 @@ void MainWindow::on_targetClientComboBox_currentIndexChanged(int index)
     }
 }
 
+void MainWindow::on_socketProfileComboBox_currentIndexChanged(int index)
+{
+    updateSocketProfile();
+}
+
+bool MainWindow::setSocketProfile(const QString &name)
+{
+    int index = SocketTuning::profileNames().indexOf(name.trimmed().toLower());
+    if (index < 0)
+    {
+        return false;
+    }
+    ui->socketProfileComboBox->setCurrentIndex(index);
+    updateSocketProfile();
+    return true;
+}
+
+bool MainWindow::setServerBackend(const QString &name)
+{
+    QString key = name.trimmed().toLower();
+    if (key != "qt" && key != "epoll")
+    {
+        return false;
+    }
+    ui->serverBackendComboBox->setCurrentIndex(key == "epoll" ? 1 : 0);
+    return true;
+}
+
+bool MainWindow::startCapture(const QString &path, QString *errorString)
+{
+    if (!server->startCapture(path, errorString))
+    {
+        return false;
+    }
+    appendToLog(tr("流量捕获已开启: %1").arg(path));
+    return true;
+}
+
+void MainWindow::on_serverBackendComboBox_currentIndexChanged(int index)
+{
+    // 下次启动服务器时生效
+    server->setBackend(index == 1 ? TCPServer::EpollBackend : TCPServer::QtBackend);
+}
+
+void MainWindow::on_framingCheckBox_toggled(bool checked)
+{
+    // 默认关闭，不向只支持纯文本的服务端发送Hello；已连接时立即开始或停止协商
+    client->setFramingEnabled(checked);
+}
+
+void MainWindow::updateSocketProfile()
+{
+    // 下拉框的顺序与SocketTuning::profileNames()一致
+    SocketTuning::Profile profile;
+    QString name = SocketTuning::profileNames().value(ui->socketProfileComboBox->currentIndex());
+    if (!SocketTuning::profileByName(name, profile))
+    {
+        profile = SocketTuning::defaultProfile();
+    }
+
+    client->setSocketProfile(profile);
+    server->setSocketProfile(profile);
+}
+
 void MainWindow::updateEncodingSettings()
 {
     // 获取当前选择的编码
@@ -561,6 +657,58 @@ void MainWindow::on_sendFileButton_clicked()
     }
 }
 
+void MainWindow::on_sendFolderButton_clicked()
+{
+    QString folderPath = QFileDialog::getExistingDirectory(this, tr("选择文件夹"));
+    if (folderPath.isEmpty())
+    {
+        return;
+    }
+
+    QString folderName = QFileInfo(folderPath).fileName();
+
+    if (currentMode == ClientMode && client->isConnected())
+    {
+        if (client->sendFiles(QStringList(folderPath)))
+        {
+            appendTimestampedMessage(tr("发送文件夹: %1").arg(folderName), SentMessage);
+        }
+    }
+    else if (currentMode == ServerMode && server->isRunning())
+    {
+        // 批量传输只发给特定客户端
+        int targetIndex = ui->targetClientComboBox->currentIndex();
+        if (targetIndex == 0)
+        {
+            QMessageBox::information(this, tr("发送文件夹"), tr("请选择要发送的客户端"));
+            return;
+        }
+
+        QString clientInfo = ui->targetClientComboBox->currentText();
+        if (server->sendFilesToClient(clientInfo, QStringList(folderPath)))
+        {
+            appendTimestampedMessage(tr("发送文件夹给 %1: %2").arg(clientInfo).arg(folderName),
+                                     SentMessage);
+        }
+    }
+}
+
+void MainWindow::on_receiveFolderButton_clicked()
+{
+    // 选择目录之前不接收对方批量发来的文件
+    QString start = client->receiveDirectory().isEmpty() ? FileBatch::defaultDirectory()
+                                                          : client->receiveDirectory();
+    QString directory = QFileDialog::getExistingDirectory(this, tr("选择批量接收目录"), start);
+    if (directory.isEmpty())
+    {
+        return;
+    }
+
+    client->setReceiveDirectory(directory);
+    server->setReceiveDirectory(directory);
+    appendToLog(tr("批量接收的文件将保存在: %1").arg(directory));
+}
+
 void MainWindow::on_sendImageButton_clicked()
 {
     QString imagePath = QFileDialog::getOpenFileName(
@@ -672,16 +820,15 @@ void MainWindow::onClientFileReceived(const QString &fileName, qint64 fileSize,
     if (!saveDir.isEmpty())
     {
         QString savePath = QDir(saveDir).filePath(fileName);
-        QFile file(savePath);
-        if (file.open(QIODevice::WriteOnly))
+        // 较大的文件预分配后经由映射写入
+        QString error;
+        if (MappedFile::write(savePath, fileData, &error))
         {
-            file.write(fileData);
-            file.close();
             appendToLog(tr("文件已保存至: %1").arg(savePath));
         }
         else
         {
-            appendToLog(tr("无法保存文件: %1").arg(file.errorString()));
+            appendToLog(tr("无法保存文件: %1").arg(error));
         }
     }
 }
@@ -751,16 +898,15 @@ void MainWindow::onServerFileReceived(const QString &clientInfo, const QString &
     if (!saveDir.isEmpty())
     {
         QString savePath = QDir(saveDir).filePath(fileName);
-        QFile file(savePath);
-        if (file.open(QIODevice::WriteOnly))
+        // 较大的文件预分配后经由映射写入
+        QString error;
+        if (MappedFile::write(savePath, fileData, &error))
         {
-            file.write(fileData);
-            file.close();
             appendToLog(tr("文件已保存至: %1").arg(savePath));
         }
         else
         {
-            appendToLog(tr("无法保存文件: %1").arg(file.errorString()));
+            appendToLog(tr("无法保存文件: %1").arg(error));
         }
     }
 }
@@ -817,4 +963,32 @@ void MainWindow::onServerImageReceived(const QString &clientInfo, const QString
     {
         appendToLog(tr("无法显示接收到的图片"));
     }
-}
\ No newline at end of file
+}
+
+void MainWindow::onClientFilesReceived(const QStringList &paths, qint64 totalBytes, bool finished)
+{
+    appendTimestampedMessage(tr("收到 %1 个文件 (%2 字节)，保存在: %3")
+                                 .arg(paths.size())
+                                 .arg(totalBytes)
+                                 .arg(client->receiveDirectory()),
+                             ReceivedMessage);
+    if (finished)
+    {
+        appendToLog(tr("批量文件传输完成"));
+    }
+}
+
+void MainWindow::onServerFilesReceived(const QString &clientInfo, const QStringList &paths,
+                                       qint64 totalBytes, bool finished)
+{
+    appendTimestampedMessage(tr("收到来自 %1 的 %2 个文件 (%3 字节)，保存在: %4")
+                                 .arg(clientInfo)
+                                 .arg(paths.size())
+                                 .arg(totalBytes)
+                                 .arg(server->receiveDirectory()),
+                             ReceivedMessage);
+    if (finished)
+    {
+        appendToLog(tr("来自 %1 的批量文件传输完成").arg(clientInfo));
+    }
+}
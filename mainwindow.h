@@ -20,6 +20,15 @@ class MainWindow : public QMainWindow
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    // 按名称选择socket调优预设（见SocketTuning::profileNames），名称不存在时返回false
+    bool setSocketProfile(const QString &name);
+
+    // 按名称（qt或epoll）选择服务端后端，名称不存在时返回false
+    bool setServerBackend(const QString &name);
+
+    // 把服务端收发的流量捕获到path，失败时通过errorString返回原因
+    bool startCapture(const QString &path, QString *errorString = nullptr);
+
   private slots:
     void on_modeComboBox_currentTextChanged(const QString &mode);
     void on_startButton_clicked();
@@ -31,9 +40,13 @@ class MainWindow : public QMainWindow
     void on_sendEncodingComboBox_currentIndexChanged(int index);
     void on_receiveEncodingComboBox_currentIndexChanged(int index);
     void on_targetClientComboBox_currentIndexChanged(int index);
+    void on_socketProfileComboBox_currentIndexChanged(int index);
+    void on_serverBackendComboBox_currentIndexChanged(int index);
+    void on_framingCheckBox_toggled(bool checked);
 
     // 客户端相关槽函数
     void onClientConnected();
+    void onClientNegotiated(quint32 capabilities);
     void onClientDisconnected();
     void onClientMessageReceived(const QString &message);
     void onClientError(const QString &errorMessage);
@@ -45,9 +58,12 @@ class MainWindow : public QMainWindow
     void onServerClientDisconnected(const QString &clientInfo);
     void onServerMessageReceived(const QString &clientInfo, const QString &message);
     void onServerError(const QString &errorMessage);
+    void onServerConnectionRejected(const QString &clientInfo, const QString &reason);
 
     // 文件传输相关槽函数
     void on_sendFileButton_clicked();
+    void on_sendFolderButton_clicked();
+    void on_receiveFolderButton_clicked();
     void on_sendImageButton_clicked();
     void onClientFileReceived(const QString &fileName, qint64 fileSize, const QString &fileType,
                               const QByteArray &fileData);
@@ -58,6 +74,9 @@ class MainWindow : public QMainWindow
     void onServerImageReceived(const QString &clientInfo, const QString &imageName,
                                qint64 imageSize, const QString &imageType,
                                const QByteArray &imageData);
+    void onClientFilesReceived(const QStringList &paths, qint64 totalBytes, bool finished);
+    void onServerFilesReceived(const QString &clientInfo, const QStringList &paths,
+                               qint64 totalBytes, bool finished);
 
   private:
     Ui::MainWindow *ui;
@@ -94,6 +113,9 @@ class MainWindow : public QMainWindow
     // 更新编码设置
     void updateEncodingSettings();
 
+    // 按下拉框选择更新客户端和服务端的socket调优配置
+    void updateSocketProfile();
+
     // 更新客户端列表
     void updateClientList();
 };
@@ -0,0 +1,154 @@
+#include "TCPDelta.h"
+#include <QRandomGenerator>
+#include <QTest>
+#include <QtEndian>
+
+// TCPDelta：签名、增量和还原的往返，以及格式错误的签名和增量
+class DeltaTest : public QObject
+{
+    Q_OBJECT
+
+  private:
+    static QByteArray randomBytes(int size, quint32 seed)
+    {
+        QRandomGenerator generator(seed);
+        QByteArray data(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i)
+        {
+            data[i] = char(generator.bounded(256));
+        }
+        return data;
+    }
+
+    // 计算base到target的增量并还原，返回增量的长度
+    static qsizetype roundTrip(const QByteArray &base, const QByteArray &target)
+    {
+        int blockSize = TCPDelta::blockSizeFor(base.size());
+        QByteArray delta = TCPDelta::diff(TCPDelta::signature(base, blockSize), target);
+        if (delta.isEmpty())
+        {
+            return -1;
+        }
+
+        QByteArray restored;
+        QString error;
+        if (!TCPDelta::patch(base, delta, restored, &error) || restored != target)
+        {
+            return -1;
+        }
+        return delta.size();
+    }
+
+  private slots:
+    void blockSizeIsBounded()
+    {
+        QCOMPARE(TCPDelta::blockSizeFor(0), TCPDelta::MinBlockSize);
+        QCOMPARE(TCPDelta::blockSizeFor(qint64(1) << 40), TCPDelta::MaxBlockSize);
+    }
+
+    void roundTrip_data()
+    {
+        QTest::addColumn<QByteArray>("base");
+        QTest::addColumn<QByteArray>("target");
+
+        QByteArray base = randomBytes(300 * 1024, 1);
+        QTest::newRow("identical") << base << base;
+
+        QByteArray changed = base;
+        changed.replace(100000, 16, randomBytes(16, 2));
+        QTest::newRow("changed") << base << changed;
+
+        // 插入使之后的块全部错位，滚动校验和要能重新对齐
+        QByteArray inserted = base;
+        inserted.insert(12345, randomBytes(777, 3));
+        QTest::newRow("inserted") << base << inserted;
+
+        QByteArray removed = base;
+        removed.remove(50000, 4096);
+        QTest::newRow("removed") << base << removed;
+
+        QTest::newRow("appended") << base << base + randomBytes(5000, 4);
+        QTest::newRow("truncated") << base << base.left(base.size() - 3000);
+        QTest::newRow("unrelated") << base << randomBytes(100 * 1024, 5);
+        QTest::newRow("empty base") << QByteArray() << randomBytes(5000, 6);
+        QTest::newRow("empty target") << base << QByteArray();
+        QTest::newRow("shorter than a block") << randomBytes(100, 7) << randomBytes(120, 8);
+    }
+
+    void roundTrip()
+    {
+        QFETCH(QByteArray, base);
+        QFETCH(QByteArray, target);
+        QVERIFY(roundTrip(base, target) >= 0);
+    }
+
+    // 只有少量改动时增量远小于新版本
+    void smallChangeGivesSmallDelta()
+    {
+        QByteArray base = randomBytes(1024 * 1024, 9);
+        QByteArray target = base;
+        target.replace(500000, 10, randomBytes(10, 10));
+
+        qsizetype size = roundTrip(base, target);
+        QVERIFY(size > 0);
+        QVERIFY2(size < target.size() / 50, qPrintable(QString::number(size)));
+    }
+
+    void malformedSignature()
+    {
+        QByteArray target = randomBytes(5000, 11);
+        QVERIFY(TCPDelta::diff(QByteArray(), target).isEmpty());
+        QVERIFY(TCPDelta::diff(QByteArray(7, '\0'), target).isEmpty());
+
+        // 块数与长度不符
+        QByteArray signature = TCPDelta::signature(randomBytes(10000, 12), TCPDelta::MinBlockSize);
+        QVERIFY(TCPDelta::diff(signature.chopped(1), target).isEmpty());
+
+        // 块大小超出范围
+        qToBigEndian<quint32>(quint32(TCPDelta::MaxBlockSize) + 1, signature.data());
+        QVERIFY(TCPDelta::diff(signature, target).isEmpty());
+    }
+
+    void malformedDelta()
+    {
+        QByteArray base = randomBytes(10000, 13);
+        QByteArray target = base;
+        target[5000] = char(target[5000] ^ 1);
+        QByteArray delta =
+            TCPDelta::diff(TCPDelta::signature(base, TCPDelta::MinBlockSize), target);
+        QVERIFY(!delta.isEmpty());
+
+        QByteArray restored;
+        QString error;
+        QVERIFY(!TCPDelta::patch(base, QByteArray(3, '\0'), restored, &error));
+        QVERIFY(!error.isEmpty());
+
+        // 每个截短的增量要么被拒绝，要么不会越界读写
+        for (qsizetype size = 4; size < delta.size(); ++size)
+        {
+            restored.clear();
+            if (TCPDelta::patch(base, delta.left(size), restored))
+            {
+                QVERIFY(restored.size() <= target.size());
+            }
+        }
+
+        // 复制范围超出旧版本
+        QByteArray copy(4, '\0');
+        qToBigEndian<quint32>(quint32(TCPDelta::MinBlockSize), copy.data());
+        char instruction[9] = {1};
+        qToBigEndian<quint32>(5, instruction + 1);
+        qToBigEndian<quint32>(100, instruction + 5);
+        copy.append(instruction, 9);
+        QVERIFY(!TCPDelta::patch(base, copy, restored));
+
+        // 未知指令
+        QByteArray unknown(4, '\0');
+        qToBigEndian<quint32>(quint32(TCPDelta::MinBlockSize), unknown.data());
+        unknown.append(char(9));
+        QVERIFY(!TCPDelta::patch(base, unknown, restored));
+    }
+};
+
+QTEST_GUILESS_MAIN(DeltaTest)
+#include "DeltaTest.moc"
@@ -0,0 +1,189 @@
+#include "FileBatch.h"
+#include "TCPSchema.h"
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QtEndian>
+
+// FileBatch：打包、拆分和保存的往返，以及对方发来的危险路径
+class FileBatchTest : public QObject
+{
+    Q_OBJECT
+
+  private:
+    // 构造只含一个文件的批量消息，路径不经检查，模拟恶意的对端
+    static QByteArray batchFor(const QByteArray &path, const QByteArray &data)
+    {
+        QByteArray manifest;
+        char field[8];
+        qToBigEndian<quint16>(quint16(path.size()), field);
+        manifest.append(field, 2);
+        manifest.append(path);
+        qToBigEndian<quint64>(quint64(data.size()), field);
+        manifest.append(field, 8);
+
+        TCPSchema::BatchMessage message;
+        message.last = 1;
+        message.manifest = manifest;
+        message.data = data;
+        return TCPSchema::encode(message);
+    }
+
+    static bool writeFile(const QString &path, const QByteArray &data)
+    {
+        QFile file(path);
+        return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+    }
+
+    static QByteArray readFile(const QString &path)
+    {
+        QFile file(path);
+        return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    }
+
+  private slots:
+    void roundTrip()
+    {
+        QTemporaryDir source;
+        QTemporaryDir target;
+        QVERIFY(source.isValid() && target.isValid());
+
+        QDir(source.path()).mkpath("folder/sub");
+        QByteArray large(int(FileBatch::MaxBatchBytes * 2 + 1000), Qt::Uninitialized);
+        for (int i = 0; i < large.size(); ++i)
+        {
+            large[i] = char(i % 251);
+        }
+        QVERIFY(writeFile(source.filePath("folder/a.txt"), "alpha"));
+        QVERIFY(writeFile(source.filePath("folder/sub/b.txt"), "beta"));
+        QVERIFY(writeFile(source.filePath("folder/large.bin"), large));
+
+        QList<FileBatch::Entry> entries;
+        QVERIFY(FileBatch::list(QStringList() << source.filePath("folder"), entries));
+        QCOMPARE(entries.size(), 3);
+
+        // 大文件拆成三段，每段单独成为一批
+        QList<QList<FileBatch::Entry>> batches = FileBatch::split(entries);
+        int pieces = 0;
+        for (const QList<FileBatch::Entry> &batch : batches)
+        {
+            if (batch.size() == 1 && batch.first().length < batch.first().size)
+            {
+                pieces++;
+            }
+        }
+        QCOMPARE(pieces, 3);
+
+        QStringList saved;
+        for (int i = 0; i < batches.size(); ++i)
+        {
+            QString error;
+            QByteArray payload = FileBatch::encode(batches[i], i == batches.size() - 1, &error);
+            QVERIFY2(error.isEmpty(), qPrintable(error));
+            QVERIFY(payload.size() <= FileBatch::MaxBatchBytes + 4096);
+
+            FileBatch::Result result;
+            QVERIFY2(FileBatch::save(payload, target.path(), result, &error), qPrintable(error));
+            QCOMPARE(result.last, i == batches.size() - 1);
+            saved += result.paths;
+        }
+
+        QCOMPARE(saved.size(), 3);
+        QCOMPARE(readFile(target.filePath("folder/a.txt")), QByteArray("alpha"));
+        QCOMPARE(readFile(target.filePath("folder/sub/b.txt")), QByteArray("beta"));
+        QCOMPARE(readFile(target.filePath("folder/large.bin")), large);
+        QVERIFY(!QFile::exists(target.filePath("folder/large.bin") + FileBatch::PartSuffix));
+    }
+
+    void unsafePath_data()
+    {
+        QTest::addColumn<QByteArray>("path");
+        QTest::newRow("parent") << QByteArray("../escape.txt");
+        QTest::newRow("nested parent") << QByteArray("a/../../escape.txt");
+        QTest::newRow("absolute") << QByteArray("/tmp/escape.txt");
+        QTest::newRow("backslash") << QByteArray("a\\..\\escape.txt");
+        QTest::newRow("drive") << QByteArray("C:escape.txt");
+        QTest::newRow("dot") << QByteArray("a/./b.txt");
+        QTest::newRow("empty part") << QByteArray("a//b.txt");
+        QTest::newRow("empty") << QByteArray();
+    }
+
+    void unsafePath()
+    {
+        QFETCH(QByteArray, path);
+        QTemporaryDir parent;
+        QVERIFY(parent.isValid());
+        QDir(parent.path()).mkpath("inbox");
+        QString root = parent.filePath("inbox");
+
+        FileBatch::Result result;
+        QString error;
+        QVERIFY(!FileBatch::save(batchFor(path, "payload"), root, result, &error));
+        QVERIFY(!error.isEmpty());
+        QVERIFY(result.paths.isEmpty());
+        QVERIFY(!QFile::exists(parent.filePath("escape.txt")));
+        QCOMPARE(QDir(root).entryList(QDir::AllEntries | QDir::NoDotAndDotDot).size(), 0);
+    }
+
+    // 接收目录中的符号链接指向目录之外时不经由它写入
+    void symLink()
+    {
+#ifdef Q_OS_UNIX
+        QTemporaryDir root;
+        QTemporaryDir outside;
+        QVERIFY(root.isValid() && outside.isValid());
+        QVERIFY(QFile::link(outside.path(), root.filePath("link")));
+
+        FileBatch::Result result;
+        QString error;
+        QVERIFY(!FileBatch::save(batchFor("link/file.txt", "payload"), root.path(), result,
+                                 &error));
+        QVERIFY(!QFile::exists(outside.filePath("file.txt")));
+
+        // 指向目录之外的文件的链接也不能被当作目标或临时文件
+        QVERIFY(QFile::link(outside.filePath("target.txt"), root.filePath("direct.txt")));
+        QVERIFY(!FileBatch::save(batchFor("direct.txt", "payload"), root.path(), result, &error));
+        QVERIFY(QFile::link(outside.filePath("target.txt"),
+                            root.filePath(QString("part.txt") + FileBatch::PartSuffix)));
+        QVERIFY(!FileBatch::save(batchFor("part.txt", "payload"), root.path(), result, &error));
+        QVERIFY(!QFile::exists(outside.filePath("target.txt")));
+#else
+        QSKIP("需要符号链接");
+#endif
+    }
+
+    void existingFile()
+    {
+        QTemporaryDir root;
+        QVERIFY(root.isValid());
+        QVERIFY(writeFile(root.filePath("keep.txt"), "original"));
+
+        FileBatch::Result result;
+        QString error;
+        QVERIFY(!FileBatch::save(batchFor("keep.txt", "replacement"), root.path(), result,
+                                 &error));
+        QCOMPARE(readFile(root.filePath("keep.txt")), QByteArray("original"));
+    }
+
+    // 清单中的大小超过数据部分时拒绝
+    void sizePastData()
+    {
+        QTemporaryDir root;
+        QVERIFY(root.isValid());
+
+        QByteArray payload = batchFor("file.txt", "payload");
+        TCPSchema::BatchMessage message;
+        QVERIFY(TCPSchema::decode(payload, message));
+        QByteArray manifest = message.manifest.toByteArray();
+        qToBigEndian<quint64>(1000, manifest.data() + manifest.size() - 8);
+        message.manifest = manifest;
+
+        FileBatch::Result result;
+        QVERIFY(!FileBatch::save(TCPSchema::encode(message), root.path(), result));
+        QVERIFY(!QFile::exists(root.filePath("file.txt")));
+    }
+};
+
+QTEST_GUILESS_MAIN(FileBatchTest)
+#include "FileBatchTest.moc"
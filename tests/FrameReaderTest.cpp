@@ -0,0 +1,205 @@
+#include "TCPFrame.h"
+#include <QTest>
+
+// TCPFrameReader：分片重组、任意位置断开的输入、单流上限、未完成流的个数和合计上限
+class FrameReaderTest : public QObject
+{
+    Q_OBJECT
+
+  private:
+    static QByteArray frame(quint8 type, quint8 flags, quint32 streamId, const QByteArray &payload)
+    {
+        return TCPFrame::encodeHeader(type, flags, streamId, quint32(payload.size())) + payload;
+    }
+
+    static QByteArray pattern(int size, int seed)
+    {
+        QByteArray data(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i)
+        {
+            data[i] = char((i * 31 + seed) & 0xFF);
+        }
+        return data;
+    }
+
+  private slots:
+    void plainText()
+    {
+        TCPFrameReader reader;
+        reader.append("hello");
+
+        TCPFrameReader::Message message;
+        QVERIFY(reader.next(message));
+        QVERIFY(!message.framed);
+        QCOMPARE(message.type, quint8(TCPFrame::TextFrame));
+        QCOMPARE(message.payload, QByteArray("hello"));
+        QVERIFY(!reader.next(message));
+    }
+
+    // 两个流的分片交错到达，输入按很小的块追加，每条消息在最后一个分片到达后才取出
+    void interleavedChunks_data()
+    {
+        QTest::addColumn<int>("step");
+        QTest::newRow("1") << 1;
+        QTest::newRow("7") << 7;
+        QTest::newRow("4096") << 4096;
+        QTest::newRow("whole") << INT_MAX;
+    }
+
+    void interleavedChunks()
+    {
+        QFETCH(int, step);
+        QByteArray file = pattern(3 * TCPFrame::DefaultChunkSize + 100, 1);
+        QByteArray text = pattern(200, 2);
+
+        QByteArray stream;
+        const int chunk = TCPFrame::DefaultChunkSize;
+        stream += frame(TCPFrame::FileFrame, 0, 5, file.mid(0, chunk));
+        stream += frame(TCPFrame::TextFrame, 0, 6, text.mid(0, 100));
+        stream += frame(TCPFrame::FileFrame, 0, 5, file.mid(chunk, chunk));
+        stream += frame(TCPFrame::TextFrame, TCPFrame::EndOfStream, 6, text.mid(100));
+        stream += frame(TCPFrame::FileFrame, 0, 5, file.mid(2 * chunk, chunk));
+        stream += frame(TCPFrame::FileFrame, TCPFrame::EndOfStream, 5, file.mid(3 * chunk));
+
+        TCPFrameReader reader;
+        QList<TCPFrameReader::Message> messages;
+        for (qsizetype offset = 0; offset < stream.size(); offset += step)
+        {
+            reader.append(stream.mid(offset, step));
+            TCPFrameReader::Message message;
+            while (reader.next(message))
+            {
+                messages.append(message);
+            }
+        }
+
+        QVERIFY(!reader.hasError());
+        QCOMPARE(messages.size(), 2);
+        QCOMPARE(messages[0].streamId, quint32(6));
+        QCOMPARE(messages[0].type, quint8(TCPFrame::TextFrame));
+        QCOMPARE(messages[0].payload, text);
+        QCOMPARE(messages[1].streamId, quint32(5));
+        QCOMPARE(messages[1].type, quint8(TCPFrame::FileFrame));
+        QVERIFY(messages[1].framed);
+        QCOMPARE(messages[1].payload, file);
+    }
+
+    // 帧头声明的长度超过上限时立即报错，不等待负载
+    void declaredLengthOverLimit()
+    {
+        TCPFrameReader reader;
+        reader.setMaxStreamSize(1000);
+        reader.append(TCPFrame::encodeHeader(TCPFrame::FileFrame, TCPFrame::EndOfStream, 1, 1001));
+
+        TCPFrameReader::Message message;
+        QVERIFY(!reader.next(message));
+        QVERIFY(reader.hasError());
+    }
+
+    // 同一个流的分片累计超过上限时报错
+    void accumulatedOverLimit()
+    {
+        TCPFrameReader reader;
+        reader.setMaxStreamSize(1000);
+        reader.append(frame(TCPFrame::FileFrame, 0, 1, pattern(600, 3)));
+        reader.append(frame(TCPFrame::FileFrame, TCPFrame::EndOfStream, 1, pattern(600, 4)));
+
+        TCPFrameReader::Message message;
+        QVERIFY(!reader.next(message));
+        QVERIFY(reader.hasError());
+    }
+
+    // 恰好等于上限的消息可以收下
+    void exactlyAtLimit()
+    {
+        TCPFrameReader reader;
+        reader.setMaxStreamSize(1000);
+        QByteArray payload = pattern(1000, 5);
+        reader.append(frame(TCPFrame::FileFrame, 0, 1, payload.left(400)));
+        reader.append(frame(TCPFrame::FileFrame, TCPFrame::EndOfStream, 1, payload.mid(400)));
+
+        TCPFrameReader::Message message;
+        QVERIFY(reader.next(message));
+        QCOMPARE(message.payload, payload);
+        QVERIFY(!reader.hasError());
+    }
+
+    void limitIsClamped()
+    {
+        TCPFrameReader reader;
+        QCOMPARE(reader.streamSizeLimit(), TCPFrameReader::DefaultMaxStreamSize);
+        reader.setMaxStreamSize(TCPFrameReader::MaxStreamSizeLimit * 2);
+        QCOMPARE(reader.streamSizeLimit(), TCPFrameReader::MaxStreamSizeLimit);
+        reader.setMaxStreamSize(-1);
+        QCOMPARE(reader.streamSizeLimit(), qint64(0));
+    }
+
+    // 同时打开的流超过个数上限时报错，已收完的流不计入
+    void tooManyPartialStreams()
+    {
+        TCPFrameReader reader;
+        reader.setMaxPartialStreams(2);
+        reader.append(frame(TCPFrame::FileFrame, 0, 1, pattern(10, 1)));
+        reader.append(frame(TCPFrame::FileFrame, TCPFrame::EndOfStream, 1, pattern(10, 2)));
+        reader.append(frame(TCPFrame::FileFrame, 0, 2, pattern(10, 3)));
+        reader.append(frame(TCPFrame::FileFrame, 0, 3, pattern(10, 4)));
+
+        TCPFrameReader::Message message;
+        QVERIFY(reader.next(message));
+        QCOMPARE(message.streamId, quint32(1));
+        QVERIFY(!reader.next(message));
+        QVERIFY(!reader.hasError());
+
+        reader.append(frame(TCPFrame::FileFrame, 0, 4, pattern(10, 5)));
+        QVERIFY(!reader.next(message));
+        QVERIFY(reader.hasError());
+    }
+
+    // 每个流都在单流上限之内，但合计超过上限时报错
+    void partialBytesOverLimit()
+    {
+        TCPFrameReader reader;
+        reader.setMaxStreamSize(1000);
+        reader.setMaxPartialBytes(1500);
+        reader.append(frame(TCPFrame::FileFrame, 0, 1, pattern(800, 1)));
+        reader.append(frame(TCPFrame::FileFrame, 0, 2, pattern(800, 2)));
+
+        TCPFrameReader::Message message;
+        QVERIFY(!reader.next(message));
+        QVERIFY(reader.hasError());
+    }
+
+    // 收完的流释放合计额度，之后的流可以继续使用
+    void partialBytesReleased()
+    {
+        TCPFrameReader reader;
+        reader.setMaxStreamSize(1000);
+        reader.setMaxPartialBytes(1000);
+        QByteArray first = pattern(900, 1);
+        QByteArray second = pattern(900, 2);
+        reader.append(frame(TCPFrame::FileFrame, 0, 1, first.left(500)));
+        reader.append(frame(TCPFrame::FileFrame, TCPFrame::EndOfStream, 1, first.mid(500)));
+        reader.append(frame(TCPFrame::FileFrame, 0, 2, second.left(500)));
+        reader.append(frame(TCPFrame::FileFrame, TCPFrame::EndOfStream, 2, second.mid(500)));
+
+        TCPFrameReader::Message message;
+        QVERIFY(reader.next(message));
+        QCOMPARE(message.payload, first);
+        QVERIFY(reader.next(message));
+        QCOMPARE(message.payload, second);
+        QVERIFY(!reader.hasError());
+    }
+
+    void invalidMagic()
+    {
+        TCPFrameReader reader;
+        reader.append(QByteArray("\xFF\x00", 2) + QByteArray(20, 'x'));
+
+        TCPFrameReader::Message message;
+        QVERIFY(!reader.next(message));
+        QVERIFY(reader.hasError());
+    }
+};
+
+QTEST_GUILESS_MAIN(FrameReaderTest)
+#include "FrameReaderTest.moc"
@@ -0,0 +1,135 @@
+#include "TCPSchema.h"
+#include <QTest>
+
+// TCPSchema：编码和解码的往返、越界的长度、版本演进
+class SchemaTest : public QObject
+{
+    Q_OBJECT
+
+  private:
+    static QByteArray fileMessage()
+    {
+        TCPSchema::FileMessage message;
+        message.name = "report.pdf";
+        message.size = 123456789012ULL;
+        message.type = "application/pdf";
+        message.data = "0123456789";
+        return TCPSchema::encode(message);
+    }
+
+  private slots:
+    void roundTrip()
+    {
+        QByteArray encoded = fileMessage();
+        quint8 id = 0;
+        QVERIFY(TCPSchema::peek(encoded, id));
+        QCOMPARE(id, quint8(TCPSchema::FileMessageId));
+
+        TCPSchema::FileMessage message;
+        QVERIFY(TCPSchema::decode(encoded, message));
+        QCOMPARE(message.name.toByteArray(), QByteArray("report.pdf"));
+        QCOMPARE(message.size, quint64(123456789012ULL));
+        QCOMPARE(message.type.toByteArray(), QByteArray("application/pdf"));
+        QCOMPARE(message.data.toByteArray(), QByteArray("0123456789"));
+
+        // 解码出的字节串指向原缓冲区
+        QVERIFY(message.data.data() >= encoded.constData());
+        QVERIFY(message.data.data() < encoded.constData() + encoded.size());
+    }
+
+    void wrongId()
+    {
+        TCPSchema::ImageMessage image;
+        QVERIFY(!TCPSchema::decode(fileMessage(), image));
+    }
+
+    void notSchema()
+    {
+        quint8 id = 0;
+        QVERIFY(!TCPSchema::peek(QByteArray("hello"), id));
+        QVERIFY(!TCPSchema::peek(QByteArray("\xFE\x01", 2), id));
+
+        // 版本0无效
+        QByteArray encoded = fileMessage();
+        encoded[2] = 0;
+        QVERIFY(!TCPSchema::peek(encoded, id));
+    }
+
+    // 当前版本的消息被截在任何位置都不能解码成功
+    void truncated()
+    {
+        QByteArray encoded = fileMessage();
+        for (qsizetype size = 0; size < encoded.size(); ++size)
+        {
+            TCPSchema::FileMessage message;
+            QVERIFY2(!TCPSchema::decode(QByteArrayView(encoded.constData(), size), message),
+                     qPrintable(QString::number(size)));
+        }
+    }
+
+    // 字节串的长度字段超出消息末尾
+    void lengthPastEnd()
+    {
+        QByteArray encoded = fileMessage();
+        char *nameLength = encoded.data() + TCPSchema::HeaderSize;
+        qToBigEndian<quint32>(quint32(encoded.size()), nameLength);
+
+        TCPSchema::FileMessage message;
+        QVERIFY(!TCPSchema::decode(encoded, message));
+
+        qToBigEndian<quint32>(0xFFFFFFFF, nameLength);
+        QVERIFY(!TCPSchema::decode(encoded, message));
+    }
+
+    // 版本1的批量消息没有末尾的分段表，解码后保持默认值
+    void olderVersion()
+    {
+        TCPSchema::BatchMessage batch;
+        batch.last = 1;
+        batch.manifest = "manifest";
+        batch.data = "data";
+        QByteArray encoded = TCPSchema::encode(batch);
+        encoded.chop(4); // 去掉空分段表的长度字段
+        encoded[2] = 1;
+
+        TCPSchema::BatchMessage message;
+        QVERIFY(TCPSchema::decode(encoded, message));
+        QCOMPARE(message.last, quint8(1));
+        QCOMPARE(message.manifest.toByteArray(), QByteArray("manifest"));
+        QCOMPARE(message.data.toByteArray(), QByteArray("data"));
+        QVERIFY(message.pieces.isEmpty());
+
+        // 旧版本的消息也不能在字段中间结束
+        encoded.chop(1);
+        QVERIFY(!TCPSchema::decode(encoded, message));
+    }
+
+    // 更新的版本在末尾追加的字段被忽略
+    void newerVersion()
+    {
+        QByteArray encoded = fileMessage();
+        encoded[2] = char(TCPSchema::FileMessage::Version + 1);
+        encoded.append("future field");
+
+        TCPSchema::FileMessage message;
+        QVERIFY(TCPSchema::decode(encoded, message));
+        QCOMPARE(message.data.toByteArray(), QByteArray("0123456789"));
+    }
+
+    // 只编码消息头时，长度字段为随后单独发送的数据的长度
+    void encodeHead()
+    {
+        TCPSchema::FileMessage message;
+        message.name = "a";
+        message.type = "b";
+        QByteArray data = "payload";
+        QByteArray encoded = TCPSchema::encodeHead(message, quint32(data.size())) + data;
+
+        TCPSchema::FileMessage decoded;
+        QVERIFY(TCPSchema::decode(encoded, decoded));
+        QCOMPARE(decoded.data.toByteArray(), QByteArray(data));
+    }
+};
+
+QTEST_GUILESS_MAIN(SchemaTest)
+#include "SchemaTest.moc"
@@ -0,0 +1,135 @@
+#include "SocketTuning.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTest>
+
+// SocketTuning：对回环连接应用配置后用getsockopt读回，检查各选项确实生效
+class SocketTuningTest : public QObject
+{
+    Q_OBJECT
+
+  private:
+    QTcpServer listener;
+    QTcpSocket client;
+    QTcpSocket *accepted = nullptr;
+
+  private slots:
+    void initTestCase()
+    {
+        QVERIFY(listener.listen(QHostAddress::LocalHost));
+        client.connectToHost(QHostAddress::LocalHost, listener.serverPort());
+        QVERIFY(client.waitForConnected(5000));
+        QVERIFY(listener.waitForNewConnection(5000));
+        accepted = listener.nextPendingConnection();
+        QVERIFY(accepted);
+    }
+
+    void presets()
+    {
+        QCOMPARE(SocketTuning::profileNames(),
+                 QStringList() << "default" << "low-latency" << "bulk" << "many-idle");
+        for (const QString &name : SocketTuning::profileNames())
+        {
+            SocketTuning::Profile profile;
+            QVERIFY(SocketTuning::profileByName(name, profile));
+            QCOMPARE(profile.name, name);
+        }
+
+        SocketTuning::Profile profile;
+        QVERIFY(!SocketTuning::profileByName("unknown", profile));
+        QVERIFY(SocketTuning::defaultProfile().isDefault());
+    }
+
+    void noDelay()
+    {
+#ifdef Q_OS_UNIX
+        SocketTuning::Profile profile;
+        profile.noDelay = 1;
+        QVERIFY(SocketTuning::apply(&client, profile));
+        QCOMPARE(SocketTuning::read(client.socketDescriptor()).noDelay, 1);
+
+        profile.noDelay = 0;
+        QVERIFY(SocketTuning::apply(accepted, profile));
+        QCOMPARE(SocketTuning::read(accepted->socketDescriptor()).noDelay, 0);
+#else
+        QSKIP("只在Unix上读取socket选项");
+#endif
+    }
+
+    // many-idle预设：小缓冲区和较短的keepalive
+    void manyIdle()
+    {
+#ifdef Q_OS_LINUX
+        SocketTuning::Profile profile = SocketTuning::manyIdle();
+        QString error;
+        QVERIFY2(SocketTuning::apply(accepted, profile, &error), qPrintable(error));
+
+        SocketTuning::Profile current = SocketTuning::read(accepted->socketDescriptor());
+        QCOMPARE(current.keepAliveIdle, profile.keepAliveIdle);
+        QCOMPARE(current.keepAliveInterval, profile.keepAliveInterval);
+        QCOMPARE(current.keepAliveCount, profile.keepAliveCount);
+
+        // Linux读回的缓冲区大小是设置值的两倍（含内核簿记开销）
+        QVERIFY(current.sendBufferSize >= profile.sendBufferSize);
+        QVERIFY(current.sendBufferSize <= 2 * profile.sendBufferSize);
+        QVERIFY(current.receiveBufferSize >= profile.receiveBufferSize);
+        QVERIFY(current.receiveBufferSize <= 2 * profile.receiveBufferSize);
+#else
+        QSKIP("只在Linux上检查keepalive和缓冲区选项");
+#endif
+    }
+
+    // low-latency预设中的未发送水位；忙轮询通常需要CAP_NET_ADMIN，不要求设置成功
+    void notSentLowat()
+    {
+#ifdef Q_OS_LINUX
+        SocketTuning::Profile profile;
+        profile.notSentLowat = SocketTuning::lowLatency().notSentLowat;
+        profile.quickAck = 1;
+        QString error;
+        QVERIFY2(SocketTuning::apply(&client, profile, &error), qPrintable(error));
+
+        SocketTuning::Profile current = SocketTuning::read(client.socketDescriptor());
+        QCOMPARE(current.notSentLowat, profile.notSentLowat);
+        QVERIFY(current.quickAck >= 0);
+#else
+        QSKIP("只在Linux上检查TCP_NOTSENT_LOWAT");
+#endif
+    }
+
+    // 默认配置不改变任何选项
+    void defaultKeepsOptions()
+    {
+#ifdef Q_OS_UNIX
+        SocketTuning::Profile before = SocketTuning::read(client.socketDescriptor());
+        QVERIFY(SocketTuning::apply(&client, SocketTuning::defaultProfile()));
+        SocketTuning::Profile after = SocketTuning::read(client.socketDescriptor());
+        QCOMPARE(after.noDelay, before.noDelay);
+        QCOMPARE(after.sendBufferSize, before.sendBufferSize);
+        QCOMPARE(after.notSentLowat, before.notSentLowat);
+#else
+        QSKIP("只在Unix上读取socket选项");
+#endif
+    }
+
+    // 监听socket在bind之前设置SO_REUSEPORT
+    void reusePortListener()
+    {
+#ifdef Q_OS_LINUX
+        SocketTuning::Profile profile;
+        profile.reusePort = true;
+        QString error;
+        qintptr descriptor = SocketTuning::createListeningSocket(0, profile, 16, nullptr, &error);
+        QVERIFY2(descriptor >= 0, qPrintable(error));
+
+        QVERIFY(SocketTuning::read(descriptor).reusePort);
+        QTcpServer server;
+        QVERIFY(server.setSocketDescriptor(descriptor));
+#else
+        QSKIP("只在Linux上检查SO_REUSEPORT");
+#endif
+    }
+};
+
+QTEST_GUILESS_MAIN(SocketTuningTest)
+#include "SocketTuningTest.moc"